@@ -0,0 +1,42 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> allocationCount(0);
+}
+
+uint64_t AllocationCounter::GetCount()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+// The default array and nothrow forms forward to these
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    if (size == 0) size = 1;
+    while (true)
+    {
+        void* memory = std::malloc(size);
+        if (memory) return memory;
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
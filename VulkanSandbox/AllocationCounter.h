@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// -- ALLOCATION COUNTER --
+// Counts calls to the global operator new, so the render loop can check that it never touches the heap
+namespace AllocationCounter
+{
+	uint64_t GetCount();
+}
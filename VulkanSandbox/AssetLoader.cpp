@@ -0,0 +1,276 @@
+#include "AssetLoader.h"
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+
+#include "CpuProfiler.h"
+#include "Utilities.h"
+
+void AssetLoader::Init(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t threadCount)
+{
+    m_device = device;
+    m_queue = queue;
+    m_stopping = false;
+
+    // Every batch frees its own short lived command buffer once its fence signaled
+    VkCommandPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolCreateInfo.queueFamilyIndex = queueFamily;
+
+    VkResult result = vkCreateCommandPool(m_device, &poolCreateInfo, nullptr, &m_commandPool);
+    CHECK_VK_RESULT(result, "Failed to create Asset Loader Command Pool");
+
+    if (threadCount == 0)
+    {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        m_workers.emplace_back(&AssetLoader::workerLoop, this, i);
+    }
+}
+
+void AssetLoader::Destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued.clear();
+        m_stopping = true;
+    }
+    m_assetAdded.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+    m_decoded.clear();
+
+    // Whoever submitted the assets owns what was uploaded, only the staging buffers are left here
+    for (Batch& batch : m_batches)
+    {
+        vkWaitForFences(m_device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        destroyBatch(batch);
+    }
+    m_batches.clear();
+
+    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+}
+
+void AssetLoader::Submit(const std::string& name, WorkFunction work, UploadFunction upload, CompleteFunction complete)
+{
+    std::unique_ptr<Asset> asset(new Asset());
+    asset->name = name;
+    asset->work = std::move(work);
+    asset->upload = std::move(upload);
+    asset->complete = std::move(complete);
+
+    ++m_submittedCount;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued.push_back(std::move(asset));
+    }
+    m_assetAdded.notify_one();
+}
+
+void AssetLoader::Update(float budget)
+{
+    CPU_ZONE("Asset Loader Update");
+
+    completeBatches(false);
+
+    uint64_t begin = CpuProfiler::GetTime();
+    Batch batch = {};
+
+    while (static_cast<double>(CpuProfiler::GetTime() - begin) / 1000000.0 < budget)
+    {
+        std::unique_ptr<Asset> asset;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_decoded.empty()) break;
+
+            asset = std::move(m_decoded.front());
+            m_decoded.pop_front();
+        }
+
+        if (!asset->error.empty())
+        {
+            std::cout << "Failed to load " << asset->name << ": " << asset->error << std::endl;
+            ++m_failedCount;
+            continue;
+        }
+
+        // Nothing to copy, so nothing to wait for either
+        if (!asset->upload)
+        {
+            if (asset->complete) asset->complete();
+            ++m_completedCount;
+            continue;
+        }
+
+        if (batch.commandBuffer == VK_NULL_HANDLE)
+        {
+            VkCommandBufferAllocateInfo allocateInfo = {};
+            allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocateInfo.commandPool = m_commandPool;
+            allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocateInfo.commandBufferCount = 1;
+
+            VkResult result = vkAllocateCommandBuffers(m_device, &allocateInfo, &batch.commandBuffer);
+            CHECK_VK_RESULT(result, "Failed to allocate Asset Loader Command Buffer");
+
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+            CHECK_VK_RESULT(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo), "Failed to begin Command Buffer");
+        }
+
+        {
+            CPU_ZONE(asset->name.c_str());
+            asset->upload(batch.commandBuffer, batch.stagingBuffers);
+        }
+        batch.assets.push_back(std::move(asset));
+    }
+
+    if (batch.commandBuffer == VK_NULL_HANDLE) return;
+
+    // Waiting for the fence on the host doesn't make the copies visible to later frames, this does
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkResult result = vkCreateFence(m_device, &fenceCreateInfo, nullptr, &batch.fence);
+    CHECK_VK_RESULT(result, "Failed to create Asset Loader Fence");
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    result = vkQueueSubmit(m_queue, 1, &submitInfo, batch.fence);
+    CHECK_VK_RESULT(result, "Failed to submit Asset Loader Command Buffer");
+
+    m_batches.push_back(std::move(batch));
+}
+
+void AssetLoader::Flush()
+{
+    CPU_ZONE("Asset Loader Flush");
+
+    while (!IsIdle())
+    {
+        Update(std::numeric_limits<float>::max());
+        completeBatches(true);
+
+        // Completing may have submitted more assets, those are picked up right away
+        if (!IsIdle() && m_batches.empty())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool AssetLoader::IsIdle()
+{
+    return GetPendingCount() == 0;
+}
+
+uint32_t AssetLoader::GetPendingCount()
+{
+    return m_submittedCount - m_completedCount - m_failedCount;
+}
+
+uint32_t AssetLoader::GetCompletedCount()
+{
+    return m_completedCount;
+}
+
+uint32_t AssetLoader::GetFailedCount()
+{
+    return m_failedCount;
+}
+
+uint32_t AssetLoader::GetThreadCount()
+{
+    return static_cast<uint32_t>(m_workers.size());
+}
+
+void AssetLoader::workerLoop(uint32_t index)
+{
+    CpuProfiler::SetThreadName(("Asset Loader " + std::to_string(index)).c_str());
+
+    while (true)
+    {
+        std::unique_ptr<Asset> asset;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_assetAdded.wait(lock, [this]() { return m_stopping || !m_queued.empty(); });
+            if (m_stopping) return;
+
+            asset = std::move(m_queued.front());
+            m_queued.pop_front();
+        }
+
+        if (asset->work)
+        {
+            CPU_ZONE(asset->name.c_str());
+
+            try
+            {
+                asset->work();
+            }
+            catch (const std::exception& err)
+            {
+                asset->error = err.what();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_decoded.push_back(std::move(asset));
+    }
+}
+
+void AssetLoader::completeBatches(bool wait)
+{
+    // The queue finishes batches in the order they were submitted
+    while (!m_batches.empty())
+    {
+        Batch& batch = m_batches.front();
+
+        if (wait) vkWaitForFences(m_device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        else if (vkGetFenceStatus(m_device, batch.fence) != VK_SUCCESS) break;
+
+        for (std::unique_ptr<Asset>& asset : batch.assets)
+        {
+            if (asset->complete) asset->complete();
+            ++m_completedCount;
+        }
+
+        destroyBatch(batch);
+        m_batches.pop_front();
+    }
+}
+
+void AssetLoader::destroyBatch(Batch& batch)
+{
+    for (Buffer& buffer : batch.stagingBuffers)
+    {
+        buffer.Destroy(m_device);
+    }
+
+    vkFreeCommandBuffers(m_device, m_commandPool, 1, &batch.commandBuffer);
+    vkDestroyFence(m_device, batch.fence, nullptr);
+}
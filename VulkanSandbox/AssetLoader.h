@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Buffer.h"
+
+// -- ASSET LOADER --
+// Loads assets while frames keep rendering. Every asset goes through three steps: reading and decoding on a worker
+// thread, recording its uploads on the main thread in Update, and completing on the main thread once a fence says
+// the copies are done. Neither the workers nor the GPU are ever waited for, assets simply show up a few frames later.
+class AssetLoader
+{
+public:
+    // Worker thread, may only touch data of its own asset
+    typedef std::function<void()> WorkFunction;
+    // Main thread, records copies and adds the staging buffers it used to the list, they are destroyed after the copy
+    typedef std::function<void(VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers)> UploadFunction;
+    // Main thread, the uploaded resources can be used from here on
+    typedef std::function<void()> CompleteFunction;
+
+    // threadCount 0 uses every hardware thread but one
+    void Init(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t threadCount = 0);
+    // Drops assets that haven't been uploaded and waits for the rest of the GPU copies, nothing is completed
+    void Destroy();
+
+    // Any step may be empty. An asset whose work throws is reported and never uploaded.
+    void Submit(const std::string& name, WorkFunction work, UploadFunction upload, CompleteFunction complete);
+
+    // Completes assets whose copies finished, then records uploads of decoded ones until the budget in ms is used up.
+    // All uploads of one call share a command buffer and a fence.
+    void Update(float budget);
+    // Updates until every submitted asset is completed
+    void Flush();
+
+    bool IsIdle();
+    uint32_t GetPendingCount();     // Submitted but not completed
+    uint32_t GetCompletedCount();
+    uint32_t GetFailedCount();
+    uint32_t GetThreadCount();
+
+private:
+    struct Asset
+    {
+        std::string name;
+        WorkFunction work;
+        UploadFunction upload;
+        CompleteFunction complete;
+        std::string error;
+    };
+
+    // One submission of Update
+    struct Batch
+    {
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        std::vector<Buffer> stagingBuffers;
+        std::vector<std::unique_ptr<Asset>> assets;
+    };
+
+    VkDevice m_device;
+    VkQueue m_queue;
+    VkCommandPool m_commandPool;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_assetAdded;
+    std::deque<std::unique_ptr<Asset>> m_queued;        // Waiting for a worker
+    std::deque<std::unique_ptr<Asset>> m_decoded;       // Waiting to be uploaded
+    bool m_stopping = false;
+
+    // Main thread only
+    std::deque<Batch> m_batches;
+    uint32_t m_submittedCount = 0;
+    uint32_t m_completedCount = 0;
+    uint32_t m_failedCount = 0;
+
+    void workerLoop(uint32_t index);
+    void completeBatches(bool wait);
+    void destroyBatch(Batch& batch);
+
+};
@@ -0,0 +1,367 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Bvh.h"
+#include "Scene.h"
+
+namespace
+{
+    const uint32_t ITERATIONS = 20;
+    // Entities share a parent node like the meshes of an object do
+    const uint32_t GROUP_SIZE = 10;
+
+    // What the scene looked like before, one heap allocation per entity reached through a pointer
+    struct ObjectEntity
+    {
+        std::string name;
+        glm::mat4 localTransform;
+        glm::mat4 transform;
+        BoundingBox localBounds;
+        BoundingBox bounds;
+        bool castsShadows;
+        std::vector<uint32_t> meshes;
+    };
+
+    template<typename Function>
+    double measure(Function function)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < ITERATIONS; ++i)
+            function(i);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        return std::chrono::duration<double, std::milli>(end - begin).count() / ITERATIONS;
+    }
+
+    template<typename Function>
+    double measureOnce(Function function)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+        function();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    }
+
+    void report(const char* name, double sceneTime, double objectTime)
+    {
+        std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << sceneTime << " ms" << std::setw(10) << objectTime << " ms" << std::endl;
+    }
+}
+
+void Benchmark::RunScene(uint32_t entityCount)
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-1000.f, 1000.f);
+
+    BoundingBox unitBox;
+    unitBox.min = glm::vec3(-1.f);
+    unitBox.max = glm::vec3(1.f);
+
+    Scene scene;
+    TransformHierarchy& hierarchy = scene.GetHierarchy();
+    std::vector<TransformHandle> groups;
+    std::vector<TransformHandle> nodes;
+    std::vector<SceneHandle> handles;
+    std::vector<std::unique_ptr<ObjectEntity>> objects;
+
+    glm::quat identity(1.f, 0.f, 0.f, 0.f);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        glm::vec3 translation(position(random), position(random), position(random));
+        glm::mat4 transform = glm::translate(glm::mat4(1.f), translation);
+        uint32_t flags = SCENE_FLAG_SHADED | (i % 4 != 0 ? static_cast<uint32_t>(SCENE_FLAG_CASTS_SHADOWS) : 0u);
+
+        if (i % GROUP_SIZE == 0)
+            groups.push_back(hierarchy.Create(TransformHandle(), glm::vec3(0.f), identity, glm::vec3(1.f)));
+        TransformHandle node = hierarchy.Create(groups.back(), translation, identity, glm::vec3(1.f));
+        nodes.push_back(node);
+        handles.push_back(scene.Create(nullptr, 0, node, unitBox, flags));
+
+        std::unique_ptr<ObjectEntity> object(new ObjectEntity());
+        object->name = i % 100 == 0 ? "Light" : "Entity " + std::to_string(i);
+        object->transform = transform;
+        object->localTransform = transform;
+        object->localBounds = unitBox;
+        object->bounds = unitBox.Transformed(transform);
+        object->castsShadows = (flags & SCENE_FLAG_CASTS_SHADOWS) != 0;
+        object->meshes.push_back(i);
+        objects.push_back(std::move(object));
+    }
+    scene.Update();
+
+    glm::mat4 projection = glm::perspective(glm::radians(90.f), 16.f / 9.f, 0.1f, 2000.f);
+    Frustum frustum(projection * glm::lookAt(glm::vec3(0.f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f)));
+    glm::vec3 lightPosition(200.f, 0.f, 0.f);
+    float lightRange = 400.f;
+
+    std::vector<uint32_t> drawList;
+    std::vector<ObjectEntity*> objectDrawList;
+    drawList.reserve(entityCount);
+    objectDrawList.reserve(entityCount);
+
+    // Keeps the work from being optimized away
+    float checksum = 0.f;
+
+    std::cout << "Scene benchmark, " << entityCount << " entities, average of " << ITERATIONS << " runs" << std::endl;
+    std::cout << std::left << std::setw(20) << "" << std::right << std::setw(13) << "Scene" << std::setw(13) << "Objects" << std::endl;
+
+    // Every parent moves, the hierarchy recomputes them and everything below in one pass
+    double sceneTime = measure([&](uint32_t iteration)
+    {
+        glm::vec3 offset(0.f, static_cast<float>(iteration), 0.f);
+        for (TransformHandle group : groups)
+            hierarchy.SetLocal(group, offset, identity, glm::vec3(1.f));
+        scene.Update();
+    });
+    double objectTime = measure([&](uint32_t iteration)
+    {
+        glm::mat4 offset = glm::translate(glm::mat4(1.f), glm::vec3(0.f, static_cast<float>(iteration), 0.f));
+        for (const std::unique_ptr<ObjectEntity>& object : objects)
+        {
+            object->transform = offset * object->localTransform;
+            object->bounds = object->localBounds.Transformed(object->transform);
+        }
+    });
+    report("Transform update", sceneTime, objectTime);
+
+    // Nothing moved, dirty flags leave every matrix alone
+    sceneTime = measure([&](uint32_t)
+    {
+        scene.Update();
+    });
+    std::cout << std::left << std::setw(20) << "Idle update" << std::right << std::setw(10) << sceneTime << " ms"
+        << std::endl;
+
+    sceneTime = measure([&](uint32_t)
+    {
+        drawList.clear();
+        const std::vector<BoundingBox>& bounds = scene.GetBounds();
+        for (uint32_t i = 0; i < scene.GetCount(); ++i)
+        {
+            if (frustum.Intersects(bounds[i]))
+                drawList.push_back(i);
+        }
+    });
+    objectTime = measure([&](uint32_t)
+    {
+        objectDrawList.clear();
+        for (const std::unique_ptr<ObjectEntity>& object : objects)
+        {
+            if (frustum.Intersects(object->bounds))
+                objectDrawList.push_back(object.get());
+        }
+    });
+    report("Frustum culling", sceneTime, objectTime);
+
+    sceneTime = measure([&](uint32_t)
+    {
+        drawList.clear();
+        const std::vector<BoundingBox>& bounds = scene.GetBounds();
+        const std::vector<uint32_t>& flags = scene.GetFlags();
+        for (uint32_t i = 0; i < scene.GetCount(); ++i)
+        {
+            if ((flags[i] & SCENE_FLAG_CASTS_SHADOWS) && bounds[i].IntersectsSphere(lightPosition, lightRange))
+                drawList.push_back(i);
+        }
+    });
+    objectTime = measure([&](uint32_t)
+    {
+        objectDrawList.clear();
+        for (const std::unique_ptr<ObjectEntity>& object : objects)
+        {
+            if (object->castsShadows && object->bounds.IntersectsSphere(lightPosition, lightRange))
+                objectDrawList.push_back(object.get());
+        }
+    });
+    report("Caster gathering", sceneTime, objectTime);
+
+    // What recording reads per draw: the model matrix and whether the entity is shaded
+    sceneTime = measure([&](uint32_t)
+    {
+        const std::vector<glm::mat4>& transforms = scene.GetTransforms();
+        const std::vector<uint32_t>& flags = scene.GetFlags();
+        for (uint32_t i = 0; i < scene.GetCount(); ++i)
+        {
+            if (flags[i] & SCENE_FLAG_SHADED)
+                checksum += transforms[i][3][1];
+        }
+    });
+    objectTime = measure([&](uint32_t)
+    {
+        for (const std::unique_ptr<ObjectEntity>& object : objects)
+        {
+            for (uint32_t mesh : object->meshes)
+            {
+                if (object->name != "Light")
+                    checksum += object->transform[3][1] + static_cast<float>(mesh & 1);
+            }
+        }
+    });
+    report("Draw iteration", sceneTime, objectTime);
+
+    // Entities come and go, handles to the others have to stay valid
+    std::uniform_int_distribution<uint32_t> pick(0, entityCount - 1);
+    sceneTime = measure([&](uint32_t)
+    {
+        for (uint32_t i = 0; i < entityCount / 10; ++i)
+        {
+            uint32_t entity = pick(random);
+            scene.Destroy(handles[entity]);
+            handles[entity] = scene.Create(nullptr, 0, nodes[entity], unitBox, SCENE_FLAG_SHADED);
+        }
+    });
+    objectTime = measure([&](uint32_t)
+    {
+        for (uint32_t i = 0; i < entityCount / 10; ++i)
+        {
+            std::unique_ptr<ObjectEntity>& object = objects[pick(random)];
+            object.reset(new ObjectEntity());
+            object->name = "Entity";
+            object->meshes.push_back(i);
+        }
+    });
+    report("Churn 10%", sceneTime, objectTime);
+
+    std::cout << "Checksum: " << checksum << ", last draw list: " << drawList.size() << " entities, "
+        << objectDrawList.size() << " objects" << std::endl;
+}
+
+void Benchmark::RunBvh(uint32_t triangleCount)
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    // A height field, two triangles per cell
+    uint32_t cells = std::max(1u, static_cast<uint32_t>(std::sqrt(triangleCount / 2.f)));
+    float cellSize = 2000.f / cells;
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    positions.reserve((cells + 1) * (cells + 1));
+    indices.reserve(cells * cells * 6);
+    for (uint32_t z = 0; z <= cells; ++z)
+    {
+        for (uint32_t x = 0; x <= cells; ++x)
+            positions.push_back({ x * cellSize - 1000.f, unit(random) * 50.f, z * cellSize - 1000.f });
+    }
+    for (uint32_t z = 0; z < cells; ++z)
+    {
+        for (uint32_t x = 0; x < cells; ++x)
+        {
+            uint32_t corner = z * (cells + 1) + x;
+            indices.insert(indices.end(), { corner, corner + cells + 1, corner + 1 });
+            indices.insert(indices.end(), { corner + 1, corner + cells + 1, corner + cells + 2 });
+        }
+    }
+
+    TriangleBvh triangles;
+    double buildTime = measureOnce([&]()
+    {
+        triangles.Build(positions, indices);
+    });
+
+    const uint32_t RAY_COUNT = 10000;
+    std::vector<Ray> rays;
+    rays.reserve(RAY_COUNT);
+    for (uint32_t i = 0; i < RAY_COUNT; ++i)
+    {
+        glm::vec3 origin(unit(random) * 1600.f - 800.f, 200.f, unit(random) * 1600.f - 800.f);
+        glm::vec3 direction = glm::normalize(glm::vec3(unit(random) - 0.5f, -1.f, unit(random) - 0.5f));
+        rays.emplace_back(origin, direction);
+    }
+
+    uint32_t hits = 0;
+    double raycastTime = measureOnce([&]()
+    {
+        for (const Ray& ray : rays)
+        {
+            float distance;
+            if (triangles.Raycast(ray, 10000.f, distance)) ++hits;
+        }
+    });
+
+    std::cout << "BVH benchmark, " << triangles.GetTriangleCount() << " triangles" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Triangle BVH build     " << std::setw(10) << buildTime << " ms" << std::endl;
+    std::cout << "Raycast                " << std::setw(10) << raycastTime * 1000.0 / RAY_COUNT << " us, "
+        << hits << " of " << RAY_COUNT << " hit" << std::endl;
+
+    // Scene entities spread like in RunScene
+    const uint32_t ENTITY_COUNT = 100000;
+    std::uniform_real_distribution<float> position(-1000.f, 1000.f);
+    std::vector<BoundingBox> bounds(ENTITY_COUNT);
+    for (BoundingBox& box : bounds)
+    {
+        box.min = glm::vec3(position(random), position(random), position(random));
+        box.max = box.min + glm::vec3(2.f);
+    }
+
+    Bvh bvh;
+    buildTime = measureOnce([&]()
+    {
+        bvh.Build(bounds);
+    });
+
+    // A tenth of the entities moves a little every frame
+    double refitTime = measure([&](uint32_t)
+    {
+        for (uint32_t i = 0; i < ENTITY_COUNT; i += 10)
+        {
+            bounds[i].min.y += 1.f;
+            bounds[i].max.y += 1.f;
+        }
+        bvh.Refit(bounds);
+    });
+
+    glm::mat4 projection = glm::perspective(glm::radians(90.f), 16.f / 9.f, 0.1f, 2000.f);
+    Frustum frustum(projection * glm::lookAt(glm::vec3(0.f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f)));
+
+    std::vector<uint32_t> results;
+    results.reserve(ENTITY_COUNT);
+    double bvhCullTime = measure([&](uint32_t)
+    {
+        results.clear();
+        bvh.QueryFrustum(frustum, [&](uint32_t item) { results.push_back(item); });
+    });
+    size_t bvhVisible = results.size();
+
+    double linearCullTime = measure([&](uint32_t)
+    {
+        results.clear();
+        for (uint32_t i = 0; i < ENTITY_COUNT; ++i)
+        {
+            if (frustum.Intersects(bounds[i])) results.push_back(i);
+        }
+    });
+    size_t linearVisible = results.size();
+
+    BoundingBox region;
+    region.min = glm::vec3(-50.f);
+    region.max = glm::vec3(50.f);
+    double boxTime = measure([&](uint32_t)
+    {
+        results.clear();
+        bvh.QueryBox(region, [&](uint32_t item) { results.push_back(item); });
+    });
+
+    std::cout << "Scene BVH, " << ENTITY_COUNT << " entities, " << bvh.GetNodeCount() << " nodes" << std::endl;
+    std::cout << "Build                  " << std::setw(10) << buildTime << " ms" << std::endl;
+    std::cout << "Refit                  " << std::setw(10) << refitTime << " ms" << std::endl;
+    std::cout << "Frustum query          " << std::setw(10) << bvhCullTime << " ms, " << bvhVisible << " visible" << std::endl;
+    std::cout << "Frustum linear         " << std::setw(10) << linearCullTime << " ms, " << linearVisible << " visible"
+        << std::endl;
+    std::cout << "Box query              " << std::setw(10) << boxTime * 1000.0 << " us" << std::endl;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+// CPU benchmarks that run without a window or device, started from the command line
+namespace Benchmark
+{
+	// Scene table updates, culling and iteration against a heap-allocated object per entity
+	void RunScene(uint32_t entityCount);
+	// Triangle BVH build and raycasts, scene BVH build, refit, frustum and box queries
+	void RunBvh(uint32_t triangleCount);
+}
@@ -0,0 +1,172 @@
+#include "BenchmarkReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    uint64_t getPeakMemory()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters = {};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage = {};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+}
+
+BenchmarkReport::BenchmarkReport()
+{
+}
+
+void BenchmarkReport::Reserve(uint32_t frameCount)
+{
+    m_frames.reserve(frameCount);
+}
+
+void BenchmarkReport::AddFrame(const Frame& frame)
+{
+    m_frames.push_back(frame);
+}
+
+void BenchmarkReport::SetLoadTimes(float firstFrameTime, float loadedTime)
+{
+    m_firstFrameTime = firstFrameTime;
+    m_loadedTime = loadedTime;
+}
+
+void BenchmarkReport::Finish()
+{
+    m_peakMemory = getPeakMemory();
+}
+
+void BenchmarkReport::Print() const
+{
+    Summary cpu = summarize(&Frame::cpuTime);
+    Summary gpu = summarize(&Frame::gpuTime);
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << m_frames.size() << " frames" << std::endl;
+    std::cout << "CPU ms  p50 " << cpu.p50 << "  p95 " << cpu.p95 << "  p99 " << cpu.p99 << "  max " << cpu.max << std::endl;
+    std::cout << "GPU ms  p50 " << gpu.p50 << "  p95 " << gpu.p95 << "  p99 " << gpu.p99 << "  max " << gpu.max << std::endl;
+    std::cout << "Draws   average " << summarize(&Frame::drawCount).average << ", "
+        << summarize(&Frame::drawCalls).average << " draw calls, " << summarize(&Frame::triangles).average << " triangles"
+        << std::endl;
+    std::cout << "Loading first frame " << m_firstFrameTime << " ms, fully loaded " << m_loadedTime << " ms" << std::endl;
+    std::cout << "Peak memory " << m_peakMemory / (1024 * 1024) << " MiB" << std::endl;
+    std::cout << std::defaultfloat;
+}
+
+bool BenchmarkReport::WriteJson(const std::string& path, const std::string& name) const
+{
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+
+    auto writeSummary = [&file](const char* key, const Summary& summary, bool last)
+    {
+        file << "    \"" << key << "\": { \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95 << ", \"p99\": "
+            << summary.p99 << ", \"max\": " << summary.max << ", \"average\": " << summary.average << " }"
+            << (last ? "\n" : ",\n");
+    };
+
+    // Names come from the command line, only quotes and backslashes need escaping there
+    std::string escapedName;
+    for (char c : name)
+    {
+        if (c == '"' || c == '\\') escapedName += '\\';
+        escapedName += c;
+    }
+
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    file << "    \"name\": \"" << escapedName << "\",\n";
+    file << "    \"frames\": " << m_frames.size() << ",\n";
+    writeSummary("cpuTime", summarize(&Frame::cpuTime), false);
+    writeSummary("gpuTime", summarize(&Frame::gpuTime), false);
+    writeSummary("drawCount", summarize(&Frame::drawCount), false);
+    writeSummary("allocations", summarize(&Frame::allocations), false);
+    writeSummary("drawCalls", summarize(&Frame::drawCalls), false);
+    writeSummary("triangles", summarize(&Frame::triangles), false);
+    writeSummary("pipelineBinds", summarize(&Frame::pipelineBinds), false);
+    writeSummary("descriptorBinds", summarize(&Frame::descriptorBinds), false);
+    writeSummary("pushConstants", summarize(&Frame::pushConstants), false);
+    writeSummary("vertexInvocations", summarize(&Frame::vertexInvocations), false);
+    writeSummary("clippingPrimitives", summarize(&Frame::clippingPrimitives), false);
+    writeSummary("fragmentInvocations", summarize(&Frame::fragmentInvocations), false);
+    file << "    \"firstFrameTime\": " << m_firstFrameTime << ",\n";
+    file << "    \"loadedTime\": " << m_loadedTime << ",\n";
+    file << "    \"peakMemory\": " << m_peakMemory << "\n";
+    file << "}\n";
+
+    return file.good();
+}
+
+bool BenchmarkReport::WriteCsv(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+
+    file << std::fixed << std::setprecision(4);
+    file << "frame,cpuTime,gpuTime,drawCount,allocations,drawCalls,triangles,pipelineBinds,descriptorBinds,pushConstants,"
+        "vertexInvocations,clippingPrimitives,fragmentInvocations\n";
+    for (size_t i = 0; i < m_frames.size(); ++i)
+    {
+        const Frame& frame = m_frames[i];
+        file << i << ',' << frame.cpuTime << ',' << frame.gpuTime << ',' << frame.drawCount << ',' << frame.allocations
+            << ',' << frame.drawCalls << ',' << frame.triangles << ',' << frame.pipelineBinds << ',' << frame.descriptorBinds
+            << ',' << frame.pushConstants << ',' << frame.vertexInvocations << ',' << frame.clippingPrimitives
+            << ',' << frame.fragmentInvocations << '\n';
+    }
+
+    return file.good();
+}
+
+template<typename Value>
+BenchmarkReport::Summary BenchmarkReport::summarize(Value Frame::* member) const
+{
+    Summary summary = {};
+    if (m_frames.empty()) return summary;
+
+    std::vector<float> values;
+    values.reserve(m_frames.size());
+    double sum = 0.0;
+    for (const Frame& frame : m_frames)
+    {
+        values.push_back(static_cast<float>(frame.*member));
+        sum += static_cast<double>(frame.*member);
+    }
+    std::sort(values.begin(), values.end());
+
+    // Nearest rank, the smallest value that at least the given share of frames is below or equal to
+    auto percentile = [&values](float share)
+    {
+        size_t rank = static_cast<size_t>(std::ceil(share * values.size()));
+        return values[std::min(std::max(rank, size_t(1)), values.size()) - 1];
+    };
+
+    summary.p50 = percentile(0.50f);
+    summary.p95 = percentile(0.95f);
+    summary.p99 = percentile(0.99f);
+    summary.max = values.back();
+    summary.average = static_cast<float>(sum / values.size());
+    return summary;
+}
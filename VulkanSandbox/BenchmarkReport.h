@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// -- BENCHMARK REPORT --
+// Per frame measurements of a benchmark run, summarized as percentiles. Written as JSON for the summary and CSV for
+// the individual frames, so runs of different builds can be compared.
+class BenchmarkReport
+{
+public:
+    struct Frame
+    {
+        float cpuTime;          // ms
+        float gpuTime;          // ms, lags a few frames behind the CPU
+        uint32_t drawCount;             // Visible entities
+        uint64_t allocations;
+
+        // Recorded commands of every pass
+        uint32_t drawCalls;
+        uint64_t triangles;
+        uint32_t pipelineBinds;
+        uint32_t descriptorBinds;
+        uint32_t pushConstants;
+
+        // Pipeline statistics, 0 where the device has no support for them
+        uint64_t vertexInvocations;
+        uint64_t clippingPrimitives;
+        uint64_t fragmentInvocations;
+    };
+
+    BenchmarkReport();
+
+    void Reserve(uint32_t frameCount);
+    void AddFrame(const Frame& frame);
+    // ms from the start of loading until the first frame and until everything was loaded
+    void SetLoadTimes(float firstFrameTime, float loadedTime);
+    // Samples the process memory, call once all frames are added
+    void Finish();
+
+    void Print() const;
+    bool WriteJson(const std::string& path, const std::string& name) const;
+    bool WriteCsv(const std::string& path) const;
+
+private:
+    struct Summary
+    {
+        float p50;
+        float p95;
+        float p99;
+        float max;
+        float average;
+    };
+
+    std::vector<Frame> m_frames;
+    uint64_t m_peakMemory = 0;
+    float m_firstFrameTime = 0.f;
+    float m_loadedTime = 0.f;
+
+    template<typename Value>
+    Summary summarize(Value Frame::* member) const;
+
+};
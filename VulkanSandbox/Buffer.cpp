@@ -1,5 +1,7 @@
 ﻿#include "Buffer.h"
 
+#include "CommandBufferAllocator.h"
+#include "GpuMemory.h"
 #include "Image.h"
 #include "Utilities.h"
 
@@ -19,7 +21,7 @@ void Buffer::Init(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize
 
 void Buffer::Destroy(VkDevice device)
 {
-    vkFreeMemory(device, m_bufferMemory, nullptr);
+    GpuMemory::Free(device, m_bufferMemory);
     vkDestroyBuffer(device, m_buffer, nullptr);
 }
 
@@ -54,30 +56,40 @@ void Buffer::CreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDe
     memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(physicalDevice, memoryRequirements.memoryTypeBits,
                                                           memoryProperties);
 
-    CHECK_VK_RESULT(vkAllocateMemory(device, &memoryAllocInfo, nullptr, memory), "Failed to allocate Memory");
+    CHECK_VK_RESULT(GpuMemory::Allocate(device, memoryAllocInfo, GpuMemory::GetBufferCategory(bufferUsage), memory),
+                    "Failed to allocate Memory");
     CHECK_VK_RESULT(vkBindBufferMemory(device, *buffer, *memory, 0), "Failed to bind Memory to Buffer");
 }
 
-void Buffer::CopyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool, VkBuffer source,
+void Buffer::CopyBuffer(VkQueue transferQueue, CommandBufferAllocator& commandAllocator, VkBuffer source,
                         VkBuffer destination, VkDeviceSize size)
 {
-    VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
+    VkCommandBuffer transferCommandBuffer = commandAllocator.BeginOneShot();
+    RecordCopyBuffer(transferCommandBuffer, source, destination, size);
+    commandAllocator.SubmitOneShot(transferQueue, transferCommandBuffer);
+}
+
+void Buffer::CopyBufferToImage(VkQueue transferQueue, CommandBufferAllocator& commandAllocator,
+    VkBuffer source, VkImage destination, uint32_t width, uint32_t height)
+{
+    VkCommandBuffer transferCommandBuffer = commandAllocator.BeginOneShot();
+    RecordCopyBufferToImage(transferCommandBuffer, source, destination, width, height);
+    commandAllocator.SubmitOneShot(transferQueue, transferCommandBuffer);
+}
 
+void Buffer::RecordCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer source, VkBuffer destination, VkDeviceSize size)
+{
     VkBufferCopy copyRegion;
     copyRegion.srcOffset = 0;
     copyRegion.dstOffset = 0;
     copyRegion.size = size;
 
-    vkCmdCopyBuffer(transferCommandBuffer, source, destination, 1, &copyRegion);
-
-    endCommandBufferAndSubmit(device, transferCommandPool, transferQueue, transferCommandBuffer);
+    vkCmdCopyBuffer(commandBuffer, source, destination, 1, &copyRegion);
 }
 
-void Buffer::CopyBufferToImage(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-    VkBuffer source, VkImage destination, uint32_t width, uint32_t height)
+void Buffer::RecordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer source, VkImage destination,
+    uint32_t width, uint32_t height)
 {
-    VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
-
     VkBufferImageCopy imageCopyRegion = {};
     imageCopyRegion.bufferOffset = 0;
     imageCopyRegion.bufferRowLength = 0;
@@ -89,8 +101,5 @@ void Buffer::CopyBufferToImage(VkDevice device, VkQueue transferQueue, VkCommand
     imageCopyRegion.imageOffset = { 0, 0, 0 };
     imageCopyRegion.imageExtent = { width, height, 1 };
 
-    vkCmdCopyBufferToImage(transferCommandBuffer, source, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyRegion);
-    
-    endCommandBufferAndSubmit(device, transferCommandPool, transferQueue, transferCommandBuffer);
-
+    vkCmdCopyBufferToImage(commandBuffer, source, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyRegion);
 }
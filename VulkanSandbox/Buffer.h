@@ -2,6 +2,8 @@
 
 #include <vulkan/vulkan.h>
 
+class CommandBufferAllocator;
+
 class Buffer
 {
 public:
@@ -21,11 +23,16 @@ public:
                              VkMemoryPropertyFlags memoryProperties,
                              VkBuffer* buffer, VkDeviceMemory* memory);
 
-    static void CopyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
+    static void CopyBuffer(VkQueue transferQueue, CommandBufferAllocator& commandAllocator,
                            VkBuffer source, VkBuffer destination, VkDeviceSize size);
-    static void CopyBufferToImage(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
+    static void CopyBufferToImage(VkQueue transferQueue, CommandBufferAllocator& commandAllocator,
                                   VkBuffer source, VkImage destination, uint32_t width, uint32_t height);
 
+    // Record the copies into a command buffer someone else submits
+    static void RecordCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer source, VkBuffer destination, VkDeviceSize size);
+    static void RecordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer source, VkImage destination,
+                                        uint32_t width, uint32_t height);
+
 private:
     VkBuffer m_buffer;
     VkDeviceMemory m_bufferMemory;
@@ -0,0 +1,275 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    const uint32_t BIN_COUNT = 12;
+    // Leaves this small are never split further, larger ones only when SAH says so
+    const uint32_t MIN_LEAF_ITEMS = 2;
+    const uint32_t MAX_LEAF_ITEMS = 16;
+
+    struct Bin
+    {
+        BoundingBox bounds;
+        uint32_t count = 0;
+    };
+
+    float surfaceArea(const BoundingBox& box)
+    {
+        glm::vec3 size = box.max - box.min;
+        return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    // Default boxes sit at the origin, the first box added replaces it
+    void grow(BoundingBox& box, uint32_t count, const BoundingBox& other)
+    {
+        if (count == 0) box = other;
+        else box.Expand(other);
+    }
+
+    uint32_t binOf(float center, float min, float scale)
+    {
+        return std::min(BIN_COUNT - 1, static_cast<uint32_t>((center - min) * scale));
+    }
+}
+
+Bvh::Bvh()
+{
+}
+
+void Bvh::Build(const std::vector<BoundingBox>& bounds)
+{
+    Clear();
+    if (bounds.empty()) return;
+
+    uint32_t count = static_cast<uint32_t>(bounds.size());
+    m_items.resize(count);
+    m_centers.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        m_items[i] = i;
+        m_centers[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+    }
+
+    // A binary tree with at least one item per leaf never has more nodes than this
+    m_nodes.reserve(2 * count - 1);
+    m_nodes.push_back({ BoundingBox(), 0, count });
+    subdivide(bounds, 0, 0);
+
+    m_itemBounds.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+        m_itemBounds[i] = bounds[m_items[i]];
+}
+
+void Bvh::Refit(const std::vector<BoundingBox>& bounds)
+{
+    for (uint32_t i = 0; i < m_items.size(); ++i)
+        m_itemBounds[i] = bounds[m_items[i]];
+
+    for (uint32_t i = static_cast<uint32_t>(m_nodes.size()); i-- > 0;)
+        updateBounds(i);
+}
+
+void Bvh::Clear()
+{
+    m_nodes.clear();
+    m_items.clear();
+    m_itemBounds.clear();
+}
+
+bool Bvh::Empty() const
+{
+    return m_nodes.empty();
+}
+
+uint32_t Bvh::GetNodeCount() const
+{
+    return static_cast<uint32_t>(m_nodes.size());
+}
+
+void Bvh::subdivide(const std::vector<BoundingBox>& bounds, uint32_t nodeIndex, uint32_t depth)
+{
+    uint32_t first = m_nodes[nodeIndex].first;
+    uint32_t count = m_nodes[nodeIndex].count;
+
+    BoundingBox nodeBounds = bounds[m_items[first]];
+    BoundingBox centerBounds;
+    centerBounds.min = centerBounds.max = m_centers[m_items[first]];
+    for (uint32_t i = first + 1; i < first + count; ++i)
+    {
+        nodeBounds.Expand(bounds[m_items[i]]);
+        centerBounds.Expand(m_centers[m_items[i]]);
+    }
+    m_nodes[nodeIndex].bounds = nodeBounds;
+
+    if (count <= MIN_LEAF_ITEMS || depth + 1 >= MAX_DEPTH) return;
+
+    float bestCost = std::numeric_limits<float>::max();
+    uint32_t bestAxis = 0;
+    uint32_t bestSplit = 0;
+
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        float extent = centerBounds.max[axis] - centerBounds.min[axis];
+        if (extent <= 0.f) continue;
+
+        Bin bins[BIN_COUNT];
+        float scale = BIN_COUNT / extent;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            uint32_t item = m_items[i];
+            Bin& bin = bins[binOf(m_centers[item][axis], centerBounds.min[axis], scale)];
+            grow(bin.bounds, bin.count, bounds[item]);
+            ++bin.count;
+        }
+
+        // A split at s puts bins 0 to s - 1 on the left, sweep from the left first and then from the right
+        float leftCosts[BIN_COUNT];
+        BoundingBox left;
+        uint32_t leftCount = 0;
+        for (uint32_t s = 1; s < BIN_COUNT; ++s)
+        {
+            if (bins[s - 1].count > 0)
+            {
+                grow(left, leftCount, bins[s - 1].bounds);
+                leftCount += bins[s - 1].count;
+            }
+            leftCosts[s] = leftCount > 0 ? surfaceArea(left) * leftCount : -1.f;
+        }
+
+        BoundingBox right;
+        uint32_t rightCount = 0;
+        for (uint32_t s = BIN_COUNT - 1; s > 0; --s)
+        {
+            if (bins[s].count > 0)
+            {
+                grow(right, rightCount, bins[s].bounds);
+                rightCount += bins[s].count;
+            }
+            if (leftCosts[s] < 0.f || rightCount == 0) continue;
+
+            float cost = leftCosts[s] + surfaceArea(right) * rightCount;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = s;
+            }
+        }
+    }
+
+    // All centers in one spot, there is nothing to split
+    if (bestSplit == 0) return;
+    if (bestCost >= surfaceArea(nodeBounds) * count && count <= MAX_LEAF_ITEMS) return;
+
+    float min = centerBounds.min[bestAxis];
+    float scale = BIN_COUNT / (centerBounds.max[bestAxis] - min);
+    uint32_t* middle = std::partition(m_items.data() + first, m_items.data() + first + count, [&](uint32_t item)
+    {
+        return binOf(m_centers[item][bestAxis], min, scale) < bestSplit;
+    });
+
+    uint32_t leftCount = static_cast<uint32_t>(middle - (m_items.data() + first));
+    if (leftCount == 0 || leftCount == count) return;
+
+    uint32_t left = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back({ BoundingBox(), first, leftCount });
+    m_nodes.push_back({ BoundingBox(), first + leftCount, count - leftCount });
+
+    m_nodes[nodeIndex].first = left;
+    m_nodes[nodeIndex].count = 0;
+
+    subdivide(bounds, left, depth + 1);
+    subdivide(bounds, left + 1, depth + 1);
+}
+
+void Bvh::updateBounds(uint32_t nodeIndex)
+{
+    Node& node = m_nodes[nodeIndex];
+
+    if (node.count == 0)
+    {
+        node.bounds = m_nodes[node.first].bounds;
+        node.bounds.Expand(m_nodes[node.first + 1].bounds);
+        return;
+    }
+
+    node.bounds = m_itemBounds[node.first];
+    for (uint32_t i = node.first + 1; i < node.first + node.count; ++i)
+        node.bounds.Expand(m_itemBounds[i]);
+}
+
+// -- TRIANGLE BVH --
+
+TriangleBvh::TriangleBvh()
+{
+}
+
+void TriangleBvh::Build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+    uint32_t cornerCount = static_cast<uint32_t>(indices.empty() ? positions.size() : indices.size());
+    uint32_t triangleCount = cornerCount / 3;
+
+    m_corners.resize(triangleCount * 3);
+    std::vector<BoundingBox> bounds(triangleCount);
+    for (uint32_t i = 0; i < triangleCount * 3; ++i)
+    {
+        m_corners[i] = indices.empty() ? positions[i] : positions[indices[i]];
+
+        BoundingBox& box = bounds[i / 3];
+        if (i % 3 == 0) box.min = box.max = m_corners[i];
+        else box.Expand(m_corners[i]);
+    }
+
+    m_bvh.Build(bounds);
+}
+
+void TriangleBvh::Clear()
+{
+    m_corners.clear();
+    m_bvh.Clear();
+}
+
+bool TriangleBvh::Empty() const
+{
+    return m_bvh.Empty();
+}
+
+uint32_t TriangleBvh::GetTriangleCount() const
+{
+    return static_cast<uint32_t>(m_corners.size() / 3);
+}
+
+bool TriangleBvh::Raycast(const Ray& ray, float maxDistance, float& distance) const
+{
+    uint32_t triangle;
+    return m_bvh.Raycast(ray, maxDistance, [&](uint32_t item, float& closest)
+    {
+        // Moeller-Trumbore, both faces count
+        const glm::vec3& a = m_corners[item * 3];
+        glm::vec3 edge1 = m_corners[item * 3 + 1] - a;
+        glm::vec3 edge2 = m_corners[item * 3 + 2] - a;
+
+        glm::vec3 p = glm::cross(ray.direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) < 1e-12f) return false;
+
+        float inverseDeterminant = 1.f / determinant;
+        glm::vec3 toOrigin = ray.origin - a;
+        float u = glm::dot(toOrigin, p) * inverseDeterminant;
+        if (u < 0.f || u > 1.f) return false;
+
+        glm::vec3 q = glm::cross(toOrigin, edge1);
+        float v = glm::dot(ray.direction, q) * inverseDeterminant;
+        if (v < 0.f || u + v > 1.f) return false;
+
+        float t = glm::dot(edge2, q) * inverseDeterminant;
+        if (t < 0.f || t >= closest) return false;
+
+        closest = t;
+        return true;
+    }, triangle, distance);
+}
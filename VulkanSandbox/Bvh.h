@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Frustum.h"
+
+// -- BVH --
+// Bounding volume hierarchy over a list of boxes, built with binned SAH. Queries report item indices into the list
+// the tree was built from. Children are stored after their parent, so refitting is a single reverse pass.
+class Bvh
+{
+public:
+    Bvh();
+
+    void Build(const std::vector<BoundingBox>& bounds);
+    // Takes the new bounds of the same items, the tree keeps its shape and only the node bounds change
+    void Refit(const std::vector<BoundingBox>& bounds);
+    void Clear();
+
+    bool Empty() const;
+    uint32_t GetNodeCount() const;
+
+    // function(item) for every item whose box intersects
+    template<typename Function>
+    void QueryFrustum(const Frustum& frustum, Function function) const;
+    template<typename Function>
+    void QueryBox(const BoundingBox& box, Function function) const;
+
+    // test(item, distance) is called for items whose box the ray hits before distance, it returns true and lowers
+    // distance when the item itself is hit closer. Nodes are visited front to back.
+    template<typename Function>
+    bool Raycast(const Ray& ray, float maxDistance, Function test, uint32_t& item, float& distance) const;
+
+private:
+    static const uint32_t MAX_DEPTH = 64;
+
+    // An inner node's children are first and first + 1, a leaf holds count items starting at first
+    struct Node
+    {
+        BoundingBox bounds;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_items;
+    // Item bounds in the order of m_items, leaves test them without going back to the source list
+    std::vector<BoundingBox> m_itemBounds;
+
+    std::vector<glm::vec3> m_centers;
+
+    void subdivide(const std::vector<BoundingBox>& bounds, uint32_t nodeIndex, uint32_t depth);
+    void updateBounds(uint32_t nodeIndex);
+
+};
+
+template<typename Function>
+void Bvh::QueryFrustum(const Frustum& frustum, Function function) const
+{
+    if (m_nodes.empty()) return;
+
+    uint32_t stack[MAX_DEPTH + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        if (!frustum.Intersects(node.bounds)) continue;
+
+        if (node.count == 0)
+        {
+            stack[stackSize++] = node.first + 1;
+            stack[stackSize++] = node.first;
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; ++i)
+        {
+            if (frustum.Intersects(m_itemBounds[i]))
+                function(m_items[i]);
+        }
+    }
+}
+
+template<typename Function>
+void Bvh::QueryBox(const BoundingBox& box, Function function) const
+{
+    if (m_nodes.empty()) return;
+
+    uint32_t stack[MAX_DEPTH + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        if (!node.bounds.Intersects(box)) continue;
+
+        if (node.count == 0)
+        {
+            stack[stackSize++] = node.first + 1;
+            stack[stackSize++] = node.first;
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; ++i)
+        {
+            if (m_itemBounds[i].Intersects(box))
+                function(m_items[i]);
+        }
+    }
+}
+
+template<typename Function>
+bool Bvh::Raycast(const Ray& ray, float maxDistance, Function test, uint32_t& item, float& distance) const
+{
+    float entry;
+    if (m_nodes.empty() || !m_nodes[0].bounds.IntersectsRay(ray, maxDistance, entry)) return false;
+
+    bool hit = false;
+    float closest = maxDistance;
+
+    uint32_t stack[MAX_DEPTH + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+
+        if (node.count == 0)
+        {
+            float leftEntry, rightEntry;
+            bool hitLeft = m_nodes[node.first].bounds.IntersectsRay(ray, closest, leftEntry);
+            bool hitRight = m_nodes[node.first + 1].bounds.IntersectsRay(ray, closest, rightEntry);
+
+            // The nearer child goes on top so it is visited first and shrinks closest for the other one
+            if (hitLeft && hitRight)
+            {
+                bool leftFirst = leftEntry <= rightEntry;
+                stack[stackSize++] = leftFirst ? node.first + 1 : node.first;
+                stack[stackSize++] = leftFirst ? node.first : node.first + 1;
+            }
+            else if (hitLeft)
+            {
+                stack[stackSize++] = node.first;
+            }
+            else if (hitRight)
+            {
+                stack[stackSize++] = node.first + 1;
+            }
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; ++i)
+        {
+            if (!m_itemBounds[i].IntersectsRay(ray, closest, entry)) continue;
+
+            if (test(m_items[i], closest))
+            {
+                hit = true;
+                item = m_items[i];
+            }
+        }
+    }
+
+    if (hit) distance = closest;
+    return hit;
+}
+
+// -- TRIANGLE BVH --
+// Keeps a copy of a mesh's triangles in model space for ray queries
+class TriangleBvh
+{
+public:
+    TriangleBvh();
+
+    // Triangle list, three indices per triangle. Without indices every three positions are a triangle
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+    void Clear();
+
+    bool Empty() const;
+    uint32_t GetTriangleCount() const;
+
+    bool Raycast(const Ray& ray, float maxDistance, float& distance) const;
+
+private:
+    // Three corners per triangle
+    std::vector<glm::vec3> m_corners;
+    Bvh m_bvh;
+
+};
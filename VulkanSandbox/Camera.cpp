@@ -36,6 +36,10 @@ void Camera::AddRotation(float roll, float pitch, float yaw)
 
 void Camera::SetProjection(float fov, float aspectRatio, float near, float far)
 {
+    m_fov = fov;
+    m_aspectRatio = aspectRatio;
+    m_near = near;
+    m_far = far;
     m_projectionMatrix = glm::perspectiveZO(glm::radians(fov), aspectRatio, near, far);
 }
 
@@ -46,7 +50,8 @@ const glm::vec3& Camera::GetPosition()
 
 glm::vec3 Camera::GetRotation()
 {
-    return { m_pitch, m_yaw, 0.f };
+    // Same order as AddRotation and SetRotation, roll is not used
+    return { 0.f, m_pitch, m_yaw };
 }
 
 void Camera::SetPosition(const glm::vec3& newPos)
@@ -73,6 +78,26 @@ glm::mat4 Camera::GetProjectionMatrix()
     return m_projectionMatrix;
 }
 
+float Camera::GetFov()
+{
+    return m_fov;
+}
+
+float Camera::GetAspectRatio()
+{
+    return m_aspectRatio;
+}
+
+float Camera::GetNearPlane()
+{
+    return m_near;
+}
+
+float Camera::GetFarPlane()
+{
+    return m_far;
+}
+
 const glm::vec3& Camera::GetForwardVector()
 {
     return m_forward;
@@ -83,6 +108,17 @@ const glm::vec3& Camera::GetUpVector()
     return m_up;
 }
 
+Ray Camera::GetRay(const glm::vec2& screenPosition)
+{
+    glm::mat4 inverseViewProjection = glm::inverse(m_projectionMatrix * m_viewMatrix);
+
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(screenPosition, 0.f, 1.f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(screenPosition, 1.f, 1.f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+
+    return Ray(origin, glm::normalize(glm::vec3(farPoint) / farPoint.w - origin));
+}
+
 void Camera::onPosUpdate()
 {
     if (m_pitch > 89.f) m_pitch = 89.f;
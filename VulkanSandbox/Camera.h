@@ -7,13 +7,19 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/rotate_vector.hpp>
 
+#include "Frustum.h"
+
+// Must match SHADOW_CASCADE_COUNT in the shaders
+constexpr uint32_t SHADOW_CASCADE_COUNT = 4;
+static_assert(SHADOW_CASCADE_COUNT <= 4, "Cascade splits are packed into a single vec4");
+
 struct UboViewProjection
 {
     glm::mat4 view;
     glm::mat4 projection;
     glm::vec4 camPosition;
-    glm::mat4 lightSpace;
-    glm::mat4 spotLightSpace;
+    glm::mat4 cascadeLightSpace[SHADOW_CASCADE_COUNT];
+    glm::vec4 cascadeSplits;    // Far view distance of each cascade
 };
 
 class Camera
@@ -37,9 +43,17 @@ public:
     glm::mat4 GetViewMatrix();
     glm::mat4 GetProjectionMatrix();
 
+    float GetFov();
+    float GetAspectRatio();
+    float GetNearPlane();
+    float GetFarPlane();
+
     const glm::vec3& GetForwardVector();
     const glm::vec3& GetUpVector();
 
+    // Ray from the near to the far plane through a point in normalized device coordinates, y pointing up
+    Ray GetRay(const glm::vec2& screenPosition);
+
 private:
     glm::vec3 m_position;
     float m_pitch, m_yaw;
@@ -47,6 +61,11 @@ private:
     glm::mat4 m_viewMatrix;
     glm::mat4 m_projectionMatrix;
 
+    float m_fov = 90.f;
+    float m_aspectRatio = 1.f;
+    float m_near = 0.1f;
+    float m_far = 1000.f;
+
     const glm::vec3 DEFAULT_FORWARD = { 0.f, 0.f, -1.f };
     const glm::vec3 DEFAULT_UP = { 0.f, 1.f, 0.f };
 
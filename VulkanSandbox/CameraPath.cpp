@@ -0,0 +1,127 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+CameraPath::CameraPath()
+{
+}
+
+void CameraPath::AddKeyframe(float time, const glm::vec3& position, const glm::vec3& rotation)
+{
+    m_keyframes.push_back({ time, position, rotation });
+}
+
+void CameraPath::Clear()
+{
+    m_keyframes.clear();
+}
+
+bool CameraPath::Load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+
+    std::vector<Keyframe> keyframes;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream stream(line);
+        Keyframe keyframe;
+        stream >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+            >> keyframe.rotation.x >> keyframe.rotation.y >> keyframe.rotation.z;
+        if (stream.fail()) return false;
+
+        if (!keyframes.empty() && keyframe.time <= keyframes.back().time) return false;
+        keyframes.push_back(keyframe);
+    }
+
+    m_keyframes = std::move(keyframes);
+    return true;
+}
+
+bool CameraPath::Save(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+
+    file << "# time position.x position.y position.z roll pitch yaw\n";
+    for (const Keyframe& keyframe : m_keyframes)
+    {
+        file << keyframe.time << ' ' << keyframe.position.x << ' ' << keyframe.position.y << ' ' << keyframe.position.z
+            << ' ' << keyframe.rotation.x << ' ' << keyframe.rotation.y << ' ' << keyframe.rotation.z << '\n';
+    }
+
+    return file.good();
+}
+
+void CameraPath::Sample(float time, glm::vec3& position, glm::vec3& rotation) const
+{
+    if (m_keyframes.empty()) return;
+
+    if (time <= m_keyframes.front().time || m_keyframes.size() == 1)
+    {
+        position = m_keyframes.front().position;
+        rotation = m_keyframes.front().rotation;
+        return;
+    }
+    if (time >= m_keyframes.back().time)
+    {
+        position = m_keyframes.back().position;
+        rotation = m_keyframes.back().rotation;
+        return;
+    }
+
+    auto next = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time, [](float value, const Keyframe& keyframe)
+    {
+        return value < keyframe.time;
+    });
+    uint32_t index = static_cast<uint32_t>(next - m_keyframes.begin()) - 1;
+
+    const Keyframe& a = m_keyframes[index];
+    const Keyframe& b = m_keyframes[index + 1];
+    float length = b.time - a.time;
+    float t = (time - a.time) / length;
+
+    // Cubic Hermite basis, with the tangents below this is a Catmull-Rom spline that allows uneven keyframe spacing
+    float t2 = t * t;
+    float t3 = t2 * t;
+    float h00 = 2.f * t3 - 3.f * t2 + 1.f;
+    float h10 = t3 - 2.f * t2 + t;
+    float h01 = -2.f * t3 + 3.f * t2;
+    float h11 = t3 - t2;
+
+    position = h00 * a.position + h10 * length * tangent(index, &Keyframe::position) +
+        h01 * b.position + h11 * length * tangent(index + 1, &Keyframe::position);
+    rotation = h00 * a.rotation + h10 * length * tangent(index, &Keyframe::rotation) +
+        h01 * b.rotation + h11 * length * tangent(index + 1, &Keyframe::rotation);
+}
+
+bool CameraPath::Empty() const
+{
+    return m_keyframes.empty();
+}
+
+float CameraPath::GetDuration() const
+{
+    return m_keyframes.empty() ? 0.f : m_keyframes.back().time - m_keyframes.front().time;
+}
+
+uint32_t CameraPath::GetKeyframeCount() const
+{
+    return static_cast<uint32_t>(m_keyframes.size());
+}
+
+template<typename Value>
+Value CameraPath::tangent(uint32_t index, Value Keyframe::* member) const
+{
+    // The first and last keyframe only have one neighbour
+    uint32_t previous = index > 0 ? index - 1 : index;
+    uint32_t next = std::min(index + 1, static_cast<uint32_t>(m_keyframes.size()) - 1);
+
+    return (m_keyframes[next].*member - m_keyframes[previous].*member) /
+        (m_keyframes[next].time - m_keyframes[previous].time);
+}
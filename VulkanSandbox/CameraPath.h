@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+
+// -- CAMERA PATH --
+// Camera keyframes over time, played back as a smooth curve through every keyframe. Saved as text, one keyframe per
+// line: time, position and rotation (roll, pitch, yaw in degrees), separated by spaces.
+class CameraPath
+{
+public:
+    struct Keyframe
+    {
+        float time;
+        glm::vec3 position;
+        glm::vec3 rotation;
+    };
+
+    CameraPath();
+
+    // Keyframes have to be added in time order
+    void AddKeyframe(float time, const glm::vec3& position, const glm::vec3& rotation);
+    void Clear();
+
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+
+    // Times outside the path clamp to its first or last keyframe
+    void Sample(float time, glm::vec3& position, glm::vec3& rotation) const;
+
+    bool Empty() const;
+    float GetDuration() const;
+    uint32_t GetKeyframeCount() const;
+
+private:
+    std::vector<Keyframe> m_keyframes;
+
+    // Slope at a keyframe from its neighbours, weighted by their distance in time
+    template<typename Value>
+    Value tangent(uint32_t index, Value Keyframe::* member) const;
+
+};
@@ -0,0 +1,139 @@
+#include "CommandBufferAllocator.h"
+
+#include <stdexcept>
+
+CommandBufferAllocator::CommandBufferAllocator()
+{
+}
+
+void CommandBufferAllocator::Init(VkDevice device, uint32_t queueFamily, uint32_t frameCount, uint32_t threadCount)
+{
+    m_device = device;
+    m_frameCount = frameCount;
+    m_threadCount = threadCount;
+
+    m_framePools.resize(m_frameCount * m_threadCount);
+    for (size_t i = 0; i < m_framePools.size(); ++i)
+    {
+        createPool(m_framePools[i], queueFamily);
+    }
+
+    createPool(m_uploadPool, queueFamily);
+}
+
+void CommandBufferAllocator::Destroy()
+{
+    // Destroying a pool frees all of its command buffers
+    for (size_t i = 0; i < m_framePools.size(); ++i)
+    {
+        vkDestroyCommandPool(m_device, m_framePools[i].commandPool, nullptr);
+    }
+    m_framePools.clear();
+
+    vkDestroyCommandPool(m_device, m_uploadPool.commandPool, nullptr);
+}
+
+void CommandBufferAllocator::ResetFrame(uint32_t frame)
+{
+    for (uint32_t thread = 0; thread < m_threadCount; ++thread)
+    {
+        resetPool(m_framePools[frame * m_threadCount + thread]);
+    }
+}
+
+VkCommandBuffer CommandBufferAllocator::Allocate(uint32_t frame, uint32_t thread, VkCommandBufferLevel level)
+{
+    return take(m_framePools[frame * m_threadCount + thread], level);
+}
+
+VkCommandBuffer CommandBufferAllocator::BeginOneShot()
+{
+    VkCommandBuffer commandBuffer = take(m_uploadPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    ++m_pendingOneShots;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    CHECK_VK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "Failed to begin Command Buffer");
+    return commandBuffer;
+}
+
+void CommandBufferAllocator::SubmitOneShot(VkQueue queue, VkCommandBuffer commandBuffer)
+{
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    CHECK_VK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE), "Failed to submit Command Buffer to Queue");
+
+    vkQueueWaitIdle(queue);
+
+    // Buffers still being recorded would be reset with the pool, so wait until the last one is submitted
+    if (--m_pendingOneShots == 0)
+    {
+        resetPool(m_uploadPool);
+    }
+}
+
+uint32_t CommandBufferAllocator::GetThreadCount()
+{
+    return m_threadCount;
+}
+
+uint32_t CommandBufferAllocator::GetAllocatedCount()
+{
+    return m_allocatedCount;
+}
+
+void CommandBufferAllocator::createPool(Pool& pool, uint32_t queueFamily)
+{
+    // No RESET_COMMAND_BUFFER_BIT: buffers are only ever reset together with their pool
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.queueFamilyIndex = queueFamily;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    VkResult result = vkCreateCommandPool(m_device, &commandPoolCreateInfo, nullptr, &pool.commandPool);
+    CHECK_VK_RESULT(result, "Failed to create Command Pool");
+
+    pool.usedPrimary = 0;
+    pool.usedSecondary = 0;
+}
+
+void CommandBufferAllocator::resetPool(Pool& pool)
+{
+    if (pool.usedPrimary == 0 && pool.usedSecondary == 0) return;
+
+    vkResetCommandPool(m_device, pool.commandPool, 0);
+    pool.usedPrimary = 0;
+    pool.usedSecondary = 0;
+}
+
+VkCommandBuffer CommandBufferAllocator::take(Pool& pool, VkCommandBufferLevel level)
+{
+    bool primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    std::vector<VkCommandBuffer>& buffers = primary ? pool.primary : pool.secondary;
+    uint32_t& used = primary ? pool.usedPrimary : pool.usedSecondary;
+
+    if (used == buffers.size())
+    {
+        VkCommandBufferAllocateInfo commandBufferAllocInfo = {};
+        commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocInfo.commandPool = pool.commandPool;
+        commandBufferAllocInfo.level = level;
+        commandBufferAllocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        VkResult result = vkAllocateCommandBuffers(m_device, &commandBufferAllocInfo, &commandBuffer);
+        CHECK_VK_RESULT(result, "Failed to allocate Command Buffer");
+
+        buffers.push_back(commandBuffer);
+        ++m_allocatedCount;
+    }
+
+    return buffers[used++];
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "Utilities.h"
+
+// -- COMMAND BUFFER ALLOCATOR --
+// Every frame in flight has one transient pool per recording thread. Pools are never reset per buffer: when a frame
+// retires ResetFrame resets all its pools in one call and the buffers allocated from them are handed out again.
+// One-shot upload buffers come from a separate pool and are recycled the same way once no upload is outstanding.
+class CommandBufferAllocator
+{
+public:
+    CommandBufferAllocator();
+
+    void Init(VkDevice device, uint32_t queueFamily, uint32_t frameCount, uint32_t threadCount);
+    void Destroy();
+
+    // -- FRAMES --
+    // The frame's fence must have signaled
+    void ResetFrame(uint32_t frame);
+    // Valid until the frame is reset. Each thread must only allocate from its own pools.
+    VkCommandBuffer Allocate(uint32_t frame, uint32_t thread = 0, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    // -- UPLOADS --
+    // Synchronous, SubmitOneShot waits until the queue is idle. Main thread only.
+    VkCommandBuffer BeginOneShot();
+    void SubmitOneShot(VkQueue queue, VkCommandBuffer commandBuffer);
+
+    uint32_t GetThreadCount();
+    // Command buffers allocated from the driver so far, stays flat once every pool has warmed up
+    uint32_t GetAllocatedCount();
+
+private:
+    struct Pool
+    {
+        VkCommandPool commandPool;
+        std::vector<VkCommandBuffer> primary;
+        std::vector<VkCommandBuffer> secondary;
+        uint32_t usedPrimary;
+        uint32_t usedSecondary;
+    };
+
+    VkDevice m_device;
+    uint32_t m_frameCount;
+    uint32_t m_threadCount;
+
+    std::vector<Pool> m_framePools;     // frame * m_threadCount + thread
+    Pool m_uploadPool;
+    uint32_t m_pendingOneShots = 0;
+    uint32_t m_allocatedCount = 0;
+
+    void createPool(Pool& pool, uint32_t queueFamily);
+    void resetPool(Pool& pool);
+    VkCommandBuffer take(Pool& pool, VkCommandBufferLevel level);
+
+};
@@ -0,0 +1,172 @@
+#include "CpuProfiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    const uint64_t EVENTS_PER_THREAD = 16384;
+
+    struct Event
+    {
+        uint64_t begin;
+        uint64_t end;
+        char name[CpuProfiler::MAX_NAME_LENGTH + 1];
+    };
+
+    // Only its own thread writes events. written counts every event ever recorded, the newest one is at
+    // (written - 1) % EVENTS_PER_THREAD.
+    struct ThreadBuffer
+    {
+        uint32_t id;
+        std::string name;
+        std::unique_ptr<Event[]> events;
+        std::atomic<uint64_t> written;
+        uint64_t captureStart;          // written when the capture began
+    };
+
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+
+    std::atomic<bool> capturing(false);
+    uint64_t captureBeginTime = 0;
+
+    ThreadBuffer& getThreadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (buffer) return *buffer;
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+
+        std::unique_ptr<ThreadBuffer> newBuffer(new ThreadBuffer());
+        newBuffer->id = static_cast<uint32_t>(threadBuffers.size()) + 1;
+        newBuffer->name = "Thread " + std::to_string(newBuffer->id);
+        newBuffer->events.reset(new Event[EVENTS_PER_THREAD]);
+        newBuffer->written.store(0, std::memory_order_relaxed);
+        newBuffer->captureStart = 0;
+
+        buffer = newBuffer.get();
+        threadBuffers.push_back(std::move(newBuffer));
+        return *buffer;
+    }
+
+    void writeEscaped(std::ofstream& file, const char* text)
+    {
+        for (const char* c = text; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\') file << '\\' << *c;
+            else if (static_cast<unsigned char>(*c) < 0x20) file << ' ';
+            else file << *c;
+        }
+    }
+}
+
+void CpuProfiler::BeginCapture()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    for (std::unique_ptr<ThreadBuffer>& buffer : threadBuffers)
+        buffer->captureStart = buffer->written.load(std::memory_order_acquire);
+
+    captureBeginTime = GetTime();
+    capturing.store(true, std::memory_order_release);
+}
+
+void CpuProfiler::EndCapture()
+{
+    capturing.store(false, std::memory_order_release);
+}
+
+bool CpuProfiler::IsCapturing()
+{
+    return capturing.load(std::memory_order_relaxed);
+}
+
+void CpuProfiler::SetThreadName(const char* name)
+{
+    ThreadBuffer& buffer = getThreadBuffer();
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer.name = name;
+}
+
+bool CpuProfiler::WriteTrace(const std::string& path)
+{
+    if (IsCapturing()) return false;
+
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool first = true;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : threadBuffers)
+    {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+            << ",\"args\":{\"name\":\"";
+        writeEscaped(file, buffer->name.c_str());
+        file << "\"}}";
+        first = false;
+
+        // The slot after the newest event may be written right now by a zone that ended late, leave it out
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t start = buffer->captureStart;
+        if (written - start > EVENTS_PER_THREAD - 1) start = written - (EVENTS_PER_THREAD - 1);
+
+        for (uint64_t i = start; i < written; ++i)
+        {
+            const Event& event = buffer->events[i % EVENTS_PER_THREAD];
+
+            // Timestamps are in microseconds from the start of the capture
+            double begin = static_cast<double>(static_cast<int64_t>(event.begin - captureBeginTime)) / 1000.0;
+            double duration = static_cast<double>(event.end - event.begin) / 1000.0;
+
+            file << ",\n{\"name\":\"";
+            writeEscaped(file, event.name);
+            file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << begin << ",\"dur\":" << duration << "}";
+        }
+    }
+
+    file << "\n]}\n";
+    return file.good();
+}
+
+uint64_t CpuProfiler::GetTime()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+CpuProfiler::ScopedZone::ScopedZone(const char* name)
+{
+    // Zones that begin outside of a capture are never recorded
+    m_name = capturing.load(std::memory_order_relaxed) ? name : nullptr;
+    m_begin = m_name ? GetTime() : 0;
+}
+
+CpuProfiler::ScopedZone::~ScopedZone()
+{
+    if (!m_name) return;
+
+    uint64_t end = GetTime();
+
+    ThreadBuffer& buffer = getThreadBuffer();
+    uint64_t written = buffer.written.load(std::memory_order_relaxed);
+
+    Event& event = buffer.events[written % EVENTS_PER_THREAD];
+    event.begin = m_begin;
+    event.end = end;
+    std::strncpy(event.name, m_name, MAX_NAME_LENGTH);
+    event.name[MAX_NAME_LENGTH] = '\0';
+
+    buffer.written.store(written + 1, std::memory_order_release);
+}
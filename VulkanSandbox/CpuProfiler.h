@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Set to 0 to compile every CPU_ZONE out
+#ifndef CPU_PROFILER_ENABLED
+#define CPU_PROFILER_ENABLED 1
+#endif
+
+// -- CPU PROFILER --
+// Scoped zones recorded while a capture runs. Every thread writes into its own ring buffer, so recording takes no
+// lock, and only the newest zones are kept once a buffer is full. Captures are written in the Chrome trace event
+// format, which chrome://tracing and Perfetto open.
+namespace CpuProfiler
+{
+	// Names longer than this are cut off in the trace
+	constexpr uint32_t MAX_NAME_LENGTH = 47;
+
+	void BeginCapture();
+	void EndCapture();
+	bool IsCapturing();
+
+	// Shown as the thread's name in the trace, call it from the thread itself
+	void SetThreadName(const char* name);
+
+	// Writes the zones of the last capture, capturing has to be stopped first
+	bool WriteTrace(const std::string& path);
+
+	// Monotonic time in nanoseconds
+	uint64_t GetTime();
+
+	class ScopedZone
+	{
+	public:
+		explicit ScopedZone(const char* name);
+		~ScopedZone();
+
+		ScopedZone(const ScopedZone&) = delete;
+		ScopedZone& operator=(const ScopedZone&) = delete;
+
+	private:
+		const char* m_name;
+		uint64_t m_begin;
+	};
+}
+
+#define CPU_ZONE_CONCAT_INNER(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_INNER(a, b)
+
+#if CPU_PROFILER_ENABLED
+// Measures the rest of the enclosing scope. The name is copied when the zone ends.
+#define CPU_ZONE(name) CpuProfiler::ScopedZone CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
+#else
+#define CPU_ZONE(name)
+#endif
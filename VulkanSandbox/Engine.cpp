@@ -1,22 +1,34 @@
 ﻿#include "Engine.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "BenchmarkReport.h"
+#include "CameraPath.h"
+#include "CpuProfiler.h"
 #include "Window.h"
 #include "VulkanRenderer.h"
 #include "imgui/imgui.h"
 
 Window window;
 VulkanRenderer renderer;
+bool headless = false;
 
 bool updateWindow();
 void update();
 
 void Engine::Init()
 {
+    CpuProfiler::SetThreadName("Main");
+
     window.Init("Vulkan Sandbox", 1280, 720);
     renderer.Init();
 
     while (updateWindow())
     {
+        CPU_ZONE("Frame");
         update();
         renderer.Draw();
     }
@@ -25,9 +37,105 @@ void Engine::Init()
     window.Destroy();
 }
 
+void Engine::InitHeadless(const HeadlessSettings& settings)
+{
+    headless = true;
+
+    CpuProfiler::SetThreadName("Main");
+    if (!settings.cpuTracePath.empty()) CpuProfiler::BeginCapture();
+
+    renderer.InitHeadless(settings.width, settings.height);
+
+    // Assets keep loading while the first frames render, measuring starts once the scene is complete
+    uint32_t loadingFrames = 0;
+    while (renderer.GetLoadedTime() < 0.f)
+    {
+        CPU_ZONE("Loading Frame");
+        ImGui::GetIO().DeltaTime = settings.timeStep;
+        renderer.Update(settings.timeStep);
+        renderer.Draw();
+        ++loadingFrames;
+    }
+    std::cout << loadingFrames << " frames while loading" << std::endl;
+
+    if (!settings.cameraPath.empty())
+    {
+        CameraPath path;
+        if (path.Load(settings.cameraPath)) renderer.PlayCameraPath(path, true);
+        else std::cout << "Failed to load camera path " << settings.cameraPath << std::endl;
+    }
+
+    BenchmarkReport report;
+    report.Reserve(settings.frameCount);
+    report.SetLoadTimes(renderer.GetFirstFrameTime(), renderer.GetLoadedTime());
+
+    uint32_t dumpInterval = std::max(settings.dumpInterval, 1u);
+
+    for (uint32_t frame = 0; frame < settings.frameCount; ++frame)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+
+        {
+            CPU_ZONE("Frame");
+            ImGui::GetIO().DeltaTime = settings.timeStep;
+            renderer.Update(settings.timeStep);
+            renderer.Draw();
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if (frame >= settings.warmupFrames)
+        {
+            VulkanRenderer::FrameStats stats = renderer.GetFrameStats();
+
+            BenchmarkReport::Frame reportFrame;
+            reportFrame.cpuTime = std::chrono::duration<float, std::milli>(end - begin).count();
+            reportFrame.gpuTime = stats.gpuTime;
+            reportFrame.drawCount = stats.drawCount;
+            reportFrame.allocations = stats.allocations;
+            reportFrame.drawCalls = stats.counters.drawCalls;
+            reportFrame.triangles = stats.counters.triangles;
+            reportFrame.pipelineBinds = stats.counters.pipelineBinds;
+            reportFrame.descriptorBinds = stats.counters.descriptorBinds;
+            reportFrame.pushConstants = stats.counters.pushConstants;
+            reportFrame.vertexInvocations = stats.pipelineStatistics.vertexInvocations;
+            reportFrame.clippingPrimitives = stats.pipelineStatistics.clippingPrimitives;
+            reportFrame.fragmentInvocations = stats.pipelineStatistics.fragmentInvocations;
+            report.AddFrame(reportFrame);
+        }
+
+        // Not part of the frame time
+        if (!settings.dumpDirectory.empty() && frame % dumpInterval == 0)
+        {
+            char fileName[32];
+            std::snprintf(fileName, sizeof(fileName), "/frame_%05u.png", frame);
+            renderer.SaveFrame(settings.dumpDirectory + fileName);
+        }
+    }
+
+    if (!settings.cpuTracePath.empty())
+    {
+        CpuProfiler::EndCapture();
+        if (!CpuProfiler::WriteTrace(settings.cpuTracePath))
+            std::cout << "Failed to write CPU trace " << settings.cpuTracePath << std::endl;
+    }
+
+    report.Finish();
+    report.Print();
+
+    if (!settings.reportPath.empty())
+    {
+        std::string name = settings.cameraPath.empty() ? "default camera" : settings.cameraPath;
+        if (!report.WriteJson(settings.reportPath + ".json", name) || !report.WriteCsv(settings.reportPath + ".csv"))
+            std::cout << "Failed to write report " << settings.reportPath << std::endl;
+    }
+
+    renderer.Destroy();
+}
+
 Window* Engine::GetWindow()
 {
-    return &window;
+    return headless ? nullptr : &window;
 }
 
 VulkanRenderer* Engine::GetRenderer()
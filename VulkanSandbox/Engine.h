@@ -1,11 +1,39 @@
 ﻿#pragma once
 
+#include <cstdint>
+#include <string>
+
 class Window;
 class VulkanRenderer;
 
 namespace Engine
 {
+	struct HeadlessSettings
+	{
+		uint32_t width = 1280;
+		uint32_t height = 720;
+		uint32_t frameCount = 1000;
+		// Every frame advances by this many seconds, no matter how long it took
+		float timeStep = 1.f / 60.f;
+		// Frames are written here as PNG if it is not empty
+		std::string dumpDirectory;
+		uint32_t dumpInterval = 1;
+
+		// Camera path played from the first frame after loading, looping if it is shorter than the run
+		std::string cameraPath;
+		// Frame times are written to <reportPath>.json and <reportPath>.csv if it is not empty
+		std::string reportPath;
+		// Left out of the report, the first frames include pipeline and cache warm up. Frames rendered while assets are
+		// still loading come before these and are never counted.
+		uint32_t warmupFrames = 10;
+		// The whole run including loading is captured by the CPU profiler and written here if it is not empty
+		std::string cpuTracePath;
+	};
+
 	void Init();
+	// Renders a fixed number of frames without a window and reports frame time percentiles. GetWindow returns
+	// nullptr while it runs.
+	void InitHeadless(const HeadlessSettings& settings);
 
 	Window* GetWindow();
 	VulkanRenderer* GetRenderer();
@@ -0,0 +1,118 @@
+#include "FrameContext.h"
+
+#include "CpuProfiler.h"
+
+FrameContext::FrameContext()
+{
+}
+
+void FrameContext::Init(VkDevice device, uint32_t index, size_t arenaCapacity)
+{
+    m_device = device;
+    m_index = index;
+
+    m_arena.Init(arenaCapacity);
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    VkResult result = vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_imageAvailable);
+    CHECK_VK_RESULT(result, "Failed to create Semaphore");
+
+    result = vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_renderFinished);
+    CHECK_VK_RESULT(result, "Failed to create Semaphore");
+
+    result = vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_fence);
+    CHECK_VK_RESULT(result, "Failed to create Fence");
+}
+
+void FrameContext::Destroy()
+{
+    vkDestroyFence(m_device, m_fence, nullptr);
+    vkDestroySemaphore(m_device, m_renderFinished, nullptr);
+    vkDestroySemaphore(m_device, m_imageAvailable, nullptr);
+    m_arena.Destroy();
+}
+
+void FrameContext::WaitUntilFinished()
+{
+    vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, UINT64_MAX);
+}
+
+bool FrameContext::PollFinished(float& latency)
+{
+    if (!m_pending || vkGetFenceStatus(m_device, m_fence) != VK_SUCCESS) return false;
+
+    m_pending = false;
+    latency = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - m_beginTime).count();
+    return true;
+}
+
+VkCommandBuffer FrameContext::Begin(CommandBufferAllocator& commandAllocator)
+{
+    // A submission nobody polled is simply not measured
+    m_pending = false;
+    m_beginTime = std::chrono::high_resolution_clock::now();
+
+    vkResetFences(m_device, 1, &m_fence);
+    commandAllocator.ResetFrame(m_index);
+    m_arena.Reset();
+    m_commandBuffer = commandAllocator.Allocate(m_index);
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkResult result = vkBeginCommandBuffer(m_commandBuffer, &commandBufferBeginInfo);
+    CHECK_VK_RESULT(result, "Failed to begin Command Buffer");
+
+    return m_commandBuffer;
+}
+
+void FrameContext::Submit(VkQueue queue, bool presenting)
+{
+    CPU_ZONE("Submit");
+
+    vkEndCommandBuffer(m_commandBuffer);
+
+    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = presenting ? 1 : 0;
+    submitInfo.pWaitSemaphores = &m_imageAvailable;
+    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_commandBuffer;
+    submitInfo.signalSemaphoreCount = presenting ? 1 : 0;
+    submitInfo.pSignalSemaphores = &m_renderFinished;
+
+    VkResult result = vkQueueSubmit(queue, 1, &submitInfo, m_fence);
+    CHECK_VK_RESULT(result, "Failed to submit Command Buffer to Queue");
+
+    m_pending = true;
+}
+
+uint32_t FrameContext::GetIndex()
+{
+    return m_index;
+}
+
+LinearAllocator& FrameContext::GetArena()
+{
+    return m_arena;
+}
+
+VkSemaphore FrameContext::GetImageAvailableSemaphore()
+{
+    return m_imageAvailable;
+}
+
+VkSemaphore FrameContext::GetRenderFinishedSemaphore()
+{
+    return m_renderFinished;
+}
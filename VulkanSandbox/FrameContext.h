@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+
+#include "CommandBufferAllocator.h"
+#include "LinearAllocator.h"
+#include "Utilities.h"
+
+// -- FRAME CONTEXT --
+// Everything one frame in flight records into or hands to the GPU. A context is only begun again after its
+// fence has signaled, so its command pools and every uniform buffer, storage buffer and descriptor set indexed
+// by GetIndex() are never written while the GPU still reads them. The arena holds CPU data built for the frame and
+// is reset when the context is begun.
+class FrameContext
+{
+public:
+    FrameContext();
+
+    void Init(VkDevice device, uint32_t index, size_t arenaCapacity);
+    void Destroy();
+
+    void WaitUntilFinished();
+    // True once per submission, the first time it is seen finished. latency is the time since Begin in ms.
+    bool PollFinished(float& latency);
+
+    // Resets the frame's command pools and starts recording, the fence must have signaled
+    VkCommandBuffer Begin(CommandBufferAllocator& commandAllocator);
+    // Waits for imageAvailable, signals renderFinished and the fence. Without presenting only the fence is signaled.
+    void Submit(VkQueue queue, bool presenting = true);
+
+    uint32_t GetIndex();
+    LinearAllocator& GetArena();
+    VkSemaphore GetImageAvailableSemaphore();
+    VkSemaphore GetRenderFinishedSemaphore();
+
+private:
+    VkDevice m_device;
+    uint32_t m_index;
+
+    VkCommandBuffer m_commandBuffer;
+    VkSemaphore m_imageAvailable;
+    VkSemaphore m_renderFinished;
+    VkFence m_fence;
+    LinearAllocator m_arena;
+
+    std::chrono::high_resolution_clock::time_point m_beginTime;
+    bool m_pending = false;
+
+};
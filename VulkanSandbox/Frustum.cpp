@@ -0,0 +1,136 @@
+#include "Frustum.h"
+
+#include <algorithm>
+#include <cmath>
+
+Ray::Ray(const glm::vec3& origin, const glm::vec3& direction)
+    : origin(origin), direction(direction), inverseDirection(1.f / direction)
+{
+}
+
+void BoundingBox::Expand(const glm::vec3& point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void BoundingBox::Expand(const BoundingBox& box)
+{
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+}
+
+BoundingBox BoundingBox::Transformed(const glm::mat4& transform) const
+{
+    // Same box as transforming all 8 corners: the center moves, the extent grows by the absolute rotation and scale
+    glm::vec3 center = (min + max) * 0.5f;
+    glm::vec3 extent = (max - min) * 0.5f;
+
+    glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.f));
+    glm::vec3 newExtent = glm::abs(glm::vec3(transform[0])) * extent.x + glm::abs(glm::vec3(transform[1])) * extent.y +
+        glm::abs(glm::vec3(transform[2])) * extent.z;
+
+    BoundingBox box;
+    box.min = newCenter - newExtent;
+    box.max = newCenter + newExtent;
+    return box;
+}
+
+bool BoundingBox::IntersectsSphere(const glm::vec3& center, float radius) const
+{
+    glm::vec3 closest = glm::clamp(center, min, max);
+    glm::vec3 offset = closest - center;
+    return glm::dot(offset, offset) <= radius * radius;
+}
+
+bool BoundingBox::Intersects(const BoundingBox& box) const
+{
+    return glm::all(glm::lessThanEqual(min, box.max)) && glm::all(glm::lessThanEqual(box.min, max));
+}
+
+bool BoundingBox::IntersectsRay(const Ray& ray, float maxDistance, float& distance) const
+{
+    // Zero direction components give infinities that drop out of the min and max
+    glm::vec3 t0 = (min - ray.origin) * ray.inverseDirection;
+    glm::vec3 t1 = (max - ray.origin) * ray.inverseDirection;
+    glm::vec3 entries = glm::min(t0, t1);
+    glm::vec3 exits = glm::max(t0, t1);
+
+    float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.f));
+    float exit = std::min(std::min(exits.x, exits.y), std::min(exits.z, maxDistance));
+    if (enter > exit) return false;
+
+    distance = enter;
+    return true;
+}
+
+Frustum::Frustum()
+{
+    m_planes.fill(glm::vec4(0.f));
+    m_planeMask = 0;
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+    // Rows of the matrix, glm is column major
+    glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+    m_planes[Left] = row3 + row0;
+    m_planes[Right] = row3 - row0;
+    m_planes[Bottom] = row3 + row1;
+    m_planes[Top] = row3 - row1;
+    m_planes[Near] = row2;          // Depth is 0 to 1
+    m_planes[Far] = row3 - row2;
+
+    for (glm::vec4& plane : m_planes)
+    {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.f) plane /= length;
+    }
+}
+
+void Frustum::IgnorePlane(Plane plane)
+{
+    m_planeMask &= ~(1u << plane);
+}
+
+bool Frustum::Intersects(const BoundingBox& box) const
+{
+    for (uint32_t i = 0; i < m_planes.size(); ++i)
+    {
+        if (!(m_planeMask & (1u << i)))
+            continue;
+
+        // Only the corner furthest along the plane normal has to be checked
+        const glm::vec4& plane = m_planes[i];
+        glm::vec3 corner(plane.x >= 0.f ? box.max.x : box.min.x,
+                         plane.y >= 0.f ? box.max.y : box.min.y,
+                         plane.z >= 0.f ? box.max.z : box.min.z);
+
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f)
+            return false;
+    }
+
+    return true;
+}
+
+bool Cone::Intersects(const BoundingBox& box) const
+{
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    float radius = glm::length(box.max - center);
+
+    glm::vec3 toCenter = center - position;
+    float alongAxis = glm::dot(toCenter, direction);
+
+    if (alongAxis > range + radius || alongAxis < -radius)
+        return false;
+
+    // Distance from the sphere center to the cone surface
+    float fromAxis = std::sqrt(std::max(glm::dot(toCenter, toCenter) - alongAxis * alongAxis, 0.f));
+    float distance = std::cos(angle) * fromAxis - std::sin(angle) * alongAxis;
+
+    return distance <= radius;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    // Precomputed for the slab tests against boxes
+    glm::vec3 inverseDirection;
+
+    Ray(const glm::vec3& origin, const glm::vec3& direction);
+};
+
+struct BoundingBox
+{
+    glm::vec3 min = glm::vec3(0.f);
+    glm::vec3 max = glm::vec3(0.f);
+
+    void Expand(const glm::vec3& point);
+    void Expand(const BoundingBox& box);
+
+    // Box around all eight transformed corners
+    BoundingBox Transformed(const glm::mat4& transform) const;
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const;
+    bool Intersects(const BoundingBox& box) const;
+    // Distance along the ray in units of its direction, 0 if the origin is inside
+    bool IntersectsRay(const Ray& ray, float maxDistance, float& distance) const;
+};
+
+class Frustum
+{
+public:
+    enum Plane
+    {
+        Left = 0,
+        Right,
+        Bottom,
+        Top,
+        Near,
+        Far,
+    };
+
+    Frustum();
+    explicit Frustum(const glm::mat4& viewProjection);
+
+    // Ignored planes are never tested, the volume is open on that side
+    void IgnorePlane(Plane plane);
+
+    bool Intersects(const BoundingBox& box) const;
+
+private:
+    std::array<glm::vec4, 6> m_planes;
+    uint32_t m_planeMask = 0x3F;
+
+};
+
+struct Cone
+{
+    glm::vec3 position = glm::vec3(0.f);
+    glm::vec3 direction = glm::vec3(0.f, 0.f, -1.f);
+    float angle = 0.f;      // Half angle in radians
+    float range = 0.f;
+
+    // Tests the bounding sphere of the box, can let a few boxes near the edge through
+    bool Intersects(const BoundingBox& box) const;
+};
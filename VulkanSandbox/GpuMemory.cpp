@@ -0,0 +1,294 @@
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    struct Allocation
+    {
+        VkDeviceSize size;
+        uint32_t heapIndex;
+        GpuMemory::Category category;
+    };
+
+    struct Heap
+    {
+        GpuMemory::HeapUsage usage;
+        VkDeviceSize allocatedAtUpdate;     // Our part of usage when the budget was last queried
+    };
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    bool budgetExtension = false;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+
+    // Guards everything below, never held while calling back
+    std::mutex registryMutex;
+    std::unordered_map<VkDeviceMemory, Allocation> allocations;
+    Heap heaps[VK_MAX_MEMORY_HEAPS] = {};
+    GpuMemory::CategoryUsage categories[static_cast<size_t>(GpuMemory::Category::Count)] = {};
+
+    // Recursive, so a callback can remove itself
+    std::recursive_mutex callbackMutex;
+    std::vector<std::pair<uint32_t, GpuMemory::BudgetCallback>> callbacks;
+    uint32_t nextCallbackId = 1;
+
+    // Allocations made since the last query aren't in the reported usage yet
+    VkDeviceSize currentUsage(const Heap& heap)
+    {
+        if (!budgetExtension) return heap.usage.allocated;
+        return heap.usage.usage + heap.usage.allocated - std::min(heap.usage.allocated, heap.allocatedAtUpdate);
+    }
+
+    void callBudgetCallbacks(uint32_t heapIndex, VkDeviceSize requested)
+    {
+        std::lock_guard<std::recursive_mutex> lock(callbackMutex);
+        for (size_t i = 0; i < callbacks.size(); ++i)
+        {
+            callbacks[i].second(heapIndex, requested);
+        }
+    }
+}
+
+bool GpuMemory::IsBudgetSupported(VkPhysicalDevice physicalDevice)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+    for (const VkExtensionProperties& extension : extensions)
+    {
+        if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+void GpuMemory::Init(VkPhysicalDevice device, bool useBudgetExtension)
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+
+        physicalDevice = device;
+        budgetExtension = useBudgetExtension;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+        {
+            HeapUsage& usage = heaps[i].usage;
+            usage.size = memoryProperties.memoryHeaps[i].size;
+            usage.budget = usage.size;
+            usage.deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        }
+    }
+
+    UpdateBudget();
+}
+
+VkResult GpuMemory::Allocate(VkDevice device, const VkMemoryAllocateInfo& allocateInfo, Category category,
+    VkDeviceMemory* memory)
+{
+    uint32_t heapIndex = memoryProperties.memoryTypes[allocateInfo.memoryTypeIndex].heapIndex;
+
+    bool overBudget;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        const Heap& heap = heaps[heapIndex];
+        overBudget = currentUsage(heap) + allocateInfo.allocationSize > heap.usage.budget;
+    }
+
+    if (overBudget)
+        callBudgetCallbacks(heapIndex, allocateInfo.allocationSize);
+
+    VkResult result = vkAllocateMemory(device, &allocateInfo, nullptr, memory);
+
+    // The budget is only an estimate, the callbacks get one more chance when the driver actually runs out
+    if ((result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) && !overBudget)
+    {
+        callBudgetCallbacks(heapIndex, allocateInfo.allocationSize);
+        result = vkAllocateMemory(device, &allocateInfo, nullptr, memory);
+    }
+
+    if (result != VK_SUCCESS) return result;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    Allocation allocation;
+    allocation.size = allocateInfo.allocationSize;
+    allocation.heapIndex = heapIndex;
+    allocation.category = category;
+    allocations.emplace(*memory, allocation);
+
+    heaps[heapIndex].usage.allocated += allocation.size;
+    CategoryUsage& categoryUsage = categories[static_cast<size_t>(category)];
+    categoryUsage.bytes += allocation.size;
+    categoryUsage.allocations++;
+
+    return result;
+}
+
+void GpuMemory::Free(VkDevice device, VkDeviceMemory memory)
+{
+    if (memory == VK_NULL_HANDLE) return;
+
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+
+        auto it = allocations.find(memory);
+        if (it != allocations.end())
+        {
+            const Allocation& allocation = it->second;
+            heaps[allocation.heapIndex].usage.allocated -= allocation.size;
+            CategoryUsage& categoryUsage = categories[static_cast<size_t>(allocation.category)];
+            categoryUsage.bytes -= allocation.size;
+            categoryUsage.allocations--;
+            allocations.erase(it);
+        }
+    }
+
+    vkFreeMemory(device, memory, nullptr);
+}
+
+void GpuMemory::UpdateBudget()
+{
+    bool nearBudget[VK_MAX_MEMORY_HEAPS] = {};
+
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        if (physicalDevice == VK_NULL_HANDLE) return;
+
+        if (budgetExtension)
+        {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+            budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+            VkPhysicalDeviceMemoryProperties2 properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            properties.pNext = &budgetProperties;
+            vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+            {
+                heaps[i].usage.usage = budgetProperties.heapUsage[i];
+                heaps[i].usage.budget = budgetProperties.heapBudget[i];
+                heaps[i].allocatedAtUpdate = heaps[i].usage.allocated;
+            }
+        }
+
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+        {
+            const Heap& heap = heaps[i];
+            nearBudget[i] = static_cast<double>(currentUsage(heap)) >
+                static_cast<double>(heap.usage.budget) * BUDGET_WARNING_THRESHOLD;
+        }
+    }
+
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; ++i)
+    {
+        if (nearBudget[i]) callBudgetCallbacks(i, 0);
+    }
+}
+
+uint32_t GpuMemory::AddBudgetCallback(const BudgetCallback& callback)
+{
+    std::lock_guard<std::recursive_mutex> lock(callbackMutex);
+    callbacks.emplace_back(nextCallbackId, callback);
+    return nextCallbackId++;
+}
+
+void GpuMemory::RemoveBudgetCallback(uint32_t id)
+{
+    std::lock_guard<std::recursive_mutex> lock(callbackMutex);
+    for (size_t i = 0; i < callbacks.size(); ++i)
+    {
+        if (callbacks[i].first == id)
+        {
+            callbacks.erase(callbacks.begin() + i);
+            return;
+        }
+    }
+}
+
+GpuMemory::Category GpuMemory::GetBufferCategory(VkBufferUsageFlags usage)
+{
+    if (usage & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT))
+        return Category::Mesh;
+    if (usage & (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+        return Category::Uniform;
+    if (usage & (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT))
+        return Category::Staging;
+    return Category::Other;
+}
+
+GpuMemory::Category GpuMemory::GetImageCategory(VkImageUsageFlags usage)
+{
+    // Shadow maps are sampled too, but what they hold is rendered
+    if (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT))
+        return Category::RenderTarget;
+    if (usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+        return Category::Texture;
+    return Category::Other;
+}
+
+const char* GpuMemory::GetCategoryName(Category category)
+{
+    switch (category)
+    {
+    case Category::Mesh: return "Mesh";
+    case Category::Texture: return "Texture";
+    case Category::RenderTarget: return "Render Target";
+    case Category::Staging: return "Staging";
+    case Category::Uniform: return "Uniform";
+    default: return "Other";
+    }
+}
+
+GpuMemory::CategoryUsage GpuMemory::GetCategoryUsage(Category category)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return categories[static_cast<size_t>(category)];
+}
+
+uint32_t GpuMemory::GetHeapCount()
+{
+    return memoryProperties.memoryHeapCount;
+}
+
+GpuMemory::HeapUsage GpuMemory::GetHeapUsage(uint32_t heapIndex)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    HeapUsage usage = heaps[heapIndex].usage;
+    usage.usage = currentUsage(heaps[heapIndex]);
+    return usage;
+}
+
+bool GpuMemory::HasBudgetExtension()
+{
+    return budgetExtension;
+}
+
+uint32_t GpuMemory::ReportLeaks()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    if (allocations.empty()) return 0;
+
+    VkDeviceSize total = 0;
+    for (const auto& entry : allocations)
+    {
+        const Allocation& allocation = entry.second;
+        std::cout << "Leaked GPU memory: " << allocation.size << " bytes, " << GetCategoryName(allocation.category)
+            << ", heap " << allocation.heapIndex << std::endl;
+        total += allocation.size;
+    }
+
+    std::cout << allocations.size() << " GPU memory allocations leaked, " << total << " bytes" << std::endl;
+    return static_cast<uint32_t>(allocations.size());
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+
+#include <vulkan/vulkan.h>
+
+// -- GPU MEMORY --
+// Every device memory allocation goes through here, tagged with what it holds. Usage is tracked per category and per
+// heap, against the budget VK_EXT_memory_budget reports or the heap sizes without it. Allocations that would go over
+// a heap's budget first give the budget callbacks a chance to free something.
+namespace GpuMemory
+{
+	enum class Category
+	{
+		Mesh,
+		Texture,
+		RenderTarget,
+		Staging,
+		Uniform,
+		Other,
+		Count
+	};
+
+	struct CategoryUsage
+	{
+		VkDeviceSize bytes;
+		uint32_t allocations;
+	};
+
+	struct HeapUsage
+	{
+		VkDeviceSize size;
+		VkDeviceSize allocated;		// By us
+		VkDeviceSize usage;			// By the whole process with the budget extension, otherwise what we allocated
+		VkDeviceSize budget;
+		bool deviceLocal;
+	};
+
+	// Called with the heap that is running out and the bytes that are about to be allocated from it
+	using BudgetCallback = std::function<void(uint32_t heapIndex, VkDeviceSize requested)>;
+
+	// Share of a heap's budget above which the callbacks are called every update
+	constexpr float BUDGET_WARNING_THRESHOLD = 0.9f;
+
+	bool IsBudgetSupported(VkPhysicalDevice physicalDevice);
+
+	// The budget extension has to be enabled on the device if it is used
+	void Init(VkPhysicalDevice physicalDevice, bool useBudgetExtension);
+
+	VkResult Allocate(VkDevice device, const VkMemoryAllocateInfo& allocateInfo, Category category, VkDeviceMemory* memory);
+	void Free(VkDevice device, VkDeviceMemory memory);
+
+	// Queries the budget again, call once per frame
+	void UpdateBudget();
+
+	uint32_t AddBudgetCallback(const BudgetCallback& callback);
+	void RemoveBudgetCallback(uint32_t id);
+
+	Category GetBufferCategory(VkBufferUsageFlags usage);
+	Category GetImageCategory(VkImageUsageFlags usage);
+	const char* GetCategoryName(Category category);
+
+	CategoryUsage GetCategoryUsage(Category category);
+	uint32_t GetHeapCount();
+	HeapUsage GetHeapUsage(uint32_t heapIndex);
+	bool HasBudgetExtension();
+
+	// Prints every allocation that is still alive, returns how many there are
+	uint32_t ReportLeaks();
+}
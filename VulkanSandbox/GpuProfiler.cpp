@@ -0,0 +1,232 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#include "LinearAllocator.h"
+
+GpuProfiler::GpuProfiler()
+{
+    m_frame = {};
+    m_frame.name = "Frame";
+}
+
+void GpuProfiler::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t frameCount)
+{
+    m_device = device;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_timestampPeriod = properties.limits.timestampPeriod;
+
+    // Timestamps only count up in the valid bits and wrap around after that
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    uint32_t validBits = queueFamily < queueFamilyCount ? queueFamilies[queueFamily].timestampValidBits : 0;
+    m_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    m_supported = validBits > 0;
+
+    m_queryPools.resize(frameCount);
+    m_zones.resize(frameCount);
+    m_zoneCounts.resize(frameCount, 0);
+
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+        queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolCreateInfo.queryCount = MAX_ZONES * 2;
+
+        VkResult result = vkCreateQueryPool(m_device, &queryPoolCreateInfo, nullptr, &m_queryPools[i]);
+        CHECK_VK_RESULT(result, "Failed to create Query Pool");
+    }
+}
+
+void GpuProfiler::Destroy()
+{
+    for (size_t i = 0; i < m_queryPools.size(); ++i)
+    {
+        vkDestroyQueryPool(m_device, m_queryPools[i], nullptr);
+    }
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    if (!m_supported) return;
+
+    collect(frameIndex);
+
+    m_currentFrame = frameIndex;
+    m_queryCount = 0;
+    m_zoneCounts[frameIndex] = 0;
+    m_openZones.clear();
+
+    vkCmdResetQueryPool(commandBuffer, m_queryPools[frameIndex], 0, MAX_ZONES * 2);
+}
+
+void GpuProfiler::BeginZone(VkCommandBuffer commandBuffer, const std::string& name)
+{
+    if (!m_supported) return;
+
+    if (m_queryCount + 2 > MAX_ZONES * 2)
+    {
+        m_openZones.push_back(DROPPED_ZONE);
+        return;
+    }
+
+    std::vector<Zone>& zones = m_zones[m_currentFrame];
+    uint32_t& zoneCount = m_zoneCounts[m_currentFrame];
+    if (zoneCount == zones.size())
+        zones.emplace_back();
+
+    Zone& zone = zones[zoneCount];
+    zone.name = name;
+    zone.beginQuery = m_queryCount++;
+    zone.endQuery = m_queryCount++;
+    zone.depth = static_cast<uint32_t>(m_openZones.size());
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPools[m_currentFrame], zone.beginQuery);
+
+    m_openZones.push_back(zoneCount++);
+}
+
+void GpuProfiler::EndZone(VkCommandBuffer commandBuffer)
+{
+    if (!m_supported || m_openZones.empty()) return;
+
+    uint32_t zoneIndex = m_openZones.back();
+    m_openZones.pop_back();
+    if (zoneIndex == DROPPED_ZONE) return;
+
+    const Zone& zone = m_zones[m_currentFrame][zoneIndex];
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPools[m_currentFrame], zone.endQuery);
+}
+
+float GpuProfiler::GetZoneTime(const std::string& name)
+{
+    auto it = m_statIndices.find(name);
+    return it != m_statIndices.end() ? m_stats[it->second].time : 0.f;
+}
+
+float GpuProfiler::GetFrameTime()
+{
+    return m_frame.time;
+}
+
+uint32_t GpuProfiler::GetZoneCount()
+{
+    return static_cast<uint32_t>(m_collectedZones.size());
+}
+
+const GpuProfiler::ZoneStats& GpuProfiler::GetZone(uint32_t index)
+{
+    return m_stats[m_collectedZones[index]];
+}
+
+const GpuProfiler::ZoneStats& GpuProfiler::GetFrame()
+{
+    return m_frame;
+}
+
+bool GpuProfiler::ExportJson(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+
+    // History from oldest to newest, samples that were never written are 0
+    auto writeZone = [&file](const ZoneStats& zone, bool last)
+    {
+        file << "        { \"name\": \"" << zone.name << "\", \"depth\": " << zone.depth << ", \"time\": " << zone.time
+            << ", \"average\": " << zone.average << ", \"max\": " << zone.max << ", \"history\": [";
+        for (uint32_t i = 0; i < HISTORY_SIZE; ++i)
+            file << (i > 0 ? ", " : "") << zone.history[(zone.historyOffset + i) % HISTORY_SIZE];
+        file << "] }" << (last ? "\n" : ",\n");
+    };
+
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    file << "    \"unit\": \"ms\",\n";
+    file << "    \"zones\": [\n";
+    writeZone(m_frame, m_collectedZones.empty());
+    for (size_t i = 0; i < m_collectedZones.size(); ++i)
+        writeZone(m_stats[m_collectedZones[i]], i + 1 == m_collectedZones.size());
+    file << "    ]\n";
+    file << "}\n";
+
+    return file.good();
+}
+
+void GpuProfiler::collect(uint32_t frameIndex)
+{
+    std::vector<Zone>& zones = m_zones[frameIndex];
+    uint32_t zoneCount = m_zoneCounts[frameIndex];
+    if (zoneCount == 0) return;
+
+    uint32_t queryCount = zoneCount * 2;
+    ScratchScope scratch;
+    ArenaVector<uint64_t> timestamps(queryCount, scratch.GetAllocator<uint64_t>());
+
+    // Don't wait, a frame that isn't finished yet is simply skipped
+    VkResult result = vkGetQueryPoolResults(m_device, m_queryPools[frameIndex], 0, queryCount,
+        timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) return;
+
+    m_collectedZones.clear();
+
+    uint64_t frameBegin = timestamps[zones[0].beginQuery];
+    uint64_t frameEnd = timestamps[zones[0].endQuery];
+    for (uint32_t i = 0; i < zoneCount; ++i)
+    {
+        const Zone& zone = zones[i];
+
+        auto it = m_statIndices.find(zone.name);
+        if (it == m_statIndices.end())
+        {
+            ZoneStats stats = {};
+            stats.name = zone.name;
+            it = m_statIndices.emplace(zone.name, static_cast<uint32_t>(m_stats.size())).first;
+            m_stats.push_back(stats);
+        }
+
+        ZoneStats& stats = m_stats[it->second];
+        stats.depth = zone.depth;
+        addSample(stats, toMilliseconds(timestamps[zone.beginQuery], timestamps[zone.endQuery]));
+        m_collectedZones.push_back(it->second);
+
+        // Zones all come from one command buffer, so the first begin and the last end span the frame
+        if (zone.depth == 0)
+        {
+            frameBegin = std::min(frameBegin, timestamps[zone.beginQuery]);
+            frameEnd = std::max(frameEnd, timestamps[zone.endQuery]);
+        }
+    }
+
+    addSample(m_frame, toMilliseconds(frameBegin, frameEnd));
+}
+
+float GpuProfiler::toMilliseconds(uint64_t begin, uint64_t end)
+{
+    uint64_t ticks = (end - begin) & m_timestampMask;
+    return static_cast<float>(static_cast<double>(ticks) * m_timestampPeriod / 1000000.0);
+}
+
+void GpuProfiler::addSample(ZoneStats& stats, float time)
+{
+    stats.time = time;
+    stats.history[stats.historyOffset] = time;
+    stats.historyOffset = (stats.historyOffset + 1) % HISTORY_SIZE;
+    stats.sampleCount = std::min(stats.sampleCount + 1, HISTORY_SIZE);
+
+    float sum = 0.f;
+    stats.max = 0.f;
+    for (float sample : stats.history)
+    {
+        sum += sample;
+        stats.max = std::max(stats.max, sample);
+    }
+    stats.average = sum / stats.sampleCount;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Utilities.h"
+
+// -- GPU PROFILER --
+// Timestamp queries around named zones, which can be nested. Each frame in flight has its own query pool, the
+// results are read back the next time that frame is recorded, so times lag a few frames behind but reading them
+// never waits on the GPU.
+class GpuProfiler
+{
+public:
+    static constexpr uint32_t HISTORY_SIZE = 240;
+
+    struct ZoneStats
+    {
+        std::string name;
+        uint32_t depth;             // Number of zones it was nested in
+        float time;                 // ms in the last collected frame
+        float average;              // ms over the history
+        float max;
+        std::array<float, HISTORY_SIZE> history;
+        uint32_t historyOffset;     // Oldest entry of the history, the next one to be overwritten
+        uint32_t sampleCount;       // Below HISTORY_SIZE until the history has filled up
+    };
+
+    GpuProfiler();
+
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t frameCount);
+    void Destroy();
+
+    // Must be recorded before any zone of the frame
+    void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    void BeginZone(VkCommandBuffer commandBuffer, const std::string& name);
+    void EndZone(VkCommandBuffer commandBuffer);
+
+    // Milliseconds of the last collected frame, 0 for unknown zones
+    float GetZoneTime(const std::string& name);
+    // Milliseconds from the first zone's begin to the last zone's end in the last collected frame
+    float GetFrameTime();
+
+    // Zones of the last collected frame in the order they began, a parent comes before its children
+    uint32_t GetZoneCount();
+    const ZoneStats& GetZone(uint32_t index);
+    const ZoneStats& GetFrame();
+
+    bool ExportJson(const std::string& path);
+
+private:
+    const uint32_t MAX_ZONES = 64;
+    // Marks a zone that didn't fit into the query pool, so its EndZone is skipped too
+    const uint32_t DROPPED_ZONE = ~0u;
+
+    struct Zone
+    {
+        std::string name;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+        uint32_t depth;
+    };
+
+    VkDevice m_device;
+    float m_timestampPeriod;
+    uint64_t m_timestampMask;
+    bool m_supported;
+
+    std::vector<VkQueryPool> m_queryPools;
+    std::vector<std::vector<Zone>> m_zones;     // Zones recorded into each frame, reused so names keep their storage
+    std::vector<uint32_t> m_zoneCounts;
+    std::vector<uint32_t> m_openZones;          // Indices into the current frame's zones
+    uint32_t m_currentFrame = 0;
+    uint32_t m_queryCount = 0;
+
+    // Collected results, every zone name seen so far keeps its history
+    std::vector<ZoneStats> m_stats;
+    std::map<std::string, uint32_t> m_statIndices;
+    std::vector<uint32_t> m_collectedZones;     // Indices into m_stats of the last collected frame
+    ZoneStats m_frame;
+
+    void collect(uint32_t frameIndex);
+    float toMilliseconds(uint64_t begin, uint64_t end);
+    static void addSample(ZoneStats& stats, float time);
+
+};
@@ -3,7 +3,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#include "MaterialManager.h"
+#include "CpuProfiler.h"
 
 HeightMapObject::HeightMapObject(const std::string& name)
     : Object(name)
@@ -14,27 +14,29 @@ HeightMapObject::~HeightMapObject()
 {
 }
 
-void HeightMapObject::Init(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue,
-    VkCommandPool transferCommandPool, const std::string& modelFile)
-{
-    m_device = device;
-    m_physicalDevice = physicalDevice;
-
-    loadHeightMap(transferQueue, transferCommandPool, modelFile);
-}
-
 void HeightMapObject::Destroy()
 {
     Object::Destroy();
 }
 
-void HeightMapObject::loadHeightMap(VkQueue transferQueue, VkCommandPool transferCommandPool,
-    const std::string& heightMapFile)
+void HeightMapObject::importModel(const std::string& heightMapFile, ModelData& model) const
 {
+    CPU_ZONE("Load Terrain");
+
     int width, height, channels;
     unsigned char* data = stbi_load(heightMapFile.c_str(), &width, &height, &channels, 0);
+    if (!data) throw std::runtime_error("Failed to load Height Map: " + heightMapFile);
 
-    std::vector<Vertex> vertices;
+    // No node tree, the mesh hangs off a single node without a transform
+    model.nodes.push_back({ glm::vec3(0.f), glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(1.f), UINT32_MAX });
+    model.materials.push_back({ "heightmap-1.png", "", "" });
+    model.meshes.emplace_back();
+
+    ModelData::MeshData& mesh = model.meshes.back();
+    mesh.materialIndex = 0;
+    mesh.node = 0;
+
+    std::vector<Vertex>& vertices = mesh.vertices;
     float yScale = 64.f*100.f / 256.f;
     float yShift = 16.f;
     
@@ -64,7 +66,7 @@ void HeightMapObject::loadHeightMap(VkQueue transferQueue, VkCommandPool transfe
     
     stbi_image_free(data);
 
-    std::vector<uint32_t> indices;
+    std::vector<uint32_t>& indices = mesh.indices;
 
     for (int i = 0; i < height-1; ++i)
     {
@@ -76,11 +78,4 @@ void HeightMapObject::loadHeightMap(VkQueue transferQueue, VkCommandPool transfe
             }
         }
     }
-
-    m_numStrips = height-1;
-    m_numVertsPerStrip = width*2;
-
-    m_meshes.emplace_back(m_device, m_physicalDevice, transferQueue, transferCommandPool, vertices, indices, glm::mat4(1.f), 0);
-    
-    m_materialIndices.push_back(MaterialManager::CreateMaterial("heightmap-1.png", "", "", transferQueue, transferCommandPool));
 }
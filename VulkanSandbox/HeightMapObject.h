@@ -8,14 +8,10 @@ public:
     HeightMapObject(const std::string& name);
     ~HeightMapObject() override;
 
-    void Init(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool, const std::string& modelFile) override;
     void Destroy() override;
 
-private:
-    uint32_t m_numStrips;
-    uint32_t m_numVertsPerStrip;
-    
-    void loadHeightMap(VkQueue transferQueue, VkCommandPool transferCommandPool, const std::string& heightMapFile);
-    
+protected:
+    // One triangle strip mesh with the height map's texture, the model file is the height map
+    void importModel(const std::string& heightMapFile, ModelData& model) const override;
     
 };
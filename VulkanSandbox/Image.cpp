@@ -1,5 +1,7 @@
 ﻿#include "Image.h"
 
+#include "CommandBufferAllocator.h"
+#include "GpuMemory.h"
 #include "Utilities.h"
 
 Image::Image()
@@ -13,25 +15,34 @@ Image::~Image()
 void Image::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format,
                  VkSampleCountFlagBits samples,
                  VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags memoryFlags,
-                 VkImageAspectFlags aspectFlags)
+                 VkImageAspectFlags aspectFlags, uint32_t arrayLayers)
 {
+    m_arrayLayers = arrayLayers;
     m_image = CreateImage(device, physicalDevice, width, height, format, samples, tiling, useFlags, memoryFlags,
-                          &m_memory);
-    m_imageView = CreateImageView(device, m_image, format, aspectFlags);
+                          &m_memory, arrayLayers);
+
+    // Layered images get an array view over all of their layers
+    VkImageViewType viewType = arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+    m_imageView = CreateImageView(device, m_image, format, aspectFlags, viewType, 0, arrayLayers);
 }
 
 void Image::Destroy(VkDevice device)
 {
     vkDestroyImageView(device, m_imageView, nullptr);
-    vkFreeMemory(device, m_memory, nullptr);
+    GpuMemory::Free(device, m_memory);
     vkDestroyImage(device, m_image, nullptr);
 }
 
-void Image::TransitionLayout(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkImageLayout oldLayout,
+void Image::TransitionLayout(VkQueue queue, CommandBufferAllocator& commandAllocator, VkImageLayout oldLayout,
                              VkImageLayout newLayout)
 {
-    VkCommandBuffer commandBuffer = beginCommandBuffer(device, commandPool);
+    VkCommandBuffer commandBuffer = commandAllocator.BeginOneShot();
+    RecordTransitionLayout(commandBuffer, oldLayout, newLayout);
+    commandAllocator.SubmitOneShot(queue, commandBuffer);
+}
 
+void Image::RecordTransitionLayout(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
     VkImageMemoryBarrier imageMemoryBarrier = {};
     imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     imageMemoryBarrier.oldLayout = oldLayout;
@@ -43,7 +54,7 @@ void Image::TransitionLayout(VkDevice device, VkQueue queue, VkCommandPool comma
     imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
     imageMemoryBarrier.subresourceRange.levelCount = 1;
     imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
-    imageMemoryBarrier.subresourceRange.layerCount = 1;
+    imageMemoryBarrier.subresourceRange.layerCount = m_arrayLayers;
 
     VkPipelineStageFlags srcStage = 0;
     VkPipelineStageFlags dstStage = 0;
@@ -67,15 +78,13 @@ void Image::TransitionLayout(VkDevice device, VkQueue queue, VkCommandPool comma
     }
 
     vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-    endCommandBufferAndSubmit(device, commandPool, queue, commandBuffer);
 }
 
 VkImage Image::CreateImage(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height,
                            VkFormat format,
                            VkSampleCountFlagBits samples, VkImageTiling tiling, VkImageUsageFlags useFlags,
                            VkMemoryPropertyFlags memoryFlags,
-                           VkDeviceMemory* imageMemory)
+                           VkDeviceMemory* imageMemory, uint32_t arrayLayers)
 {
     VkImageCreateInfo imageCreateInfo = {};
     imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -84,7 +93,7 @@ VkImage Image::CreateImage(VkDevice device, VkPhysicalDevice physicalDevice, uin
     imageCreateInfo.extent.height = height;
     imageCreateInfo.extent.depth = 1;
     imageCreateInfo.mipLevels = 1;
-    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.arrayLayers = arrayLayers;
     imageCreateInfo.format = format;
     imageCreateInfo.tiling = tiling;
     imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -105,7 +114,7 @@ VkImage Image::CreateImage(VkDevice device, VkPhysicalDevice physicalDevice, uin
     memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(physicalDevice, memoryRequirements.memoryTypeBits,
                                                           memoryFlags);
 
-    result = vkAllocateMemory(device, &memoryAllocInfo, nullptr, imageMemory);
+    result = GpuMemory::Allocate(device, memoryAllocInfo, GpuMemory::GetImageCategory(useFlags), imageMemory);
     CHECK_VK_RESULT(result, "Failed to allocate memory for Image");
 
     result = vkBindImageMemory(device, image, *imageMemory, 0);
@@ -114,12 +123,13 @@ VkImage Image::CreateImage(VkDevice device, VkPhysicalDevice physicalDevice, uin
     return image;
 }
 
-VkImageView Image::CreateImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView Image::CreateImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
+                                   VkImageViewType viewType, uint32_t baseArrayLayer, uint32_t layerCount)
 {
     VkImageViewCreateInfo imageViewCreateInfo = {};
     imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     imageViewCreateInfo.image = image;
-    imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewCreateInfo.viewType = viewType;
     imageViewCreateInfo.format = format;
 
     imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -130,8 +140,8 @@ VkImageView Image::CreateImageView(VkDevice device, VkImage image, VkFormat form
     imageViewCreateInfo.subresourceRange.aspectMask = aspectFlags;
     imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
     imageViewCreateInfo.subresourceRange.levelCount = 1;
-    imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
-    imageViewCreateInfo.subresourceRange.layerCount = 1;
+    imageViewCreateInfo.subresourceRange.baseArrayLayer = baseArrayLayer;
+    imageViewCreateInfo.subresourceRange.layerCount = layerCount;
 
     VkImageView imageView;
     VkResult result = vkCreateImageView(device, &imageViewCreateInfo, nullptr, &imageView);
@@ -153,3 +163,8 @@ VkImageView Image::GetImageView()
 {
     return m_imageView;
 }
+
+uint32_t Image::GetArrayLayers()
+{
+    return m_arrayLayers;
+}
@@ -2,6 +2,8 @@
 
 #include <vulkan/vulkan.h>
 
+class CommandBufferAllocator;
+
 class Image
 {
 public:
@@ -10,24 +12,30 @@ public:
 
     void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format,
               VkSampleCountFlagBits samples, VkImageTiling tiling,
-              VkImageUsageFlags useFlags, VkMemoryPropertyFlags memoryFlags, VkImageAspectFlags aspectFlags);
+              VkImageUsageFlags useFlags, VkMemoryPropertyFlags memoryFlags, VkImageAspectFlags aspectFlags,
+              uint32_t arrayLayers = 1);
     void Destroy(VkDevice device);
 
-    void TransitionLayout(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkImageLayout oldLayout,
+    void TransitionLayout(VkQueue queue, CommandBufferAllocator& commandAllocator, VkImageLayout oldLayout,
                           VkImageLayout newLayout);
+    void RecordTransitionLayout(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout);
 
     static VkImage CreateImage(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height,
                                VkFormat format, VkSampleCountFlagBits samples, VkImageTiling tiling,
                                VkImageUsageFlags useFlags, VkMemoryPropertyFlags memoryFlags,
-                               VkDeviceMemory* imageMemory);
-    static VkImageView CreateImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+                               VkDeviceMemory* imageMemory, uint32_t arrayLayers = 1);
+    static VkImageView CreateImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
+                                       VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t baseArrayLayer = 0,
+                                       uint32_t layerCount = 1);
 
     VkImage GetImage();
     VkDeviceMemory GetMemory();
     VkImageView GetImageView();
+    uint32_t GetArrayLayers();
 
 private:
     VkImage m_image;
     VkDeviceMemory m_memory;
     VkImageView m_imageView;
+    uint32_t m_arrayLayers = 1;
 };
@@ -0,0 +1,296 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+LightClusters::LightClusters()
+{
+}
+
+void LightClusters::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount)
+{
+    m_device = device;
+    m_physicalDevice = physicalDevice;
+    m_frameCount = frameCount;
+
+    m_grid = {};
+    m_clusterLights.resize(CLUSTER_COUNT);
+    m_lightIndices.reserve(MAX_CLUSTER_LIGHT_INDICES);
+
+    createDescriptorSets();
+}
+
+void LightClusters::Destroy()
+{
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+
+    for (size_t i = 0; i < m_gridBuffers.size(); ++i)
+    {
+        m_gridBuffers[i].Destroy(m_device);
+        m_indexBuffers[i].Destroy(m_device);
+    }
+}
+
+void LightClusters::Update(uint32_t frameIndex, const std::vector<SpotLight>& lights, Camera& camera, VkExtent2D extent)
+{
+    float near = camera.GetNearPlane();
+    float far = camera.GetFarPlane();
+    float logDepthRange = std::log(far / near);
+
+    m_grid.depthSlicing.x = static_cast<float>(CLUSTER_COUNT_Z) / logDepthRange;
+    m_grid.depthSlicing.y = -static_cast<float>(CLUSTER_COUNT_Z) * std::log(near) / logDepthRange;
+    m_grid.screenSize = glm::vec4(static_cast<float>(extent.width), static_cast<float>(extent.height), 0.f, 0.f);
+
+    for (std::vector<uint32_t>& clusterLights : m_clusterLights)
+        clusterLights.clear();
+
+    glm::mat4 view = camera.GetViewMatrix();
+    glm::mat4 projection = camera.GetProjectionMatrix();
+    uint32_t lightCount = static_cast<uint32_t>(std::min<size_t>(lights.size(), MAX_SPOT_LIGHTS));
+
+    for (uint32_t i = 0; i < lightCount; ++i)
+    {
+        const SpotLight& light = lights[i];
+        glm::vec3 direction = glm::normalize(light.direction);
+        float angle = glm::radians(light.cutoff);
+
+        // Smallest sphere around the cone, wide cones are bounded by their cap
+        glm::vec3 center;
+        float radius;
+        if (angle > glm::quarter_pi<float>())
+        {
+            center = light.position + direction * (std::cos(angle) * light.range);
+            radius = std::sin(angle) * light.range;
+        }
+        else
+        {
+            radius = light.range / (2.f * std::cos(angle));
+            center = light.position + direction * radius;
+        }
+
+        binLight(i, glm::vec3(view * glm::vec4(center, 1.f)), radius, projection, near);
+    }
+
+    // Flatten the per cluster lists into one index list
+    m_lightIndices.clear();
+    m_maxLightsPerCluster = 0;
+    m_overflowed = false;
+    uint32_t usedClusters = 0;
+
+    for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+    {
+        const std::vector<uint32_t>& clusterLights = m_clusterLights[cluster];
+        uint32_t count = static_cast<uint32_t>(clusterLights.size());
+
+        if (m_lightIndices.size() + count > MAX_CLUSTER_LIGHT_INDICES)
+        {
+            count = MAX_CLUSTER_LIGHT_INDICES - static_cast<uint32_t>(m_lightIndices.size());
+            m_overflowed = true;
+        }
+
+        m_grid.clusters[cluster] = glm::uvec2(static_cast<uint32_t>(m_lightIndices.size()), count);
+        m_lightIndices.insert(m_lightIndices.end(), clusterLights.begin(), clusterLights.begin() + count);
+
+        m_maxLightsPerCluster = std::max(m_maxLightsPerCluster, count);
+        if (count > 0) ++usedClusters;
+    }
+
+    m_averageLightsPerCluster = usedClusters > 0 ?
+        static_cast<float>(m_lightIndices.size()) / static_cast<float>(usedClusters) : 0.f;
+
+    void* data;
+    vkMapMemory(m_device, m_gridBuffers[frameIndex].GetMemory(), 0, sizeof(ClusterGrid), 0, &data);
+    memcpy(data, &m_grid, sizeof(ClusterGrid));
+    vkUnmapMemory(m_device, m_gridBuffers[frameIndex].GetMemory());
+
+    if (!m_lightIndices.empty())
+    {
+        VkDeviceSize indexSize = m_lightIndices.size() * sizeof(uint32_t);
+        vkMapMemory(m_device, m_indexBuffers[frameIndex].GetMemory(), 0, indexSize, 0, &data);
+        memcpy(data, m_lightIndices.data(), indexSize);
+        vkUnmapMemory(m_device, m_indexBuffers[frameIndex].GetMemory());
+    }
+}
+
+VkDescriptorSetLayout LightClusters::GetDescriptorSetLayout()
+{
+    return m_setLayout;
+}
+
+VkDescriptorSet LightClusters::GetDescriptorSet(uint32_t frameIndex)
+{
+    return m_descriptorSets[frameIndex];
+}
+
+uint32_t LightClusters::GetMaxLightsPerCluster()
+{
+    return m_maxLightsPerCluster;
+}
+
+float LightClusters::GetAverageLightsPerCluster()
+{
+    return m_averageLightsPerCluster;
+}
+
+uint32_t LightClusters::GetLightIndexCount()
+{
+    return static_cast<uint32_t>(m_lightIndices.size());
+}
+
+bool LightClusters::GetIndexListOverflowed()
+{
+    return m_overflowed;
+}
+
+void LightClusters::binLight(uint32_t light, const glm::vec3& viewCenter, float radius, const glm::mat4& projection, float near)
+{
+    // View space looks down -z
+    float depthMin = std::max(-viewCenter.z - radius, near);
+    float depthMax = -viewCenter.z + radius;
+    if (depthMax < near)
+        return;
+
+    auto slice = [this](float depth)
+    {
+        int index = static_cast<int>(std::floor(std::log(depth) * m_grid.depthSlicing.x + m_grid.depthSlicing.y));
+        return std::clamp(index, 0, static_cast<int>(CLUSTER_COUNT_Z) - 1);
+    };
+
+    // Screen rectangle of the sphere's bounding box, which is entirely in front of the near plane after clamping
+    glm::vec2 ndcMin(FLT_MAX);
+    glm::vec2 ndcMax(-FLT_MAX);
+    for (uint32_t c = 0; c < 8; ++c)
+    {
+        glm::vec3 corner(viewCenter.x + (c & 1 ? radius : -radius),
+                         viewCenter.y + (c & 2 ? radius : -radius),
+                         c & 4 ? -depthMax : -depthMin);
+
+        glm::vec4 clip = projection * glm::vec4(corner, 1.f);
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+
+    if (ndcMax.x < -1.f || ndcMin.x > 1.f || ndcMax.y < -1.f || ndcMin.y > 1.f)
+        return;
+
+    auto tile = [](float coord, uint32_t count)
+    {
+        int index = static_cast<int>(std::floor(coord * static_cast<float>(count)));
+        return std::clamp(index, 0, static_cast<int>(count) - 1);
+    };
+
+    // The viewport is flipped, +y in NDC is the top row of the framebuffer
+    int xMin = tile(ndcMin.x * 0.5f + 0.5f, CLUSTER_COUNT_X);
+    int xMax = tile(ndcMax.x * 0.5f + 0.5f, CLUSTER_COUNT_X);
+    int yMin = tile(0.5f - ndcMax.y * 0.5f, CLUSTER_COUNT_Y);
+    int yMax = tile(0.5f - ndcMin.y * 0.5f, CLUSTER_COUNT_Y);
+    int zMin = slice(depthMin);
+    int zMax = slice(depthMax);
+
+    for (int z = zMin; z <= zMax; ++z)
+    {
+        for (int y = yMin; y <= yMax; ++y)
+        {
+            for (int x = xMin; x <= xMax; ++x)
+            {
+                uint32_t cluster = x + CLUSTER_COUNT_X * (y + CLUSTER_COUNT_Y * z);
+                m_clusterLights[cluster].push_back(light);
+            }
+        }
+    }
+}
+
+void LightClusters::createDescriptorSets()
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings = {};
+
+    layoutBindings[0].binding = 0;
+    layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    layoutBindings[0].descriptorCount = 1;
+    layoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutBindings[0].pImmutableSamplers = nullptr;
+
+    layoutBindings[1].binding = 1;
+    layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    layoutBindings[1].descriptorCount = 1;
+    layoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutBindings[1].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+    layoutCreateInfo.pBindings = layoutBindings.data();
+
+    VkResult result = vkCreateDescriptorSetLayout(m_device, &layoutCreateInfo, nullptr, &m_setLayout);
+    CHECK_VK_RESULT(result, "Failed to create Descriptor Set Layout");
+
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = m_frameCount * 2;
+
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = m_frameCount;
+    poolCreateInfo.poolSizeCount = 1;
+    poolCreateInfo.pPoolSizes = &poolSize;
+
+    result = vkCreateDescriptorPool(m_device, &poolCreateInfo, nullptr, &m_descriptorPool);
+    CHECK_VK_RESULT(result, "Failed to create Descriptor Pool");
+
+    m_descriptorSets.resize(m_frameCount);
+    std::vector<VkDescriptorSetLayout> layouts(m_frameCount, m_setLayout);
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {};
+    descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocInfo.descriptorPool = m_descriptorPool;
+    descriptorSetAllocInfo.descriptorSetCount = m_frameCount;
+    descriptorSetAllocInfo.pSetLayouts = layouts.data();
+
+    result = vkAllocateDescriptorSets(m_device, &descriptorSetAllocInfo, m_descriptorSets.data());
+    CHECK_VK_RESULT(result, "Failed to allocate Descriptor Set for Light Clusters");
+
+    m_gridBuffers.resize(m_frameCount);
+    m_indexBuffers.resize(m_frameCount);
+
+    for (uint32_t i = 0; i < m_frameCount; ++i)
+    {
+        m_gridBuffers[i].Init(m_device, m_physicalDevice, sizeof(ClusterGrid), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_indexBuffers[i].Init(m_device, m_physicalDevice, sizeof(ClusterLightIndices), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        VkDescriptorBufferInfo gridBufferInfo = {};
+        gridBufferInfo.buffer = m_gridBuffers[i].GetBuffer();
+        gridBufferInfo.offset = 0;
+        gridBufferInfo.range = sizeof(ClusterGrid);
+
+        VkDescriptorBufferInfo indexBufferInfo = {};
+        indexBufferInfo.buffer = m_indexBuffers[i].GetBuffer();
+        indexBufferInfo.offset = 0;
+        indexBufferInfo.range = sizeof(ClusterLightIndices);
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = m_descriptorSets[i];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &gridBufferInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = m_descriptorSets[i];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &indexBufferInfo;
+
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
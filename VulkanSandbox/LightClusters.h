@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Camera.h"
+#include "Lights.h"
+
+// Must match the cluster defines in shader.frag
+constexpr uint32_t CLUSTER_COUNT_X = 16;
+constexpr uint32_t CLUSTER_COUNT_Y = 9;
+constexpr uint32_t CLUSTER_COUNT_Z = 24;
+constexpr uint32_t CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+constexpr uint32_t MAX_CLUSTER_LIGHT_INDICES = CLUSTER_COUNT * 32;
+
+// std430 layout
+struct ClusterGrid
+{
+    glm::vec4 depthSlicing;             // x scale, y bias: slice = log(viewDepth) * x + y
+    glm::vec4 screenSize;               // xy framebuffer size
+    glm::uvec2 clusters[CLUSTER_COUNT]; // x first index into the light index list, y light count
+};
+
+struct ClusterLightIndices
+{
+    uint32_t indices[MAX_CLUSTER_LIGHT_INDICES];
+};
+
+// -- LIGHT CLUSTERS --
+// The view frustum is split into a froxel grid, tiles on screen and exponential slices in depth. Every frame
+// each spot light is binned on the CPU into all clusters its bounding sphere touches, so the fragment shader
+// only loops over the lights of its own cluster.
+class LightClusters
+{
+public:
+    LightClusters();
+
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount);
+    void Destroy();
+
+    // Bins the lights and uploads the grid and index list of this frame
+    void Update(uint32_t frameIndex, const std::vector<SpotLight>& lights, Camera& camera, VkExtent2D extent);
+
+    VkDescriptorSetLayout GetDescriptorSetLayout();
+    VkDescriptorSet GetDescriptorSet(uint32_t frameIndex);
+
+    // Statistics of the last update
+    uint32_t GetMaxLightsPerCluster();
+    float GetAverageLightsPerCluster();     // Over clusters with at least one light
+    uint32_t GetLightIndexCount();
+    bool GetIndexListOverflowed();
+
+private:
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    uint32_t m_frameCount;
+
+    VkDescriptorSetLayout m_setLayout;
+    VkDescriptorPool m_descriptorPool;
+    std::vector<VkDescriptorSet> m_descriptorSets;
+    std::vector<Buffer> m_gridBuffers;
+    std::vector<Buffer> m_indexBuffers;
+
+    ClusterGrid m_grid;
+    std::vector<std::vector<uint32_t>> m_clusterLights;     // Lights of every cluster, reused every frame
+    std::vector<uint32_t> m_lightIndices;
+
+    uint32_t m_maxLightsPerCluster = 0;
+    float m_averageLightsPerCluster = 0.f;
+    bool m_overflowed = false;
+
+    void binLight(uint32_t light, const glm::vec3& viewCenter, float radius, const glm::mat4& projection, float near);
+
+    void createDescriptorSets();
+
+};
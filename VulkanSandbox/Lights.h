@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Utilities.h"
+
+// Must match MAX_SPOT_LIGHTS and MAX_POINT_LIGHTS in the shaders
+constexpr uint32_t MAX_SPOT_LIGHTS = 512;
+constexpr uint32_t MAX_POINT_LIGHTS = 8;
+
+struct SpotLight
+{
+    glm::vec3 position = { 0.f, 1.5f, 150.f };
+    glm::vec3 direction = { 0.f, 0.f, -1.f };
+    float strength = 10.f;
+    float cutoff = 60.f;        // Half angle in degrees
+    float range = 250.f;        // Far plane of the shadow projection
+};
+
+// std430 layout, one entry per spot light
+struct GpuSpotLight
+{
+    glm::mat4 viewProjection;
+    glm::vec4 positionStrength;     // xyz position, w strength
+    glm::vec4 directionCutoff;      // xyz direction, w cutoff in degrees
+    glm::vec4 atlasRect;            // xy offset, zw scale in shadow atlas uv, zero scale when unshadowed
+    glm::vec4 range;                // x range
+};
+
+struct SpotLightBuffer
+{
+    uint32_t count;
+    uint32_t padding[3];
+    GpuSpotLight lights[MAX_SPOT_LIGHTS];
+};
+
+struct PointLight
+{
+    glm::vec3 position = { 0.f, 10.f, 0.f };
+    float strength = 10.f;
+    float range = 100.f;
+};
+
+// std430 layout, faces are ordered +X, -X, +Y, -Y, +Z, -Z
+struct GpuPointLight
+{
+    glm::vec4 positionStrength;     // xyz position, w strength
+    glm::vec4 range;                // x range
+    glm::mat4 faceViewProjection[6];
+};
+
+struct PointLightBuffer
+{
+    uint32_t count;
+    uint32_t padding[3];
+    GpuPointLight lights[MAX_POINT_LIGHTS];
+};
@@ -0,0 +1,133 @@
+#include "LinearAllocator.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    const size_t SCRATCH_CAPACITY = 1024 * 1024;
+
+    // Frees the thread's scratch memory when the thread exits
+    struct ThreadScratch
+    {
+        LinearAllocator allocator;
+
+        ThreadScratch()
+        {
+            allocator.Init(SCRATCH_CAPACITY);
+        }
+
+        ~ThreadScratch()
+        {
+            allocator.Destroy();
+        }
+    };
+}
+
+LinearAllocator::LinearAllocator()
+{
+}
+
+void LinearAllocator::Init(size_t capacity)
+{
+    m_capacity = capacity;
+    m_offset = 0;
+    m_memory = static_cast<uint8_t*>(::operator new(m_capacity));
+}
+
+void LinearAllocator::Destroy()
+{
+    Reset();
+
+    ::operator delete(m_memory);
+    m_memory = nullptr;
+    m_capacity = 0;
+}
+
+void* LinearAllocator::Allocate(size_t size, size_t alignment)
+{
+    uintptr_t base = reinterpret_cast<uintptr_t>(m_memory);
+    uintptr_t aligned = (base + m_offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    size_t offset = static_cast<size_t>(aligned - base);
+
+    if (offset + size <= m_capacity)
+    {
+        m_offset = offset + size;
+        return m_memory + offset;
+    }
+
+    // operator new is aligned for everything but over-aligned types, which aren't allocated here
+    void* memory = ::operator new(size);
+    m_overflow.push_back(memory);
+    m_overflowSize += size + alignment;
+    return memory;
+}
+
+void LinearAllocator::Reset()
+{
+    m_offset = 0;
+
+    if (m_overflowSize == 0) return;
+
+    for (void* memory : m_overflow)
+    {
+        ::operator delete(memory);
+    }
+    m_overflow.clear();
+
+    // Grow so the same amount fits next time
+    size_t capacity = m_capacity + m_overflowSize;
+    m_overflowSize = 0;
+
+    ::operator delete(m_memory);
+    Init(capacity);
+}
+
+LinearAllocator::Marker LinearAllocator::GetMarker()
+{
+    return { m_offset, m_overflow.size() };
+}
+
+void LinearAllocator::Rewind(const Marker& marker)
+{
+    if (marker.offset == 0 && marker.overflowCount == 0)
+    {
+        Reset();
+        return;
+    }
+
+    m_offset = marker.offset;
+
+    // Freed here, but still counted in m_overflowSize so the next Reset grows the block for them
+    for (size_t i = marker.overflowCount; i < m_overflow.size(); ++i)
+    {
+        ::operator delete(m_overflow[i]);
+    }
+    m_overflow.resize(marker.overflowCount);
+}
+
+size_t LinearAllocator::GetUsed()
+{
+    return m_offset + m_overflowSize;
+}
+
+size_t LinearAllocator::GetCapacity()
+{
+    return m_capacity;
+}
+
+LinearAllocator& LinearAllocator::GetScratch()
+{
+    thread_local ThreadScratch scratch;
+    return scratch.allocator;
+}
+
+ScratchScope::ScratchScope()
+    : m_allocator(LinearAllocator::GetScratch()), m_marker(m_allocator.GetMarker())
+{
+}
+
+ScratchScope::~ScratchScope()
+{
+    m_allocator.Rewind(m_marker);
+}
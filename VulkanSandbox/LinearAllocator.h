@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// -- LINEAR ALLOCATOR --
+// Bump allocator for data that lives at most until the next Reset, like everything built while recording a frame.
+// Deallocation is a no-op. Running out of space falls back to the heap and the next Reset grows the block, so after
+// a few frames the same workload never touches the heap.
+class LinearAllocator
+{
+public:
+    LinearAllocator();
+
+    void Init(size_t capacity);
+    void Destroy();
+
+    void* Allocate(size_t size, size_t alignment);
+    void Reset();
+
+    // Heap fallbacks don't move the offset, so a marker also remembers how many there were
+    struct Marker
+    {
+        size_t offset;
+        size_t overflowCount;
+    };
+
+    // Everything allocated after GetMarker is dropped by Rewind. Only rewinding to an empty allocator is a Reset
+    // and grows the block, inner markers leave it in place because outer allocations still point into it.
+    Marker GetMarker();
+    void Rewind(const Marker& marker);
+
+    size_t GetUsed();
+    size_t GetCapacity();
+
+    // This thread's allocator for ScratchScope
+    static LinearAllocator& GetScratch();
+
+private:
+    uint8_t* m_memory = nullptr;
+    size_t m_capacity = 0;
+    size_t m_offset = 0;
+
+    // Served from the heap since the last Reset
+    std::vector<void*> m_overflow;
+    size_t m_overflowSize = 0;
+
+};
+
+// -- ARENA ALLOCATOR --
+// STL adaptor, containers using it must not outlive the allocator's next Reset or Rewind
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator() = default;
+    ArenaAllocator(LinearAllocator& allocator) : m_allocator(&allocator) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_allocator(other.GetLinearAllocator()) {}
+
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(m_allocator->Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t)
+    {
+    }
+
+    LinearAllocator* GetLinearAllocator() const
+    {
+        return m_allocator;
+    }
+
+private:
+    LinearAllocator* m_allocator = nullptr;
+
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.GetLinearAllocator() == b.GetLinearAllocator();
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return !(a == b);
+}
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// -- SCRATCH SCOPE --
+// Temporary allocations from this thread's scratch allocator, all freed when the scope ends. Scopes nest.
+class ScratchScope
+{
+public:
+    ScratchScope();
+    ~ScratchScope();
+
+    template<typename T>
+    ArenaAllocator<T> GetAllocator()
+    {
+        return ArenaAllocator<T>(m_allocator);
+    }
+
+private:
+    LinearAllocator& m_allocator;
+    LinearAllocator::Marker m_marker;
+
+};
@@ -1,13 +1,18 @@
 #include "MaterialManager.h"
 
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include <stb_image.h>
 #include <cstring>
 
+#include "AssetLoader.h"
 #include "Buffer.h"
+#include "CommandBufferAllocator.h"
+#include "CpuProfiler.h"
 #include "Image.h"
+#include "ShaderLibrary.h"
 #include "Utilities.h"
 
 VkDevice device;
@@ -17,7 +22,7 @@ VkSampler textureSampler;
 VkSampler normalSampler;
 VkSampler specularSampler;
 
-VkDescriptorSetLayout samplerSetLayout;
+VkDescriptorSetLayout samplerSetLayout;      // Owned by the shader library
 VkDescriptorPool samplerDescriptorPool;
 
 // All Textures + their Samplers
@@ -27,8 +32,8 @@ std::vector<ETextureType> textureTypes;
 
 // Materials
 std::vector<Material> materials;
+uint32_t placeholderMaterial = 0;
 
-void createSetLayout();
 void createDescriptorPool();
 void createSampler();
 
@@ -39,7 +44,7 @@ void MaterialManager::Init(VkDevice _device, VkPhysicalDevice _physicalDevice)
     device = _device;
     physicalDevice = _physicalDevice;
 
-    createSetLayout();
+    samplerSetLayout = ShaderLibrary::GetSetLayout({ "frag.spv" }, 1).layout;
     createDescriptorPool();
     createSampler();
 }
@@ -56,7 +61,6 @@ void MaterialManager::Destroy()
     vkDestroySampler(device, normalSampler, nullptr);
     
     vkDestroyDescriptorPool(device, samplerDescriptorPool, nullptr);
-    vkDestroyDescriptorSetLayout(device, samplerSetLayout, nullptr);
 }
 
 VkDescriptorSetLayout MaterialManager::GetDescriptorSetLayout()
@@ -88,43 +92,80 @@ Material MaterialManager::GetMaterial(uint32_t materialId)
     return materials[materialId];
 }
 
-uint32_t createTexture(const std::string& fileName, ETextureType type, VkQueue queue, VkCommandPool commandPool, VkDescriptorSet descriptorSet)
+// Decoded pixels, filled on any thread
+struct TextureData
+{
+    int width = 0;
+    int height = 0;
+    VkDeviceSize imageSize = 0;
+    std::unique_ptr<stbi_uc, void(*)(void*)> pixels = { nullptr, stbi_image_free };
+};
+
+// A material between decoding and uploading its textures
+struct PendingMaterial
+{
+    std::string textureNames[3];
+    TextureData textures[3];
+    Material material;
+    VkDescriptorSet descriptorSet;
+};
+
+const ETextureType materialTextureTypes[3] = { ETextureType::DIFFUSE, ETextureType::SPECULAR, ETextureType::NORMAL };
+
+void decodeTexture(const std::string& fileName, TextureData& texture)
 {
-    
-    int width, height;
-    VkDeviceSize imageSize;
     stbi_uc* imageData;
     if (!fileName.empty())
-        imageData = loadTextureImageFile(fileName, &width, &height, &imageSize);
+        imageData = loadTextureImageFile(fileName, &texture.width, &texture.height, &texture.imageSize);
     else
-        imageData = loadTextureImageFile("plain.png", &width, &height, &imageSize);
-    
+        imageData = loadTextureImageFile("plain.png", &texture.width, &texture.height, &texture.imageSize);
+
+    texture.pixels.reset(imageData);
+}
+
+VkDescriptorSet allocateMaterialSet()
+{
+    VkDescriptorSet descriptorSet;
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {};
+    descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocInfo.descriptorPool = samplerDescriptorPool;
+    descriptorSetAllocInfo.descriptorSetCount = 1;
+    descriptorSetAllocInfo.pSetLayouts = &samplerSetLayout;
+
+    VkResult result = vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSet);
+    CHECK_VK_RESULT(result, "Failed to allocate Descriptor Set for Image");
+
+    return descriptorSet;
+}
+
+// Records the upload, the image can only be sampled once the command buffer finished
+uint32_t uploadTexture(const TextureData& texture, ETextureType type, VkCommandBuffer commandBuffer,
+                       std::vector<Buffer>& stagingBuffers, VkDescriptorSet descriptorSet)
+{
     Buffer stagingBuffer;
-    stagingBuffer.Init(device, physicalDevice, imageSize,
+    stagingBuffer.Init(device, physicalDevice, texture.imageSize,
                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    stagingBuffers.push_back(stagingBuffer);
 
     void* data;
-    vkMapMemory(device, stagingBuffer.GetMemory(), 0, imageSize, 0, &data);
-    memcpy(data, imageData, imageSize);
+    vkMapMemory(device, stagingBuffer.GetMemory(), 0, texture.imageSize, 0, &data);
+    memcpy(data, texture.pixels.get(), texture.imageSize);
     vkUnmapMemory(device, stagingBuffer.GetMemory());
 
-    stbi_image_free(imageData);
-
     Image textureImage;
-    textureImage.Init(device, physicalDevice, width, height,
+    textureImage.Init(device, physicalDevice, texture.width, texture.height,
                       VK_FORMAT_R8G8B8A8_UNORM, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
                       VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
 
-    textureImage.TransitionLayout(device, queue, commandPool,
-                                  VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    Buffer::CopyBufferToImage(device, queue, commandPool, stagingBuffer.GetBuffer(), textureImage.GetImage(), width, height);
-    textureImage.TransitionLayout(device, queue, commandPool,
-                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    textureImage.RecordTransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    Buffer::RecordCopyBufferToImage(commandBuffer, stagingBuffer.GetBuffer(), textureImage.GetImage(),
+                                    texture.width, texture.height);
+    textureImage.RecordTransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     
     textureImages.push_back(std::move(textureImage));
-    stagingBuffer.Destroy(device);
 
     uint32_t id = static_cast<uint32_t>(textureImages.size())-1;
 
@@ -154,68 +195,85 @@ uint32_t createTexture(const std::string& fileName, ETextureType type, VkQueue q
     return id;
 }
 
+void decodeMaterial(PendingMaterial& pending)
+{
+    for (int i = 0; i < 3; ++i)
+        decodeTexture(pending.textureNames[i], pending.textures[i]);
+}
+
+void uploadMaterial(PendingMaterial& pending, VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers)
+{
+    pending.descriptorSet = allocateMaterialSet();
+
+    uint32_t* textureIds[3] = { &pending.material.diffuse, &pending.material.specular, &pending.material.normal };
+    for (int i = 0; i < 3; ++i)
+    {
+        *textureIds[i] = uploadTexture(pending.textures[i], materialTextureTypes[i], commandBuffer, stagingBuffers,
+            pending.descriptorSet);
+        pending.textures[i].pixels.reset();
+    }
+}
+
 uint32_t MaterialManager::CreateMaterial(const std::string& diffuse, const std::string& specular,
-    const std::string& normal, VkQueue queue, VkCommandPool commandPool)
+    const std::string& normal, VkQueue queue, CommandBufferAllocator& commandAllocator)
 {
-    VkDescriptorSet descriptorSet;
+    CPU_ZONE("Create Material");
 
-    VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {};
-    descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    descriptorSetAllocInfo.descriptorPool = samplerDescriptorPool;
-    descriptorSetAllocInfo.descriptorSetCount = 1;
-    descriptorSetAllocInfo.pSetLayouts = &samplerSetLayout;
+    PendingMaterial pending;
+    pending.textureNames[0] = diffuse;
+    pending.textureNames[1] = specular;
+    pending.textureNames[2] = normal;
 
-    VkResult result = vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSet);
-    CHECK_VK_RESULT(result, "Failed to allocate Descriptor Set for Image");
-    
-    Material mat = {};
-    mat.diffuse = createTexture(diffuse, ETextureType::DIFFUSE, queue, commandPool, descriptorSet);
-    mat.specular = createTexture(specular, ETextureType::SPECULAR, queue, commandPool, descriptorSet);
-    mat.normal = createTexture(normal, ETextureType::NORMAL, queue, commandPool, descriptorSet);
+    decodeMaterial(pending);
+
+    std::vector<Buffer> stagingBuffers;
+    VkCommandBuffer commandBuffer = commandAllocator.BeginOneShot();
+    uploadMaterial(pending, commandBuffer, stagingBuffers);
+    commandAllocator.SubmitOneShot(queue, commandBuffer);
+
+    for (Buffer& buffer : stagingBuffers)
+        buffer.Destroy(device);
     
-    materials.push_back(mat);
-    samplerDescriptorSets.push_back(descriptorSet);
+    materials.push_back(pending.material);
+    samplerDescriptorSets.push_back(pending.descriptorSet);
     
     return static_cast<uint32_t>(materials.size())-1;
 }
 
-void createSetLayout()
+void MaterialManager::InitPlaceholder(VkQueue queue, CommandBufferAllocator& commandAllocator)
 {
-    VkDescriptorSetLayoutBinding samplerLayoutBinding;
-    samplerLayoutBinding.binding = 0;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.descriptorCount = 1;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutBinding specularLayoutBinding;
-    specularLayoutBinding.binding = 1;
-    specularLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    specularLayoutBinding.descriptorCount = 1;
-    specularLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    specularLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutBinding normalLayoutBinding;
-    normalLayoutBinding.binding = 2;
-    normalLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    normalLayoutBinding.descriptorCount = 1;
-    normalLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    normalLayoutBinding.pImmutableSamplers = nullptr;
-
-    std::vector<VkDescriptorSetLayoutBinding> bindings =
-    {
-        samplerLayoutBinding,
-        specularLayoutBinding,
-        normalLayoutBinding
-    };
-
-    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
-    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutCreateInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutCreateInfo.pBindings = bindings.data();
-
-    VkResult result = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &samplerSetLayout);
-    CHECK_VK_RESULT(result, "Failed to create Sampler Descriptor Layout");
+    placeholderMaterial = CreateMaterial("", "", "", queue, commandAllocator);
+}
+
+uint32_t MaterialManager::LoadMaterial(const std::string& diffuse, const std::string& specular,
+    const std::string& normal, AssetLoader& loader)
+{
+    uint32_t id = static_cast<uint32_t>(materials.size());
+    materials.push_back(materials[placeholderMaterial]);
+    samplerDescriptorSets.push_back(samplerDescriptorSets[placeholderMaterial]);
+
+    std::shared_ptr<PendingMaterial> pending = std::make_shared<PendingMaterial>();
+    pending->textureNames[0] = diffuse;
+    pending->textureNames[1] = specular;
+    pending->textureNames[2] = normal;
+
+    loader.Submit("Material " + std::to_string(id),
+        [pending]()
+        {
+            decodeMaterial(*pending);
+        },
+        [pending](VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers)
+        {
+            uploadMaterial(*pending, commandBuffer, stagingBuffers);
+        },
+        [pending, id]()
+        {
+            // Frames recorded from here on bind the new set, older ones keep using the placeholder's
+            materials[id] = pending->material;
+            samplerDescriptorSets[id] = pending->descriptorSet;
+        });
+
+    return id;
 }
 
 void createDescriptorPool()
@@ -270,6 +328,8 @@ void createSampler()
 
 stbi_uc* loadTextureImageFile(const std::string& fileName, int* width, int* height, VkDeviceSize* imageSize)
 {
+    CPU_ZONE("Decode Texture");
+
     int channels;
 
     std::string fileLoc = "textures/" + fileName;
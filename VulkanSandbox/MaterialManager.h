@@ -4,6 +4,9 @@
 #include <string>
 #include <vulkan/vulkan.h>
 
+class AssetLoader;
+class CommandBufferAllocator;
+
 enum class ETextureType { DIFFUSE, NORMAL, SPECULAR };
 
 struct Material
@@ -25,7 +28,13 @@ public:
 
     static Material GetMaterial(uint32_t materialId);
     
-    static uint32_t CreateMaterial(const std::string& diffuse, const std::string& specular, const std::string& normal, VkQueue queue, VkCommandPool commandPool);
+    static uint32_t CreateMaterial(const std::string& diffuse, const std::string& specular, const std::string& normal, VkQueue queue, CommandBufferAllocator& commandAllocator);
+
+    // Flat white material that loading materials show until their textures are uploaded
+    static void InitPlaceholder(VkQueue queue, CommandBufferAllocator& commandAllocator);
+    // The returned id can be drawn right away, it uses the placeholder until the loader completes the material.
+    // Materials whose textures fail to load keep the placeholder.
+    static uint32_t LoadMaterial(const std::string& diffuse, const std::string& specular, const std::string& normal, AssetLoader& loader);
 
 private:
     // List of textures
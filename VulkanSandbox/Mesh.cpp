@@ -2,30 +2,39 @@
 
 #include <cstring>
 
+#include "CommandBufferAllocator.h"
+#include "CpuProfiler.h"
+
 Mesh::Mesh()
 {
 }
 
-Mesh::Mesh(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
-    const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const glm::mat4& parentTransform,
-    uint32_t materialId)
+Mesh::Mesh(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue, CommandBufferAllocator& commandAllocator,
+    const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t materialId)
 {
     m_device = device;
     m_physicalDevice = physicalDevice;
 
-    m_transform = parentTransform;
     m_materialIndex = materialId;
-    
-    indices.empty() ? m_indexed = false : m_indexed = true;
 
-    createVertexBuffer(transferQueue, transferCommandPool, vertices);
-    m_vertexCount = static_cast<int>(vertices.size());
+    std::vector<Buffer> stagingBuffers;
+    VkCommandBuffer commandBuffer = commandAllocator.BeginOneShot();
+    init(commandBuffer, stagingBuffers, vertices, indices);
+    commandAllocator.SubmitOneShot(transferQueue, commandBuffer);
 
-    if (m_indexed)
-    {
-        createIndexBuffer(transferQueue, transferCommandPool, indices);
-        m_indexCount = static_cast<int>(indices.size());
-    }
+    for (Buffer& buffer : stagingBuffers)
+        buffer.Destroy(m_device);
+}
+
+Mesh::Mesh(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers,
+    const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t materialId)
+{
+    m_device = device;
+    m_physicalDevice = physicalDevice;
+
+    m_materialIndex = materialId;
+
+    init(commandBuffer, stagingBuffers, vertices, indices);
 }
 
 Mesh::~Mesh()
@@ -63,62 +72,82 @@ Buffer* Mesh::GetIndexBuffer()
     return &m_indexBuffer;
 }
 
-const glm::mat4& Mesh::GetTransform()
+uint32_t Mesh::GetMaterialIndex()
 {
-    return m_transform;
+    return m_materialIndex;
 }
 
-uint32_t Mesh::GetMaterialIndex()
+const BoundingBox& Mesh::GetBounds()
 {
-    return m_materialIndex;
+    return m_bounds;
 }
 
-void Mesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool,
-                              const std::vector<Vertex>& vertices)
+TriangleBvh Mesh::BuildBvh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
 {
-    VkDeviceSize bufferSize = sizeof(Vertex) * vertices.size();
+    CPU_ZONE("Build Mesh BVH");
 
-    Buffer stagingBuffer;
-    stagingBuffer.Init(m_device, m_physicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        positions[i] = vertices[i].position;
 
-    void* data;
-    vkMapMemory(m_device, stagingBuffer.GetMemory(), 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), bufferSize);
-    vkUnmapMemory(m_device, stagingBuffer.GetMemory());
+    TriangleBvh bvh;
+    bvh.Build(positions, indices);
+    return bvh;
+}
 
-    m_vertexBuffer.Init(m_device, m_physicalDevice, bufferSize,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+void Mesh::SetBvh(TriangleBvh&& bvh)
+{
+    m_bvh = std::move(bvh);
+}
 
-    Buffer::CopyBuffer(m_device, transferQueue, transferCommandPool,
-        stagingBuffer.GetBuffer(), m_vertexBuffer.GetBuffer(),
-        bufferSize);
+bool Mesh::Raycast(const Ray& ray, float maxDistance, float& distance)
+{
+    if (m_bvh.Empty())
+        return m_bounds.IntersectsRay(ray, maxDistance, distance);
 
-    stagingBuffer.Destroy(m_device);
+    return m_bvh.Raycast(ray, maxDistance, distance);
 }
 
-void Mesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool,
-    const std::vector<uint32_t>& indices)
+void Mesh::init(VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers,
+    const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
 {
-    VkDeviceSize bufferSize = sizeof(uint32_t) * indices.size();
+    indices.empty() ? m_indexed = false : m_indexed = true;
+
+    if (!vertices.empty())
+    {
+        m_bounds.min = vertices[0].position;
+        m_bounds.max = m_bounds.min;
+        for (const Vertex& vertex : vertices)
+            m_bounds.Expand(vertex.position);
+    }
+
+    createBuffer(commandBuffer, stagingBuffers, vertices.data(), sizeof(Vertex) * vertices.size(),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_vertexBuffer);
+    m_vertexCount = static_cast<int>(vertices.size());
 
+    if (m_indexed)
+    {
+        createBuffer(commandBuffer, stagingBuffers, indices.data(), sizeof(uint32_t) * indices.size(),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexBuffer);
+        m_indexCount = static_cast<int>(indices.size());
+    }
+}
+
+void Mesh::createBuffer(VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers, const void* source,
+    VkDeviceSize bufferSize, VkBufferUsageFlags usage, Buffer& buffer)
+{
     Buffer stagingBuffer;
     stagingBuffer.Init(m_device, m_physicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    stagingBuffers.push_back(stagingBuffer);
 
     void* data;
     vkMapMemory(m_device, stagingBuffer.GetMemory(), 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), bufferSize);
+    memcpy(data, source, bufferSize);
     vkUnmapMemory(m_device, stagingBuffer.GetMemory());
 
-    m_indexBuffer.Init(m_device, m_physicalDevice, bufferSize,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+    buffer.Init(m_device, m_physicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    Buffer::CopyBuffer(m_device, transferQueue, transferCommandPool,
-        stagingBuffer.GetBuffer(), m_indexBuffer.GetBuffer(),
-        bufferSize);
-    
-    stagingBuffer.Destroy(m_device);
-}
\ No newline at end of file
+    Buffer::RecordCopyBuffer(commandBuffer, stagingBuffer.GetBuffer(), buffer.GetBuffer(), bufferSize);
+}
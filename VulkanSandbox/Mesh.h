@@ -1,14 +1,19 @@
 ﻿#pragma once
 
 #include "Buffer.h"
+#include "Bvh.h"
+#include "Frustum.h"
 #include "Utilities.h"
 
 class Mesh
 {
 public:
     Mesh();
-    Mesh(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
-        const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const glm::mat4& parentTransform, uint32_t materialId);
+    Mesh(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue, CommandBufferAllocator& commandAllocator,
+        const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t materialId);
+    // Records the copies instead of submitting them, the staging buffers must live until the command buffer finished
+    Mesh(VkDevice device, VkPhysicalDevice physicalDevice, VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers,
+        const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t materialId);
     ~Mesh();
 
     void Destroy();
@@ -20,27 +25,38 @@ public:
     int GetIndexCount();
     Buffer* GetIndexBuffer();
 
-    const glm::mat4& GetTransform();
     uint32_t GetMaterialIndex();
 
+    // Bounds of the vertices, placing them is up to the scene node drawing the mesh
+    const BoundingBox& GetBounds();
+
+    // A CPU copy of the triangles for ray queries, the vertices and indices have to form a triangle list. Touches
+    // nothing on the GPU, so it can be built on a loader thread and handed to the mesh later.
+    static TriangleBvh BuildBvh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+    void SetBvh(TriangleBvh&& bvh);
+    // In mesh space, without a triangle BVH the bounds are hit
+    bool Raycast(const Ray& ray, float maxDistance, float& distance);
+
 private:
     VkDevice m_device;
     VkPhysicalDevice m_physicalDevice;
 
     uint32_t m_materialIndex;
     
-    glm::mat4 m_transform;
+    BoundingBox m_bounds;
+    TriangleBvh m_bvh;
     
     int m_vertexCount;
     Buffer m_vertexBuffer;
-    void createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool,
-        const std::vector<Vertex>& vertices);
 
     bool m_indexed;
     int m_indexCount;
     Buffer m_indexBuffer;
-    void createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool,
-        const std::vector<uint32_t>& indices);
+
+    void init(VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers,
+        const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+    void createBuffer(VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers, const void* source,
+        VkDeviceSize bufferSize, VkBufferUsageFlags usage, Buffer& buffer);
     
     
 };
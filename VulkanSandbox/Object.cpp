@@ -2,16 +2,17 @@
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
-#include <glm/gtc/type_ptr.hpp>
 
+#include "AssetLoader.h"
+#include "CpuProfiler.h"
 #include "MaterialManager.h"
 
 Object::Object(const std::string& name)
 {
     Name = name;
     m_position = { 0.f, 0.f, 0.f };
+    m_rotation = { 0.f, 0.f, 0.f };
     m_scale = { 1.f, 1.f, 1.f };
-    matrixUpdate();
 }
 
 Object::~Object()
@@ -19,68 +20,68 @@ Object::~Object()
 }
 
 void Object::Init(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue,
-    VkCommandPool transferCommandPool, const std::string& modelFile)
+    CommandBufferAllocator& commandAllocator, const std::string& modelFile)
 {
+    CPU_ZONE("Load Object");
+
     m_device = device;
     m_physicalDevice = physicalDevice;
 
-    Assimp::Importer importer;
+    ModelData model;
+    importModel(modelFile, model);
 
-    const aiScene* scene = importer.ReadFile(modelFile, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
-    if (!scene) throw std::runtime_error("Failed to load Model: " + modelFile);
+    for (const ModelData::MaterialData& material : model.materials)
+        m_materialIndices.push_back(MaterialManager::CreateMaterial(material.diffuse, material.specular, material.normal, transferQueue, commandAllocator));
 
-    for (size_t i = 0; i < scene->mNumMaterials; ++i)
+    m_meshes.reserve(model.meshes.size());
+    m_meshNodes.reserve(model.meshes.size());
+    for (ModelData::MeshData& mesh : model.meshes)
     {
-        aiMaterial* material = scene->mMaterials[i];
+        m_meshes.emplace_back(m_device, m_physicalDevice, transferQueue, commandAllocator, mesh.vertices, mesh.indices, mesh.materialIndex);
+        m_meshes.back().SetBvh(std::move(mesh.bvh));
+        m_meshNodes.push_back(mesh.node);
+    }
 
-        std::string diffuse;
-        std::string specular;
-        std::string normal;
+    m_nodes = std::move(model.nodes);
+    m_loaded = true;
+}
 
-        if (material->GetTextureCount(aiTextureType_DIFFUSE))
-        {
-            aiString path;
-            if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS)
-            {
-                std::string fileName = path.data;
-                int idx = fileName.rfind("/");
-                if (idx != std::string::npos) fileName = fileName.substr(idx+1);
-                
-               diffuse = fileName;
-            }
-        }
+void Object::Load(VkDevice device, VkPhysicalDevice physicalDevice, AssetLoader& loader, const std::string& modelFile,
+    Scene* scene)
+{
+    m_device = device;
+    m_physicalDevice = physicalDevice;
 
-        if (material->GetTextureCount(aiTextureType_SPECULAR))
-        {
-            aiString path;
-            if (material->GetTexture(aiTextureType_SPECULAR, 0, &path) == AI_SUCCESS)
-            {
-                std::string fileName = path.data;
-                int idx = fileName.rfind("\\");
-                if (idx != std::string::npos) fileName = fileName.substr(idx+1);
-                
-                specular = fileName;
-            }
-        }
+    std::shared_ptr<ModelData> model = std::make_shared<ModelData>();
 
-        if (material->GetTextureCount(aiTextureType_NORMALS))
+    loader.Submit(Name,
+        [this, model, modelFile]()
         {
-            aiString path;
-            if (material->GetTexture(aiTextureType_NORMALS, 0, &path) == AI_SUCCESS)
+            importModel(modelFile, *model);
+        },
+        [this, model, &loader](VkCommandBuffer commandBuffer, std::vector<Buffer>& stagingBuffers)
+        {
+            // Materials load on their own and show the placeholder until then
+            for (const ModelData::MaterialData& material : model->materials)
+                m_materialIndices.push_back(MaterialManager::LoadMaterial(material.diffuse, material.specular, material.normal, loader));
+
+            m_meshes.reserve(model->meshes.size());
+            m_meshNodes.reserve(model->meshes.size());
+            for (ModelData::MeshData& mesh : model->meshes)
             {
-                std::string fileName = path.data;
-                int idx = fileName.rfind("\\");
-                if (idx != std::string::npos) fileName = fileName.substr(idx+1);
-                
-                normal = fileName;
+                m_meshes.emplace_back(m_device, m_physicalDevice, commandBuffer, stagingBuffers, mesh.vertices, mesh.indices, mesh.materialIndex);
+                m_meshes.back().SetBvh(std::move(mesh.bvh));
+                m_meshNodes.push_back(mesh.node);
             }
-        }
 
-        if (!diffuse.empty() || !specular.empty() || !normal.empty())
-            m_materialIndices.push_back(MaterialManager::CreateMaterial(diffuse, specular, normal, transferQueue, transferCommandPool));
-    }
-
-    m_meshes = LoadNode(transferQueue, transferCommandPool, scene->mRootNode, scene, glm::mat4(1.f));
+            m_nodes = std::move(model->nodes);
+            model->meshes.clear();
+        },
+        [this, scene]()
+        {
+            m_loaded = true;
+            if (scene) AddToScene(*scene);
+        });
 }
 
 void Object::Update(float deltaTime)
@@ -89,6 +90,8 @@ void Object::Update(float deltaTime)
 
 void Object::Destroy()
 {
+    RemoveFromScene();
+
     for (auto& mesh : m_meshes)
     {
         mesh.Destroy();
@@ -100,9 +103,9 @@ std::vector<Mesh>& Object::GetMeshes()
     return m_meshes;
 }
 
-const glm::mat4& Object::GetTransform()
+bool Object::IsLoaded()
 {
-    return m_transform;
+    return m_loaded;
 }
 
 const glm::vec3& Object::GetPosition()
@@ -113,13 +116,117 @@ const glm::vec3& Object::GetPosition()
 void Object::SetPosition(const glm::vec3& newPos)
 {
     m_position = newPos;
-    matrixUpdate();
+    transformUpdate();
+}
+
+const glm::vec3& Object::GetRotation()
+{
+    return m_rotation;
+}
+
+void Object::SetRotation(const glm::vec3& rotation)
+{
+    m_rotation = rotation;
+    transformUpdate();
+}
+
+const glm::vec3& Object::GetScale()
+{
+    return m_scale;
 }
 
 void Object::SetScale(const glm::vec3& scale)
 {
     m_scale = scale;
-    matrixUpdate();
+    transformUpdate();
+}
+
+void Object::AddToScene(Scene& scene)
+{
+    m_scene = &scene;
+    TransformHierarchy& hierarchy = m_scene->GetHierarchy();
+
+    m_node = hierarchy.Create(TransformHandle(), m_position, glm::quat(glm::radians(m_rotation)), m_scale);
+
+    std::vector<TransformHandle> nodes;
+    nodes.reserve(m_nodes.size());
+    for (const Node& node : m_nodes)
+    {
+        TransformHandle parent = node.parent == UINT32_MAX ? m_node : nodes[node.parent];
+        nodes.push_back(hierarchy.Create(parent, node.position, node.rotation, node.scale));
+    }
+
+    for (size_t i = 0; i < m_meshes.size(); ++i)
+    {
+        TransformHandle node = i < m_meshNodes.size() ? nodes[m_meshNodes[i]] : m_node;
+        SceneHandle entity = m_scene->Create(&m_meshes[i], GetMaterialId(m_meshes[i].GetMaterialIndex()), node,
+            m_meshes[i].GetBounds(), getSceneFlags());
+        m_entities.push_back(entity);
+    }
+}
+
+void Object::RemoveFromScene()
+{
+    if (!m_scene) return;
+
+    for (SceneHandle entity : m_entities)
+    {
+        m_scene->Destroy(entity);
+    }
+
+    // Takes the model's nodes with it
+    m_scene->GetHierarchy().Destroy(m_node);
+
+    m_entities.clear();
+    m_node = TransformHandle();
+    m_scene = nullptr;
+}
+
+bool Object::HasEntity(SceneHandle entity)
+{
+    for (SceneHandle own : m_entities)
+    {
+        if (own.slot == entity.slot && own.generation == entity.generation)
+            return true;
+    }
+
+    return false;
+}
+
+bool Object::IsStatic()
+{
+    return m_static;
+}
+
+void Object::SetStatic(bool isStatic)
+{
+    m_static = isStatic;
+    for (SceneHandle entity : m_entities)
+        m_scene->SetFlags(entity, getSceneFlags());
+}
+
+bool Object::CastsShadows()
+{
+    return m_castsShadows;
+}
+
+void Object::SetCastsShadows(bool castsShadows)
+{
+    m_castsShadows = castsShadows;
+    for (SceneHandle entity : m_entities)
+        m_scene->SetFlags(entity, getSceneFlags());
+}
+
+bool Object::IsShaded()
+{
+    return m_shaded;
+}
+
+void Object::SetShaded(bool shaded)
+{
+    m_shaded = shaded;
+    for (SceneHandle entity : m_entities)
+        m_scene->SetFlags(entity, getSceneFlags());
 }
 
 uint32_t Object::GetMaterialId(uint32_t index)
@@ -130,37 +237,121 @@ uint32_t Object::GetMaterialId(uint32_t index)
     return m_materialIndices[index];
 }
 
-void Object::matrixUpdate()
+void Object::transformUpdate()
+{
+    if (!m_scene) return;
+
+    m_scene->GetHierarchy().SetLocal(m_node, m_position, glm::quat(glm::radians(m_rotation)), m_scale);
+}
+
+uint32_t Object::getSceneFlags()
 {
-    m_transform = glm::translate(glm::mat4(1.f), m_position) * glm::scale(glm::mat4(1.f), m_scale);
+    uint32_t flags = 0;
+    if (m_shaded) flags |= SCENE_FLAG_SHADED;
+    if (m_castsShadows) flags |= SCENE_FLAG_CASTS_SHADOWS;
+    if (m_static) flags |= SCENE_FLAG_STATIC;
+    return flags;
+}
+
+void Object::importModel(const std::string& modelFile, ModelData& model) const
+{
+    Assimp::Importer importer;
+
+    const aiScene* scene;
+    {
+        CPU_ZONE("Import Model");
+        scene = importer.ReadFile(modelFile, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+    }
+    if (!scene) throw std::runtime_error("Failed to load Model: " + modelFile);
+
+    for (size_t i = 0; i < scene->mNumMaterials; ++i)
+    {
+        aiMaterial* material = scene->mMaterials[i];
+
+        std::string diffuse;
+        std::string specular;
+        std::string normal;
+
+        if (material->GetTextureCount(aiTextureType_DIFFUSE))
+        {
+            aiString path;
+            if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS)
+            {
+                std::string fileName = path.data;
+                int idx = fileName.rfind("/");
+                if (idx != std::string::npos) fileName = fileName.substr(idx+1);
+                
+               diffuse = fileName;
+            }
+        }
+
+        if (material->GetTextureCount(aiTextureType_SPECULAR))
+        {
+            aiString path;
+            if (material->GetTexture(aiTextureType_SPECULAR, 0, &path) == AI_SUCCESS)
+            {
+                std::string fileName = path.data;
+                int idx = fileName.rfind("\\");
+                if (idx != std::string::npos) fileName = fileName.substr(idx+1);
+                
+                specular = fileName;
+            }
+        }
+
+        if (material->GetTextureCount(aiTextureType_NORMALS))
+        {
+            aiString path;
+            if (material->GetTexture(aiTextureType_NORMALS, 0, &path) == AI_SUCCESS)
+            {
+                std::string fileName = path.data;
+                int idx = fileName.rfind("\\");
+                if (idx != std::string::npos) fileName = fileName.substr(idx+1);
+                
+                normal = fileName;
+            }
+        }
+
+        if (!diffuse.empty() || !specular.empty() || !normal.empty())
+            model.materials.push_back({ diffuse, specular, normal });
+    }
+
+    model.meshes.reserve(scene->mNumMeshes);
+    importNode(scene->mRootNode, scene, UINT32_MAX, model);
 }
 
-std::vector<Mesh> Object::LoadNode(VkQueue transferQueue, VkCommandPool transferCommandPool, aiNode* node,
-                                   const aiScene* scene, const glm::mat4 parentTransform)
+// The node's transform is kept as a node of its own
+void Object::importNode(aiNode* node, const aiScene* scene, uint32_t parent, ModelData& model)
 {
-    glm::mat4 nodeTransform = glm::transpose(glm::make_mat4(&node->mTransformation.a1)) * parentTransform;
-    std::vector<Mesh> meshes = {};
+    aiVector3D scale;
+    aiQuaternion rotation;
+    aiVector3D position;
+    node->mTransformation.Decompose(scale, rotation, position);
+
+    uint32_t index = static_cast<uint32_t>(model.nodes.size());
+    model.nodes.push_back({ { position.x, position.y, position.z }, { rotation.w, rotation.x, rotation.y, rotation.z },
+        { scale.x, scale.y, scale.z }, parent });
     
     for (size_t i = 0; i < node->mNumMeshes; ++i)
     {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.emplace_back(LoadMesh(transferQueue, transferCommandPool, mesh, scene, nodeTransform));
+        importMesh(scene->mMeshes[node->mMeshes[i]], index, model);
     }
 
     for (size_t i = 0; i < node->mNumChildren; ++i)
     {
-        std::vector<Mesh> childMeshes = LoadNode(transferQueue, transferCommandPool, node->mChildren[i], scene, nodeTransform);
-        meshes.insert(meshes.end(), childMeshes.begin(), childMeshes.end());
+        importNode(node->mChildren[i], scene, index, model);
     }
-
-    return meshes;
 }
 
-Mesh Object::LoadMesh(VkQueue transferQueue, VkCommandPool transferCommandPool, aiMesh* mesh, const aiScene* scene,
-    const glm::mat4 parentTransform)
+void Object::importMesh(aiMesh* mesh, uint32_t node, ModelData& model)
 {
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
+    CPU_ZONE("Load Mesh");
+
+    model.meshes.emplace_back();
+    ModelData::MeshData& result = model.meshes.back();
+    result.node = node;
+
+    std::vector<Vertex>& vertices = result.vertices;
+    std::vector<uint32_t>& indices = result.indices;
 
     for (size_t i = 0; i < mesh->mNumVertices; ++i)
     {
@@ -187,8 +378,8 @@ Mesh Object::LoadMesh(VkQueue transferQueue, VkCommandPool transferCommandPool,
         }
     }
 
-    if (mesh->mMaterialIndex >= m_materialIndices.size())
-        return { m_device, m_physicalDevice, transferQueue, transferCommandPool, vertices, indices, parentTransform, 0 };
-    
-    return { m_device, m_physicalDevice, transferQueue, transferCommandPool, vertices, indices, parentTransform, mesh->mMaterialIndex };
+    result.materialIndex = mesh->mMaterialIndex < model.materials.size() ? mesh->mMaterialIndex : 0;
+
+    // Models are triangulated on import, so the indices are a triangle list
+    result.bvh = Mesh::BuildBvh(vertices, indices);
 }
@@ -4,6 +4,9 @@
 #include <assimp/scene.h>
 
 #include "Mesh.h"
+#include "Scene.h"
+
+class AssetLoader;
 
 class Object
 {
@@ -11,19 +14,39 @@ public:
     Object(const std::string& name);
     virtual ~Object();
 
-    virtual void Init(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue, VkCommandPool transferCommandPool, const std::string& modelFile);
+    virtual void Init(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue transferQueue, CommandBufferAllocator& commandAllocator, const std::string& modelFile);
+    // Imports on a loader thread and uploads through the loader, the object stays empty until IsLoaded. Once loaded
+    // it is added to the scene, if there is one.
+    virtual void Load(VkDevice device, VkPhysicalDevice physicalDevice, AssetLoader& loader, const std::string& modelFile, Scene* scene);
     virtual void Update(float deltaTime);
     virtual void Destroy();
 
     std::vector<Mesh>& GetMeshes();
+    bool IsLoaded();
 
-    const glm::mat4& GetTransform();
-
+    // Setting these only marks the object's node dirty, the scene recomputes world matrices once per frame
     const glm::vec3& GetPosition();
     void SetPosition(const glm::vec3& newPos);
-
+    // Euler angles in degrees
+    const glm::vec3& GetRotation();
+    void SetRotation(const glm::vec3& rotation);
+    const glm::vec3& GetScale();
     void SetScale(const glm::vec3& scale);
 
+    // One node for the object, one per model node below it and one entity per mesh, kept in sync with the object's
+    // transform and flags
+    void AddToScene(Scene& scene);
+    void RemoveFromScene();
+    bool HasEntity(SceneHandle entity);
+
+    bool IsStatic();
+    void SetStatic(bool isStatic);
+    bool CastsShadows();
+    void SetCastsShadows(bool castsShadows);
+    // Unshaded objects are drawn in their diffuse color only
+    bool IsShaded();
+    void SetShaded(bool shaded);
+
     std::string Name;
 
     uint32_t GetMaterialId(uint32_t index);
@@ -34,14 +57,64 @@ protected:
 
     glm::vec3 m_scale;
     glm::vec3 m_position;
-    glm::mat4 m_transform;
+    glm::vec3 m_rotation;
+
+    // The model's node tree, parents come before their children
+    struct Node
+    {
+        glm::vec3 position;
+        glm::quat rotation;
+        glm::vec3 scale;
+        uint32_t parent;
+    };
+
+    std::vector<Node> m_nodes;
+    // Node of every mesh, meshes without one hang off the object's node
+    std::vector<uint32_t> m_meshNodes;
+
+    // An imported model before anything is uploaded, can be filled on any thread
+    struct ModelData
+    {
+        struct MaterialData
+        {
+            std::string diffuse;
+            std::string specular;
+            std::string normal;
+        };
+
+        struct MeshData
+        {
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            uint32_t materialIndex;
+            uint32_t node;
+            TriangleBvh bvh;
+        };
+
+        std::vector<MaterialData> materials;
+        std::vector<Node> nodes;
+        std::vector<MeshData> meshes;
+    };
+
+    bool m_loaded = false;
+
+    bool m_static = true;
+    bool m_castsShadows = true;
+    bool m_shaded = true;
+
+    Scene* m_scene = nullptr;
+    TransformHandle m_node;
+    std::vector<SceneHandle> m_entities;
 
-    void matrixUpdate();
+    void transformUpdate();
+    uint32_t getSceneFlags();
 
     std::vector<uint32_t> m_materialIndices;
     std::vector<Mesh> m_meshes;
 
-    std::vector<Mesh> LoadNode(VkQueue transferQueue, VkCommandPool transferCommandPool, aiNode* node, const aiScene* scene, const glm::mat4 parentTransform);
-    Mesh LoadMesh(VkQueue transferQueue, VkCommandPool transferCommandPool, aiMesh* mesh, const aiScene* scene, const glm::mat4 parentTransform);
+    // Runs on a loader thread when the object is loaded asynchronously, so it must only write to the model
+    virtual void importModel(const std::string& modelFile, ModelData& model) const;
+    static void importNode(aiNode* node, const aiScene* scene, uint32_t parent, ModelData& model);
+    static void importMesh(aiMesh* mesh, uint32_t node, ModelData& model);
     
 };
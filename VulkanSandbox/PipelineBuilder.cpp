@@ -0,0 +1,296 @@
+#include "PipelineBuilder.h"
+
+#include <stdexcept>
+
+#include "CpuProfiler.h"
+#include "Utilities.h"
+
+void PipelineBuilder::Init(VkDevice device, uint32_t threadCount)
+{
+    m_device = device;
+    m_stopping = false;
+
+    VkPipelineCacheCreateInfo cacheCreateInfo = {};
+    cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    VkResult result = vkCreatePipelineCache(m_device, &cacheCreateInfo, nullptr, &m_cache);
+    CHECK_VK_RESULT(result, "Failed to create Pipeline Cache");
+
+    if (threadCount == 0)
+    {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        m_workers.emplace_back(&PipelineBuilder::workerLoop, this, i);
+    }
+}
+
+void PipelineBuilder::Destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.clear();
+        m_stopping = true;
+    }
+    m_jobAdded.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+
+    for (const Entry& entry : m_entries)
+    {
+        if (entry.pipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(m_device, entry.pipeline, nullptr);
+    }
+    m_entries.clear();
+
+    vkDestroyPipelineCache(m_device, m_cache, nullptr);
+}
+
+PipelineBuilder::Handle PipelineBuilder::Submit(const std::string& name, const VkGraphicsPipelineCreateInfo& createInfo)
+{
+    std::unique_ptr<Job> job = copyCreateInfo(createInfo);
+    Handle handle;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        handle = static_cast<Handle>(m_entries.size());
+        m_entries.emplace_back();
+        m_entries.back().name = name;
+
+        job->handle = handle;
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobAdded.notify_one();
+
+    return handle;
+}
+
+VkPipeline PipelineBuilder::Get(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return checkEntry(m_entries[handle]);
+}
+
+void PipelineBuilder::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobDone.wait(lock, [this]() { return m_jobs.empty() && m_busyWorkers == 0; });
+}
+
+VkPipelineCache PipelineBuilder::GetCache()
+{
+    return m_cache;
+}
+
+uint32_t PipelineBuilder::GetThreadCount()
+{
+    return static_cast<uint32_t>(m_workers.size());
+}
+
+uint32_t PipelineBuilder::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<uint32_t>(m_jobs.size()) + m_busyWorkers;
+}
+
+uint32_t PipelineBuilder::GetPipelineCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<uint32_t>(m_entries.size());
+}
+
+float PipelineBuilder::GetBuildTime()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<float>(static_cast<double>(m_buildTime) / 1000000.0);
+}
+
+void PipelineBuilder::workerLoop(uint32_t index)
+{
+    CpuProfiler::SetThreadName(("Pipeline Builder " + std::to_string(index)).c_str());
+
+    while (true)
+    {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobAdded.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+            if (m_stopping) return;
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            ++m_busyWorkers;
+        }
+
+        uint64_t begin = CpuProfiler::GetTime();
+
+        // Pipeline caches are internally synchronized, every worker uses the same one
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkResult result;
+        {
+            CPU_ZONE("Build Pipeline");
+            result = vkCreateGraphicsPipelines(m_device, m_cache, 1, &job->createInfo, nullptr, &pipeline);
+        }
+
+        uint64_t end = CpuProfiler::GetTime();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            // VK_NOT_READY means still building, failures are reported with any other code
+            Entry& entry = m_entries[job->handle];
+            entry.pipeline = result == VK_SUCCESS ? pipeline : VK_NULL_HANDLE;
+            entry.result = result == VK_NOT_READY ? VK_ERROR_INITIALIZATION_FAILED : result;
+            m_buildTime += end - begin;
+            --m_busyWorkers;
+        }
+        m_jobDone.notify_all();
+    }
+}
+
+std::unique_ptr<PipelineBuilder::Job> PipelineBuilder::copyCreateInfo(const VkGraphicsPipelineCreateInfo& createInfo)
+{
+    if (createInfo.pNext) throw std::runtime_error("Pipeline Builder can't copy pNext chains");
+
+    std::unique_ptr<Job> job(new Job());
+    job->createInfo = createInfo;
+    job->createInfo.basePipelineHandle = VK_NULL_HANDLE;
+    job->createInfo.basePipelineIndex = -1;
+
+    // -- SHADER STAGES --
+
+    // Sized up front, the stages point into these
+    job->stages.assign(createInfo.pStages, createInfo.pStages + createInfo.stageCount);
+    job->entryPoints.resize(createInfo.stageCount);
+    job->specializationInfos.resize(createInfo.stageCount);
+    job->specializationEntries.resize(createInfo.stageCount);
+    job->specializationData.resize(createInfo.stageCount);
+
+    for (uint32_t i = 0; i < createInfo.stageCount; ++i)
+    {
+        VkPipelineShaderStageCreateInfo& stage = job->stages[i];
+        if (stage.pNext) throw std::runtime_error("Pipeline Builder can't copy pNext chains");
+
+        job->entryPoints[i] = stage.pName;
+        stage.pName = job->entryPoints[i].c_str();
+
+        if (stage.pSpecializationInfo)
+        {
+            const VkSpecializationInfo& specialization = *stage.pSpecializationInfo;
+            const char* data = static_cast<const char*>(specialization.pData);
+
+            job->specializationEntries[i].assign(specialization.pMapEntries, specialization.pMapEntries + specialization.mapEntryCount);
+            job->specializationData[i].assign(data, data + specialization.dataSize);
+
+            job->specializationInfos[i] = specialization;
+            job->specializationInfos[i].pMapEntries = job->specializationEntries[i].data();
+            job->specializationInfos[i].pData = job->specializationData[i].data();
+            stage.pSpecializationInfo = &job->specializationInfos[i];
+        }
+    }
+    job->createInfo.pStages = job->stages.data();
+
+    // -- FIXED FUNCTION STATE --
+
+    if (createInfo.pVertexInputState)
+    {
+        const VkPipelineVertexInputStateCreateInfo& state = *createInfo.pVertexInputState;
+        job->vertexBindings.assign(state.pVertexBindingDescriptions, state.pVertexBindingDescriptions + state.vertexBindingDescriptionCount);
+        job->vertexAttributes.assign(state.pVertexAttributeDescriptions, state.pVertexAttributeDescriptions + state.vertexAttributeDescriptionCount);
+
+        job->vertexInputState = state;
+        job->vertexInputState.pVertexBindingDescriptions = job->vertexBindings.data();
+        job->vertexInputState.pVertexAttributeDescriptions = job->vertexAttributes.data();
+        job->createInfo.pVertexInputState = &job->vertexInputState;
+    }
+
+    if (createInfo.pInputAssemblyState)
+    {
+        job->inputAssemblyState = *createInfo.pInputAssemblyState;
+        job->createInfo.pInputAssemblyState = &job->inputAssemblyState;
+    }
+
+    if (createInfo.pTessellationState)
+    {
+        job->tessellationState = *createInfo.pTessellationState;
+        job->createInfo.pTessellationState = &job->tessellationState;
+    }
+
+    if (createInfo.pViewportState)
+    {
+        const VkPipelineViewportStateCreateInfo& state = *createInfo.pViewportState;
+        if (state.pViewports) job->viewports.assign(state.pViewports, state.pViewports + state.viewportCount);
+        if (state.pScissors) job->scissors.assign(state.pScissors, state.pScissors + state.scissorCount);
+
+        // Dynamic viewports and scissors leave the arrays null
+        job->viewportState = state;
+        job->viewportState.pViewports = state.pViewports ? job->viewports.data() : nullptr;
+        job->viewportState.pScissors = state.pScissors ? job->scissors.data() : nullptr;
+        job->createInfo.pViewportState = &job->viewportState;
+    }
+
+    if (createInfo.pRasterizationState)
+    {
+        job->rasterizationState = *createInfo.pRasterizationState;
+        job->createInfo.pRasterizationState = &job->rasterizationState;
+    }
+
+    if (createInfo.pMultisampleState)
+    {
+        const VkPipelineMultisampleStateCreateInfo& state = *createInfo.pMultisampleState;
+        if (state.pSampleMask)
+        {
+            // One bit per sample, in 32 bit words
+            uint32_t wordCount = (static_cast<uint32_t>(state.rasterizationSamples) + 31) / 32;
+            job->sampleMask.assign(state.pSampleMask, state.pSampleMask + wordCount);
+        }
+
+        job->multisampleState = state;
+        job->multisampleState.pSampleMask = state.pSampleMask ? job->sampleMask.data() : nullptr;
+        job->createInfo.pMultisampleState = &job->multisampleState;
+    }
+
+    if (createInfo.pDepthStencilState)
+    {
+        job->depthStencilState = *createInfo.pDepthStencilState;
+        job->createInfo.pDepthStencilState = &job->depthStencilState;
+    }
+
+    if (createInfo.pColorBlendState)
+    {
+        const VkPipelineColorBlendStateCreateInfo& state = *createInfo.pColorBlendState;
+        job->blendAttachments.assign(state.pAttachments, state.pAttachments + state.attachmentCount);
+
+        job->colorBlendState = state;
+        job->colorBlendState.pAttachments = job->blendAttachments.data();
+        job->createInfo.pColorBlendState = &job->colorBlendState;
+    }
+
+    if (createInfo.pDynamicState)
+    {
+        const VkPipelineDynamicStateCreateInfo& state = *createInfo.pDynamicState;
+        job->dynamicStates.assign(state.pDynamicStates, state.pDynamicStates + state.dynamicStateCount);
+
+        job->dynamicState = state;
+        job->dynamicState.pDynamicStates = job->dynamicStates.data();
+        job->createInfo.pDynamicState = &job->dynamicState;
+    }
+
+    return job;
+}
+
+VkPipeline PipelineBuilder::checkEntry(const Entry& entry)
+{
+    if (entry.result != VK_SUCCESS && entry.result != VK_NOT_READY)
+        throw std::runtime_error("Failed to create Graphics Pipeline: " + entry.name);
+
+    return entry.pipeline;
+}
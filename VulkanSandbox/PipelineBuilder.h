@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// -- PIPELINE BUILDER --
+// Compiles graphics pipelines on worker threads against one shared pipeline cache. Submitting copies the create info,
+// so it doesn't have to outlive the call, and returns a handle that can be polled while recording. The builder owns
+// every pipeline it built until it is destroyed.
+class PipelineBuilder
+{
+public:
+    typedef uint32_t Handle;
+
+    // threadCount 0 uses every hardware thread but one
+    void Init(VkDevice device, uint32_t threadCount = 0);
+    // Drops what hasn't started yet, waits for the rest and destroys every pipeline
+    void Destroy();
+
+    // pNext chains aren't copied and must be null
+    Handle Submit(const std::string& name, const VkGraphicsPipelineCreateInfo& createInfo);
+
+    // VK_NULL_HANDLE until the pipeline is built, throws if building it failed
+    VkPipeline Get(Handle handle);
+    // Blocks until nothing is queued or building, needed before anything a submitted pipeline uses is destroyed
+    void WaitIdle();
+
+    VkPipelineCache GetCache();
+    uint32_t GetThreadCount();
+    uint32_t GetPendingCount();
+    uint32_t GetPipelineCount();
+    float GetBuildTime();           // ms all built pipelines took together, summed over the workers
+
+private:
+    // Create info with copies of everything it points to
+    struct Job
+    {
+        Handle handle;
+        VkGraphicsPipelineCreateInfo createInfo;
+
+        std::vector<VkPipelineShaderStageCreateInfo> stages;
+        std::vector<std::string> entryPoints;
+        std::vector<VkSpecializationInfo> specializationInfos;
+        std::vector<std::vector<VkSpecializationMapEntry>> specializationEntries;
+        std::vector<std::vector<char>> specializationData;
+
+        VkPipelineVertexInputStateCreateInfo vertexInputState;
+        std::vector<VkVertexInputBindingDescription> vertexBindings;
+        std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+        VkPipelineTessellationStateCreateInfo tessellationState;
+        VkPipelineViewportStateCreateInfo viewportState;
+        std::vector<VkViewport> viewports;
+        std::vector<VkRect2D> scissors;
+        VkPipelineRasterizationStateCreateInfo rasterizationState;
+        VkPipelineMultisampleStateCreateInfo multisampleState;
+        std::vector<VkSampleMask> sampleMask;
+        VkPipelineDepthStencilStateCreateInfo depthStencilState;
+        VkPipelineColorBlendStateCreateInfo colorBlendState;
+        std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+        VkPipelineDynamicStateCreateInfo dynamicState;
+        std::vector<VkDynamicState> dynamicStates;
+    };
+
+    struct Entry
+    {
+        std::string name;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkResult result = VK_NOT_READY;
+    };
+
+    VkDevice m_device;
+    VkPipelineCache m_cache;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_jobAdded;
+    std::condition_variable m_jobDone;
+    std::deque<std::unique_ptr<Job>> m_jobs;
+    std::deque<Entry> m_entries;        // Indexed by handle, a deque so entries never move
+    uint32_t m_busyWorkers = 0;
+    uint64_t m_buildTime = 0;           // ns
+    bool m_stopping = false;
+
+    void workerLoop(uint32_t index);
+    static std::unique_ptr<Job> copyCreateInfo(const VkGraphicsPipelineCreateInfo& createInfo);
+    VkPipeline checkEntry(const Entry& entry);
+
+};
@@ -0,0 +1,119 @@
+#include "PngWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+    // Deflate stored blocks hold at most this many bytes
+    const uint32_t STORED_BLOCK_SIZE = 65535;
+
+    uint32_t crc(const uint8_t* data, size_t size, uint32_t value = 0xFFFFFFFF)
+    {
+        static const std::array<uint32_t, 256> table = []()
+        {
+            std::array<uint32_t, 256> entries;
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                entries[i] = c;
+            }
+            return entries;
+        }();
+
+        for (size_t i = 0; i < size; ++i)
+            value = table[(value ^ data[i]) & 0xFF] ^ (value >> 8);
+        return value;
+    }
+
+    void appendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+    {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    void writeChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data)
+    {
+        std::vector<uint8_t> chunk;
+        chunk.reserve(data.size() + 12);
+        appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+
+        // Covers the type and the data, not the length
+        appendBigEndian(chunk, crc(chunk.data() + 4, chunk.size() - 4) ^ 0xFFFFFFFF);
+
+        file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+    }
+}
+
+bool PngWriter::Write(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba, uint32_t rowPitch)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.push_back(8);    // Bits per channel
+    header.push_back(6);    // RGBA
+    header.push_back(0);    // Deflate
+    header.push_back(0);    // Adaptive filtering
+    header.push_back(0);    // Not interlaced
+    writeChunk(file, "IHDR", header);
+
+    // Every row starts with its filter type, 0 leaves it unfiltered
+    uint32_t rowSize = width * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * rowPitch, rgba + y * rowPitch + rowSize);
+    }
+
+    // zlib stream of stored deflate blocks followed by the Adler-32 of the raw data
+    std::vector<uint8_t> compressed;
+    compressed.reserve(raw.size() + raw.size() / STORED_BLOCK_SIZE * 5 + 16);
+    compressed.push_back(0x78);
+    compressed.push_back(0x01);
+
+    size_t offset = 0;
+    do
+    {
+        uint32_t blockSize = static_cast<uint32_t>(std::min<size_t>(raw.size() - offset, STORED_BLOCK_SIZE));
+        bool last = offset + blockSize == raw.size();
+
+        compressed.push_back(last ? 1 : 0);
+        compressed.push_back(static_cast<uint8_t>(blockSize));
+        compressed.push_back(static_cast<uint8_t>(blockSize >> 8));
+        compressed.push_back(static_cast<uint8_t>(~blockSize));
+        compressed.push_back(static_cast<uint8_t>(~blockSize >> 8));
+        compressed.insert(compressed.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+
+        offset += blockSize;
+    } while (offset < raw.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint8_t value : raw)
+    {
+        a = (a + value) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(compressed, (b << 16) | a);
+
+    writeChunk(file, "IDAT", compressed);
+    writeChunk(file, "IEND", {});
+
+    return file.good();
+}
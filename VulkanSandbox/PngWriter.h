@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Writes 8 bit RGBA images as PNG. The image data is stored without compression, which keeps this free of a zlib
+// dependency at the cost of file size.
+namespace PngWriter
+{
+	// rowPitch is the distance between rows in bytes
+	bool Write(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba, uint32_t rowPitch);
+}
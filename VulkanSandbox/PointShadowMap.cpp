@@ -0,0 +1,641 @@
+#include "PointShadowMap.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "GpuProfiler.h"
+#include "Mesh.h"
+#include "RenderStats.h"
+#include "Scene.h"
+#include "ShaderLibrary.h"
+
+// Look direction and up vector of every cube face
+static const std::array<glm::vec3, 6> faceDirections =
+{
+    glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.f, 0.f),
+    glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, -1.f, 0.f),
+    glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f)
+};
+
+static const std::array<glm::vec3, 6> faceUps =
+{
+    glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f),
+    glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f),
+    glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f)
+};
+
+PointShadowMap::PointShadowMap()
+{
+}
+
+bool PointShadowMap::IsMultiviewSupported(VkPhysicalDevice physicalDevice)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+    bool hasExtension = false;
+    for (const VkExtensionProperties& extension : extensions)
+    {
+        if (strcmp(extension.extensionName, VK_KHR_MULTIVIEW_EXTENSION_NAME) == 0)
+            hasExtension = true;
+    }
+    if (!hasExtension) return false;
+
+    VkPhysicalDeviceMultiviewFeatures multiviewFeatures = {};
+    multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &multiviewFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    return multiviewFeatures.multiview == VK_TRUE;
+}
+
+void PointShadowMap::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount, uint32_t faceSize,
+    PipelineBuilder* pipelineBuilder)
+{
+    m_device = device;
+    m_pipelineBuilder = pipelineBuilder;
+    m_physicalDevice = physicalDevice;
+    m_frameCount = frameCount;
+    m_faceExtent.width = faceSize;
+    m_faceExtent.height = faceSize;
+    m_shadowFormat = chooseShadowMapFormat(physicalDevice);
+    m_multiviewSupported = IsMultiviewSupported(physicalDevice);
+    m_multiviewEnabled = m_multiviewSupported;
+
+    for (uint32_t light = 0; light < MAX_POINT_LIGHTS; ++light)
+        m_zoneNames.push_back("Light " + std::to_string(light));
+
+    m_lightData = {};
+
+    createShadowMapImageAndSampler();
+    createDescriptorSets();
+    createRenderPasses();
+    createFramebuffers();
+    createPipelines();
+}
+
+void PointShadowMap::Destroy()
+{
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+
+    for (size_t i = 0; i < m_lightFramebuffers.size(); ++i)
+    {
+        vkDestroyFramebuffer(m_device, m_lightFramebuffers[i], nullptr);
+    }
+
+    for (size_t i = 0; i < m_lightViews.size(); ++i)
+    {
+        vkDestroyImageView(m_device, m_lightViews[i], nullptr);
+    }
+
+    for (size_t i = 0; i < m_faceFramebuffers.size(); ++i)
+    {
+        vkDestroyFramebuffer(m_device, m_faceFramebuffers[i], nullptr);
+        vkDestroyImageView(m_device, m_faceViews[i], nullptr);
+    }
+
+    vkDestroyRenderPass(m_device, m_multiviewRenderPass, nullptr);
+    vkDestroyRenderPass(m_device, m_faceRenderPass, nullptr);
+
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+
+    for (size_t i = 0; i < m_lightBuffers.size(); ++i)
+    {
+        m_lightBuffers[i].Destroy(m_device);
+    }
+
+    vkDestroySampler(m_device, m_shadowMapSampler, nullptr);
+    m_shadowMapImage.Destroy(m_device);
+}
+
+void PointShadowMap::Update(uint32_t frameIndex, const std::vector<PointLight>& lights)
+{
+    m_lightData.count = static_cast<uint32_t>(std::min<size_t>(lights.size(), MAX_POINT_LIGHTS));
+
+    for (uint32_t i = 0; i < m_lightData.count; ++i)
+    {
+        const PointLight& light = lights[i];
+        glm::mat4 projection = glm::perspectiveZO(glm::radians(90.f), 1.f, 0.1f, light.range);
+
+        GpuPointLight& gpuLight = m_lightData.lights[i];
+        gpuLight.positionStrength = glm::vec4(light.position, light.strength);
+        gpuLight.range = glm::vec4(light.range, 0.f, 0.f, 0.f);
+
+        for (uint32_t face = 0; face < 6; ++face)
+        {
+            gpuLight.faceViewProjection[face] = projection *
+                glm::lookAt(light.position, light.position + faceDirections[face], faceUps[face]);
+        }
+    }
+
+    void* data;
+    vkMapMemory(m_device, m_lightBuffers[frameIndex].GetMemory(), 0, sizeof(PointLightBuffer), 0, &data);
+    memcpy(data, &m_lightData, sizeof(PointLightBuffer));
+    vkUnmapMemory(m_device, m_lightBuffers[frameIndex].GetMemory());
+}
+
+void PointShadowMap::RecordCommands(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene& scene, GpuProfiler* profiler)
+{
+    // Layers of lights that were never rendered are still sampled through the array view
+    if (!m_layoutsInitialized)
+    {
+        VkImageMemoryBarrier imageMemoryBarrier = {};
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageMemoryBarrier.image = m_shadowMapImage.GetImage();
+        imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+        imageMemoryBarrier.subresourceRange.levelCount = 1;
+        imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+        imageMemoryBarrier.subresourceRange.layerCount = m_shadowMapImage.GetArrayLayers();
+        imageMemoryBarrier.srcAccessMask = 0;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+        m_layoutsInitialized = true;
+    }
+
+    m_casterCount = 0;
+
+    // Until the pipeline is built the faces are only cleared
+    VkPipeline pipeline = m_pipelineBuilder->Get(m_multiviewEnabled ? m_multiviewPipeline : m_facePipeline);
+
+    const std::vector<BoundingBox>& bounds = scene.GetBounds();
+    const std::vector<uint32_t>& flags = scene.GetFlags();
+
+    for (uint32_t light = 0; light < m_lightData.count; ++light)
+    {
+        glm::vec3 position = glm::vec3(m_lightData.lights[light].positionStrength);
+        float range = m_lightData.lights[light].range.x;
+
+        m_casters.clear();
+        for (uint32_t i = 0; i < scene.GetCount(); ++i)
+        {
+            if ((flags[i] & SCENE_FLAG_CASTS_SHADOWS) && bounds[i].IntersectsSphere(position, range))
+                m_casters.push_back(i);
+        }
+        m_casterCount += static_cast<uint32_t>(m_casters.size());
+
+        if (profiler) profiler->BeginZone(commandBuffer, m_zoneNames[light]);
+
+        if (m_multiviewEnabled)
+        {
+            recordPass(commandBuffer, frameIndex, scene, m_multiviewRenderPass, m_lightFramebuffers[light],
+                pipeline, light * 6);
+        }
+        else
+        {
+            for (uint32_t face = 0; face < 6; ++face)
+            {
+                recordPass(commandBuffer, frameIndex, scene, m_faceRenderPass, m_faceFramebuffers[light * 6 + face],
+                    pipeline, light * 6 + face);
+            }
+        }
+
+        if (profiler) profiler->EndZone(commandBuffer);
+    }
+}
+
+void PointShadowMap::SetMultiviewEnabled(bool enabled)
+{
+    m_multiviewEnabled = enabled && m_multiviewSupported;
+}
+
+bool PointShadowMap::GetMultiviewEnabled()
+{
+    return m_multiviewEnabled;
+}
+
+bool PointShadowMap::GetMultiviewSupported()
+{
+    return m_multiviewSupported;
+}
+
+VkDescriptorSetLayout PointShadowMap::GetDescriptorSetLayout()
+{
+    return m_setLayout;
+}
+
+VkDescriptorSet PointShadowMap::GetDescriptorSet(uint32_t frameIndex)
+{
+    return m_descriptorSets[frameIndex];
+}
+
+uint32_t PointShadowMap::GetCasterCount()
+{
+    return m_casterCount;
+}
+
+void PointShadowMap::recordPass(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene& scene, VkRenderPass renderPass,
+    VkFramebuffer framebuffer, VkPipeline pipeline, uint32_t layer)
+{
+    std::array<VkClearValue, 1> clearValues = {};
+    clearValues[0].depthStencil.depth = 1.f;
+    clearValues[0].depthStencil.stencil = 0;
+
+    VkRenderPassBeginInfo renderPassBeginInfo = {};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = renderPass;
+    renderPassBeginInfo.renderArea.offset = { 0, 0 };
+    renderPassBeginInfo.renderArea.extent = m_faceExtent;
+    renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassBeginInfo.pClearValues = clearValues.data();
+    renderPassBeginInfo.framebuffer = framebuffer;
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if (pipeline != VK_NULL_HANDLE)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        RenderStats::CountPipelineBind();
+
+        VkDescriptorSet descriptorSet = m_descriptorSets[frameIndex];
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout,
+            0, 1, &descriptorSet, 0, nullptr);
+        RenderStats::CountDescriptorBinds(1);
+
+        const std::vector<glm::mat4>& transforms = scene.GetTransforms();
+        const std::vector<Mesh*>& meshes = scene.GetMeshes();
+
+        for (uint32_t caster : m_casters)
+        {
+            Mesh* mesh = meshes[caster];
+
+            VkBuffer vertexBuffers[] = { mesh->GetVertexBuffer()->GetBuffer() };
+            VkDeviceSize offsets[] = { 0 };
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+            RenderStats::CountVertexBufferBind();
+
+            PushShadow pushShadow = {};
+            pushShadow.model = transforms[caster];
+            pushShadow.layer = layer;
+            vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushShadow), &pushShadow);
+            RenderStats::CountPushConstants();
+
+            if (mesh->Indexed())
+            {
+                vkCmdBindIndexBuffer(commandBuffer, mesh->GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexed(commandBuffer, mesh->GetIndexCount(), 1, 0, 0, 0);
+                RenderStats::CountDraw(mesh->GetIndexCount());
+            }
+            else
+            {
+                vkCmdDraw(commandBuffer, mesh->GetVertexCount(), 1, 0, 0);
+                RenderStats::CountDraw(mesh->GetVertexCount());
+            }
+        }
+    }
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+void PointShadowMap::createShadowMapImageAndSampler()
+{
+    m_shadowMapImage.Init(m_device, m_physicalDevice, m_faceExtent.width, m_faceExtent.height, m_shadowFormat,
+        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_IMAGE_ASPECT_DEPTH_BIT, MAX_POINT_LIGHTS * 6);
+
+    m_lightViews.resize(MAX_POINT_LIGHTS);
+    m_faceViews.resize(MAX_POINT_LIGHTS * 6);
+
+    for (uint32_t light = 0; light < MAX_POINT_LIGHTS; ++light)
+    {
+        m_lightViews[light] = Image::CreateImageView(m_device, m_shadowMapImage.GetImage(), m_shadowFormat,
+            VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, light * 6, 6);
+
+        for (uint32_t face = 0; face < 6; ++face)
+        {
+            m_faceViews[light * 6 + face] = Image::CreateImageView(m_device, m_shadowMapImage.GetImage(), m_shadowFormat,
+                VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_VIEW_TYPE_2D, light * 6 + face, 1);
+        }
+    }
+
+    VkSamplerCreateInfo samplerCreateInfo = {};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCreateInfo.mipLodBias = 0.f;
+    samplerCreateInfo.minLod = 0.f;
+    samplerCreateInfo.maxLod = 0.f;
+    samplerCreateInfo.anisotropyEnable = VK_FALSE;
+    samplerCreateInfo.compareEnable = VK_TRUE;
+    samplerCreateInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+    VkResult result = vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_shadowMapSampler);
+    CHECK_VK_RESULT(result, "Failed to create Point Shadow Map Sampler");
+}
+
+void PointShadowMap::createDescriptorSets()
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings = {};
+
+    layoutBindings[0].binding = 0;
+    layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    layoutBindings[0].descriptorCount = 1;
+    layoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutBindings[0].pImmutableSamplers = nullptr;
+
+    layoutBindings[1].binding = 1;
+    layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    layoutBindings[1].descriptorCount = 1;
+    layoutBindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutBindings[1].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+    layoutCreateInfo.pBindings = layoutBindings.data();
+
+    VkResult result = vkCreateDescriptorSetLayout(m_device, &layoutCreateInfo, nullptr, &m_setLayout);
+    CHECK_VK_RESULT(result, "Failed to create Descriptor Set Layout");
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = m_frameCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = m_frameCount;
+
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = m_frameCount;
+    poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolCreateInfo.pPoolSizes = poolSizes.data();
+
+    result = vkCreateDescriptorPool(m_device, &poolCreateInfo, nullptr, &m_descriptorPool);
+    CHECK_VK_RESULT(result, "Failed to create Descriptor Pool");
+
+    m_descriptorSets.resize(m_frameCount);
+    std::vector<VkDescriptorSetLayout> layouts(m_frameCount, m_setLayout);
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {};
+    descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocInfo.descriptorPool = m_descriptorPool;
+    descriptorSetAllocInfo.descriptorSetCount = m_frameCount;
+    descriptorSetAllocInfo.pSetLayouts = layouts.data();
+
+    result = vkAllocateDescriptorSets(m_device, &descriptorSetAllocInfo, m_descriptorSets.data());
+    CHECK_VK_RESULT(result, "Failed to allocate Descriptor Set for Point Shadow Maps");
+
+    m_lightBuffers.resize(m_frameCount);
+
+    for (uint32_t i = 0; i < m_frameCount; ++i)
+    {
+        m_lightBuffers[i].Init(m_device, m_physicalDevice, sizeof(PointLightBuffer), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = m_shadowMapImage.GetImageView();
+        imageInfo.sampler = m_shadowMapSampler;
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = m_lightBuffers[i].GetBuffer();
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(PointLightBuffer);
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = m_descriptorSets[i];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pImageInfo = &imageInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = m_descriptorSets[i];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+void PointShadowMap::createRenderPasses()
+{
+    // All six views of a light land in the six layers of its framebuffer
+    if (m_multiviewSupported) m_multiviewRenderPass = createRenderPass(0x3F);
+    m_faceRenderPass = createRenderPass(0);
+}
+
+VkRenderPass PointShadowMap::createRenderPass(uint32_t viewMask)
+{
+    VkAttachmentDescription depthAttachment = {};
+    depthAttachment.format = m_shadowFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef;
+    depthAttachmentRef.attachment = 0;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 0;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    std::array<VkSubpassDependency, 2> dependencies{};
+
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassMultiviewCreateInfo multiviewCreateInfo = {};
+    multiviewCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+    multiviewCreateInfo.subpassCount = 1;
+    multiviewCreateInfo.pViewMasks = &viewMask;
+
+    VkRenderPassCreateInfo renderPassCreateInfo = {};
+    renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassCreateInfo.pNext = viewMask != 0 ? &multiviewCreateInfo : nullptr;
+    renderPassCreateInfo.attachmentCount = 1;
+    renderPassCreateInfo.pAttachments = &depthAttachment;
+    renderPassCreateInfo.subpassCount = 1;
+    renderPassCreateInfo.pSubpasses = &subpass;
+    renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassCreateInfo.pDependencies = dependencies.data();
+
+    VkRenderPass renderPass;
+    VkResult result = vkCreateRenderPass(m_device, &renderPassCreateInfo, nullptr, &renderPass);
+    CHECK_VK_RESULT(result, "Failed to create Render Pass");
+    return renderPass;
+}
+
+void PointShadowMap::createFramebuffers()
+{
+    m_lightFramebuffers.resize(m_multiviewSupported ? m_lightViews.size() : 0);
+    m_faceFramebuffers.resize(m_faceViews.size());
+
+    // Multiview framebuffers have a single layer, the views pick the image layers
+    for (size_t i = 0; i < m_lightFramebuffers.size(); ++i)
+    {
+        VkFramebufferCreateInfo frameBufferCreateInfo = {};
+        frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        frameBufferCreateInfo.renderPass = m_multiviewRenderPass;
+        frameBufferCreateInfo.width = m_faceExtent.width;
+        frameBufferCreateInfo.height = m_faceExtent.height;
+        frameBufferCreateInfo.attachmentCount = 1;
+        frameBufferCreateInfo.pAttachments = &m_lightViews[i];
+        frameBufferCreateInfo.layers = 1;
+
+        VkResult result = vkCreateFramebuffer(m_device, &frameBufferCreateInfo, nullptr, &m_lightFramebuffers[i]);
+        CHECK_VK_RESULT(result, "Failed to create Framebuffer");
+    }
+
+    for (size_t i = 0; i < m_faceFramebuffers.size(); ++i)
+    {
+        VkFramebufferCreateInfo frameBufferCreateInfo = {};
+        frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        frameBufferCreateInfo.renderPass = m_faceRenderPass;
+        frameBufferCreateInfo.width = m_faceExtent.width;
+        frameBufferCreateInfo.height = m_faceExtent.height;
+        frameBufferCreateInfo.attachmentCount = 1;
+        frameBufferCreateInfo.pAttachments = &m_faceViews[i];
+        frameBufferCreateInfo.layers = 1;
+
+        VkResult result = vkCreateFramebuffer(m_device, &frameBufferCreateInfo, nullptr, &m_faceFramebuffers[i]);
+        CHECK_VK_RESULT(result, "Failed to create Framebuffer");
+    }
+}
+
+void PointShadowMap::createPipelines()
+{
+    VkPushConstantRange worldPushConstantRange = {};
+    worldPushConstantRange.size = sizeof(PushShadow);
+    worldPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    worldPushConstantRange.offset = 0;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &worldPushConstantRange;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &m_setLayout;
+
+    VkResult result = vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
+    CHECK_VK_RESULT(result, "Failed to create Pipeline Layout");
+
+    if (m_multiviewSupported)
+        m_multiviewPipeline = createPipeline("Point Shadow Multiview", "pointShadowMultiview.vert.spv", m_multiviewRenderPass);
+    m_facePipeline = createPipeline("Point Shadow Face", "pointShadow.vert.spv", m_faceRenderPass);
+}
+
+PipelineBuilder::Handle PointShadowMap::createPipeline(const std::string& name, const std::string& shader,
+    VkRenderPass renderPass)
+{
+    // Both are built from pointShadow.vert, only the multiview one reads gl_ViewIndex and needs the feature
+    VkPipelineShaderStageCreateInfo shaderStages[] = { ShaderLibrary::GetStage(shader) };
+
+    auto vertexBindingDescription = Vertex::getBindingDescription();
+    auto vertexAttributeDescriptions = Vertex::getAttributeDescriptions();
+
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {};
+    vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+    vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexBindingDescription;
+    vertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributeDescriptions.size());
+    vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescriptions.data();
+
+    // -- INPUT ASSEMBLER --
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStageCreateInfo = {};
+    inputAssemblyStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyStageCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyStageCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+    // -- VIEWPORT & SCISSOR --
+
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = defaultViewport(m_faceExtent);
+
+    // -- RASTERIZER --
+
+    // The faces look out of the light, culling back faces would need the winding flipped per face
+    VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo =
+        defaultRasterizerCreateInfo(VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_TRUE);
+    rasterizerCreateInfo.depthBiasConstantFactor = 1.25f;
+    rasterizerCreateInfo.depthBiasSlopeFactor = 1.75f;
+
+    // -- MULTISAMPLING --
+
+    VkPipelineMultisampleStateCreateInfo multisampleCreateInfo = {};
+    multisampleCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleCreateInfo.sampleShadingEnable = VK_FALSE;
+    multisampleCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    // -- BLENDING --
+
+    VkPipelineColorBlendStateCreateInfo colorBlendCreateInfo = {};
+    colorBlendCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendCreateInfo.logicOpEnable = VK_FALSE;
+    colorBlendCreateInfo.attachmentCount = 0;
+
+    // -- DEPTH STENCIL TESTING --
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {};
+    depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencilStateCreateInfo.depthBoundsTestEnable = VK_FALSE;
+    depthStencilStateCreateInfo.stencilTestEnable = VK_FALSE;
+
+    // -- PIPELINE CREATION --
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stageCount = 1;
+    pipelineCreateInfo.pStages = shaderStages;
+    pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
+    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStageCreateInfo;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pDynamicState = nullptr;
+    pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
+    pipelineCreateInfo.layout = m_pipelineLayout;
+    pipelineCreateInfo.renderPass = renderPass;
+    pipelineCreateInfo.subpass = 0;
+    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCreateInfo.basePipelineIndex = -1;
+
+    return m_pipelineBuilder->Submit(name, pipelineCreateInfo);
+}
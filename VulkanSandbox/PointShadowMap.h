@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+
+#include "Frustum.h"
+#include "Image.h"
+#include "Lights.h"
+#include "PipelineBuilder.h"
+#include "Buffer.h"
+
+class GpuProfiler;
+class Scene;
+
+// -- POINT LIGHT SHADOWS --
+// Every point light owns six consecutive layers of one depth image array, one per cube face. With multiview
+// all six faces are rendered by a single render pass per light, otherwise every face gets its own pass.
+// Devices without multiview only get the per face passes. Casters are culled once per light against its range
+// and the list is shared by all faces.
+class PointShadowMap
+{
+public:
+    PointShadowMap();
+
+    // The multiview feature has to be enabled on the device if it is supported
+    static bool IsMultiviewSupported(VkPhysicalDevice physicalDevice);
+
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount, uint32_t faceSize,
+              PipelineBuilder* pipelineBuilder);
+    void Destroy();
+
+    // Builds the face matrices and uploads the light buffer of this frame
+    void Update(uint32_t frameIndex, const std::vector<PointLight>& lights);
+    // Every light gets its own profiler zone if a profiler is given
+    void RecordCommands(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene& scene, GpuProfiler* profiler = nullptr);
+
+    // Stays disabled if the device doesn't support multiview
+    void SetMultiviewEnabled(bool enabled);
+    bool GetMultiviewEnabled();
+    bool GetMultiviewSupported();
+
+    // Shadow maps and light buffer, used by the main pass
+    VkDescriptorSetLayout GetDescriptorSetLayout();
+    VkDescriptorSet GetDescriptorSet(uint32_t frameIndex);
+
+    uint32_t GetCasterCount();      // Casters drawn over all lights in the last recording
+
+private:
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    uint32_t m_frameCount;
+    VkExtent2D m_faceExtent;
+    VkFormat m_shadowFormat;
+    bool m_multiviewSupported = false;
+    bool m_multiviewEnabled = false;
+    std::vector<std::string> m_zoneNames;
+
+    Image m_shadowMapImage;                             // 6 * MAX_POINT_LIGHTS layers
+    VkSampler m_shadowMapSampler;
+    std::vector<VkImageView> m_lightViews;              // Six layers each, one per light
+    std::vector<VkImageView> m_faceViews;               // light * 6 + face
+
+    // Multiview: one pass per light
+    VkRenderPass m_multiviewRenderPass = VK_NULL_HANDLE;
+    std::vector<VkFramebuffer> m_lightFramebuffers;
+    PipelineBuilder::Handle m_multiviewPipeline;
+
+    // Fallback: one pass per face
+    VkRenderPass m_faceRenderPass;
+    std::vector<VkFramebuffer> m_faceFramebuffers;
+    PipelineBuilder::Handle m_facePipeline;
+
+    PipelineBuilder* m_pipelineBuilder;
+    VkPipelineLayout m_pipelineLayout;
+
+    VkDescriptorSetLayout m_setLayout;
+    VkDescriptorPool m_descriptorPool;
+    std::vector<VkDescriptorSet> m_descriptorSets;
+    std::vector<Buffer> m_lightBuffers;
+
+    PointLightBuffer m_lightData;
+    std::vector<uint32_t> m_casters;    // Scene indices, reused for every face of a light
+    uint32_t m_casterCount = 0;
+
+    bool m_layoutsInitialized = false;
+
+    void recordPass(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene& scene, VkRenderPass renderPass,
+                    VkFramebuffer framebuffer, VkPipeline pipeline, uint32_t layer);
+
+    void createShadowMapImageAndSampler();
+    void createDescriptorSets();
+    void createRenderPasses();
+    void createFramebuffers();
+    void createPipelines();
+
+    VkRenderPass createRenderPass(uint32_t viewMask);
+    PipelineBuilder::Handle createPipeline(const std::string& name, const std::string& shader, VkRenderPass renderPass);
+
+};
@@ -0,0 +1,807 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+
+#include "CpuProfiler.h"
+#include "GpuMemory.h"
+#include "Image.h"
+#include "LinearAllocator.h"
+
+RenderGraph::RenderGraph()
+{
+}
+
+void RenderGraph::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t framesInFlight, GpuProfiler* profiler)
+{
+    m_device = device;
+    m_physicalDevice = physicalDevice;
+    m_framesInFlight = framesInFlight;
+    m_profiler = profiler;
+}
+
+void RenderGraph::Destroy()
+{
+    Clear();
+}
+
+void RenderGraph::Clear()
+{
+    destroyCompiled();
+
+    m_images.clear();
+    m_passes.clear();
+}
+
+RenderGraphImage RenderGraph::CreateImage(const std::string& name, VkFormat format, VkSampleCountFlagBits samples)
+{
+    ImageResource image = {};
+    image.name = name;
+    image.format = format;
+    image.samples = samples;
+    image.imported = false;
+
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        image.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        break;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        image.aspect = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        break;
+    default:
+        image.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        break;
+    }
+
+    m_images.push_back(image);
+    return static_cast<RenderGraphImage>(m_images.size() - 1);
+}
+
+RenderGraphImage RenderGraph::ImportImage(const std::string& name, VkFormat format, const std::vector<VkImage>& images,
+                                          const std::vector<VkImageView>& views, VkImageLayout finalLayout)
+{
+    ImageResource image = {};
+    image.name = name;
+    image.format = format;
+    image.samples = VK_SAMPLE_COUNT_1_BIT;
+    image.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    image.imported = true;
+    image.finalLayout = finalLayout;
+    image.images = images;
+    image.views = views;
+
+    m_images.push_back(image);
+    return static_cast<RenderGraphImage>(m_images.size() - 1);
+}
+
+RenderGraphPass RenderGraph::AddPass(const std::string& name, RenderGraphRecordFunction record)
+{
+    Pass pass = {};
+    pass.name = name;
+    pass.record = record;
+    pass.external = false;
+    pass.renderPass = VK_NULL_HANDLE;
+
+    m_passes.push_back(pass);
+    return static_cast<RenderGraphPass>(m_passes.size() - 1);
+}
+
+RenderGraphPass RenderGraph::AddExternalPass(const std::string& name, RenderGraphRecordFunction record)
+{
+    RenderGraphPass pass = AddPass(name, record);
+    m_passes[pass].external = true;
+    return pass;
+}
+
+void RenderGraph::AddColorAttachment(RenderGraphPass pass, RenderGraphImage image, VkAttachmentLoadOp loadOp,
+                                     VkClearColorValue clearColor, RenderGraphImage resolveTarget)
+{
+    Access access = {};
+    access.image = image;
+    access.usage = Usage::Color;
+    access.loadOp = loadOp;
+    access.clearValue.color = clearColor;
+    m_passes[pass].accesses.push_back(access);
+
+    // The resolve target always directly follows its color attachment
+    if (resolveTarget != RENDER_GRAPH_NONE)
+    {
+        Access resolve = {};
+        resolve.image = resolveTarget;
+        resolve.usage = Usage::Resolve;
+        resolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        m_passes[pass].accesses.push_back(resolve);
+    }
+}
+
+void RenderGraph::SetDepthAttachment(RenderGraphPass pass, RenderGraphImage image, VkAttachmentLoadOp loadOp, float clearDepth)
+{
+    Access access = {};
+    access.image = image;
+    access.usage = Usage::Depth;
+    access.loadOp = loadOp;
+    access.clearValue.depthStencil.depth = clearDepth;
+    access.clearValue.depthStencil.stencil = 0;
+    m_passes[pass].accesses.push_back(access);
+}
+
+void RenderGraph::AddSampledImage(RenderGraphPass pass, RenderGraphImage image)
+{
+    Access access = {};
+    access.image = image;
+    access.usage = Usage::Sampled;
+    access.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    m_passes[pass].accesses.push_back(access);
+}
+
+void RenderGraph::Compile(VkExtent2D extent)
+{
+    destroyCompiled();
+    m_extent = extent;
+
+    cullPasses();
+    createImages();
+    createRenderPasses();
+    createFramebuffers();
+    createBarriers();
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t imageIndex)
+{
+    for (Pass& pass : m_passes)
+    {
+        if (pass.culled) continue;
+
+        CPU_ZONE(pass.name.c_str());
+        if (m_profiler) m_profiler->BeginZone(commandBuffer, pass.name);
+
+        recordBarriers(commandBuffer, pass.barriers, frame, imageIndex);
+
+        if (pass.external)
+        {
+            pass.record(commandBuffer, frame);
+        }
+        else
+        {
+            VkRenderPassBeginInfo renderPassBeginInfo = {};
+            renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassBeginInfo.renderPass = pass.renderPass;
+            renderPassBeginInfo.renderArea.offset = { 0, 0 };
+            renderPassBeginInfo.renderArea.extent = m_extent;
+            renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+            renderPassBeginInfo.pClearValues = pass.clearValues.data();
+            renderPassBeginInfo.framebuffer = pass.framebuffers[frame * pass.framebuffersPerFrame + imageIndex % pass.framebuffersPerFrame];
+
+            vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+            pass.record(commandBuffer, frame);
+            vkCmdEndRenderPass(commandBuffer);
+        }
+
+        if (m_profiler) m_profiler->EndZone(commandBuffer);
+    }
+
+    recordBarriers(commandBuffer, m_finalBarriers, frame, imageIndex);
+}
+
+VkRenderPass RenderGraph::GetRenderPass(RenderGraphPass pass)
+{
+    return m_passes[pass].renderPass;
+}
+
+VkImageView RenderGraph::GetImageView(RenderGraphImage image, uint32_t frame)
+{
+    return m_images[image].views[frame];
+}
+
+bool RenderGraph::IsPassCulled(RenderGraphPass pass)
+{
+    return m_passes[pass].culled;
+}
+
+uint32_t RenderGraph::GetPassCount()
+{
+    return static_cast<uint32_t>(m_passes.size());
+}
+
+uint32_t RenderGraph::GetCulledPassCount()
+{
+    return m_culledPassCount;
+}
+
+VkDeviceSize RenderGraph::GetTransientMemorySize()
+{
+    VkDeviceSize size = 0;
+    for (const MemoryBlock& block : m_memoryBlocks)
+    {
+        size += block.size;
+    }
+    return size;
+}
+
+VkDeviceSize RenderGraph::GetUnaliasedMemorySize()
+{
+    return m_unaliasedMemorySize;
+}
+
+void RenderGraph::destroyCompiled()
+{
+    for (Pass& pass : m_passes)
+    {
+        for (VkFramebuffer framebuffer : pass.framebuffers)
+        {
+            vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+        }
+        pass.framebuffers.clear();
+
+        if (pass.renderPass != VK_NULL_HANDLE)
+        {
+            vkDestroyRenderPass(m_device, pass.renderPass, nullptr);
+            pass.renderPass = VK_NULL_HANDLE;
+        }
+    }
+
+    for (ImageResource& image : m_images)
+    {
+        if (image.imported) continue;
+
+        for (size_t i = 0; i < image.images.size(); ++i)
+        {
+            vkDestroyImageView(m_device, image.views[i], nullptr);
+            vkDestroyImage(m_device, image.images[i], nullptr);
+        }
+        image.images.clear();
+        image.views.clear();
+    }
+
+    for (MemoryBlock& block : m_memoryBlocks)
+    {
+        for (VkDeviceMemory memory : block.memory)
+        {
+            GpuMemory::Free(m_device, memory);
+        }
+    }
+    m_memoryBlocks.clear();
+    m_finalBarriers.clear();
+}
+
+void RenderGraph::cullPasses()
+{
+    // Walk backwards from the imported images, a pass survives if something later reads what it writes
+    std::vector<bool> live(m_images.size(), false);
+    for (size_t i = 0; i < m_images.size(); ++i)
+    {
+        live[i] = m_images[i].imported;
+    }
+
+    m_culledPassCount = 0;
+
+    for (size_t p = m_passes.size(); p-- > 0;)
+    {
+        Pass& pass = m_passes[p];
+
+        pass.culled = !pass.external;
+        for (const Access& access : pass.accesses)
+        {
+            if (writes(access) && live[access.image])
+                pass.culled = false;
+        }
+
+        if (pass.culled)
+        {
+            ++m_culledPassCount;
+            continue;
+        }
+
+        for (const Access& access : pass.accesses)
+        {
+            if (writes(access) && !reads(access))
+                live[access.image] = false;
+        }
+        for (const Access& access : pass.accesses)
+        {
+            if (reads(access))
+                live[access.image] = true;
+        }
+    }
+}
+
+void RenderGraph::createImages()
+{
+    for (ImageResource& image : m_images)
+    {
+        image.usage = 0;
+        image.firstPass = UINT32_MAX;
+        image.lastPass = 0;
+        image.memoryBlock = UINT32_MAX;
+    }
+
+    for (uint32_t p = 0; p < m_passes.size(); ++p)
+    {
+        if (m_passes[p].culled) continue;
+
+        for (const Access& access : m_passes[p].accesses)
+        {
+            ImageResource& image = m_images[access.image];
+            image.firstPass = std::min(image.firstPass, p);
+            image.lastPass = std::max(image.lastPass, p);
+
+            switch (access.usage)
+            {
+            case Usage::Color:
+            case Usage::Resolve:
+                image.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                break;
+            case Usage::Depth:
+                image.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                break;
+            case Usage::Sampled:
+                image.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+                break;
+            }
+        }
+    }
+
+    std::vector<RenderGraphImage> transientImages;
+    std::vector<VkMemoryRequirements> memoryRequirements(m_images.size());
+
+    for (RenderGraphImage i = 0; i < m_images.size(); ++i)
+    {
+        ImageResource& image = m_images[i];
+        if (image.imported || image.firstPass == UINT32_MAX) continue;
+
+        // Never sampled, so the contents don't have to outlive the pass
+        if (!(image.usage & VK_IMAGE_USAGE_SAMPLED_BIT))
+            image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+        VkImageCreateInfo imageCreateInfo = {};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.extent.width = m_extent.width;
+        imageCreateInfo.extent.height = m_extent.height;
+        imageCreateInfo.extent.depth = 1;
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.format = image.format;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageCreateInfo.usage = image.usage;
+        imageCreateInfo.samples = image.samples;
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        image.images.resize(m_framesInFlight);
+        for (uint32_t f = 0; f < m_framesInFlight; ++f)
+        {
+            VkResult result = vkCreateImage(m_device, &imageCreateInfo, nullptr, &image.images[f]);
+            CHECK_VK_RESULT(result, "Failed to create Image");
+        }
+
+        vkGetImageMemoryRequirements(m_device, image.images[0], &memoryRequirements[i]);
+        transientImages.push_back(i);
+    }
+
+    // Biggest images first, each goes into the first block none of whose images is alive at the same time
+    std::sort(transientImages.begin(), transientImages.end(), [&](RenderGraphImage a, RenderGraphImage b)
+    {
+        return memoryRequirements[a].size > memoryRequirements[b].size;
+    });
+
+    std::vector<std::vector<RenderGraphImage>> blockImages;
+    m_unaliasedMemorySize = 0;
+
+    for (RenderGraphImage i : transientImages)
+    {
+        ImageResource& image = m_images[i];
+        const VkMemoryRequirements& requirements = memoryRequirements[i];
+        m_unaliasedMemorySize += requirements.size;
+
+        for (uint32_t b = 0; b < m_memoryBlocks.size() && image.memoryBlock == UINT32_MAX; ++b)
+        {
+            if (!(m_memoryBlocks[b].memoryTypeBits & requirements.memoryTypeBits)) continue;
+
+            bool overlaps = false;
+            for (RenderGraphImage other : blockImages[b])
+            {
+                if (image.firstPass <= m_images[other].lastPass && m_images[other].firstPass <= image.lastPass)
+                    overlaps = true;
+            }
+
+            if (!overlaps)
+                image.memoryBlock = b;
+        }
+
+        if (image.memoryBlock == UINT32_MAX)
+        {
+            MemoryBlock block = {};
+            block.memoryTypeBits = requirements.memoryTypeBits;
+            m_memoryBlocks.push_back(block);
+            blockImages.emplace_back();
+            image.memoryBlock = static_cast<uint32_t>(m_memoryBlocks.size() - 1);
+        }
+
+        MemoryBlock& block = m_memoryBlocks[image.memoryBlock];
+        block.size = std::max(block.size, requirements.size);
+        block.alignment = std::max(block.alignment, requirements.alignment);
+        block.memoryTypeBits &= requirements.memoryTypeBits;
+        blockImages[image.memoryBlock].push_back(i);
+    }
+
+    for (MemoryBlock& block : m_memoryBlocks)
+    {
+        VkMemoryAllocateInfo memoryAllocInfo = {};
+        memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memoryAllocInfo.allocationSize = block.size;
+        memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(m_physicalDevice, block.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        block.memory.resize(m_framesInFlight);
+        for (uint32_t f = 0; f < m_framesInFlight; ++f)
+        {
+            VkResult result = GpuMemory::Allocate(m_device, memoryAllocInfo, GpuMemory::Category::RenderTarget, &block.memory[f]);
+            CHECK_VK_RESULT(result, "Failed to allocate Render Graph Memory");
+        }
+    }
+
+    for (RenderGraphImage i : transientImages)
+    {
+        ImageResource& image = m_images[i];
+
+        // Sampling a combined depth stencil image only works through a single aspect
+        VkImageAspectFlags viewAspect = image.aspect;
+        if (image.usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+            viewAspect &= ~VK_IMAGE_ASPECT_STENCIL_BIT;
+
+        image.views.resize(m_framesInFlight);
+        for (uint32_t f = 0; f < m_framesInFlight; ++f)
+        {
+            vkBindImageMemory(m_device, image.images[f], m_memoryBlocks[image.memoryBlock].memory[f], 0);
+            image.views[f] = Image::CreateImageView(m_device, image.images[f], image.format, viewAspect);
+        }
+    }
+}
+
+void RenderGraph::createRenderPasses()
+{
+    for (uint32_t p = 0; p < m_passes.size(); ++p)
+    {
+        Pass& pass = m_passes[p];
+        if (pass.external) continue;
+
+        std::vector<VkAttachmentDescription> attachments;
+        std::vector<VkAttachmentReference> colorRefs;
+        std::vector<VkAttachmentReference> resolveRefs;
+        VkAttachmentReference depthRef = {};
+        bool hasResolve = false;
+        bool hasDepth = false;
+
+        pass.clearValues.clear();
+
+        for (const Access& access : pass.accesses)
+        {
+            if (access.usage == Usage::Sampled) continue;
+
+            const ImageResource& image = m_images[access.image];
+
+            // Only store what a later pass or the swapchain still needs
+            bool store = image.imported || pass.culled;
+            for (uint32_t later = p + 1; later < m_passes.size() && !store; ++later)
+            {
+                if (m_passes[later].culled) continue;
+
+                for (const Access& laterAccess : m_passes[later].accesses)
+                {
+                    if (laterAccess.image == access.image && reads(laterAccess))
+                        store = true;
+                }
+            }
+
+            VkImageLayout layout = getLayout(image, access.usage);
+
+            // Layouts are transitioned by the graph's barriers, never by the render pass
+            VkAttachmentDescription attachment = {};
+            attachment.format = image.format;
+            attachment.samples = image.samples;
+            attachment.loadOp = access.loadOp;
+            attachment.storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.initialLayout = layout;
+            attachment.finalLayout = layout;
+
+            VkAttachmentReference reference = {};
+            reference.attachment = static_cast<uint32_t>(attachments.size());
+            reference.layout = layout;
+
+            attachments.push_back(attachment);
+            pass.clearValues.push_back(access.clearValue);
+
+            switch (access.usage)
+            {
+            case Usage::Color:
+                colorRefs.push_back(reference);
+                resolveRefs.push_back({ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+                break;
+            case Usage::Resolve:
+                resolveRefs.back() = reference;
+                hasResolve = true;
+                break;
+            case Usage::Depth:
+                depthRef = reference;
+                hasDepth = true;
+                break;
+            default:
+                break;
+            }
+        }
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+        subpass.pColorAttachments = colorRefs.data();
+        subpass.pResolveAttachments = hasResolve ? resolveRefs.data() : nullptr;
+        subpass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+        VkRenderPassCreateInfo renderPassCreateInfo = {};
+        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassCreateInfo.pAttachments = attachments.data();
+        renderPassCreateInfo.subpassCount = 1;
+        renderPassCreateInfo.pSubpasses = &subpass;
+
+        VkResult result = vkCreateRenderPass(m_device, &renderPassCreateInfo, nullptr, &pass.renderPass);
+        CHECK_VK_RESULT(result, "Failed to create Render Pass");
+    }
+}
+
+void RenderGraph::createFramebuffers()
+{
+    for (Pass& pass : m_passes)
+    {
+        if (pass.external || pass.culled) continue;
+
+        // Passes touching an imported image need one framebuffer per swapchain image
+        pass.framebuffersPerFrame = 1;
+        for (const Access& access : pass.accesses)
+        {
+            if (access.usage != Usage::Sampled && m_images[access.image].imported)
+                pass.framebuffersPerFrame = static_cast<uint32_t>(m_images[access.image].views.size());
+        }
+
+        pass.framebuffers.resize(m_framesInFlight * pass.framebuffersPerFrame);
+
+        for (uint32_t f = 0; f < m_framesInFlight; ++f)
+        {
+            for (uint32_t i = 0; i < pass.framebuffersPerFrame; ++i)
+            {
+                std::vector<VkImageView> attachments;
+                for (const Access& access : pass.accesses)
+                {
+                    if (access.usage != Usage::Sampled)
+                        attachments.push_back(getImageView(access.image, f, i));
+                }
+
+                VkFramebufferCreateInfo frameBufferCreateInfo = {};
+                frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+                frameBufferCreateInfo.renderPass = pass.renderPass;
+                frameBufferCreateInfo.width = m_extent.width;
+                frameBufferCreateInfo.height = m_extent.height;
+                frameBufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+                frameBufferCreateInfo.pAttachments = attachments.data();
+                frameBufferCreateInfo.layers = 1;
+
+                VkResult result = vkCreateFramebuffer(m_device, &frameBufferCreateInfo, nullptr,
+                    &pass.framebuffers[f * pass.framebuffersPerFrame + i]);
+                CHECK_VK_RESULT(result, "Failed to create Framebuffer");
+            }
+        }
+    }
+}
+
+void RenderGraph::createBarriers()
+{
+    struct State
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags access = 0;
+        bool used = false;
+    };
+
+    // Tracked per image and per memory block, an image taking over aliased memory waits for the previous owner
+    std::vector<State> imageStates(m_images.size());
+    std::vector<State> blockStates(m_memoryBlocks.size());
+
+    const VkAccessFlags writeAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    for (Pass& pass : m_passes)
+    {
+        pass.barriers.clear();
+        if (pass.culled) continue;
+
+        for (const Access& access : pass.accesses)
+        {
+            const ImageResource& image = m_images[access.image];
+            State& state = imageStates[access.image];
+
+            Barrier barrier = {};
+            barrier.image = access.image;
+            barrier.oldLayout = state.layout;
+            barrier.newLayout = getLayout(image, access.usage);
+            barrier.srcStage = state.stages;
+            barrier.srcAccess = state.access;
+            barrier.dstStage = getStages(access.usage);
+            barrier.dstAccess = getAccessFlags(access);
+
+            bool needsBarrier = true;
+
+            if (!reads(access))
+            {
+                // Previous contents are discarded
+                barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+                if (!state.used && image.imported)
+                {
+                    // Chains with the wait on the acquire semaphore
+                    barrier.srcStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+                    barrier.srcAccess = 0;
+                }
+                else if (!state.used && !image.imported && blockStates[image.memoryBlock].used)
+                {
+                    barrier.srcStage = blockStates[image.memoryBlock].stages;
+                    barrier.srcAccess = blockStates[image.memoryBlock].access;
+                }
+            }
+            else if (state.layout == barrier.newLayout && !(state.access & writeAccess) && !writes(access))
+            {
+                needsBarrier = false;
+            }
+
+            if (barrier.srcStage == 0)
+                barrier.srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+            if (needsBarrier)
+            {
+                pass.barriers.push_back(barrier);
+                state.stages = barrier.dstStage;
+                state.access = barrier.dstAccess;
+            }
+            else
+            {
+                state.stages |= barrier.dstStage;
+                state.access |= barrier.dstAccess;
+            }
+            state.layout = barrier.newLayout;
+            state.used = true;
+
+            if (!image.imported)
+                blockStates[image.memoryBlock] = state;
+        }
+    }
+
+    for (RenderGraphImage i = 0; i < m_images.size(); ++i)
+    {
+        const ImageResource& image = m_images[i];
+        const State& state = imageStates[i];
+        if (!image.imported || !state.used || state.layout == image.finalLayout) continue;
+
+        Barrier barrier = {};
+        barrier.image = i;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = image.finalLayout;
+        barrier.srcStage = state.stages;
+        barrier.srcAccess = state.access;
+        barrier.dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        barrier.dstAccess = 0;
+        m_finalBarriers.push_back(barrier);
+    }
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers, uint32_t frame,
+                                 uint32_t imageIndex)
+{
+    if (barriers.empty()) return;
+
+    ScratchScope scratch;
+    ArenaVector<VkImageMemoryBarrier> imageMemoryBarriers(barriers.size(), scratch.GetAllocator<VkImageMemoryBarrier>());
+    VkPipelineStageFlags srcStage = 0;
+    VkPipelineStageFlags dstStage = 0;
+
+    for (size_t i = 0; i < barriers.size(); ++i)
+    {
+        const Barrier& barrier = barriers[i];
+
+        VkImageMemoryBarrier& imageMemoryBarrier = imageMemoryBarriers[i];
+        imageMemoryBarrier = {};
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = barrier.oldLayout;
+        imageMemoryBarrier.newLayout = barrier.newLayout;
+        imageMemoryBarrier.srcAccessMask = barrier.srcAccess;
+        imageMemoryBarrier.dstAccessMask = barrier.dstAccess;
+        imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageMemoryBarrier.image = getImage(barrier.image, frame, imageIndex);
+        imageMemoryBarrier.subresourceRange.aspectMask = m_images[barrier.image].aspect;
+        imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+        imageMemoryBarrier.subresourceRange.levelCount = 1;
+        imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+        imageMemoryBarrier.subresourceRange.layerCount = 1;
+
+        srcStage |= barrier.srcStage;
+        dstStage |= barrier.dstStage;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr,
+        static_cast<uint32_t>(imageMemoryBarriers.size()), imageMemoryBarriers.data());
+}
+
+VkImage RenderGraph::getImage(RenderGraphImage image, uint32_t frame, uint32_t imageIndex)
+{
+    return m_images[image].imported ? m_images[image].images[imageIndex] : m_images[image].images[frame];
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphImage image, uint32_t frame, uint32_t imageIndex)
+{
+    return m_images[image].imported ? m_images[image].views[imageIndex] : m_images[image].views[frame];
+}
+
+bool RenderGraph::writes(const Access& access)
+{
+    return access.usage != Usage::Sampled;
+}
+
+bool RenderGraph::reads(const Access& access)
+{
+    return access.usage == Usage::Sampled || access.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+}
+
+VkImageLayout RenderGraph::getLayout(const ImageResource& image, Usage usage)
+{
+    switch (usage)
+    {
+    case Usage::Color:
+    case Usage::Resolve:
+        return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    case Usage::Depth:
+        return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    case Usage::Sampled:
+        return image.aspect & VK_IMAGE_ASPECT_DEPTH_BIT ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                                        : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    return VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+VkPipelineStageFlags RenderGraph::getStages(Usage usage)
+{
+    switch (usage)
+    {
+    case Usage::Color:
+    case Usage::Resolve:
+        return VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    case Usage::Depth:
+        return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    case Usage::Sampled:
+        return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
+    return VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+}
+
+VkAccessFlags RenderGraph::getAccessFlags(const Access& access)
+{
+    switch (access.usage)
+    {
+    case Usage::Color:
+        return VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+            (access.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0);
+    case Usage::Resolve:
+        return VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    case Usage::Depth:
+        return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    case Usage::Sampled:
+        return VK_ACCESS_SHADER_READ_BIT;
+    }
+    return 0;
+}
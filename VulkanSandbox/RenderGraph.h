@@ -0,0 +1,161 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "GpuProfiler.h"
+#include "Utilities.h"
+
+typedef uint32_t RenderGraphImage;
+typedef uint32_t RenderGraphPass;
+typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t frameIndex)> RenderGraphRecordFunction;
+
+constexpr RenderGraphImage RENDER_GRAPH_NONE = UINT32_MAX;
+
+// -- RENDER GRAPH --
+// Passes declare the images they render to or sample and the graph derives everything in between: render passes,
+// framebuffers, layout transitions and barriers. Passes whose results are never used are culled. Transient images
+// exist once per frame in flight, images whose lifetimes don't overlap share the same memory.
+// External passes record their own render passes and synchronization and are never culled.
+class RenderGraph
+{
+public:
+    RenderGraph();
+
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t framesInFlight, GpuProfiler* profiler);
+    void Destroy();
+
+    // -- SETUP --
+    // Drops all passes and images, the graph has to be built and compiled again afterwards
+    void Clear();
+
+    RenderGraphImage CreateImage(const std::string& name, VkFormat format, VkSampleCountFlagBits samples);
+    // One image per swapchain image, left in finalLayout at the end of the frame
+    RenderGraphImage ImportImage(const std::string& name, VkFormat format, const std::vector<VkImage>& images,
+                                 const std::vector<VkImageView>& views, VkImageLayout finalLayout);
+
+    RenderGraphPass AddPass(const std::string& name, RenderGraphRecordFunction record);
+    RenderGraphPass AddExternalPass(const std::string& name, RenderGraphRecordFunction record);
+
+    // LOAD reads the previous contents, every other load op overwrites them
+    void AddColorAttachment(RenderGraphPass pass, RenderGraphImage image, VkAttachmentLoadOp loadOp,
+                            VkClearColorValue clearColor = {}, RenderGraphImage resolveTarget = RENDER_GRAPH_NONE);
+    void SetDepthAttachment(RenderGraphPass pass, RenderGraphImage image, VkAttachmentLoadOp loadOp, float clearDepth = 1.f);
+    void AddSampledImage(RenderGraphPass pass, RenderGraphImage image);
+
+    void Compile(VkExtent2D extent);
+    void Execute(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t imageIndex);
+
+    // Valid for culled passes too, so pipelines can always be created
+    VkRenderPass GetRenderPass(RenderGraphPass pass);
+    VkImageView GetImageView(RenderGraphImage image, uint32_t frame);
+    bool IsPassCulled(RenderGraphPass pass);
+
+    // Statistics of the last compile
+    uint32_t GetPassCount();
+    uint32_t GetCulledPassCount();
+    VkDeviceSize GetTransientMemorySize();      // Per frame in flight
+    VkDeviceSize GetUnaliasedMemorySize();      // What the transient images would need without aliasing
+
+private:
+    enum class Usage
+    {
+        Color,
+        Resolve,
+        Depth,
+        Sampled
+    };
+
+    struct Access
+    {
+        RenderGraphImage image;
+        Usage usage;
+        VkAttachmentLoadOp loadOp;
+        VkClearValue clearValue;
+    };
+
+    struct Barrier
+    {
+        RenderGraphImage image;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+        VkPipelineStageFlags srcStage;
+        VkAccessFlags srcAccess;
+        VkPipelineStageFlags dstStage;
+        VkAccessFlags dstAccess;
+    };
+
+    struct ImageResource
+    {
+        std::string name;
+        VkFormat format;
+        VkSampleCountFlagBits samples;
+        VkImageAspectFlags aspect;
+        bool imported;
+        VkImageLayout finalLayout;
+
+        std::vector<VkImage> images;            // Per frame in flight, or per swapchain image when imported
+        std::vector<VkImageView> views;
+
+        VkImageUsageFlags usage;
+        uint32_t firstPass;
+        uint32_t lastPass;
+        uint32_t memoryBlock;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        RenderGraphRecordFunction record;
+        bool external;
+        std::vector<Access> accesses;
+        bool culled;
+
+        VkRenderPass renderPass;
+        std::vector<VkFramebuffer> framebuffers;
+        uint32_t framebuffersPerFrame;
+        std::vector<VkClearValue> clearValues;
+        std::vector<Barrier> barriers;
+    };
+
+    struct MemoryBlock
+    {
+        VkDeviceSize size;
+        VkDeviceSize alignment;
+        uint32_t memoryTypeBits;
+        std::vector<VkDeviceMemory> memory;    // Per frame in flight
+    };
+
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    uint32_t m_framesInFlight;
+    GpuProfiler* m_profiler;
+    VkExtent2D m_extent;
+
+    std::vector<ImageResource> m_images;
+    std::vector<Pass> m_passes;
+    std::vector<MemoryBlock> m_memoryBlocks;
+    std::vector<Barrier> m_finalBarriers;
+
+    uint32_t m_culledPassCount = 0;
+    VkDeviceSize m_unaliasedMemorySize = 0;
+
+    void destroyCompiled();
+    void cullPasses();
+    void createImages();
+    void createRenderPasses();
+    void createFramebuffers();
+    void createBarriers();
+
+    void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers, uint32_t frame, uint32_t imageIndex);
+    VkImage getImage(RenderGraphImage image, uint32_t frame, uint32_t imageIndex);
+    VkImageView getImageView(RenderGraphImage image, uint32_t frame, uint32_t imageIndex);
+
+    static bool writes(const Access& access);
+    static bool reads(const Access& access);
+    static VkImageLayout getLayout(const ImageResource& image, Usage usage);
+    static VkPipelineStageFlags getStages(Usage usage);
+    static VkAccessFlags getAccessFlags(const Access& access);
+
+};
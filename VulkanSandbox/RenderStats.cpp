@@ -0,0 +1,136 @@
+#include "RenderStats.h"
+
+namespace
+{
+    // Results are written in the order of the flag bits, which is also the order of PipelineStatistics
+    const VkQueryPipelineStatisticFlags STATISTIC_FLAGS =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    const uint32_t STATISTIC_COUNT = 5;
+
+    RenderStats::Counters recording = {};
+}
+
+bool RenderStats::IsPipelineStatisticsSupported(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+    return features.pipelineStatisticsQuery == VK_TRUE;
+}
+
+void RenderStats::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount)
+{
+    m_device = device;
+    m_supported = IsPipelineStatisticsSupported(physicalDevice);
+    if (!m_supported) return;
+
+    m_queryPools.resize(frameCount);
+    m_recorded.resize(frameCount, false);
+
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+        queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        queryPoolCreateInfo.queryCount = 1;
+        queryPoolCreateInfo.pipelineStatistics = STATISTIC_FLAGS;
+
+        VkResult result = vkCreateQueryPool(m_device, &queryPoolCreateInfo, nullptr, &m_queryPools[i]);
+        CHECK_VK_RESULT(result, "Failed to create Query Pool");
+    }
+}
+
+void RenderStats::Destroy()
+{
+    for (size_t i = 0; i < m_queryPools.size(); ++i)
+    {
+        vkDestroyQueryPool(m_device, m_queryPools[i], nullptr);
+    }
+    m_queryPools.clear();
+}
+
+void RenderStats::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    recording = {};
+
+    if (!m_supported) return;
+
+    collect(frameIndex);
+
+    m_currentFrame = frameIndex;
+    vkCmdResetQueryPool(commandBuffer, m_queryPools[frameIndex], 0, 1);
+    vkCmdBeginQuery(commandBuffer, m_queryPools[frameIndex], 0, 0);
+}
+
+void RenderStats::EndFrame(VkCommandBuffer commandBuffer)
+{
+    m_counters = recording;
+
+    if (!m_supported) return;
+
+    vkCmdEndQuery(commandBuffer, m_queryPools[m_currentFrame], 0);
+    m_recorded[m_currentFrame] = true;
+}
+
+void RenderStats::CountDraw(uint32_t vertexCount, uint32_t instanceCount)
+{
+    // Every mesh is drawn as a triangle list
+    recording.drawCalls++;
+    recording.instances += instanceCount;
+    recording.triangles += static_cast<uint64_t>(vertexCount / 3) * instanceCount;
+}
+
+void RenderStats::CountPipelineBind()
+{
+    recording.pipelineBinds++;
+}
+
+void RenderStats::CountDescriptorBinds(uint32_t setCount)
+{
+    recording.descriptorBinds += setCount;
+}
+
+void RenderStats::CountVertexBufferBind()
+{
+    recording.vertexBufferBinds++;
+}
+
+void RenderStats::CountPushConstants()
+{
+    recording.pushConstants++;
+}
+
+const RenderStats::Counters& RenderStats::GetCounters()
+{
+    return m_counters;
+}
+
+const RenderStats::PipelineStatistics& RenderStats::GetPipelineStatistics()
+{
+    return m_pipelineStatistics;
+}
+
+bool RenderStats::HasPipelineStatistics()
+{
+    return m_supported;
+}
+
+void RenderStats::collect(uint32_t frameIndex)
+{
+    if (!m_recorded[frameIndex]) return;
+
+    // Don't wait, a frame that isn't finished yet is simply skipped
+    uint64_t results[STATISTIC_COUNT];
+    VkResult result = vkGetQueryPoolResults(m_device, m_queryPools[frameIndex], 0, 1,
+        sizeof(results), results, sizeof(results), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) return;
+
+    m_pipelineStatistics.inputPrimitives = results[0];
+    m_pipelineStatistics.vertexInvocations = results[1];
+    m_pipelineStatistics.clippingInvocations = results[2];
+    m_pipelineStatistics.clippingPrimitives = results[3];
+    m_pipelineStatistics.fragmentInvocations = results[4];
+}
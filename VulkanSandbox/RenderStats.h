@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include "Utilities.h"
+
+// -- RENDER STATS --
+// Counts the commands recorded into a frame and, where the device supports pipeline statistics queries, what the GPU
+// did with them. Counters are plain statics, every pass records on the render thread, so the recording code can count
+// without being handed an object. Query results are read back the next time a frame is recorded, like the profiler's.
+class RenderStats
+{
+public:
+    struct Counters
+    {
+        uint32_t drawCalls;
+        uint32_t instances;
+        uint64_t triangles;
+        uint32_t pipelineBinds;
+        uint32_t descriptorBinds;       // Sets, not calls
+        uint32_t vertexBufferBinds;
+        uint32_t pushConstants;
+    };
+
+    struct PipelineStatistics
+    {
+        uint64_t inputPrimitives;
+        uint64_t vertexInvocations;
+        uint64_t clippingInvocations;   // Primitives that reached the clipper
+        uint64_t clippingPrimitives;    // Primitives that left it
+        uint64_t fragmentInvocations;
+    };
+
+    // The pipelineStatisticsQuery feature has to be enabled on the device for the queries to be used
+    static bool IsPipelineStatisticsSupported(VkPhysicalDevice physicalDevice);
+
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount);
+    void Destroy();
+
+    // Must be recorded outside of any render pass, the query spans every pass between the two
+    void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+    void EndFrame(VkCommandBuffer commandBuffer);
+
+    static void CountDraw(uint32_t vertexCount, uint32_t instanceCount = 1);
+    static void CountPipelineBind();
+    static void CountDescriptorBinds(uint32_t setCount);
+    static void CountVertexBufferBind();
+    static void CountPushConstants();
+
+    // Of the last recorded frame
+    const Counters& GetCounters();
+    // Of the last collected frame, all 0 without support
+    const PipelineStatistics& GetPipelineStatistics();
+    bool HasPipelineStatistics();
+
+private:
+    VkDevice m_device;
+    bool m_supported = false;
+
+    std::vector<VkQueryPool> m_queryPools;
+    std::vector<bool> m_recorded;           // Whether the frame's query was ever written
+    uint32_t m_currentFrame = 0;
+
+    Counters m_counters = {};
+    PipelineStatistics m_pipelineStatistics = {};
+
+    void collect(uint32_t frameIndex);
+
+};
@@ -0,0 +1,213 @@
+#include "Scene.h"
+
+#include <stdexcept>
+
+#include "CpuProfiler.h"
+#include "Mesh.h"
+
+Scene::Scene()
+{
+}
+
+SceneHandle Scene::Create(Mesh* mesh, uint32_t materialId, TransformHandle node,
+    const BoundingBox& localBounds, uint32_t flags)
+{
+    uint32_t slot;
+    if (!m_freeSlots.empty())
+    {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        slot = static_cast<uint32_t>(m_slots.size());
+        m_slots.push_back({ 0, 0 });
+    }
+
+    uint32_t index = static_cast<uint32_t>(m_transforms.size());
+    m_slots[slot].index = index;
+
+    m_nodes.push_back(node);
+    m_localBounds.push_back(localBounds);
+    m_transforms.push_back(glm::mat4(1.f));
+    m_bounds.push_back(localBounds);
+    m_flags.push_back(flags);
+    m_meshes.push_back(mesh);
+    m_materials.push_back(materialId);
+    m_versions.push_back(0);
+    m_slotOfIndex.push_back(slot);
+
+    m_rebuildBvh = true;
+
+    SceneHandle handle;
+    handle.slot = slot;
+    handle.generation = m_slots[slot].generation;
+    return handle;
+}
+
+void Scene::Destroy(SceneHandle handle)
+{
+    uint32_t index = getIndex(handle);
+    uint32_t last = static_cast<uint32_t>(m_transforms.size()) - 1;
+
+    // Move the last entity into the hole, every table the same way
+    if (index != last)
+    {
+        m_nodes[index] = m_nodes[last];
+        m_localBounds[index] = m_localBounds[last];
+        m_transforms[index] = m_transforms[last];
+        m_bounds[index] = m_bounds[last];
+        m_flags[index] = m_flags[last];
+        m_meshes[index] = m_meshes[last];
+        m_materials[index] = m_materials[last];
+        m_versions[index] = m_versions[last];
+        m_slotOfIndex[index] = m_slotOfIndex[last];
+
+        m_slots[m_slotOfIndex[index]].index = index;
+    }
+
+    m_nodes.pop_back();
+    m_localBounds.pop_back();
+    m_transforms.pop_back();
+    m_bounds.pop_back();
+    m_flags.pop_back();
+    m_meshes.pop_back();
+    m_materials.pop_back();
+    m_versions.pop_back();
+    m_slotOfIndex.pop_back();
+
+    // Old handles to this slot no longer match
+    ++m_slots[handle.slot].generation;
+    m_freeSlots.push_back(handle.slot);
+
+    m_rebuildBvh = true;
+}
+
+bool Scene::IsValid(SceneHandle handle)
+{
+    return handle.slot < m_slots.size() && m_slots[handle.slot].generation == handle.generation;
+}
+
+void Scene::SetFlags(SceneHandle handle, uint32_t flags)
+{
+    m_flags[getIndex(handle)] = flags;
+}
+
+void Scene::Update()
+{
+    CPU_ZONE("Scene Update");
+
+    m_hierarchy.Update();
+
+    const std::vector<glm::mat4>& worldTransforms = m_hierarchy.GetWorldTransforms();
+    const std::vector<uint8_t>& changed = m_hierarchy.GetChanged();
+
+    // Version 0 means the entity was created since the last update and hasn't been placed yet
+    bool moved = false;
+    for (uint32_t i = 0; i < GetCount(); ++i)
+    {
+        uint32_t node = m_hierarchy.GetIndex(m_nodes[i]);
+        if (!changed[node] && m_versions[i] != 0) continue;
+
+        m_transforms[i] = worldTransforms[node];
+        m_bounds[i] = m_localBounds[i].Transformed(worldTransforms[node]);
+        ++m_versions[i];
+        moved = true;
+    }
+
+    // Refitting keeps the tree usable while things move, its quality only resets with the next rebuild
+    if (m_rebuildBvh)
+        m_bvh.Build(m_bounds);
+    else if (moved)
+        m_bvh.Refit(m_bounds);
+
+    m_rebuildBvh = false;
+}
+
+TransformHierarchy& Scene::GetHierarchy()
+{
+    return m_hierarchy;
+}
+
+const Bvh& Scene::GetBvh()
+{
+    return m_bvh;
+}
+
+bool Scene::Raycast(const Ray& ray, float maxDistance, SceneHandle& entity, float& distance)
+{
+    uint32_t index;
+    bool hit = m_bvh.Raycast(ray, maxDistance, [&](uint32_t item, float& closest)
+    {
+        if (!m_meshes[item])
+        {
+            float boxDistance;
+            if (!m_bounds[item].IntersectsRay(ray, closest, boxDistance)) return false;
+            closest = boxDistance;
+            return true;
+        }
+
+        // Not normalizing the direction keeps distances the same in both spaces
+        glm::mat4 inverse = glm::inverse(m_transforms[item]);
+        Ray localRay(glm::vec3(inverse * glm::vec4(ray.origin, 1.f)), glm::vec3(inverse * glm::vec4(ray.direction, 0.f)));
+
+        float meshDistance;
+        if (!m_meshes[item]->Raycast(localRay, closest, meshDistance)) return false;
+        closest = meshDistance;
+        return true;
+    }, index, distance);
+
+    if (hit) entity = GetHandle(index);
+    return hit;
+}
+
+uint32_t Scene::GetCount()
+{
+    return static_cast<uint32_t>(m_transforms.size());
+}
+
+SceneHandle Scene::GetHandle(uint32_t index)
+{
+    SceneHandle handle;
+    handle.slot = m_slotOfIndex[index];
+    handle.generation = m_slots[handle.slot].generation;
+    return handle;
+}
+
+const std::vector<glm::mat4>& Scene::GetTransforms()
+{
+    return m_transforms;
+}
+
+const std::vector<BoundingBox>& Scene::GetBounds()
+{
+    return m_bounds;
+}
+
+const std::vector<uint32_t>& Scene::GetFlags()
+{
+    return m_flags;
+}
+
+const std::vector<Mesh*>& Scene::GetMeshes()
+{
+    return m_meshes;
+}
+
+const std::vector<uint32_t>& Scene::GetMaterials()
+{
+    return m_materials;
+}
+
+const std::vector<uint32_t>& Scene::GetVersions()
+{
+    return m_versions;
+}
+
+uint32_t Scene::getIndex(SceneHandle handle)
+{
+    if (!IsValid(handle))
+        throw std::runtime_error("Invalid Scene Handle");
+
+    return m_slots[handle.slot].index;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "Frustum.h"
+#include "TransformHierarchy.h"
+
+class Mesh;
+
+enum SceneFlags : uint32_t
+{
+    SCENE_FLAG_SHADED = 1 << 0,
+    SCENE_FLAG_CASTS_SHADOWS = 1 << 1,
+    SCENE_FLAG_STATIC = 1 << 2,
+};
+
+// Stays valid until its entity is destroyed, no matter how the tables are rearranged
+struct SceneHandle
+{
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// -- SCENE --
+// Every drawn mesh instance is an entity. Its data lives in dense structure-of-arrays tables, index i describes the
+// same entity in all of them, so passes iterate them linearly. Destroying an entity moves the last one into its
+// place, handles find their entity through a slot that is updated when that happens.
+// Entities are placed by a node of the scene's transform hierarchy, Update copies the world matrices of the nodes
+// that changed into the transform table once per frame, passes only read that cached copy.
+// A BVH over the entity bounds answers spatial queries. It is rebuilt when entities come or go and refit when they
+// move.
+class Scene
+{
+public:
+    Scene();
+
+    // localBounds are in the space of the node, the mesh is only referenced
+    SceneHandle Create(Mesh* mesh, uint32_t materialId, TransformHandle node, const BoundingBox& localBounds,
+                       uint32_t flags);
+    void Destroy(SceneHandle handle);
+    bool IsValid(SceneHandle handle);
+
+    void SetFlags(SceneHandle handle, uint32_t flags);
+
+    // Updates the hierarchy, then the transforms, bounds and versions of entities whose node changed, then the BVH
+    void Update();
+
+    TransformHierarchy& GetHierarchy();
+
+    // -- QUERIES --
+    // Valid after Update, items are entity indices
+    const Bvh& GetBvh();
+    // Closest entity whose mesh the world space ray hits
+    bool Raycast(const Ray& ray, float maxDistance, SceneHandle& entity, float& distance);
+
+    // -- TABLES --
+    // Indices are only stable until the next Destroy
+    uint32_t GetCount();
+    SceneHandle GetHandle(uint32_t index);
+
+    const std::vector<glm::mat4>& GetTransforms();
+    const std::vector<BoundingBox>& GetBounds();
+    const std::vector<uint32_t>& GetFlags();
+    const std::vector<Mesh*>& GetMeshes();
+    const std::vector<uint32_t>& GetMaterials();
+    // Bumped every time an entity's transform changes, used to invalidate cached shadow maps
+    const std::vector<uint32_t>& GetVersions();
+
+private:
+    struct Slot
+    {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    TransformHierarchy m_hierarchy;
+
+    std::vector<TransformHandle> m_nodes;
+    std::vector<BoundingBox> m_localBounds;
+    std::vector<glm::mat4> m_transforms;
+    std::vector<BoundingBox> m_bounds;
+    std::vector<uint32_t> m_flags;
+    std::vector<Mesh*> m_meshes;
+    std::vector<uint32_t> m_materials;
+    std::vector<uint32_t> m_versions;
+    std::vector<uint32_t> m_slotOfIndex;
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+
+    Bvh m_bvh;
+    bool m_rebuildBvh = false;
+
+    uint32_t getIndex(SceneHandle handle);
+
+};
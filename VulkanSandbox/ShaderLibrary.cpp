@@ -0,0 +1,407 @@
+#include "ShaderLibrary.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "CpuProfiler.h"
+#include "Utilities.h"
+
+namespace
+{
+    // Read only view of a whole file, unmapped when it goes out of scope
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& path)
+        {
+#ifdef _WIN32
+            m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (m_file == INVALID_HANDLE_VALUE) return;
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) return;
+            m_size = static_cast<size_t>(size.QuadPart);
+
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!m_mapping) return;
+            m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+            m_file = open(path.c_str(), O_RDONLY);
+            if (m_file < 0) return;
+
+            struct stat status;
+            if (fstat(m_file, &status) != 0 || status.st_size == 0) return;
+            m_size = static_cast<size_t>(status.st_size);
+
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+            m_data = data != MAP_FAILED ? data : nullptr;
+#endif
+        }
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if (m_data) UnmapViewOfFile(m_data);
+            if (m_mapping) CloseHandle(m_mapping);
+            if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+            if (m_data) munmap(m_data, m_size);
+            if (m_file >= 0) close(m_file);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const void* GetData() const { return m_data; }
+        size_t GetSize() const { return m_size; }
+
+    private:
+#ifdef _WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+#else
+        int m_file = -1;
+#endif
+        void* m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    struct ReflectedBinding
+    {
+        uint32_t set;
+        VkDescriptorSetLayoutBinding binding;
+    };
+
+    struct Module
+    {
+        VkShaderModule module;
+        VkShaderStageFlagBits stage;
+        std::vector<ReflectedBinding> bindings;
+    };
+
+    VkDevice device;
+
+    std::unordered_map<uint64_t, Module> modules;           // By content hash
+    std::unordered_map<std::string, uint64_t> fileHashes;   // File to content hash
+    std::map<std::string, std::unique_ptr<ShaderLibrary::SetLayout>> setLayouts;
+
+    // FNV-1a
+    uint64_t hashContents(const uint8_t* data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    VkShaderStageFlagBits stageFromExecutionModel(uint32_t executionModel)
+    {
+        switch (executionModel)
+        {
+        case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+        case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+        default: throw std::runtime_error("Unsupported shader execution model");
+        }
+    }
+
+    // Walks the SPIR-V once, only the instructions that describe resource variables matter. The stage comes from the
+    // first entry point.
+    void reflect(const uint32_t* words, size_t wordCount, Module& module)
+    {
+        const uint32_t SPIRV_MAGIC = 0x07230203;
+        if (wordCount < 5 || words[0] != SPIRV_MAGIC)
+            throw std::runtime_error("Not a SPIR-V module");
+
+        enum Op : uint32_t
+        {
+            OpEntryPoint = 15,
+            OpTypeImage = 25,
+            OpTypeSampler = 26,
+            OpTypeSampledImage = 27,
+            OpTypeArray = 28,
+            OpTypeRuntimeArray = 29,
+            OpTypeStruct = 30,
+            OpTypePointer = 32,
+            OpConstant = 43,
+            OpVariable = 59,
+            OpDecorate = 71
+        };
+        enum Decoration : uint32_t { DecorationBufferBlock = 3, DecorationBinding = 33, DecorationDescriptorSet = 34 };
+        enum StorageClass : uint32_t { StorageUniformConstant = 0, StorageUniform = 2, StorageStorageBuffer = 12 };
+
+        struct Type
+        {
+            uint32_t op;
+            uint32_t operands[3];   // Element type and length id for arrays, pointee for pointers, dim and sampled for images
+        };
+
+        std::unordered_map<uint32_t, Type> types;
+        std::unordered_map<uint32_t, uint32_t> constants;
+        std::unordered_map<uint32_t, uint32_t> sets;
+        std::unordered_map<uint32_t, uint32_t> bindings;
+        std::unordered_map<uint32_t, bool> bufferBlocks;
+        std::vector<std::pair<uint32_t, uint32_t>> variables;   // Id and pointer type
+        std::vector<uint32_t> variableStorage;
+        bool hasEntryPoint = false;
+
+        for (size_t i = 5; i < wordCount;)
+        {
+            uint32_t opcode = words[i] & 0xFFFF;
+            uint32_t length = words[i] >> 16;
+            if (length == 0 || i + length > wordCount)
+                throw std::runtime_error("Malformed SPIR-V module");
+
+            const uint32_t* operands = words + i + 1;
+            switch (opcode)
+            {
+            case OpEntryPoint:
+                if (!hasEntryPoint) module.stage = stageFromExecutionModel(operands[0]);
+                hasEntryPoint = true;
+                break;
+            case OpDecorate:
+                if (operands[1] == DecorationDescriptorSet) sets[operands[0]] = operands[2];
+                if (operands[1] == DecorationBinding) bindings[operands[0]] = operands[2];
+                if (operands[1] == DecorationBufferBlock) bufferBlocks[operands[0]] = true;
+                break;
+            case OpTypeImage:
+                types[operands[0]] = { opcode, { operands[2], operands[6], 0 } };
+                break;
+            case OpTypeSampler:
+            case OpTypeSampledImage:
+            case OpTypeStruct:
+                types[operands[0]] = { opcode, { 0, 0, 0 } };
+                break;
+            case OpTypeArray:
+                types[operands[0]] = { opcode, { operands[1], operands[2], 0 } };
+                break;
+            case OpTypeRuntimeArray:
+                types[operands[0]] = { opcode, { operands[1], 0, 0 } };
+                break;
+            case OpTypePointer:
+                types[operands[0]] = { opcode, { operands[2], 0, 0 } };
+                break;
+            case OpConstant:
+                constants[operands[1]] = operands[2];
+                break;
+            case OpVariable:
+                if (operands[2] == StorageUniformConstant || operands[2] == StorageUniform || operands[2] == StorageStorageBuffer)
+                {
+                    variables.emplace_back(operands[1], operands[0]);
+                    variableStorage.push_back(operands[2]);
+                }
+                break;
+            }
+
+            i += length;
+        }
+
+        if (!hasEntryPoint)
+            throw std::runtime_error("SPIR-V module has no entry point");
+
+        for (size_t v = 0; v < variables.size(); ++v)
+        {
+            uint32_t id = variables[v].first;
+            if (sets.find(id) == sets.end() || bindings.find(id) == bindings.end())
+                continue;
+
+            uint32_t typeId = types[variables[v].second].operands[0];
+
+            // Arrays of descriptors, runtime sized ones count as a single descriptor
+            uint32_t count = 1;
+            while (types[typeId].op == OpTypeArray || types[typeId].op == OpTypeRuntimeArray)
+            {
+                const Type& array = types[typeId];
+                if (array.op == OpTypeArray) count *= constants[array.operands[1]];
+                typeId = array.operands[0];
+            }
+
+            const Type& type = types[typeId];
+            VkDescriptorType descriptorType;
+            if (type.op == OpTypeSampledImage)
+                descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            else if (type.op == OpTypeSampler)
+                descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+            else if (type.op == OpTypeImage)
+            {
+                const uint32_t DIM_BUFFER = 5;
+                const uint32_t DIM_SUBPASS_DATA = 6;
+                bool storage = type.operands[1] == 2;
+                if (type.operands[0] == DIM_SUBPASS_DATA)
+                    descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                else if (type.operands[0] == DIM_BUFFER)
+                    descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                else
+                    descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            }
+            else if (type.op == OpTypeStruct)
+            {
+                // Older compilers mark storage buffers as BufferBlock in the Uniform storage class
+                bool storage = variableStorage[v] == StorageStorageBuffer || bufferBlocks[typeId];
+                descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            }
+            else
+                continue;
+
+            ReflectedBinding reflected = {};
+            reflected.set = sets[id];
+            reflected.binding.binding = bindings[id];
+            reflected.binding.descriptorType = descriptorType;
+            reflected.binding.descriptorCount = count;
+            reflected.binding.stageFlags = module.stage;
+            reflected.binding.pImmutableSamplers = nullptr;
+            module.bindings.push_back(reflected);
+        }
+    }
+
+    const Module& loadModule(const std::string& file)
+    {
+        auto fileIt = fileHashes.find(file);
+        if (fileIt != fileHashes.end()) return modules[fileIt->second];
+
+        CPU_ZONE("Load Shader");
+
+        MappedFile mappedFile("shaders/" + file);
+        if (!mappedFile.GetData() || mappedFile.GetSize() % sizeof(uint32_t) != 0)
+            throw std::runtime_error("Failed to read file: shaders/" + file);
+
+        const uint8_t* bytes = static_cast<const uint8_t*>(mappedFile.GetData());
+        uint64_t hash = hashContents(bytes, mappedFile.GetSize());
+
+        auto moduleIt = modules.find(hash);
+        if (moduleIt != modules.end())
+        {
+            fileHashes.emplace(file, hash);
+            return moduleIt->second;
+        }
+
+        Module module = {};
+        reflect(static_cast<const uint32_t*>(mappedFile.GetData()), mappedFile.GetSize() / sizeof(uint32_t), module);
+
+        VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderModuleCreateInfo.codeSize = mappedFile.GetSize();
+        shaderModuleCreateInfo.pCode = static_cast<const uint32_t*>(mappedFile.GetData());
+
+        VkResult result = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &module.module);
+        CHECK_VK_RESULT(result, "Failed to create Shader Module");
+
+        // Only a module that was created is remembered, a failed file is read again the next time
+        fileHashes.emplace(file, hash);
+        return modules.emplace(hash, std::move(module)).first->second;
+    }
+}
+
+void ShaderLibrary::Init(VkDevice _device)
+{
+    device = _device;
+}
+
+void ShaderLibrary::Destroy()
+{
+    for (auto& entry : setLayouts)
+    {
+        vkDestroyDescriptorSetLayout(device, entry.second->layout, nullptr);
+    }
+    setLayouts.clear();
+
+    for (auto& entry : modules)
+    {
+        vkDestroyShaderModule(device, entry.second.module, nullptr);
+    }
+    modules.clear();
+    fileHashes.clear();
+}
+
+VkPipelineShaderStageCreateInfo ShaderLibrary::GetStage(const std::string& file)
+{
+    const Module& module = loadModule(file);
+
+    VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {};
+    shaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfo.stage = module.stage;
+    shaderStageCreateInfo.module = module.module;
+    shaderStageCreateInfo.pName = "main";
+
+    return shaderStageCreateInfo;
+}
+
+const ShaderLibrary::SetLayout& ShaderLibrary::GetSetLayout(const std::vector<std::string>& files, uint32_t set)
+{
+    std::string key = std::to_string(set);
+    for (const std::string& file : files)
+        key += "|" + file;
+
+    auto it = setLayouts.find(key);
+    if (it != setLayouts.end()) return *it->second;
+
+    std::unique_ptr<SetLayout> setLayout(new SetLayout());
+    for (const std::string& file : files)
+    {
+        for (const ReflectedBinding& reflected : loadModule(file).bindings)
+        {
+            if (reflected.set != set) continue;
+
+            auto existing = std::find_if(setLayout->bindings.begin(), setLayout->bindings.end(),
+                [&](const VkDescriptorSetLayoutBinding& binding) { return binding.binding == reflected.binding.binding; });
+
+            if (existing == setLayout->bindings.end())
+            {
+                setLayout->bindings.push_back(reflected.binding);
+            }
+            else if (existing->descriptorType != reflected.binding.descriptorType ||
+                existing->descriptorCount != reflected.binding.descriptorCount)
+            {
+                throw std::runtime_error("Shaders disagree about binding " + std::to_string(reflected.binding.binding) +
+                    " of set " + std::to_string(set) + " in " + file);
+            }
+            else
+            {
+                existing->stageFlags |= reflected.binding.stageFlags;
+            }
+        }
+    }
+
+    std::sort(setLayout->bindings.begin(), setLayout->bindings.end(),
+        [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = static_cast<uint32_t>(setLayout->bindings.size());
+    layoutCreateInfo.pBindings = setLayout->bindings.data();
+
+    VkResult result = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &setLayout->layout);
+    CHECK_VK_RESULT(result, "Failed to create Descriptor Set Layout");
+
+    return *setLayouts.emplace(key, std::move(setLayout)).first->second;
+}
+
+uint32_t ShaderLibrary::GetFileCount()
+{
+    return static_cast<uint32_t>(fileHashes.size());
+}
+
+uint32_t ShaderLibrary::GetModuleCount()
+{
+    return static_cast<uint32_t>(modules.size());
+}
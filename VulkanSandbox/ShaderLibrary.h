@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// -- SHADER LIBRARY --
+// Owns every shader module. Each SPIR-V file is mapped and read once, files with the same contents share a module,
+// and the descriptor bindings the shaders declare are reflected, so set layouts are built from the shaders instead of
+// being written out by hand next to them.
+class ShaderLibrary
+{
+public:
+    struct SetLayout
+    {
+        VkDescriptorSetLayout layout;
+        std::vector<VkDescriptorSetLayoutBinding> bindings;     // Sorted by binding
+    };
+
+    static void Init(VkDevice device);
+    static void Destroy();
+
+    // File relative to the shaders directory, the stage is the shader's execution model
+    static VkPipelineShaderStageCreateInfo GetStage(const std::string& file);
+
+    // Union of the bindings every file declares in the set, with the stages that use them. Throws when two files
+    // disagree about a binding. The layout is owned by the library.
+    static const SetLayout& GetSetLayout(const std::vector<std::string>& files, uint32_t set);
+
+    static uint32_t GetFileCount();
+    static uint32_t GetModuleCount();
+
+};
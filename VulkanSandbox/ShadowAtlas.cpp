@@ -0,0 +1,616 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Mesh.h"
+#include "RenderStats.h"
+#include "Scene.h"
+#include "ShaderLibrary.h"
+
+static uint32_t tileCells(uint32_t size)
+{
+    uint32_t tilesPerSide = size / SHADOW_ATLAS_MIN_TILE;
+    return tilesPerSide * tilesPerSide;
+}
+
+ShadowAtlas::ShadowAtlas()
+{
+}
+
+void ShadowAtlas::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount, uint32_t atlasSize,
+    PipelineBuilder* pipelineBuilder)
+{
+    m_device = device;
+    m_pipelineBuilder = pipelineBuilder;
+    m_physicalDevice = physicalDevice;
+    m_frameCount = frameCount;
+    m_atlasSize = atlasSize;
+    m_atlasFormat = chooseShadowMapFormat(physicalDevice);
+
+    m_lightData = {};
+
+    createAtlasImageAndSampler();
+    createDescriptorSets();
+    createRenderPass();
+    createFramebuffer();
+    createPipeline();
+}
+
+void ShadowAtlas::Destroy()
+{
+    vkDestroyPipelineLayout(m_device, m_atlasPipelineLayout, nullptr);
+    vkDestroyFramebuffer(m_device, m_atlasFramebuffer, nullptr);
+    vkDestroyRenderPass(m_device, m_atlasRenderPass, nullptr);
+
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+
+    for (size_t i = 0; i < m_lightBuffers.size(); ++i)
+    {
+        m_lightBuffers[i].Destroy(m_device);
+    }
+
+    vkDestroySampler(m_device, m_atlasSampler, nullptr);
+    m_atlasImage.Destroy(m_device);
+}
+
+void ShadowAtlas::Update(uint32_t frameIndex, const std::vector<SpotLight>& lights, Camera& camera)
+{
+    SpotLightBuffer& data = m_lightData;
+    data.count = static_cast<uint32_t>(std::min<size_t>(lights.size(), MAX_SPOT_LIGHTS));
+
+    for (uint32_t i = 0; i < data.count; ++i)
+    {
+        const SpotLight& light = lights[i];
+        glm::vec3 direction = glm::normalize(light.direction);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+
+        // The projection just covers the cone
+        float fov = std::min(2.f * light.cutoff, 170.f);
+        glm::mat4 view = glm::lookAt(light.position, light.position + direction, up);
+        glm::mat4 projection = glm::perspectiveZO(glm::radians(fov), 1.f, 1.f, light.range);
+
+        GpuSpotLight& gpuLight = data.lights[i];
+        gpuLight.viewProjection = projection * view;
+        gpuLight.positionStrength = glm::vec4(light.position, light.strength);
+        gpuLight.directionCutoff = glm::vec4(direction, light.cutoff);
+        gpuLight.atlasRect = glm::vec4(0.f);
+        gpuLight.range = glm::vec4(light.range, 0.f, 0.f, 0.f);
+    }
+
+    allocateTiles(lights, camera);
+
+    float atlasSize = static_cast<float>(m_atlasSize);
+    for (Tile& tile : m_tiles)
+    {
+        GpuSpotLight& gpuLight = data.lights[tile.light];
+        gpuLight.atlasRect = glm::vec4(tile.x / atlasSize, tile.y / atlasSize, tile.size / atlasSize, tile.size / atlasSize);
+
+        tile.frustum = Frustum(gpuLight.viewProjection);
+        tile.cone.position = lights[tile.light].position;
+        tile.cone.direction = glm::vec3(gpuLight.directionCutoff);
+        tile.cone.angle = glm::radians(lights[tile.light].cutoff);
+        tile.cone.range = lights[tile.light].range;
+    }
+
+    void* mappedData;
+    vkMapMemory(m_device, m_lightBuffers[frameIndex].GetMemory(), 0, sizeof(SpotLightBuffer), 0, &mappedData);
+    memcpy(mappedData, &m_lightData, sizeof(SpotLightBuffer));
+    vkUnmapMemory(m_device, m_lightBuffers[frameIndex].GetMemory());
+}
+
+void ShadowAtlas::RecordCommands(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene& scene)
+{
+    m_casterCount = 0;
+
+    std::array<VkClearValue, 1> clearValues = {};
+    clearValues[0].depthStencil.depth = 1.f;
+    clearValues[0].depthStencil.stencil = 0;
+
+    VkRenderPassBeginInfo renderPassBeginInfo = {};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = m_atlasRenderPass;
+    renderPassBeginInfo.renderArea.offset = { 0, 0 };
+    renderPassBeginInfo.renderArea.extent = { m_atlasSize, m_atlasSize };
+    renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassBeginInfo.pClearValues = clearValues.data();
+    renderPassBeginInfo.framebuffer = m_atlasFramebuffer;
+
+    // Until the pipeline is built the atlas is only cleared
+    VkPipeline pipeline = m_pipelineBuilder->Get(m_atlasPipeline);
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if (pipeline != VK_NULL_HANDLE)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        RenderStats::CountPipelineBind();
+
+        // The vertex shader only reads the light buffer, the atlas itself is never sampled here
+        VkDescriptorSet descriptorSet = m_descriptorSets[frameIndex];
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_atlasPipelineLayout,
+            0, 1, &descriptorSet, 0, nullptr);
+        RenderStats::CountDescriptorBinds(1);
+
+        const std::vector<glm::mat4>& transforms = scene.GetTransforms();
+        const std::vector<BoundingBox>& bounds = scene.GetBounds();
+        const std::vector<uint32_t>& flags = scene.GetFlags();
+        const std::vector<Mesh*>& meshes = scene.GetMeshes();
+
+        for (const Tile& tile : m_tiles)
+        {
+            m_casters.clear();
+            for (uint32_t i = 0; i < scene.GetCount(); ++i)
+            {
+                if (!(flags[i] & SCENE_FLAG_CASTS_SHADOWS))
+                    continue;
+
+                if (tile.frustum.Intersects(bounds[i]) && tile.cone.Intersects(bounds[i]))
+                    m_casters.push_back(i);
+            }
+
+            if (m_casters.empty())
+                continue;
+            m_casterCount += static_cast<uint32_t>(m_casters.size());
+
+            VkViewport viewport = {};
+            viewport.x = static_cast<float>(tile.x);
+            viewport.y = static_cast<float>(tile.y);
+            viewport.width = static_cast<float>(tile.size);
+            viewport.height = static_cast<float>(tile.size);
+            viewport.minDepth = 0.f;
+            viewport.maxDepth = 1.f;
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+            VkRect2D scissor = {};
+            scissor.offset = { static_cast<int32_t>(tile.x), static_cast<int32_t>(tile.y) };
+            scissor.extent = { tile.size, tile.size };
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+            for (uint32_t caster : m_casters)
+            {
+                Mesh* mesh = meshes[caster];
+
+                VkBuffer vertexBuffers[] = { mesh->GetVertexBuffer()->GetBuffer() };
+                VkDeviceSize offsets[] = { 0 };
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+                RenderStats::CountVertexBufferBind();
+
+                PushShadow pushShadow = {};
+                pushShadow.model = transforms[caster];
+                pushShadow.layer = tile.light;
+                vkCmdPushConstants(commandBuffer, m_atlasPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushShadow), &pushShadow);
+                RenderStats::CountPushConstants();
+
+                if (mesh->Indexed())
+                {
+                    vkCmdBindIndexBuffer(commandBuffer, mesh->GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+                    vkCmdDrawIndexed(commandBuffer, mesh->GetIndexCount(), 1, 0, 0, 0);
+                    RenderStats::CountDraw(mesh->GetIndexCount());
+                }
+                else
+                {
+                    vkCmdDraw(commandBuffer, mesh->GetVertexCount(), 1, 0, 0);
+                    RenderStats::CountDraw(mesh->GetVertexCount());
+                }
+            }
+        }
+    }
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+VkDescriptorSetLayout ShadowAtlas::GetDescriptorSetLayout()
+{
+    return m_setLayout;
+}
+
+VkDescriptorSet ShadowAtlas::GetDescriptorSet(uint32_t frameIndex)
+{
+    return m_descriptorSets[frameIndex];
+}
+
+VkImageView ShadowAtlas::GetImageView()
+{
+    return m_atlasImage.GetImageView();
+}
+
+VkSampler ShadowAtlas::GetSampler()
+{
+    return m_atlasSampler;
+}
+
+uint32_t ShadowAtlas::GetShadowedLightCount()
+{
+    return static_cast<uint32_t>(m_tiles.size());
+}
+
+uint32_t ShadowAtlas::GetCasterCount()
+{
+    return m_casterCount;
+}
+
+void ShadowAtlas::allocateTiles(const std::vector<SpotLight>& lights, Camera& camera)
+{
+    m_tiles.clear();
+
+    Frustum cameraFrustum(camera.GetProjectionMatrix() * camera.GetViewMatrix());
+    uint32_t lightCount = static_cast<uint32_t>(std::min<size_t>(lights.size(), MAX_SPOT_LIGHTS));
+
+    for (uint32_t i = 0; i < lightCount; ++i)
+    {
+        const SpotLight& light = lights[i];
+
+        // Lights that can't reach anything visible don't need a shadow
+        BoundingBox reach;
+        reach.min = light.position - glm::vec3(light.range);
+        reach.max = light.position + glm::vec3(light.range);
+        if (!cameraFrustum.Intersects(reach))
+            continue;
+
+        // Rough share of the screen the light can cover
+        float distance = glm::length(light.position - camera.GetPosition());
+        float importance = std::min(light.range / std::max(distance, 1.f), 1.f);
+
+        Tile tile = {};
+        tile.light = i;
+        tile.importance = importance;
+        tile.size = SHADOW_ATLAS_MIN_TILE;
+        while (tile.size < SHADOW_ATLAS_MAX_TILE && static_cast<float>(tile.size * 2) <= importance * SHADOW_ATLAS_MAX_TILE)
+            tile.size *= 2;
+
+        m_tiles.push_back(tile);
+    }
+
+    std::sort(m_tiles.begin(), m_tiles.end(), [](const Tile& a, const Tile& b)
+    {
+        return a.importance > b.importance;
+    });
+
+    if (m_tiles.size() > SHADOW_ATLAS_MAX_TILES)
+        m_tiles.resize(SHADOW_ATLAS_MAX_TILES);
+
+    packTiles();
+}
+
+void ShadowAtlas::packTiles()
+{
+    uint32_t capacity = tileCells(m_atlasSize);
+
+    // Shrink the biggest tiles until everything fits, drop the least important lights if even that isn't enough
+    while (!m_tiles.empty())
+    {
+        uint32_t usedCells = 0;
+        for (const Tile& tile : m_tiles)
+            usedCells += tileCells(tile.size);
+
+        if (usedCells <= capacity)
+            break;
+
+        uint32_t largest = m_tiles.front().size;
+        if (largest == SHADOW_ATLAS_MIN_TILE)
+        {
+            m_tiles.pop_back();
+            continue;
+        }
+
+        for (Tile& tile : m_tiles)
+        {
+            if (tile.size == largest) tile.size /= 2;
+        }
+    }
+
+    // Sizes never increase along the list, so walking the atlas in Morton order keeps every tile aligned to its size
+    uint32_t cell = 0;
+    for (Tile& tile : m_tiles)
+    {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        for (uint32_t bit = 0; bit < 16; ++bit)
+        {
+            x |= ((cell >> (2 * bit)) & 1) << bit;
+            y |= ((cell >> (2 * bit + 1)) & 1) << bit;
+        }
+
+        tile.x = x * SHADOW_ATLAS_MIN_TILE;
+        tile.y = y * SHADOW_ATLAS_MIN_TILE;
+        cell += tileCells(tile.size);
+    }
+}
+
+void ShadowAtlas::createAtlasImageAndSampler()
+{
+    // No stencil, the atlas is big enough for the extra bytes to matter
+    m_atlasImage.Init(m_device, m_physicalDevice, m_atlasSize, m_atlasSize, m_atlasFormat,
+        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_IMAGE_ASPECT_DEPTH_BIT);
+
+    // Tiles are packed edge to edge, the shader keeps filter taps inside the light's tile
+    VkSamplerCreateInfo samplerCreateInfo = {};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCreateInfo.mipLodBias = 0.f;
+    samplerCreateInfo.minLod = 0.f;
+    samplerCreateInfo.maxLod = 0.f;
+    samplerCreateInfo.anisotropyEnable = VK_FALSE;
+    samplerCreateInfo.compareEnable = VK_TRUE;
+    samplerCreateInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+    VkResult result = vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_atlasSampler);
+    CHECK_VK_RESULT(result, "Failed to create Shadow Atlas Sampler");
+}
+
+void ShadowAtlas::createDescriptorSets()
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings = {};
+
+    layoutBindings[0].binding = 0;
+    layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    layoutBindings[0].descriptorCount = 1;
+    layoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutBindings[0].pImmutableSamplers = nullptr;
+
+    layoutBindings[1].binding = 1;
+    layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    layoutBindings[1].descriptorCount = 1;
+    layoutBindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    layoutBindings[1].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+    layoutCreateInfo.pBindings = layoutBindings.data();
+
+    VkResult result = vkCreateDescriptorSetLayout(m_device, &layoutCreateInfo, nullptr, &m_setLayout);
+    CHECK_VK_RESULT(result, "Failed to create Descriptor Set Layout");
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = m_frameCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = m_frameCount;
+
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = m_frameCount;
+    poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolCreateInfo.pPoolSizes = poolSizes.data();
+
+    result = vkCreateDescriptorPool(m_device, &poolCreateInfo, nullptr, &m_descriptorPool);
+    CHECK_VK_RESULT(result, "Failed to create Descriptor Pool");
+
+    m_descriptorSets.resize(m_frameCount);
+    std::vector<VkDescriptorSetLayout> layouts(m_frameCount, m_setLayout);
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {};
+    descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocInfo.descriptorPool = m_descriptorPool;
+    descriptorSetAllocInfo.descriptorSetCount = m_frameCount;
+    descriptorSetAllocInfo.pSetLayouts = layouts.data();
+
+    result = vkAllocateDescriptorSets(m_device, &descriptorSetAllocInfo, m_descriptorSets.data());
+    CHECK_VK_RESULT(result, "Failed to allocate Descriptor Set for Shadow Atlas");
+
+    m_lightBuffers.resize(m_frameCount);
+
+    for (uint32_t i = 0; i < m_frameCount; ++i)
+    {
+        m_lightBuffers[i].Init(m_device, m_physicalDevice, sizeof(SpotLightBuffer), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = m_atlasImage.GetImageView();
+        imageInfo.sampler = m_atlasSampler;
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = m_lightBuffers[i].GetBuffer();
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(SpotLightBuffer);
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = m_descriptorSets[i];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pImageInfo = &imageInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = m_descriptorSets[i];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+void ShadowAtlas::createRenderPass()
+{
+    VkAttachmentDescription depthAttachment = {};
+    depthAttachment.format = m_atlasFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef;
+    depthAttachmentRef.attachment = 0;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 0;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    // The atlas is shared by all frames, the previous frame has to be done sampling before it is cleared
+    std::array<VkSubpassDependency, 2> dependencies{};
+
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassCreateInfo = {};
+    renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassCreateInfo.attachmentCount = 1;
+    renderPassCreateInfo.pAttachments = &depthAttachment;
+    renderPassCreateInfo.subpassCount = 1;
+    renderPassCreateInfo.pSubpasses = &subpass;
+    renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassCreateInfo.pDependencies = dependencies.data();
+
+    VkResult result = vkCreateRenderPass(m_device, &renderPassCreateInfo, nullptr, &m_atlasRenderPass);
+    CHECK_VK_RESULT(result, "Failed to create Render Pass");
+}
+
+void ShadowAtlas::createFramebuffer()
+{
+    VkImageView attachment = m_atlasImage.GetImageView();
+
+    VkFramebufferCreateInfo frameBufferCreateInfo = {};
+    frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    frameBufferCreateInfo.renderPass = m_atlasRenderPass;
+    frameBufferCreateInfo.width = m_atlasSize;
+    frameBufferCreateInfo.height = m_atlasSize;
+    frameBufferCreateInfo.attachmentCount = 1;
+    frameBufferCreateInfo.pAttachments = &attachment;
+    frameBufferCreateInfo.layers = 1;
+
+    VkResult result = vkCreateFramebuffer(m_device, &frameBufferCreateInfo, nullptr, &m_atlasFramebuffer);
+    CHECK_VK_RESULT(result, "Failed to create Framebuffer");
+}
+
+void ShadowAtlas::createPipeline()
+{
+    VkPipelineShaderStageCreateInfo shaderStages[] = { ShaderLibrary::GetStage("shadowAtlas.vert.spv") };
+
+    auto vertexBindingDescription = Vertex::getBindingDescription();
+    auto vertexAttributeDescriptions = Vertex::getAttributeDescriptions();
+
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {};
+    vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+    vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexBindingDescription;
+    vertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributeDescriptions.size());
+    vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescriptions.data();
+
+    // -- INPUT ASSEMBLER --
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStageCreateInfo = {};
+    inputAssemblyStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyStageCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyStageCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+    // -- VIEWPORT & SCISSOR --
+
+    // Set per tile while recording
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = defaultViewport({ m_atlasSize, m_atlasSize });
+
+    std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
+
+    // -- RASTERIZER --
+
+    VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo =
+        defaultRasterizerCreateInfo(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_TRUE);
+    rasterizerCreateInfo.depthBiasConstantFactor = 1.25f;
+    rasterizerCreateInfo.depthBiasSlopeFactor = 1.75f;
+
+    // -- MULTISAMPLING --
+
+    VkPipelineMultisampleStateCreateInfo multisampleCreateInfo = {};
+    multisampleCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleCreateInfo.sampleShadingEnable = VK_FALSE;
+    multisampleCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    // -- BLENDING --
+
+    VkPipelineColorBlendStateCreateInfo colorBlendCreateInfo = {};
+    colorBlendCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendCreateInfo.logicOpEnable = VK_FALSE;
+    colorBlendCreateInfo.attachmentCount = 0;
+
+    // -- PIPELINE LAYOUT --
+
+    VkPushConstantRange worldPushConstantRange = {};
+    worldPushConstantRange.size = sizeof(PushShadow);
+    worldPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    worldPushConstantRange.offset = 0;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &worldPushConstantRange;
+
+    std::vector<VkDescriptorSetLayout> setLayouts =
+    {
+        m_setLayout
+    };
+
+    pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+
+    VkResult result = vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_atlasPipelineLayout);
+    CHECK_VK_RESULT(result, "Failed to create Pipeline Layout");
+
+    // -- DEPTH STENCIL TESTING --
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {};
+    depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencilStateCreateInfo.depthBoundsTestEnable = VK_FALSE;
+    depthStencilStateCreateInfo.stencilTestEnable = VK_FALSE;
+
+    // -- PIPELINE CREATION --
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stageCount = 1;
+    pipelineCreateInfo.pStages = shaderStages;
+    pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
+    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStageCreateInfo;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
+    pipelineCreateInfo.layout = m_atlasPipelineLayout;
+    pipelineCreateInfo.renderPass = m_atlasRenderPass;
+    pipelineCreateInfo.subpass = 0;
+    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCreateInfo.basePipelineIndex = -1;
+
+    m_atlasPipeline = m_pipelineBuilder->Submit("Shadow Atlas", pipelineCreateInfo);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Camera.h"
+#include "Frustum.h"
+#include "Image.h"
+#include "Lights.h"
+#include "PipelineBuilder.h"
+#include "Buffer.h"
+
+class Scene;
+
+// Tile sizes are powers of two between these, the atlas size must be a power of two as well
+constexpr uint32_t SHADOW_ATLAS_MIN_TILE = 128;
+constexpr uint32_t SHADOW_ATLAS_MAX_TILE = 1024;
+// Only the most important lights are shadowed, the rest are still lit
+constexpr uint32_t SHADOW_ATLAS_MAX_TILES = 64;
+
+// -- SHADOW ATLAS --
+// All shadowed spot lights share one depth image. Every frame each light gets a tile sized by how much of
+// the screen it can cover, and all tiles are rendered in a single render pass using per tile viewports.
+class ShadowAtlas
+{
+public:
+    ShadowAtlas();
+
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount, uint32_t atlasSize,
+              PipelineBuilder* pipelineBuilder);
+    void Destroy();
+
+    // Assigns the tiles and uploads the light buffer of this frame
+    void Update(uint32_t frameIndex, const std::vector<SpotLight>& lights, Camera& camera);
+    void RecordCommands(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene& scene);
+
+    // Atlas and light buffer, used by the main pass
+    VkDescriptorSetLayout GetDescriptorSetLayout();
+    VkDescriptorSet GetDescriptorSet(uint32_t frameIndex);
+
+    VkImageView GetImageView();
+    VkSampler GetSampler();
+
+    uint32_t GetShadowedLightCount();
+    uint32_t GetCasterCount();      // Casters drawn over all tiles in the last recording
+
+private:
+    struct Tile
+    {
+        uint32_t light;
+        float importance;
+        uint32_t size;
+        uint32_t x, y;
+        Frustum frustum;
+        Cone cone;
+    };
+
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    uint32_t m_frameCount;
+    uint32_t m_atlasSize;
+    VkFormat m_atlasFormat;
+
+    Image m_atlasImage;
+    VkSampler m_atlasSampler;
+    VkRenderPass m_atlasRenderPass;
+    VkFramebuffer m_atlasFramebuffer;
+    PipelineBuilder* m_pipelineBuilder;
+    PipelineBuilder::Handle m_atlasPipeline;
+    VkPipelineLayout m_atlasPipelineLayout;
+
+    VkDescriptorSetLayout m_setLayout;
+    VkDescriptorPool m_descriptorPool;
+    std::vector<VkDescriptorSet> m_descriptorSets;
+    std::vector<Buffer> m_lightBuffers;
+
+    SpotLightBuffer m_lightData;
+
+    std::vector<Tile> m_tiles;
+    std::vector<uint32_t> m_casters;    // Scene indices, reused for every tile
+    uint32_t m_casterCount = 0;
+
+    void allocateTiles(const std::vector<SpotLight>& lights, Camera& camera);
+    void packTiles();
+
+    void createAtlasImageAndSampler();
+    void createDescriptorSets();
+    void createRenderPass();
+    void createFramebuffer();
+    void createPipeline();
+
+};
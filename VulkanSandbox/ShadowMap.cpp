@@ -1,6 +1,10 @@
 #include "ShadowMap.h"
 
-#include "Object.h"
+#include "GpuProfiler.h"
+#include "Mesh.h"
+#include "RenderStats.h"
+#include "Scene.h"
+#include "ShaderLibrary.h"
 
 std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
 VkDescriptorSetLayout setLayout;
@@ -12,11 +16,32 @@ std::vector<std::vector<VkDescriptorImageInfo*>> descriptorImageInfos;
 std::vector<std::vector<VkWriteDescriptorSet>> descriptorWrites;
 std::vector<VkDescriptorSet> descriptorSets;
 
+// Changes whenever a caster of the given kind is added, removed or moved
+static uint64_t hashCasters(Scene& scene, const std::vector<uint32_t>& casters, bool staticCasters)
+{
+    const std::vector<uint32_t>& flags = scene.GetFlags();
+    const std::vector<uint32_t>& versions = scene.GetVersions();
+
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t caster : casters)
+    {
+        if (((flags[caster] & SCENE_FLAG_STATIC) != 0) != staticCasters)
+            continue;
+
+        // Handles instead of indices, indices move around when entities are destroyed
+        SceneHandle handle = scene.GetHandle(caster);
+        hash = (hash ^ handle.slot) * 1099511628211ull;
+        hash = (hash ^ handle.generation) * 1099511628211ull;
+        hash = (hash ^ versions[caster]) * 1099511628211ull;
+    }
+    return hash;
+}
+
 ShadowMap::ShadowMap()
 {
 }
 
-void ShadowMap::StaticInit(VkDevice device, uint32_t imageCount)
+void ShadowMap::StaticInit(VkDevice device, uint32_t frameCount)
 {
     VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
     layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -28,39 +53,39 @@ void ShadowMap::StaticInit(VkDevice device, uint32_t imageCount)
 
     VkDescriptorPoolSize poolSize = {};
     poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSize.descriptorCount = imageCount;
+    poolSize.descriptorCount = frameCount;
     poolSizes.push_back(poolSize);
 
     VkDescriptorPoolSize poolSize2 = {};
     poolSize2.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSize2.descriptorCount = imageCount;
+    poolSize2.descriptorCount = frameCount;
     poolSizes.push_back(poolSize2);
 
     VkDescriptorPoolCreateInfo poolCreateInfo = {};
     poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolCreateInfo.maxSets = imageCount;
+    poolCreateInfo.maxSets = frameCount;
     poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolCreateInfo.pPoolSizes = poolSizes.data();
 
     result = vkCreateDescriptorPool(device, &poolCreateInfo, nullptr, &descriptorPool);
     CHECK_VK_RESULT(result, "Failed to create Descriptor Pool");
 
-    descriptorSets.resize(imageCount);
-    std::vector<VkDescriptorSetLayout> layouts(imageCount, setLayout);
+    descriptorSets.resize(frameCount);
+    std::vector<VkDescriptorSetLayout> layouts(frameCount, setLayout);
     
     VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {};
     descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     descriptorSetAllocInfo.descriptorPool = descriptorPool;
-    descriptorSetAllocInfo.descriptorSetCount = imageCount;
+    descriptorSetAllocInfo.descriptorSetCount = frameCount;
     descriptorSetAllocInfo.pSetLayouts = layouts.data();
 
     result = vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, descriptorSets.data());
     CHECK_VK_RESULT(result, "Failed to allocate Descriptor Set for Depth Image");
 }
 
-void ShadowMap::UpdateDescriptorSets(VkDevice device, uint32_t imageCount)
+void ShadowMap::UpdateDescriptorSets(VkDevice device, uint32_t frameCount)
 {
-    for (uint32_t i = 0; i < imageCount; ++i)
+    for (uint32_t i = 0; i < frameCount; ++i)
     {
         vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites[i].size()), descriptorWrites[i].data(),
             0, nullptr);
@@ -78,36 +103,39 @@ VkDescriptorSetLayout ShadowMap::GetDescriptorSetLayout()
     return setLayout;
 }
 
-VkDescriptorSet ShadowMap::GetDescriptorSet(uint32_t imageIndex)
+VkDescriptorSet ShadowMap::GetDescriptorSet(uint32_t frameIndex)
 {
-    return descriptorSets[imageIndex];
+    return descriptorSets[frameIndex];
 }
 
-void ShadowMap::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t imageCount, float shadowMapWidth, float shadowMapHeight, uint32_t
-                     binding)
+void ShadowMap::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount, float shadowMapWidth, float shadowMapHeight, uint32_t
+                     binding, uint32_t layerCount)
 {
     m_device = device;
     m_physicalDevice = physicalDevice;
-    m_imageCount = imageCount;
+    m_frameCount = frameCount;
+    m_layerCount = layerCount;
     m_shadowExtent.width = static_cast<uint32_t>(shadowMapWidth);
     m_shadowExtent.height = static_cast<uint32_t>(shadowMapHeight);
+    m_shadowFormat = chooseShadowMapFormat(physicalDevice);
 
-    if (descriptorWrites.size() != imageCount)
+    if (descriptorWrites.size() != frameCount)
     {
-        descriptorImageInfos.resize(imageCount);
-        descriptorWrites.resize(imageCount);
-        descriptorSets.resize(imageCount);
+        descriptorImageInfos.resize(frameCount);
+        descriptorWrites.resize(frameCount);
+        descriptorSets.resize(frameCount);
     }
 
-    m_uboLightPerspective.Init(device, physicalDevice, VK_SHADER_STAGE_VERTEX_BIT,
-        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, imageCount);
+    m_uboLightPerspective.Init(device, physicalDevice, ShaderLibrary::GetSetLayout({ "depthMap.vert.spv" }, 0), frameCount);
 
     createDescriptorBinding(binding);
     createShadowMapImageAndSampler();
 }
 
-void ShadowMap::FinishInit(uint32_t binding)
+void ShadowMap::FinishInit(uint32_t binding, PipelineBuilder* pipelineBuilder)
 {
+    m_pipelineBuilder = pipelineBuilder;
+
     createDescriptorWrites(binding);
     createShadowMapRenderPass();
     createShadowMapFrameBuffers();
@@ -116,14 +144,26 @@ void ShadowMap::FinishInit(uint32_t binding)
 
 void ShadowMap::Destroy()
 {
-    vkDestroyPipeline(m_device, m_shadowMapPassPipeline, nullptr);
     vkDestroyPipelineLayout(m_device, m_shadowMapPassPipelineLayout, nullptr);
 
     vkDestroyRenderPass(m_device, m_shadowMapRenderPass, nullptr);
+    vkDestroyRenderPass(m_device, m_staticCacheRenderPass, nullptr);
+
+    for (size_t i = 0; i < m_staticCacheFramebuffers.size(); ++i)
+    {
+        vkDestroyFramebuffer(m_device, m_staticCacheFramebuffers[i], nullptr);
+        vkDestroyImageView(m_device, m_staticCacheLayerViews[i], nullptr);
+    }
+    m_staticCache.Destroy(m_device);
     
-    for (size_t i = 0; i < m_shadowMapImage.size(); ++i)
+    for (size_t i = 0; i < m_shadowMapFramebuffers.size(); ++i)
     {
         vkDestroyFramebuffer(m_device, m_shadowMapFramebuffers[i], nullptr);
+        vkDestroyImageView(m_device, m_shadowMapLayerViews[i], nullptr);
+    }
+
+    for (size_t i = 0; i < m_shadowMapImage.size(); ++i)
+    {
         m_shadowMapImage[i].Destroy(m_device);
     }
 
@@ -132,17 +172,116 @@ void ShadowMap::Destroy()
     m_uboLightPerspective.Destroy();
 }
 
-UboViewProjection* ShadowMap::PerspectiveData()
+UboLightSpace* ShadowMap::PerspectiveData()
 {
     return &m_uboLightPerspective.Data;
 }
 
-void ShadowMap::UpdateUbo(uint32_t imageIndex)
+void ShadowMap::UpdateUbo(uint32_t frameIndex)
 {
-    m_uboLightPerspective.Update(imageIndex);
+    m_uboLightPerspective.Update(frameIndex);
+}
+
+void ShadowMap::RecordCommands(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene& scene, GpuProfiler* profiler)
+{
+    m_renderedLayerCount = 0;
+    m_casterCount = 0;
+
+    // Until the pipeline is built the layers are only cleared, nothing is cached so they are rendered once it is
+    bool pipelineReady = m_pipelineBuilder->Get(m_shadowMapPassPipeline) != VK_NULL_HANDLE;
+
+    for (uint32_t layer = 0; layer < m_layerCount; ++layer)
+    {
+        std::vector<uint32_t>& casters = m_layerCasters[layer];
+        if (!pipelineReady)
+        {
+            casters.clear();
+            recordStaticLayer(commandBuffer, frameIndex, layer, scene, casters);
+            recordCompositeLayer(commandBuffer, frameIndex, layer, scene, casters);
+            continue;
+        }
+
+        cullCasters(layer, scene, casters);
+        m_casterCount += static_cast<uint32_t>(casters.size());
+
+        uint64_t staticCasters = hashCasters(scene, casters, true);
+        uint64_t dynamicCasters = hashCasters(scene, casters, false);
+
+        LayerCache& cache = m_layerCaches[layer];
+        const glm::mat4& viewProjection = m_uboLightPerspective.Data.viewProjection[layer];
+
+        if (profiler) profiler->BeginZone(commandBuffer, m_zoneNames[layer]);
+
+        if (!m_cachingEnabled || !cache.valid || cache.viewProjection != viewProjection || cache.staticCasters != staticCasters)
+        {
+            recordStaticLayer(commandBuffer, frameIndex, layer, scene, casters);
+
+            cache.valid = true;
+            cache.viewProjection = viewProjection;
+            cache.staticCasters = staticCasters;
+            cache.dynamicCasters = dynamicCasters;
+            ++cache.version;
+        }
+        else if (cache.dynamicCasters != dynamicCasters)
+        {
+            cache.dynamicCasters = dynamicCasters;
+            ++cache.version;
+        }
+
+        // This image already holds the current cache contents
+        uint64_t& imageVersion = m_imageVersions[frameIndex * m_layerCount + layer];
+        if (imageVersion != cache.version)
+        {
+            recordCompositeLayer(commandBuffer, frameIndex, layer, scene, casters);
+            imageVersion = cache.version;
+            ++m_renderedLayerCount;
+        }
+
+        if (profiler) profiler->EndZone(commandBuffer);
+    }
 }
 
-void ShadowMap::RecordCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex, const std::vector<Object*>& objects)
+void ShadowMap::SetCachingEnabled(bool enabled)
+{
+    m_cachingEnabled = enabled;
+}
+
+uint32_t ShadowMap::GetRenderedLayerCount()
+{
+    return m_renderedLayerCount;
+}
+
+void ShadowMap::SetCullingCone(const glm::vec3& position, const glm::vec3& direction, float angle, float range)
+{
+    m_cullWithCone = true;
+    m_cullingCone.position = position;
+    m_cullingCone.direction = glm::normalize(direction);
+    m_cullingCone.angle = angle;
+    m_cullingCone.range = range;
+}
+
+void ShadowMap::SetExtendTowardsLight(bool extend)
+{
+    m_extendTowardsLight = extend;
+}
+
+uint32_t ShadowMap::GetCasterCount()
+{
+    return m_casterCount;
+}
+
+VkImageView ShadowMap::GetAnImageView()
+{
+    return m_shadowMapImage[0].GetImageView();
+}
+
+VkSampler ShadowMap::GetSampler()
+{
+    return m_shadowMapSampler;
+}
+
+void ShadowMap::recordStaticLayer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t layer, Scene& scene,
+    const std::vector<uint32_t>& casters)
 {
     std::array<VkClearValue, 1> clearValues = {};
     clearValues[0].depthStencil.depth = 1.f;
@@ -150,67 +289,145 @@ void ShadowMap::RecordCommands(VkCommandBuffer commandBuffer, uint32_t imageInde
     
     VkRenderPassBeginInfo renderPassBeginInfo = {};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.renderPass = m_shadowMapRenderPass;
+    renderPassBeginInfo.renderPass = m_staticCacheRenderPass;
     renderPassBeginInfo.renderArea.offset = { 0, 0 };
     renderPassBeginInfo.renderArea.extent = m_shadowExtent;
     renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassBeginInfo.pClearValues = clearValues.data();
-    renderPassBeginInfo.framebuffer = m_shadowMapFramebuffers[imageIndex];
-    
+    renderPassBeginInfo.framebuffer = m_staticCacheFramebuffers[layer];
+
     vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
     {
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowMapPassPipeline);
+        drawCasters(commandBuffer, frameIndex, layer, scene, casters, true);
+    }
+    vkCmdEndRenderPass(commandBuffer);
+}
 
-        for (size_t j = 0; j < objects.size(); ++j)
-        {
-            if (objects[j]->Name == "Light")
-                continue;
-            
-            const glm::mat4& objectTransform = objects[j]->GetTransform();
-            std::vector<Mesh>& meshes = objects[j]->GetMeshes();
-
-            for (size_t i = 0; i < meshes.size(); ++i)
-            {
-                std::vector<VkDescriptorSet> bindDescriptorSets =
-                {
-                    m_uboLightPerspective.GetDescriptorSet(imageIndex),
-                };
-            
-                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowMapPassPipelineLayout,
-                    0, static_cast<uint32_t>(bindDescriptorSets.size()), bindDescriptorSets.data(),
-                    0, nullptr);
-            
-                VkBuffer vertexBuffers[] = { meshes[i].GetVertexBuffer()->GetBuffer() };
-                VkDeviceSize offsets[] = { 0 };
-                vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-
-                PushModel pushModel = {};
-                pushModel.model = objectTransform * meshes[i].GetTransform();
-                vkCmdPushConstants(commandBuffer, m_shadowMapPassPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushModel), &pushModel);
-            
-                if (meshes[i].Indexed())
-                {
-                    vkCmdBindIndexBuffer(commandBuffer, meshes[i].GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
-                    vkCmdDrawIndexed(commandBuffer, meshes[i].GetIndexCount(), 1, 0, 0, 0);
-                }
-                else
-                {
-                    vkCmdDraw(commandBuffer, meshes[i].GetVertexCount(), 1, 0, 0);
-                }
-            }
-        }
+void ShadowMap::recordCompositeLayer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t layer, Scene& scene,
+    const std::vector<uint32_t>& casters)
+{
+    uint32_t layerIndex = frameIndex * m_layerCount + layer;
+
+    // Images that were never written are still undefined, everything else was left readable by the last composite
+    VkImageMemoryBarrier imageMemoryBarrier = {};
+    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageMemoryBarrier.oldLayout = m_imageVersions[layerIndex] == 0 ?
+        VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.image = m_shadowMapImage[frameIndex].GetImage();
+    imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+    imageMemoryBarrier.subresourceRange.levelCount = 1;
+    imageMemoryBarrier.subresourceRange.baseArrayLayer = layer;
+    imageMemoryBarrier.subresourceRange.layerCount = 1;
+    imageMemoryBarrier.srcAccessMask = 0;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+    VkImageCopy copyRegion = {};
+    copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    copyRegion.srcSubresource.mipLevel = 0;
+    copyRegion.srcSubresource.baseArrayLayer = layer;
+    copyRegion.srcSubresource.layerCount = 1;
+    copyRegion.dstSubresource = copyRegion.srcSubresource;
+    copyRegion.extent = { m_shadowExtent.width, m_shadowExtent.height, 1 };
+
+    vkCmdCopyImage(commandBuffer, m_staticCache.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        m_shadowMapImage[frameIndex].GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+    VkRenderPassBeginInfo renderPassBeginInfo = {};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = m_shadowMapRenderPass;
+    renderPassBeginInfo.renderArea.offset = { 0, 0 };
+    renderPassBeginInfo.renderArea.extent = m_shadowExtent;
+    renderPassBeginInfo.clearValueCount = 0;
+    renderPassBeginInfo.pClearValues = nullptr;
+    renderPassBeginInfo.framebuffer = m_shadowMapFramebuffers[layerIndex];
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    {
+        drawCasters(commandBuffer, frameIndex, layer, scene, casters, false);
     }
     vkCmdEndRenderPass(commandBuffer);
 }
 
-VkImageView ShadowMap::GetAnImageView()
+void ShadowMap::drawCasters(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t layer, Scene& scene,
+    const std::vector<uint32_t>& casters, bool staticCasters)
 {
-    return m_shadowMapImage[0].GetImageView();
+    VkPipeline pipeline = m_pipelineBuilder->Get(m_shadowMapPassPipeline);
+    if (pipeline == VK_NULL_HANDLE) return;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    RenderStats::CountPipelineBind();
+
+    VkDescriptorSet lightSpaceDescriptorSet = m_uboLightPerspective.GetDescriptorSet(frameIndex);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowMapPassPipelineLayout,
+        0, 1, &lightSpaceDescriptorSet, 0, nullptr);
+    RenderStats::CountDescriptorBinds(1);
+
+    const std::vector<glm::mat4>& transforms = scene.GetTransforms();
+    const std::vector<uint32_t>& flags = scene.GetFlags();
+    const std::vector<Mesh*>& meshes = scene.GetMeshes();
+
+    for (uint32_t caster : casters)
+    {
+        if (((flags[caster] & SCENE_FLAG_STATIC) != 0) != staticCasters)
+            continue;
+
+        Mesh* mesh = meshes[caster];
+
+        VkBuffer vertexBuffers[] = { mesh->GetVertexBuffer()->GetBuffer() };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        RenderStats::CountVertexBufferBind();
+
+        PushShadow pushShadow = {};
+        pushShadow.model = transforms[caster];
+        pushShadow.layer = layer;
+        vkCmdPushConstants(commandBuffer, m_shadowMapPassPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushShadow), &pushShadow);
+        RenderStats::CountPushConstants();
+    
+        if (mesh->Indexed())
+        {
+            vkCmdBindIndexBuffer(commandBuffer, mesh->GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexed(commandBuffer, mesh->GetIndexCount(), 1, 0, 0, 0);
+            RenderStats::CountDraw(mesh->GetIndexCount());
+        }
+        else
+        {
+            vkCmdDraw(commandBuffer, mesh->GetVertexCount(), 1, 0, 0);
+            RenderStats::CountDraw(mesh->GetVertexCount());
+        }
+    }
 }
 
-VkSampler ShadowMap::GetSampler()
+void ShadowMap::cullCasters(uint32_t layer, Scene& scene, std::vector<uint32_t>& casters)
 {
-    return m_shadowMapSampler;
+    Frustum frustum(m_uboLightPerspective.Data.viewProjection[layer]);
+    if (m_extendTowardsLight)
+        frustum.IgnorePlane(Frustum::Near);
+
+    casters.clear();
+
+    const std::vector<BoundingBox>& bounds = scene.GetBounds();
+    const std::vector<uint32_t>& flags = scene.GetFlags();
+
+    for (uint32_t i = 0; i < scene.GetCount(); ++i)
+    {
+        if (!(flags[i] & SCENE_FLAG_CASTS_SHADOWS))
+            continue;
+
+        if (!frustum.Intersects(bounds[i]))
+            continue;
+        if (m_cullWithCone && !m_cullingCone.Intersects(bounds[i]))
+            continue;
+
+        casters.push_back(i);
+    }
 }
 
 void ShadowMap::createDescriptorBinding(uint32_t binding)
@@ -251,15 +468,42 @@ void ShadowMap::createDescriptorWrites(uint32_t binding)
 
 void ShadowMap::createShadowMapImageAndSampler()
 {
-    m_shadowMapImage.resize(m_imageCount);
+    m_shadowMapImage.resize(m_frameCount);
+    
+    m_shadowMapLayerViews.resize(m_frameCount * m_layerCount);
+    m_imageVersions.assign(m_frameCount * m_layerCount, 0);
     
     for (size_t i = 0; i < m_shadowMapImage.size(); ++i)
     {
         m_shadowMapImage[i].Init(m_device, m_physicalDevice,
-            m_shadowExtent.width, m_shadowExtent.height, VK_FORMAT_D32_SFLOAT_S8_UINT,
+            m_shadowExtent.width, m_shadowExtent.height, m_shadowFormat,
             VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            VK_IMAGE_ASPECT_DEPTH_BIT);
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, m_layerCount);
+
+        for (uint32_t layer = 0; layer < m_layerCount; ++layer)
+        {
+            m_shadowMapLayerViews[i * m_layerCount + layer] = Image::CreateImageView(m_device, m_shadowMapImage[i].GetImage(),
+                m_shadowFormat, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_VIEW_TYPE_2D, layer, 1);
+        }
+    }
+
+    m_staticCache.Init(m_device, m_physicalDevice,
+        m_shadowExtent.width, m_shadowExtent.height, m_shadowFormat,
+        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_IMAGE_ASPECT_DEPTH_BIT, m_layerCount);
+
+    m_staticCacheLayerViews.resize(m_layerCount);
+    m_layerCaches.resize(m_layerCount);
+    m_layerCasters.resize(m_layerCount);
+    m_zoneNames.resize(m_layerCount);
+
+    for (uint32_t layer = 0; layer < m_layerCount; ++layer)
+    {
+        m_zoneNames[layer] = "Layer " + std::to_string(layer);
+        m_staticCacheLayerViews[layer] = Image::CreateImageView(m_device, m_staticCache.GetImage(),
+            m_shadowFormat, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_VIEW_TYPE_2D, layer, 1);
     }
 
     VkSamplerCreateInfo samplerCreateInfo = {};
@@ -276,6 +520,8 @@ void ShadowMap::createShadowMapImageAndSampler()
     samplerCreateInfo.minLod = 0.f;
     samplerCreateInfo.maxLod = 0.f;
     samplerCreateInfo.anisotropyEnable = VK_FALSE;
+    samplerCreateInfo.compareEnable = VK_TRUE;
+    samplerCreateInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
 
     VkResult result = vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_shadowMapSampler);
     CHECK_VK_RESULT(result, "Failed to create Depth Image Sampler");
@@ -283,33 +529,35 @@ void ShadowMap::createShadowMapImageAndSampler()
 
 void ShadowMap::createShadowMapRenderPass()
 {
-    VkAttachmentDescription depthAttachment = {};
-    depthAttachment.format = VK_FORMAT_D32_SFLOAT_S8_UINT;
-    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-
-    VkAttachmentReference depthAttachmentRef;
-    depthAttachmentRef.attachment = 0;
-    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 0;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
-
+    // Static casters: cleared and rendered into the cache, which is then only ever copied from
+    std::array<VkSubpassDependency, 2> staticDependencies{};
+
+    staticDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    staticDependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    staticDependencies[0].srcAccessMask = 0;
+    staticDependencies[0].dstSubpass = 0;
+    staticDependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    staticDependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    staticDependencies[1].srcSubpass = 0;
+    staticDependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    staticDependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    staticDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    staticDependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    staticDependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    m_staticCacheRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, staticDependencies);
+
+    // Dynamic casters: drawn on top of the copied cache, the result is sampled by the main pass
     std::array<VkSubpassDependency, 2> dependencies{};
 
     dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
     dependencies[0].dstSubpass = 0;
     dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     //dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
     dependencies[1].srcSubpass = 0;
@@ -320,6 +568,32 @@ void ShadowMap::createShadowMapRenderPass()
     dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
     //dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+    m_shadowMapRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, dependencies);
+}
+
+VkRenderPass ShadowMap::createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout,
+    const std::array<VkSubpassDependency, 2>& dependencies)
+{
+    VkAttachmentDescription depthAttachment = {};
+    depthAttachment.format = m_shadowFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = loadOp;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = initialLayout;
+    depthAttachment.finalLayout = finalLayout;
+
+    VkAttachmentReference depthAttachmentRef;
+    depthAttachmentRef.attachment = 0;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 0;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
     VkRenderPassCreateInfo renderPassCreateInfo = {};
     renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderPassCreateInfo.attachmentCount = 1;
@@ -329,19 +603,21 @@ void ShadowMap::createShadowMapRenderPass()
     renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
     renderPassCreateInfo.pDependencies = dependencies.data();
 
-    VkResult result = vkCreateRenderPass(m_device, &renderPassCreateInfo, nullptr, &m_shadowMapRenderPass);
+    VkRenderPass renderPass;
+    VkResult result = vkCreateRenderPass(m_device, &renderPassCreateInfo, nullptr, &renderPass);
     CHECK_VK_RESULT(result, "Failed to create Render Pass");
+    return renderPass;
 }
 
 void ShadowMap::createShadowMapFrameBuffers()
 {
-    m_shadowMapFramebuffers.resize(m_imageCount);
+    m_shadowMapFramebuffers.resize(m_shadowMapLayerViews.size());
 
     for (size_t i = 0; i < m_shadowMapFramebuffers.size(); ++i)
     {
         std::array<VkImageView, 1> attachments =
         {
-            m_shadowMapImage[i].GetImageView()
+            m_shadowMapLayerViews[i]
         };
 
         VkFramebufferCreateInfo frameBufferCreateInfo = {};
@@ -356,11 +632,28 @@ void ShadowMap::createShadowMapFrameBuffers()
         VkResult result = vkCreateFramebuffer(m_device, &frameBufferCreateInfo, nullptr, &m_shadowMapFramebuffers[i]);
         CHECK_VK_RESULT(result, "Failed to create Framebuffer");
     }
+
+    m_staticCacheFramebuffers.resize(m_staticCacheLayerViews.size());
+
+    for (size_t i = 0; i < m_staticCacheFramebuffers.size(); ++i)
+    {
+        VkFramebufferCreateInfo frameBufferCreateInfo = {};
+        frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        frameBufferCreateInfo.renderPass = m_staticCacheRenderPass;
+        frameBufferCreateInfo.width = m_shadowExtent.width;
+        frameBufferCreateInfo.height = m_shadowExtent.height;
+        frameBufferCreateInfo.attachmentCount = 1;
+        frameBufferCreateInfo.pAttachments = &m_staticCacheLayerViews[i];
+        frameBufferCreateInfo.layers = 1;
+
+        VkResult result = vkCreateFramebuffer(m_device, &frameBufferCreateInfo, nullptr, &m_staticCacheFramebuffers[i]);
+        CHECK_VK_RESULT(result, "Failed to create Framebuffer");
+    }
 }
 
 void ShadowMap::createPipeline()
 {
-    VkPipelineShaderStageCreateInfo shaderStages[] = { loadShader(m_device, "depthMap.vert.spv", VK_SHADER_STAGE_VERTEX_BIT) };
+    VkPipelineShaderStageCreateInfo shaderStages[] = { ShaderLibrary::GetStage("depthMap.vert.spv") };
     
     auto vertexBindingDescription = Vertex::getBindingDescription();
     auto vertexAttributeDescriptions = Vertex::getAttributeDescriptions();
@@ -385,8 +678,11 @@ void ShadowMap::createPipeline()
 
     // -- RASTERIZER --
 
+    // Slope scaled bias, the tight cascade projections make a constant bias in the shader alone too coarse
     VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo =
-        defaultRasterizerCreateInfo(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE);
+        defaultRasterizerCreateInfo(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_TRUE);
+    rasterizerCreateInfo.depthBiasConstantFactor = 1.25f;
+    rasterizerCreateInfo.depthBiasSlopeFactor = 1.75f;
     
     // -- MULTISAMPLING --
 
@@ -411,7 +707,7 @@ void ShadowMap::createPipeline()
     // -- PIPELINE LAYOUT --
 
     VkPushConstantRange worldPushConstantRange = {};
-    worldPushConstantRange.size = sizeof(PushModel);
+    worldPushConstantRange.size = sizeof(PushShadow);
     worldPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     worldPushConstantRange.offset = 0;
     
@@ -461,6 +757,5 @@ void ShadowMap::createPipeline()
     pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCreateInfo.basePipelineIndex = -1;
 
-    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_shadowMapPassPipeline);
-    CHECK_VK_RESULT(result, "Failed to create Graphics Pipeline");
+    m_shadowMapPassPipeline = m_pipelineBuilder->Submit("Shadow Map", pipelineCreateInfo);
 }
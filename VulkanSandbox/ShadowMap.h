@@ -1,32 +1,54 @@
 #pragma once
 
+#include <string>
+
 #include "Camera.h"
+#include "Frustum.h"
 #include "Image.h"
+#include "PipelineBuilder.h"
 #include "UniformBuffer.h"
 
-class Object;
+class GpuProfiler;
+class Scene;
+
+struct UboLightSpace
+{
+    glm::mat4 viewProjection[SHADOW_CASCADE_COUNT];
+};
 
 class ShadowMap
 {
 public:
     ShadowMap();
 
-    static void StaticInit(VkDevice device, uint32_t imageCount);
-    static void UpdateDescriptorSets(VkDevice device, uint32_t imageCount);
+    static void StaticInit(VkDevice device, uint32_t frameCount);
+    static void UpdateDescriptorSets(VkDevice device, uint32_t frameCount);
     static void StaticDestroy(VkDevice device);
 
     static VkDescriptorSetLayout GetDescriptorSetLayout();
-    static VkDescriptorSet GetDescriptorSet(uint32_t imageIndex);
+    static VkDescriptorSet GetDescriptorSet(uint32_t frameIndex);
     
-    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t imageCount, float shadowMapWidth, float shadowMapHeight, uint32_t
-              binding);
-    void FinishInit(uint32_t binding);
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount, float shadowMapWidth, float shadowMapHeight, uint32_t
+              binding, uint32_t layerCount = 1);
+    // The pipeline is built in the background, layers are only cleared until it is done
+    void FinishInit(uint32_t binding, PipelineBuilder* pipelineBuilder);
     void Destroy();
 
-    UboViewProjection* PerspectiveData();
-    void UpdateUbo(uint32_t imageIndex);
+    UboLightSpace* PerspectiveData();
+    void UpdateUbo(uint32_t frameIndex);
+
+    // Every layer gets its own profiler zone if a profiler is given
+    void RecordCommands(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene& scene, GpuProfiler* profiler = nullptr);
+
+    void SetCachingEnabled(bool enabled);
+    uint32_t GetRenderedLayerCount();
 
-    void RecordCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex, const std::vector<Object*>& objects);
+    // -- CULLING --
+    // Every layer draws only the casters inside its light space frustum. A spot light is additionally
+    // tested against its cone, a directional light also keeps casters between the light and the frustum.
+    void SetCullingCone(const glm::vec3& position, const glm::vec3& direction, float angle, float range);
+    void SetExtendTowardsLight(bool extend);
+    uint32_t GetCasterCount();      // Casters drawn over all layers in the last recording
 
     VkImageView GetAnImageView();
     VkSampler GetSampler();
@@ -34,22 +56,66 @@ public:
 private:
     VkDevice m_device;
     VkPhysicalDevice m_physicalDevice;
-    uint32_t m_imageCount;
+    uint32_t m_frameCount;
+    uint32_t m_layerCount;
+    std::vector<std::string> m_zoneNames;
+    VkFormat m_shadowFormat;
     
-    UniformBuffer<UboViewProjection> m_uboLightPerspective;
+    UniformBuffer<UboLightSpace> m_uboLightPerspective;
     VkExtent2D m_shadowExtent;
     std::vector<Image> m_shadowMapImage;
-    VkPipeline m_shadowMapPassPipeline;
+    std::vector<VkImageView> m_shadowMapLayerViews;     // frameIndex * m_layerCount + layer
+    PipelineBuilder* m_pipelineBuilder;
+    PipelineBuilder::Handle m_shadowMapPassPipeline;
     VkPipelineLayout m_shadowMapPassPipelineLayout;
     VkRenderPass m_shadowMapRenderPass;
-    std::vector<VkFramebuffer> m_shadowMapFramebuffers;
+    std::vector<VkFramebuffer> m_shadowMapFramebuffers; // One per layer, same indexing as m_shadowMapLayerViews
     VkSampler m_shadowMapSampler;
 
+    // -- SHADOW CACHE --
+    // Static casters are rendered once into m_staticCache, every shadow map image gets a copy of it
+    // with the dynamic casters drawn on top. Nothing is rendered while both stay unchanged.
+    struct LayerCache
+    {
+        bool valid = false;
+        glm::mat4 viewProjection;
+        uint64_t staticCasters = 0;
+        uint64_t dynamicCasters = 0;
+        uint64_t version = 0;
+    };
+
+    Image m_staticCache;
+    std::vector<VkImageView> m_staticCacheLayerViews;
+    std::vector<VkFramebuffer> m_staticCacheFramebuffers;
+    VkRenderPass m_staticCacheRenderPass;
+    std::vector<LayerCache> m_layerCaches;
+    std::vector<uint64_t> m_imageVersions;              // Cache version each image layer holds, same indexing as m_shadowMapLayerViews
+    bool m_cachingEnabled = true;
+    uint32_t m_renderedLayerCount = 0;
+
+    std::vector<std::vector<uint32_t>> m_layerCasters;  // Scene indices of the culled casters per layer, reused every frame
+    Cone m_cullingCone;
+    bool m_cullWithCone = false;
+    bool m_extendTowardsLight = false;
+    uint32_t m_casterCount = 0;
+
+    void cullCasters(uint32_t layer, Scene& scene, std::vector<uint32_t>& casters);
+
+    void recordStaticLayer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t layer, Scene& scene,
+                           const std::vector<uint32_t>& casters);
+    void recordCompositeLayer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t layer, Scene& scene,
+                              const std::vector<uint32_t>& casters);
+    void drawCasters(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t layer, Scene& scene,
+                     const std::vector<uint32_t>& casters, bool staticCasters);
+
     void createDescriptorBinding(uint32_t binding);
     void createShadowMapImageAndSampler();
     void createDescriptorWrites(uint32_t binding);
     void createShadowMapRenderPass();
     void createShadowMapFrameBuffers();
     void createPipeline();
+
+    VkRenderPass createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout,
+                                  const std::array<VkSubpassDependency, 2>& dependencies);
     
 };
@@ -0,0 +1,236 @@
+#include "TransformHierarchy.h"
+
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRANSFORM_HIERARCHY_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+    const uint32_t NO_PARENT = UINT32_MAX;
+
+    void composeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, glm::mat4& out)
+    {
+        glm::mat3 rotationMatrix = glm::mat3_cast(rotation);
+        out[0] = glm::vec4(rotationMatrix[0] * scale.x, 0.f);
+        out[1] = glm::vec4(rotationMatrix[1] * scale.y, 0.f);
+        out[2] = glm::vec4(rotationMatrix[2] * scale.z, 0.f);
+        out[3] = glm::vec4(position, 1.f);
+    }
+
+    // out = a * b, each column of out is the columns of a weighted by a column of b
+    void multiplyTransforms(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+    {
+#ifdef TRANSFORM_HIERARCHY_SSE
+        __m128 a0 = _mm_loadu_ps(&a[0][0]);
+        __m128 a1 = _mm_loadu_ps(&a[1][0]);
+        __m128 a2 = _mm_loadu_ps(&a[2][0]);
+        __m128 a3 = _mm_loadu_ps(&a[3][0]);
+
+        for (int i = 0; i < 4; ++i)
+        {
+            __m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[i][0]));
+            column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[i][1])));
+            column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[i][2])));
+            column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[i][3])));
+            _mm_storeu_ps(&out[i][0], column);
+        }
+#else
+        out = a * b;
+#endif
+    }
+}
+
+TransformHierarchy::TransformHierarchy()
+{
+}
+
+TransformHandle TransformHierarchy::Create(TransformHandle parent, const glm::vec3& position, const glm::quat& rotation,
+    const glm::vec3& scale)
+{
+    uint32_t parentIndex = NO_PARENT;
+    if (parent.slot != UINT32_MAX)
+        parentIndex = GetIndex(parent);
+
+    uint32_t slot;
+    if (!m_freeSlots.empty())
+    {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        slot = static_cast<uint32_t>(m_slots.size());
+        m_slots.push_back({ 0, 0 });
+    }
+
+    // Appending keeps the order topological, the parent already exists
+    uint32_t index = static_cast<uint32_t>(m_parents.size());
+    m_slots[slot].index = index;
+
+    m_positions.push_back(position);
+    m_rotations.push_back(rotation);
+    m_scales.push_back(scale);
+    m_parents.push_back(parentIndex);
+    m_dirty.push_back(1);
+    m_changed.push_back(0);
+    m_removed.push_back(0);
+    m_localTransforms.push_back(glm::mat4(1.f));
+    m_worldTransforms.push_back(glm::mat4(1.f));
+    m_slotOfIndex.push_back(slot);
+
+    TransformHandle handle;
+    handle.slot = slot;
+    handle.generation = m_slots[slot].generation;
+    return handle;
+}
+
+void TransformHierarchy::Destroy(TransformHandle handle)
+{
+    uint32_t index = GetIndex(handle);
+
+    // Removing in place would break the order, so it waits for the next Update
+    m_removed[index] = 1;
+    m_hasRemoved = true;
+
+    ++m_slots[handle.slot].generation;
+    m_freeSlots.push_back(handle.slot);
+}
+
+bool TransformHierarchy::IsValid(TransformHandle handle)
+{
+    return handle.slot < m_slots.size() && m_slots[handle.slot].generation == handle.generation;
+}
+
+void TransformHierarchy::SetLocal(TransformHandle handle, const glm::vec3& position, const glm::quat& rotation,
+    const glm::vec3& scale)
+{
+    uint32_t index = GetIndex(handle);
+
+    m_positions[index] = position;
+    m_rotations[index] = rotation;
+    m_scales[index] = scale;
+    m_dirty[index] = 1;
+}
+
+void TransformHierarchy::Update()
+{
+    if (m_hasRemoved) compact();
+
+    uint32_t count = GetCount();
+
+    // Local matrices don't depend on each other, compose all dirty ones first
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (m_dirty[i])
+            composeTransform(m_positions[i], m_rotations[i], m_scales[i], m_localTransforms[i]);
+    }
+
+    // A parent comes first, its world matrix is final by the time its children read it
+    m_changedCount = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t parent = m_parents[i];
+        uint8_t changed = m_dirty[i] | (parent != NO_PARENT ? m_changed[parent] : 0);
+
+        m_changed[i] = changed;
+        m_dirty[i] = 0;
+        if (!changed) continue;
+
+        if (parent == NO_PARENT)
+            m_worldTransforms[i] = m_localTransforms[i];
+        else
+            multiplyTransforms(m_worldTransforms[parent], m_localTransforms[i], m_worldTransforms[i]);
+
+        ++m_changedCount;
+    }
+}
+
+uint32_t TransformHierarchy::GetIndex(TransformHandle handle)
+{
+    if (!IsValid(handle))
+        throw std::runtime_error("Invalid Transform Handle");
+
+    return m_slots[handle.slot].index;
+}
+
+uint32_t TransformHierarchy::GetCount()
+{
+    return static_cast<uint32_t>(m_parents.size());
+}
+
+const std::vector<glm::mat4>& TransformHierarchy::GetWorldTransforms()
+{
+    return m_worldTransforms;
+}
+
+const std::vector<uint8_t>& TransformHierarchy::GetChanged()
+{
+    return m_changed;
+}
+
+uint32_t TransformHierarchy::GetChangedCount()
+{
+    return m_changedCount;
+}
+
+void TransformHierarchy::compact()
+{
+    uint32_t count = GetCount();
+    m_remap.resize(count);
+
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t parent = m_parents[i];
+
+        // The parent was visited before, if it went away so does this node
+        if (!m_removed[i] && parent != NO_PARENT && m_remap[parent] == NO_PARENT)
+        {
+            m_removed[i] = 1;
+            ++m_slots[m_slotOfIndex[i]].generation;
+            m_freeSlots.push_back(m_slotOfIndex[i]);
+        }
+
+        if (m_removed[i])
+        {
+            m_remap[i] = NO_PARENT;
+            continue;
+        }
+
+        // Moving towards the front keeps the relative order
+        if (next != i)
+        {
+            m_positions[next] = m_positions[i];
+            m_rotations[next] = m_rotations[i];
+            m_scales[next] = m_scales[i];
+            m_dirty[next] = m_dirty[i];
+            m_changed[next] = m_changed[i];
+            m_removed[next] = 0;
+            m_localTransforms[next] = m_localTransforms[i];
+            m_worldTransforms[next] = m_worldTransforms[i];
+            m_slotOfIndex[next] = m_slotOfIndex[i];
+
+            m_slots[m_slotOfIndex[next]].index = next;
+        }
+
+        m_parents[next] = parent == NO_PARENT ? NO_PARENT : m_remap[parent];
+        m_remap[i] = next;
+        ++next;
+    }
+
+    m_positions.resize(next);
+    m_rotations.resize(next);
+    m_scales.resize(next);
+    m_parents.resize(next);
+    m_dirty.resize(next);
+    m_changed.resize(next);
+    m_removed.resize(next);
+    m_localTransforms.resize(next);
+    m_worldTransforms.resize(next);
+    m_slotOfIndex.resize(next);
+
+    m_hasRemoved = false;
+}
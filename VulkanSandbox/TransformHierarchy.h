@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct TransformHandle
+{
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// -- TRANSFORM HIERARCHY --
+// Nodes hold a local position, rotation and scale and a parent. Setting them only marks the node dirty, Update
+// composes the dirty local matrices and recomputes the world matrices of dirty nodes and everything below them once
+// per frame. The tables are kept in topological order, a parent always comes before its children, so that is a single
+// linear pass.
+class TransformHierarchy
+{
+public:
+    TransformHierarchy();
+
+    // Pass an invalid handle to create a root
+    TransformHandle Create(TransformHandle parent, const glm::vec3& position, const glm::quat& rotation,
+                           const glm::vec3& scale);
+    // Destroys the node and all of its descendants, the tables are compacted in the next Update
+    void Destroy(TransformHandle handle);
+    bool IsValid(TransformHandle handle);
+
+    void SetLocal(TransformHandle handle, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+    void Update();
+
+    // -- TABLES --
+    // Indices are only stable until the next Update
+    uint32_t GetIndex(TransformHandle handle);
+    uint32_t GetCount();
+
+    const std::vector<glm::mat4>& GetWorldTransforms();
+    // 1 for every node whose world matrix was recomputed in the last Update
+    const std::vector<uint8_t>& GetChanged();
+    uint32_t GetChangedCount();
+
+private:
+    struct Slot
+    {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    std::vector<glm::vec3> m_positions;
+    std::vector<glm::quat> m_rotations;
+    std::vector<glm::vec3> m_scales;
+    std::vector<uint32_t> m_parents;
+    std::vector<uint8_t> m_dirty;
+    std::vector<uint8_t> m_changed;
+    std::vector<uint8_t> m_removed;
+    std::vector<glm::mat4> m_localTransforms;
+    std::vector<glm::mat4> m_worldTransforms;
+    std::vector<uint32_t> m_slotOfIndex;
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+
+    bool m_hasRemoved = false;
+    uint32_t m_changedCount = 0;
+
+    std::vector<uint32_t> m_remap;
+
+    void compact();
+
+};
@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "Buffer.h"
+#include "ShaderLibrary.h"
 #include "Utilities.h"
 
 template <typename T>
@@ -12,16 +13,25 @@ public:
     UniformBuffer() {}
     ~UniformBuffer() {}
 
-    void Init(VkDevice device, VkPhysicalDevice physicalDevice, VkShaderStageFlags stage, VkDescriptorType type,
-              uint32_t binding, uint32_t amount)
+    // The set has to declare exactly one buffer, its layout comes from the shaders
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, const ShaderLibrary::SetLayout& setLayout, uint32_t amount)
     {
         m_device = device;
         m_physicalDevice = physicalDevice;
-        
-        createLayout(type, stage, binding);
-        createPool(type, amount);
-        createBuffers(amount);
-        createSets(type, amount);
+
+        if (setLayout.bindings.size() != 1)
+            throw std::runtime_error("Uniform Buffer set must have exactly one binding");
+
+        const VkDescriptorSetLayoutBinding& binding = setLayout.bindings[0];
+        if (binding.descriptorType != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER &&
+            binding.descriptorType != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+            throw std::runtime_error("Uniform Buffer binding is not a buffer");
+
+        m_setLayout = setLayout.layout;
+
+        createPool(binding.descriptorType, amount);
+        createBuffers(binding.descriptorType, amount);
+        createSets(binding.descriptorType, binding.binding, amount);
     }
     
     void Destroy()
@@ -31,7 +41,6 @@ public:
             m_buffers[i].Destroy(m_device);
         }
         vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
-        vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
     }
 
     void Update(uint32_t index)
@@ -58,29 +67,11 @@ private:
     VkDevice m_device;
     VkPhysicalDevice m_physicalDevice;
     
-    VkDescriptorSetLayout m_setLayout;
+    VkDescriptorSetLayout m_setLayout;      // Owned by the shader library
     VkDescriptorPool m_descriptorPool;
     std::vector<Buffer> m_buffers;
     std::vector<VkDescriptorSet> m_descriptorSets;
 
-    void createLayout(VkDescriptorType type, VkShaderStageFlags stage, uint32_t binding)
-    {
-        VkDescriptorSetLayoutBinding layoutBinding = {};
-        layoutBinding.binding = binding;
-        layoutBinding.descriptorType = type;
-        layoutBinding.descriptorCount = 1;
-        layoutBinding.stageFlags = stage;
-        layoutBinding.pImmutableSamplers = nullptr;
-
-        VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
-        layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutCreateInfo.bindingCount = 1;
-        layoutCreateInfo.pBindings = &layoutBinding;
-
-        VkResult result = vkCreateDescriptorSetLayout(m_device, &layoutCreateInfo, nullptr, &m_setLayout);
-        CHECK_VK_RESULT(result, "Failed to create Descriptor Set Layout");
-    }
-
     void createPool(VkDescriptorType type, uint32_t count)
     {
         VkDescriptorPoolSize poolSize = {};
@@ -97,21 +88,23 @@ private:
         CHECK_VK_RESULT(result, "Failed to create Descriptor Pool");
     }
 
-    void createBuffers(uint32_t count)
+    void createBuffers(VkDescriptorType type, uint32_t count)
     {
         VkDeviceSize bufferSize = sizeof(T);
+        VkBufferUsageFlags usage = type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ?
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
         
         m_buffers.resize(count);
 
         for (uint32_t i = 0; i < count; ++i)
         {
             m_buffers[i].Init(m_device, m_physicalDevice,
-                bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                bufferSize, usage,
                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
         }
     }
 
-    void createSets(VkDescriptorType type, uint32_t count)
+    void createSets(VkDescriptorType type, uint32_t binding, uint32_t count)
     {
         m_descriptorSets.resize(count);
 
@@ -135,7 +128,7 @@ private:
 
             VkWriteDescriptorSet vpSetWrite = {};
             vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            vpSetWrite.dstBinding = 0;
+            vpSetWrite.dstBinding = binding;
             vpSetWrite.dstSet = m_descriptorSets[i];
             vpSetWrite.dstArrayElement = 0;
             vpSetWrite.descriptorType = type;
@@ -23,25 +23,47 @@ const std::vector<const char*> deviceExtensions = {
 
 constexpr uint32_t MAX_TEXTURE_COUNT = 256;
 
-struct UboFragSettings
+// Debug views of shader.frag, any of them can be combined
+enum DebugViewFlags
 {
-    uint32_t bDrawShadowDepth;
+    DEBUG_VIEW_SHADOW_ATLAS = 1 << 0,   // What the first spot light sees
+    DEBUG_VIEW_CASCADES = 1 << 1,
+    DEBUG_VIEW_CLUSTERS = 1 << 2
+};
+
+// Specialization constants of shader.frag, in constant_id order. Every combination is its own pipeline, so whatever
+// is switched off here is compiled out of the shader instead of branched over.
+struct ShaderPermutation
+{
+    uint32_t shadowFilterPoisson = 0;   // 0 PCF grid, 1 Poisson disk
+    int32_t shadowFilterRadius = 1;     // Grid of (2 * radius + 1)^2 taps, or the Poisson disk radius in texels
+    uint32_t shaded = 1;                // Receives shadows
+    uint32_t spotLights = 1;
+    uint32_t pointLights = 1;
+    uint32_t debugView = 0;             // DEBUG_VIEW_* bits
+
+    // Unique for radii up to 7
+    uint32_t GetKey() const
+    {
+        return shadowFilterPoisson | (static_cast<uint32_t>(shadowFilterRadius) << 1) | (spotLights << 4) |
+            (pointLights << 5) | (debugView << 6) | (shaded << 9);
+    }
 };
 
 struct UboDirLight
 {
     glm::vec4 dlDirection = { 0.f, -1.f, -1.f, 0.f };
-
-    glm::vec4 slPosition = { 0.f, 1.5f, 150.f, 0.f };
-    glm::vec4 slDirection = { 0.f, 0.f, -1.f, 0.f };
-    float slStrength = 10.f;
-    float slCutoff = 60.f;
 };
 
 struct PushModel
 {
     glm::mat4 model;
-    uint32_t shaded;
+};
+
+struct PushShadow
+{
+    glm::mat4 model;
+    uint32_t layer;
 };
 
 struct Vertex
@@ -177,40 +199,11 @@ static VkFormat chooseSupportedFormat(VkPhysicalDevice physicalDevice, const std
     throw std::runtime_error("Failed to find a matching format");
 }
 
-static VkCommandBuffer beginCommandBuffer(VkDevice device, VkCommandPool commandPool)
-{
-    VkCommandBuffer commandBuffer;
-
-    VkCommandBufferAllocateInfo commandBufferAllocInfo = {};
-    commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocInfo.commandPool = commandPool;
-    commandBufferAllocInfo.commandBufferCount = 1;
-
-    CHECK_VK_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocInfo, &commandBuffer), "Failed to allocate Command Buffer");
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    CHECK_VK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo), "Failed to begin Command Buffer");
-    return commandBuffer;
-}
-
-static void endCommandBufferAndSubmit(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer)
+// Depth only, shadow maps never use stencil. Linear filtering is needed for hardware PCF.
+static VkFormat chooseShadowMapFormat(VkPhysicalDevice physicalDevice)
 {
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    CHECK_VK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE), "Failed to submit Command Buffer to Queue");
-
-    vkQueueWaitIdle(queue);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    return chooseSupportedFormat(physicalDevice, { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }, VK_IMAGE_TILING_OPTIMAL,
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
 }
 
 static VkSampleCountFlagBits getMaxUsableSampleCount(VkPhysicalDevice physicalDevice)
@@ -229,28 +222,6 @@ static VkSampleCountFlagBits getMaxUsableSampleCount(VkPhysicalDevice physicalDe
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
-static VkPipelineShaderStageCreateInfo loadShader(VkDevice device, const std::string& file, VkShaderStageFlagBits stage)
-{
-    auto shaderSpv = readFile("shaders/" + file);
-
-    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
-    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderModuleCreateInfo.codeSize = shaderSpv.size();
-    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(shaderSpv.data());
-
-    VkShaderModule shaderModule;
-    VkResult result = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &shaderModule);
-    CHECK_VK_RESULT(result, "Failed to create Shader Module");
-
-    VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {};
-    shaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStageCreateInfo.stage = stage;
-    shaderStageCreateInfo.module = shaderModule;
-    shaderStageCreateInfo.pName = "main";
-
-    return shaderStageCreateInfo;
-}
-
 static VkPipelineViewportStateCreateInfo defaultViewportFlipped(VkExtent2D extent)
 {
     static VkViewport viewport = {};
@@ -1,6 +1,11 @@
 #include "VulkanRenderer.h"
 
 #include <SDL_vulkan.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <set>
 #include <stdexcept>
@@ -11,8 +16,14 @@
 #include "imgui/imgui_impl_vulkan.h"
 #include "imgui/ImGuizmo.h"
 
+#include "AllocationCounter.h"
+#include "Buffer.h"
+#include "CpuProfiler.h"
 #include "Engine.h"
+#include "GpuMemory.h"
 #include "MaterialManager.h"
+#include "PngWriter.h"
+#include "ShaderLibrary.h"
 #include "Window.h"
 
 VulkanRenderer::VulkanRenderer()
@@ -26,51 +37,65 @@ VulkanRenderer::~VulkanRenderer()
 
 void VulkanRenderer::Init()
 {
+    CPU_ZONE("Renderer Init");
+
+    m_initTime = CpuProfiler::GetTime();
+
     try
     {
         createInstance();
-        createWindowSurface();
+        if (!m_headless) createWindowSurface();
         getPhysicalDevice();
         createLogicalDevice();
-        createSwapchain();
-        createDepthBufferImage();
-        createRenderPass();
+        ShaderLibrary::Init(m_device.logicalDevice);
+        m_pipelineBuilder.Init(m_device.logicalDevice);
+        if (m_headless) createOffscreenImages();
+        else createSwapchain();
         
         m_uboViewProjection.Init(m_device.logicalDevice, m_device.physicalDevice,
-            VK_SHADER_STAGE_VERTEX_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            static_cast<uint32_t>(m_swapchainImages.size()));
+            ShaderLibrary::GetSetLayout({ "vert.spv", "frag.spv" }, 0), MAX_FRAMES_IN_FLIGHT);
 
         m_uboPointLight.Init(m_device.logicalDevice, m_device.physicalDevice,
-            VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            static_cast<uint32_t>(m_swapchainImages.size()));
-
-        m_uboFragSettings.Init(m_device.logicalDevice, m_device.physicalDevice,
-            VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-            static_cast<uint32_t>(m_swapchainImages.size()));
+            ShaderLibrary::GetSetLayout({ "vert.spv", "frag.spv" }, 2), MAX_FRAMES_IN_FLIGHT);
 
         MaterialManager::Init(m_device.logicalDevice, m_device.physicalDevice);
 
         m_dlShadowMap.Init(m_device.logicalDevice, m_device.physicalDevice,
-            static_cast<uint32_t>(m_swapchainImages.size()), 1024, 1024,
-            0);
+            MAX_FRAMES_IN_FLIGHT, SHADOW_CASCADE_SIZE, SHADOW_CASCADE_SIZE,
+            0, SHADOW_CASCADE_COUNT);
+
+        ShadowMap::StaticInit(m_device.logicalDevice, MAX_FRAMES_IN_FLIGHT);
 
-        m_slShadowMap.Init(m_device.logicalDevice, m_device.physicalDevice,
-            static_cast<uint32_t>(m_swapchainImages.size()), 1024, 1024,
-            1);
+        m_dlShadowMap.FinishInit(0, &m_pipelineBuilder);
+        m_dlShadowMap.SetExtendTowardsLight(true);
 
-        ShadowMap::StaticInit(m_device.logicalDevice, static_cast<uint32_t>(m_swapchainImages.size()));
+        ShadowMap::UpdateDescriptorSets(m_device.logicalDevice, MAX_FRAMES_IN_FLIGHT);
 
-        m_dlShadowMap.FinishInit(0);
-        m_slShadowMap.FinishInit(1);
+        m_shadowAtlas.Init(m_device.logicalDevice, m_device.physicalDevice,
+            MAX_FRAMES_IN_FLIGHT, SHADOW_ATLAS_SIZE, &m_pipelineBuilder);
+        m_spotLights.push_back(SpotLight());
 
-        ShadowMap::UpdateDescriptorSets(m_device.logicalDevice, static_cast<uint32_t>(m_swapchainImages.size()));
+        m_lightClusters.Init(m_device.logicalDevice, m_device.physicalDevice, MAX_FRAMES_IN_FLIGHT);
 
+        m_pointShadowMap.Init(m_device.logicalDevice, m_device.physicalDevice,
+            MAX_FRAMES_IN_FLIGHT, POINT_SHADOW_SIZE, &m_pipelineBuilder);
+        m_pointLights.push_back(PointLight());
+
+        m_gpuProfiler.Init(m_device.logicalDevice, m_device.physicalDevice,
+            static_cast<uint32_t>(getQueueFamilies(m_device.physicalDevice).graphicsQueueFamily), MAX_FRAMES_IN_FLIGHT);
+
+        m_renderStats.Init(m_device.logicalDevice, m_device.physicalDevice, MAX_FRAMES_IN_FLIGHT);
+
+        m_renderGraph.Init(m_device.logicalDevice, m_device.physicalDevice, MAX_FRAMES_IN_FLIGHT, &m_gpuProfiler);
+        buildRenderGraph();
         
         createPipeline();
-        createFrameBuffers();
-        createCommandPool();
-        createGraphicsCommandBuffer();
-        createSynchronization();
+        createCommandAllocator();
+        createFrameContexts();
+
+        m_assetLoader.Init(m_device.logicalDevice, m_graphicsQueue,
+            static_cast<uint32_t>(getQueueFamilies(m_device.physicalDevice).graphicsQueueFamily));
+        MaterialManager::InitPlaceholder(m_graphicsQueue, m_commandAllocator);
 
         initImGui();
 
@@ -80,35 +105,38 @@ void VulkanRenderer::Init()
         
         auto obj = new Object("Building");
         m_objects.push_back(obj);
-        obj->Init(m_device.logicalDevice, m_device.physicalDevice, m_graphicsQueue, m_graphicsCommandPool, "objects/SmallBuilding01.obj");
         obj->SetPosition({0.f, -8.7f, 0.f});
         obj->SetScale({10.f, 10.f, 10.f});
+        obj->Load(m_device.logicalDevice, m_device.physicalDevice, m_assetLoader, "objects/SmallBuilding01.obj", &m_scene);
 
         auto obj2 = new Object("Ground");
         m_objects.push_back(obj2);
-        obj2->Init(m_device.logicalDevice, m_device.physicalDevice, m_graphicsQueue, m_graphicsCommandPool, "objects/Untitled-1.obj");
         obj2->SetPosition({0.f, -25.f, 0.f});
         obj2->SetScale({500.f, 0.5f, 800.f});
+        obj2->Load(m_device.logicalDevice, m_device.physicalDevice, m_assetLoader, "objects/Untitled-1.obj", &m_scene);
 
         auto light = new Object("Light");
         m_objects.push_back(light);
-        light->Init(m_device.logicalDevice, m_device.physicalDevice, m_graphicsQueue, m_graphicsCommandPool, "objects/light.obj");
         //light->SetPosition(glm::vec3(0.f, 5.f, 10.f));
         light->SetScale(glm::vec3(0.5f, 0.5f, 0.5f));
+        light->SetCastsShadows(false);
+        light->SetShaded(false);
+        light->Load(m_device.logicalDevice, m_device.physicalDevice, m_assetLoader, "objects/light.obj", &m_scene);
 
         /*auto obj4 = new Object("Building2");
         m_objects.push_back(obj4);
-        obj4->Init(m_device.logicalDevice, m_device.physicalDevice, m_graphicsQueue, m_graphicsCommandPool, "objects/Cottage_FREE.obj");
+        obj4->Init(m_device.logicalDevice, m_device.physicalDevice, m_graphicsQueue, m_commandAllocator, "objects/Cottage_FREE.obj");
         obj4->SetPosition({150.f, -8.7f, 0.f});
         obj4->SetScale({10.f, 10.f, 10.f});
 
         auto obj5 = new Object("Building3");
         m_objects.push_back(obj5);
-        obj5->Init(m_device.logicalDevice, m_device.physicalDevice, m_graphicsQueue, m_graphicsCommandPool, "objects/Cottage_FREE.obj");
+        obj5->Init(m_device.logicalDevice, m_device.physicalDevice, m_graphicsQueue, m_commandAllocator, "objects/Cottage_FREE.obj");
         obj5->SetPosition({-150.f, -8.7f, 0.f});
         obj5->SetScale({10.f, 10.f, 10.f});*/
 
-        m_terrain.Init(m_device.logicalDevice, m_device.physicalDevice, m_graphicsQueue, m_graphicsCommandPool, "textures/heightmap-1.png");
+        // Not drawn, so it never goes into the scene
+        m_terrain.Load(m_device.logicalDevice, m_device.physicalDevice, m_assetLoader, "textures/heightmap-1.png", nullptr);
     }
     catch (const std::runtime_error& err)
     {
@@ -117,8 +145,24 @@ void VulkanRenderer::Init()
     }
 }
 
+void VulkanRenderer::InitHeadless(uint32_t width, uint32_t height)
+{
+    m_headless = true;
+    m_swapchainExtent = { width, height };
+    Init();
+}
+
 void VulkanRenderer::Update(float deltaTime)
 {
+    CPU_ZONE("Update");
+
+    // Other processes change the budget too, so it is queried every frame
+    GpuMemory::UpdateBudget();
+
+    // Before the frame's allocations are counted, completing an object adds it to the scene
+    m_assetLoader.Update(ASSET_UPLOAD_BUDGET);
+    updateLoadTimes();
+
     float cameraSpeed = 50.f * deltaTime;
     if (ImGui::IsKeyDown(ImGuiKey_LeftShift))
         cameraSpeed *= 2.f;
@@ -149,27 +193,111 @@ void VulkanRenderer::Update(float deltaTime)
         firstPos = currentPos;
     }
 
+    updateFlythrough(deltaTime);
+
     glm::vec3 vec = { 0.f, 75.f, 0.f };
     vec = glm::rotate(vec, glm::radians(m_rad), glm::vec3(1.f, 0.f, 0.f));
     m_objects[2]->SetPosition(vec);
 }
 
+void VulkanRenderer::PlayCameraPath(const CameraPath& path, bool loop)
+{
+    m_cameraPath = path;
+    m_flythrough.recording = false;
+    m_flythrough.playing = !m_cameraPath.Empty();
+    m_flythrough.loop = loop;
+    m_flythrough.time = 0.f;
+}
+
+VulkanRenderer::FrameStats VulkanRenderer::GetFrameStats()
+{
+    FrameStats stats;
+    stats.drawCount = static_cast<uint32_t>(m_drawList.size());
+    stats.gpuTime = m_gpuProfiler.GetFrameTime();
+    stats.allocations = m_frameAllocations;
+    stats.counters = m_renderStats.GetCounters();
+    stats.pipelineStatistics = m_renderStats.GetPipelineStatistics();
+    return stats;
+}
+
+bool VulkanRenderer::IsLoaded()
+{
+    return m_assetLoader.IsIdle() && m_pipelineBuilder.GetPendingCount() == 0;
+}
+
+float VulkanRenderer::GetFirstFrameTime()
+{
+    return m_firstFrameTime;
+}
+
+float VulkanRenderer::GetLoadedTime()
+{
+    return m_loadedTime;
+}
+
+void VulkanRenderer::updateLoadTimes()
+{
+    if (m_loadedTime >= 0.f || m_firstFrameTime < 0.f || !IsLoaded()) return;
+
+    m_loadedTime = static_cast<float>(static_cast<double>(CpuProfiler::GetTime() - m_initTime) / 1000000.0);
+    std::cout << "First frame after " << m_firstFrameTime << " ms, fully loaded after " << m_loadedTime << " ms" << std::endl;
+}
+
+void VulkanRenderer::updateFlythrough(float deltaTime)
+{
+    if (m_flythrough.recording)
+    {
+        // Always keeps the current camera as the first keyframe
+        if (m_flythrough.time >= m_flythrough.nextKeyframe)
+        {
+            m_cameraPath.AddKeyframe(m_flythrough.time, m_camera.GetPosition(), m_camera.GetRotation());
+            m_flythrough.nextKeyframe = m_flythrough.time + FLYTHROUGH_KEYFRAME_INTERVAL;
+        }
+        m_flythrough.time += deltaTime;
+    }
+
+    if (m_flythrough.playing)
+    {
+        float duration = m_cameraPath.GetDuration();
+        if (m_flythrough.time > duration)
+        {
+            if (m_flythrough.loop && duration > 0.f) m_flythrough.time = std::fmod(m_flythrough.time, duration);
+            else m_flythrough.playing = false;
+        }
+
+        glm::vec3 position, rotation;
+        m_cameraPath.Sample(m_flythrough.time, position, rotation);
+        m_camera.SetPosition(position);
+        m_camera.SetRotation(rotation);
+
+        m_flythrough.time += deltaTime;
+    }
+}
+
 void VulkanRenderer::Destroy()
 {
     vkDeviceWaitIdle(m_device.logicalDevice);
 
     ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplSDL2_Shutdown();
+    if (!m_headless) ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
     vkDestroyDescriptorPool(m_device.logicalDevice, m_imguiDescriptorPool, nullptr);
 
+    // Before anything a queued pipeline refers to is gone
+    m_pipelineBuilder.Destroy();
+    // Before the objects and materials, whatever was uploaded already belongs to them
+    m_assetLoader.Destroy();
+
     m_uboPointLight.Destroy();
     m_uboViewProjection.Destroy();
     MaterialManager::Destroy();
-    m_uboFragSettings.Destroy();
+    m_gpuProfiler.Destroy();
+    m_renderStats.Destroy();
 
     m_dlShadowMap.Destroy();
-    m_slShadowMap.Destroy();
+    m_shadowAtlas.Destroy();
+    m_pointShadowMap.Destroy();
+    m_lightClusters.Destroy();
     ShadowMap::StaticDestroy(m_device.logicalDevice);
 
     //m_testMesh.Destroy();
@@ -178,122 +306,201 @@ void VulkanRenderer::Destroy()
         m_objects[i]->Destroy();
         delete m_objects[i];
     }
+    m_terrain.Destroy();
     
-    for (size_t i = 0; i < m_imageAvailable.size(); ++i)
+    for (size_t i = 0; i < m_frames.size(); ++i)
     {
-        vkDestroySemaphore(m_device.logicalDevice, m_imageAvailable[i], nullptr);
-        vkDestroySemaphore(m_device.logicalDevice, m_renderFinished[i], nullptr);
-        vkDestroyFence(m_device.logicalDevice, m_waitForDrawFinished[i], nullptr);
+        m_frames[i].Destroy();
     }
     
-    vkFreeCommandBuffers(m_device.logicalDevice, m_graphicsCommandPool, static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
-    vkDestroyCommandPool(m_device.logicalDevice, m_graphicsCommandPool, nullptr);
+    m_commandAllocator.Destroy();
+    
+    m_renderGraph.Destroy();
     
-    vkDestroyRenderPass(m_device.logicalDevice, m_renderPass, nullptr);
+    destroyPipelines();
 
-    for (size_t i = 0; i < m_colorResolveImage.size(); ++i)
+    if (m_headless)
     {
-        m_colorResolveImage[i].Destroy(m_device.logicalDevice);
+        for (Image& image : m_offscreenImages)
+        {
+            image.Destroy(m_device.logicalDevice);
+        }
     }
-    
-    for (size_t i = 0; i < m_depthBufferImage.size(); ++i)
+    else
     {
-        m_depthBufferImage[i].Destroy(m_device.logicalDevice);
-    }
+        for (size_t i = 0; i < m_swapchainImages.size(); ++i)
+        {
+            vkDestroyImageView(m_device.logicalDevice, m_swapchainImages[i].imageView, nullptr);
+        }
 
-    for (size_t i = 0; i < m_swapchainFrameBuffers.size(); ++i)
-    {
-        vkDestroyFramebuffer(m_device.logicalDevice, m_swapchainFrameBuffers[i], nullptr);
+        vkDestroySwapchainKHR(m_device.logicalDevice, m_swapchain, nullptr);
     }
     
-    vkDestroyPipeline(m_device.logicalDevice, m_graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(m_device.logicalDevice, m_graphicsPipelineLayout, nullptr);
+    ShaderLibrary::Destroy();
+
+    // Everything allocated from the device should be gone by now
+    GpuMemory::ReportLeaks();
 
-    for (size_t i = 0; i < m_swapchainImages.size(); ++i)
-    {
-        vkDestroyImageView(m_device.logicalDevice, m_swapchainImages[i].imageView, nullptr);
-    }
-    
-    vkDestroySwapchainKHR(m_device.logicalDevice, m_swapchain, nullptr);
     vkDestroyDevice(m_device.logicalDevice, nullptr);
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+    if (!m_headless) vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
     vkDestroyInstance(m_instance, nullptr);
 }
 
 void VulkanRenderer::Draw()
 {
-    static int currentFrame = 0;
+    CPU_ZONE("Draw");
+
+    FrameContext& frame = m_frames[m_currentFrame];
 
-    vkWaitForFences(m_device.logicalDevice, 1, &m_waitForDrawFinished[currentFrame], VK_TRUE, 0x7FFFFFFF);
-    vkResetFences(m_device.logicalDevice, 1, &m_waitForDrawFinished[currentFrame]);
+    {
+        CPU_ZONE("Wait for Frame");
+        frame.WaitUntilFinished();
+    }
+    if (m_latency.enabled) updateLatency();
 
-    ImGui_ImplVulkan_NewFrame();
-    ImGui_ImplSDL2_NewFrame(Engine::GetWindow()->GetSDLWindow());
-    ImGui::NewFrame();
-    renderImGui();
-    ImGui::Render();
+    VkCommandBuffer commandBuffer = frame.Begin(m_commandAllocator);
+    uint32_t frameIndex = frame.GetIndex();
+
+    // Headless frames run the UI without building any windows, so nothing but the scene ends up in the image
+    {
+        CPU_ZONE("UI");
+        ImGui_ImplVulkan_NewFrame();
+        if (!m_headless) ImGui_ImplSDL2_NewFrame(Engine::GetWindow()->GetSDLWindow());
+        ImGui::NewFrame();
+        if (!m_headless) renderImGui();
+        ImGui::Render();
+    }
+
+    // The UI may have switched to a permutation that was never used, which is compiled here and not while recording
+    preparePermutations();
+
+    // Building the UI allocates whenever something is added from it, everything after must not
+    uint64_t allocationCount = AllocationCounter::GetCount();
+
+    // World matrices of everything that moved since the last frame, all passes below read the cached ones
+    m_scene.Update();
     
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(m_device.logicalDevice, m_swapchain, 0x7FFFFFFF, m_imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    uint32_t imageIndex = frameIndex;
+    if (!m_headless)
+    {
+        CPU_ZONE("Acquire");
+        vkAcquireNextImageKHR(m_device.logicalDevice, m_swapchain, UINT64_MAX, frame.GetImageAvailableSemaphore(), VK_NULL_HANDLE, &imageIndex);
+    }
 
     //m_uboLightPerspective.Data.view = glm::lookAt(glm::vec3(0.f, 4.f, 0.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
 
-    m_dlShadowMap.PerspectiveData()->view = glm::mat4(glm::angleAxis(glm::radians(m_rad), glm::vec3(1.f, 0.f, 0.f)));
-    m_dlShadowMap.PerspectiveData()->projection = glm::orthoZO(m_leftRight.x, m_leftRight.y, m_topBottom.x, m_topBottom.y, m_nearFar.x, m_nearFar.y);
-    m_dlShadowMap.UpdateUbo(imageIndex);
+    {
+        CPU_ZONE("Update Buffers");
 
-    glm::vec3 position = m_uboPointLight.Data.slPosition;
-    glm::vec3 direction = glm::vec3(m_uboPointLight.Data.slDirection) + position;
+        updateShadowCascades();
+        m_dlShadowMap.UpdateUbo(frameIndex);
 
-    glm::mat4 view = glm::lookAt(position, direction, glm::vec3(0.f, 1.f, 0.f));
-    
-    m_slShadowMap.PerspectiveData()->view = view;
-    m_slShadowMap.PerspectiveData()->projection = glm::perspectiveZO(90.f, 1.f, 1.f, 250.f);
-    //m_slShadowMap.PerspectiveData()->view = glm::mat4(glm::angleAxis(glm::radians(m_rad), glm::vec3(1.f, 0.f, 0.f)));
-    //m_slShadowMap.PerspectiveData()->projection = glm::orthoZO(m_leftRight.x, m_leftRight.y, m_topBottom.x, m_topBottom.y, m_nearFar.x, m_nearFar.y);
-    m_slShadowMap.UpdateUbo(imageIndex);
-    
-    m_uboViewProjection.Data.view = m_camera.GetViewMatrix();
-    m_uboViewProjection.Data.projection = m_camera.GetProjectionMatrix();
-    m_uboViewProjection.Data.camPosition = glm::vec4(m_camera.GetPosition(), 1.f);
-    m_uboViewProjection.Data.lightSpace = m_dlShadowMap.PerspectiveData()->projection * m_dlShadowMap.PerspectiveData()->view;
-    m_uboViewProjection.Data.spotLightSpace = m_slShadowMap.PerspectiveData()->projection * m_slShadowMap.PerspectiveData()->view;
-    m_uboViewProjection.Update(imageIndex);
-    
-    m_uboPointLight.Data = m_dirLight;
-    m_uboPointLight.Update(imageIndex);
+        m_shadowAtlas.Update(frameIndex, m_spotLights, m_camera);
+        m_lightClusters.Update(frameIndex, m_spotLights, m_camera, m_swapchainExtent);
 
-    m_uboFragSettings.Update(imageIndex);
-    
-    recordCommands(imageIndex);
+        updatePointShadowBenchmark();
+        m_pointShadowMap.Update(frameIndex, m_pointLights);
+
+        m_uboViewProjection.Data.view = m_camera.GetViewMatrix();
+        m_uboViewProjection.Data.projection = m_camera.GetProjectionMatrix();
+        m_uboViewProjection.Data.camPosition = glm::vec4(m_camera.GetPosition(), 1.f);
+        m_uboViewProjection.Update(frameIndex);
 
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        m_uboPointLight.Data = m_dirLight;
+        m_uboPointLight.Update(frameIndex);
+    }
+
+    buildDrawList(frame.GetArena());
     
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &m_imageAvailable[currentFrame];
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_commandBuffers[imageIndex];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &m_renderFinished[currentFrame];
-
-    VkResult result = vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_waitForDrawFinished[currentFrame]);
-    CHECK_VK_RESULT(result, "Failed to submit Command Buffer to Queue");
-
-    VkPresentInfoKHR presentInfo = {};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &m_renderFinished[currentFrame];
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = &m_swapchain;
-    presentInfo.pImageIndices = &imageIndex;
-
-    result = vkQueuePresentKHR(m_presentationQueue, &presentInfo);
-    CHECK_VK_RESULT(result, "Failed to present Image");
-
-    currentFrame = (currentFrame + 1) % MAX_CONCURRENT_FRAMES;
+    recordCommands(commandBuffer, frameIndex, imageIndex);
+
+    frame.Submit(m_graphicsQueue, !m_headless);
+
+    if (m_firstFrameTime < 0.f)
+        m_firstFrameTime = static_cast<float>(static_cast<double>(CpuProfiler::GetTime() - m_initTime) / 1000000.0);
+
+    if (!m_headless)
+    {
+        CPU_ZONE("Present");
+
+        VkSemaphore renderFinished = frame.GetRenderFinishedSemaphore();
+
+        VkPresentInfoKHR presentInfo = {};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &renderFinished;
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &m_swapchain;
+        presentInfo.pImageIndices = &imageIndex;
+
+        VkResult result = vkQueuePresentKHR(m_presentationQueue, &presentInfo);
+        CHECK_VK_RESULT(result, "Failed to present Image");
+    }
+
+    if (m_latency.enabled) updateLatency();
+
+    // Vulkan layers written in C++ share the counted operator new on some platforms, disable validation to check this
+    m_frameAllocations = AllocationCounter::GetCount() - allocationCount;
+    assert(!m_assertNoFrameAllocations || m_frameAllocations == 0);
+
+    m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+}
+
+bool VulkanRenderer::SaveFrame(const std::string& path)
+{
+    if (!m_headless) return false;
+
+    CPU_ZONE("Save Frame");
+
+    uint32_t frameIndex = (m_currentFrame + m_framesInFlight - 1) % m_framesInFlight;
+    m_frames[frameIndex].WaitUntilFinished();
+
+    uint32_t width = m_swapchainExtent.width;
+    uint32_t height = m_swapchainExtent.height;
+    VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+
+    Buffer stagingBuffer;
+    stagingBuffer.Init(m_device.logicalDevice, m_device.physicalDevice, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VkCommandBuffer commandBuffer = m_commandAllocator.BeginOneShot();
+
+    // The render graph leaves the image in transfer source layout, only the writes have to be made visible
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_offscreenImages[frameIndex].GetImage();
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { width, height, 1 };
+
+    vkCmdCopyImageToBuffer(commandBuffer, m_offscreenImages[frameIndex].GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        stagingBuffer.GetBuffer(), 1, &region);
+
+    m_commandAllocator.SubmitOneShot(m_graphicsQueue, commandBuffer);
+
+    void* data;
+    vkMapMemory(m_device.logicalDevice, stagingBuffer.GetMemory(), 0, size, 0, &data);
+    bool written = PngWriter::Write(path, width, height, static_cast<const uint8_t*>(data), width * 4);
+    vkUnmapMemory(m_device.logicalDevice, stagingBuffer.GetMemory());
+
+    stagingBuffer.Destroy(m_device.logicalDevice);
+
+    if (!written) std::cout << "Failed to write " << path << std::endl;
+    return written;
 }
 
 void VulkanRenderer::renderImGui()
@@ -328,10 +535,10 @@ void VulkanRenderer::renderImGui()
         {
             glm::mat4 transform;
 
-            float translation[3] = { selectedObject->GetPosition().x, selectedObject->GetPosition().y, selectedObject->GetPosition().z };
-            float scale[3] = { 1.f, 1.f, 1.f };
-            float rotation[3] = { 0.f, 0.f, 0.f };
-            ImGuizmo::RecomposeMatrixFromComponents(translation, rotation, scale, glm::value_ptr(transform));
+            glm::vec3 translation = selectedObject->GetPosition();
+            glm::vec3 rotation = selectedObject->GetRotation();
+            glm::vec3 scale = selectedObject->GetScale();
+            ImGuizmo::RecomposeMatrixFromComponents(&translation.x, &rotation.x, &scale.x, glm::value_ptr(transform));
 
             ImGuizmo::Manipulate(glm::value_ptr(cameraView), glm::value_ptr(cameraProjection),
                 ImGuizmo::TRANSLATE, ImGuizmo::LOCAL,
@@ -348,6 +555,27 @@ void VulkanRenderer::renderImGui()
                 hasUsed = true;
             }
         }
+
+        // Clicking into the viewport selects the object under the cursor, the window is only hovered where no
+        // other window covers it
+        if (ImGui::IsWindowHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left) && !ImGuizmo::IsOver())
+        {
+            ImVec2 mouse = ImGui::GetMousePos();
+            glm::vec2 screenPosition(mouse.x / m_swapchainExtent.width * 2.f - 1.f,
+                1.f - mouse.y / m_swapchainExtent.height * 2.f);
+
+            SceneHandle entity;
+            float distance;
+            selectedObject = nullptr;
+            if (m_scene.Raycast(m_camera.GetRay(screenPosition), m_camera.GetFarPlane(), entity, distance))
+            {
+                for (Object* object : m_objects)
+                {
+                    if (object->HasEntity(entity))
+                        selectedObject = object;
+                }
+            }
+        }
     }
     ImGui::End();
 
@@ -378,12 +606,35 @@ void VulkanRenderer::renderImGui()
         if (ImGui::DragFloat3("Rotation", &camRot.x, 1.f))
             m_camera.SetRotation(camRot);
 
-        ImGui::Text("Shadow Map Camera:");
+        ImGui::Text("Flythrough: %u keyframes, %.2f s", m_cameraPath.GetKeyframeCount(), m_cameraPath.GetDuration());
+        ImGui::InputText("Path File", &m_flythrough.file);
+
+        if (ImGui::Button(m_flythrough.recording ? "Stop Recording" : "Record"))
+        {
+            if (!m_flythrough.recording) m_cameraPath.Clear();
+            m_flythrough.recording = !m_flythrough.recording;
+            m_flythrough.playing = false;
+            m_flythrough.time = 0.f;
+            m_flythrough.nextKeyframe = 0.f;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button(m_flythrough.playing ? "Stop" : "Play"))
+        {
+            if (m_flythrough.playing) m_flythrough.playing = false;
+            else PlayCameraPath(m_cameraPath, m_flythrough.loop);
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Loop", &m_flythrough.loop);
+
+        if (ImGui::Button("Save Path") && !m_cameraPath.Save(m_flythrough.file))
+            std::cout << "Failed to save " << m_flythrough.file << std::endl;
+        ImGui::SameLine();
+        if (ImGui::Button("Load Path") && !m_cameraPath.Load(m_flythrough.file))
+            std::cout << "Failed to load " << m_flythrough.file << std::endl;
+
+        ImGui::Text("Light Object:");
 
-        ImGui::DragFloat("View", &m_rad);
-        ImGui::DragFloat2("Left-Right", &m_leftRight.x);
-        ImGui::DragFloat2("Top-Bottom", &m_topBottom.x);
-        ImGui::DragFloat2("Near-Far", &m_nearFar.x);
+        ImGui::DragFloat("Angle", &m_rad);
     }
     ImGui::End();
 
@@ -391,16 +642,367 @@ void VulkanRenderer::renderImGui()
     ImGui::Begin("Directional Light");
     {
         ImGui::DragFloat3("Direction", &m_dirLight.dlDirection.x, 0.01f, -1.f, 1.f);
+
+        ImGui::Text("Shadow Cascades:");
+
+        ImGui::DragFloat("Shadow Distance", &m_shadowDistance, 1.f, 10.f, 5000.f);
+        ImGui::SliderFloat("Split Lambda", &m_cascadeSplitLambda, 0.f, 1.f);
+
+        ImGui::CheckboxFlags("Show Cascades", &m_shaderPermutation.debugView, DEBUG_VIEW_CASCADES);
+
+        for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+            ImGui::Text("Cascade %u: %.1f", i, m_uboViewProjection.Data.cascadeSplits[i]);
+    }
+    ImGui::End();
+
+    if (focus) ImGui::SetNextWindowFocus();
+    ImGui::Begin("Spot Lights");
+    {
+        static int selectedSpotLight = 0;
+
+        for (size_t i = 0; i < m_spotLights.size(); ++i)
+        {
+            std::string label = "Spot Light " + std::to_string(i);
+            if (ImGui::Selectable(label.c_str(), selectedSpotLight == static_cast<int>(i)))
+                selectedSpotLight = static_cast<int>(i);
+        }
+
+        if (m_spotLights.size() < MAX_SPOT_LIGHTS && ImGui::Button("Add"))
+        {
+            m_spotLights.push_back(SpotLight());
+            selectedSpotLight = static_cast<int>(m_spotLights.size()) - 1;
+        }
+
+        // A row of lamps on both sides of the building
+        ImGui::SameLine();
+        if (m_spotLights.size() + 16 <= MAX_SPOT_LIGHTS && ImGui::Button("Add Street Lamps"))
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                SpotLight lamp;
+                lamp.position = { i % 2 == 0 ? -40.f : 40.f, 10.f, -140.f + static_cast<float>(i / 2) * 40.f };
+                lamp.direction = { 0.f, -1.f, 0.f };
+                lamp.cutoff = 40.f;
+                lamp.range = 60.f;
+                m_spotLights.push_back(lamp);
+            }
+        }
+
+        // Night scene, a grid of small lamps over the whole terrain
+        if (m_spotLights.size() + 256 <= MAX_SPOT_LIGHTS && ImGui::Button("Add Lamp Grid"))
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                SpotLight lamp;
+                lamp.position = { -300.f + static_cast<float>(i % 16) * 40.f, 8.f, -300.f + static_cast<float>(i / 16) * 40.f };
+                lamp.direction = { 0.f, -1.f, 0.f };
+                lamp.strength = 5.f;
+                lamp.cutoff = 50.f;
+                lamp.range = 25.f;
+                m_spotLights.push_back(lamp);
+            }
+        }
+
+        if (selectedSpotLight < static_cast<int>(m_spotLights.size()))
+        {
+            SpotLight& light = m_spotLights[selectedSpotLight];
+
+            ImGui::Separator();
+            ImGui::DragFloat3("Position", &light.position.x, 0.01f);
+            ImGui::DragFloat3("Direction", &light.direction.x, 0.01f, -1.f, 1.f);
+            ImGui::DragFloat("Strength", &light.strength, 0.01f);
+            ImGui::DragFloat("Cutoff", &light.cutoff, 0.01f, 1.f, 85.f);
+            ImGui::DragFloat("Range", &light.range, 0.1f, 1.f, 1000.f);
+
+            if (ImGui::Button("Remove"))
+                m_spotLights.erase(m_spotLights.begin() + selectedSpotLight);
+        }
+    }
+    ImGui::End();
+
+    if (focus) ImGui::SetNextWindowFocus();
+    ImGui::Begin("Light Clusters");
+    {
+        ImGui::CheckboxFlags("Show Lights per Cluster", &m_shaderPermutation.debugView, DEBUG_VIEW_CLUSTERS);
+
+        ImGui::Text("Grid: %u x %u x %u", CLUSTER_COUNT_X, CLUSTER_COUNT_Y, CLUSTER_COUNT_Z);
+        ImGui::Text("Spot lights: %u", static_cast<uint32_t>(m_spotLights.size()));
+        ImGui::Text("Lights per cluster: max %u, average %.2f", m_lightClusters.GetMaxLightsPerCluster(),
+            m_lightClusters.GetAverageLightsPerCluster());
+        ImGui::Text("Light indices: %u of %u", m_lightClusters.GetLightIndexCount(), MAX_CLUSTER_LIGHT_INDICES);
+        if (m_lightClusters.GetIndexListOverflowed())
+            ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "Index list full, lights are missing");
+    }
+    ImGui::End();
+
+    if (focus) ImGui::SetNextWindowFocus();
+    ImGui::Begin("Rendering");
+    {
+        // Render passes differ only in load ops, so the pipelines stay compatible with the rebuilt graph
+        if (ImGui::Checkbox("Depth Pre-Pass", &m_depthPrepassEnabled))
+        {
+            vkDeviceWaitIdle(m_device.logicalDevice);
+            m_pipelineBuilder.WaitIdle();
+            buildRenderGraph();
+        }
+
+        float prepassTime = m_depthPrepassEnabled ? m_gpuProfiler.GetZoneTime("Depth Pre-Pass") : 0.f;
+        float mainPassTime = m_gpuProfiler.GetZoneTime("Main Pass");
+        ImGui::Text("Depth pre-pass: %.3f ms", prepassTime);
+        ImGui::Text("Main pass: %.3f ms", mainPassTime);
+        ImGui::Text("Total: %.3f ms", prepassTime + mainPassTime);
+
+        ImGui::Separator();
+
+        // Turned off, the light type's loop is compiled out of the main pass
+        bool spotLights = m_shaderPermutation.spotLights != 0;
+        if (ImGui::Checkbox("Spot Lights", &spotLights))
+            m_shaderPermutation.spotLights = spotLights ? 1 : 0;
+        bool pointLights = m_shaderPermutation.pointLights != 0;
+        if (ImGui::Checkbox("Point Lights", &pointLights))
+            m_shaderPermutation.pointLights = pointLights ? 1 : 0;
+        ImGui::Text("Pipeline permutations: %u", static_cast<uint32_t>(m_permutationPipelines.size()));
+        ImGui::Text("Pipelines: %u, %u compiling on %u threads, %.1f ms compile time", m_pipelineBuilder.GetPipelineCount(),
+            m_pipelineBuilder.GetPendingCount(), m_pipelineBuilder.GetThreadCount(), m_pipelineBuilder.GetBuildTime());
+        ImGui::Text("Shader modules: %u from %u files", ShaderLibrary::GetModuleCount(), ShaderLibrary::GetFileCount());
+        ImGui::Text("Assets: %u loaded, %u loading on %u threads, %u failed", m_assetLoader.GetCompletedCount(),
+            m_assetLoader.GetPendingCount(), m_assetLoader.GetThreadCount(), m_assetLoader.GetFailedCount());
+        ImGui::Text("First frame: %.1f ms", m_firstFrameTime);
+        if (m_loadedTime >= 0.f) ImGui::Text("Fully loaded: %.1f ms", m_loadedTime);
+        else ImGui::Text("Fully loaded: loading");
+
+        ImGui::Separator();
+
+        // Every context has its own resources, so fewer frames in flight only means waiting earlier
+        int framesInFlight = static_cast<int>(m_framesInFlight);
+        if (ImGui::SliderInt("Frames in Flight", &framesInFlight, 1, static_cast<int>(MAX_FRAMES_IN_FLIGHT)))
+            m_framesInFlight = static_cast<uint32_t>(framesInFlight);
+
+        ImGui::Checkbox("Measure Latency", &m_latency.enabled);
+        if (m_latency.enabled)
+        {
+            ImGui::Text("CPU start to GPU done: %.2f ms average, %.2f ms max", m_latency.average, m_latency.windowMax);
+        }
+
+        ImGui::Text("Command buffers allocated: %u", m_commandAllocator.GetAllocatedCount());
+        ImGui::Text("Draws: %u of %u entities", static_cast<uint32_t>(m_drawList.size()), m_scene.GetCount());
+        ImGui::Text("Transforms updated: %u of %u nodes", m_scene.GetHierarchy().GetChangedCount(),
+            m_scene.GetHierarchy().GetCount());
+        ImGui::Text("BVH nodes: %u", m_scene.GetBvh().GetNodeCount());
+        ImGui::Text("Heap allocations per frame: %llu", static_cast<unsigned long long>(m_frameAllocations));
+        ImGui::Checkbox("Assert No Frame Allocations", &m_assertNoFrameAllocations);
+
+        ImGui::Separator();
+        ImGui::Text("Render graph passes: %u, %u culled", m_renderGraph.GetPassCount(), m_renderGraph.GetCulledPassCount());
+        ImGui::Text("Transient memory: %.1f MB per frame, %.1f MB without aliasing",
+            static_cast<float>(m_renderGraph.GetTransientMemorySize()) / (1024.f * 1024.f),
+            static_cast<float>(m_renderGraph.GetUnaliasedMemorySize()) / (1024.f * 1024.f));
+    }
+    ImGui::End();
+
+    if (focus) ImGui::SetNextWindowFocus();
+    ImGui::Begin("GPU Memory");
+    {
+        const float MB = 1024.f * 1024.f;
+
+        ImGui::TextUnformatted(GpuMemory::HasBudgetExtension() ? "Budget from VK_EXT_memory_budget" : "Budget is the heap size");
+        for (uint32_t i = 0; i < GpuMemory::GetHeapCount(); ++i)
+        {
+            GpuMemory::HeapUsage heap = GpuMemory::GetHeapUsage(i);
+            if (heap.size == 0) continue;
+
+            // Process usage includes what the driver and ImGui allocate, ours is only what went through GpuMemory
+            float fraction = heap.budget > 0 ? static_cast<float>(heap.usage) / static_cast<float>(heap.budget) : 0.f;
+            char overlay[64];
+            std::snprintf(overlay, sizeof(overlay), "%.1f / %.1f MB", static_cast<float>(heap.usage) / MB,
+                static_cast<float>(heap.budget) / MB);
+
+            ImGui::Text("Heap %u (%s): %.1f MB ours, %.1f MB heap", i, heap.deviceLocal ? "device" : "host",
+                static_cast<float>(heap.allocated) / MB, static_cast<float>(heap.size) / MB);
+            ImGui::PushID(static_cast<int>(i));
+            ImGui::ProgressBar(fraction, ImVec2(-1.f, 0.f), overlay);
+            ImGui::PopID();
+        }
+
+        ImGui::Separator();
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(GpuMemory::Category::Count); ++i)
+        {
+            GpuMemory::Category category = static_cast<GpuMemory::Category>(i);
+            GpuMemory::CategoryUsage usage = GpuMemory::GetCategoryUsage(category);
+            ImGui::Text("%s: %.2f MB in %u allocations", GpuMemory::GetCategoryName(category),
+                static_cast<float>(usage.bytes) / MB, usage.allocations);
+        }
+    }
+    ImGui::End();
+
+    if (focus) ImGui::SetNextWindowFocus();
+    ImGui::Begin("Render Stats");
+    {
+        // Counted while recording, so these include every shadow pass but not ImGui
+        const RenderStats::Counters& counters = m_renderStats.GetCounters();
+        ImGui::Text("Draw calls: %u, %u instances", counters.drawCalls, counters.instances);
+        ImGui::Text("Triangles: %llu", static_cast<unsigned long long>(counters.triangles));
+        ImGui::Text("Pipeline binds: %u", counters.pipelineBinds);
+        ImGui::Text("Descriptor sets bound: %u", counters.descriptorBinds);
+        ImGui::Text("Vertex buffer binds: %u", counters.vertexBufferBinds);
+        ImGui::Text("Push constants: %u", counters.pushConstants);
+
+        ImGui::Separator();
+
+        if (m_renderStats.HasPipelineStatistics())
+        {
+            const RenderStats::PipelineStatistics& statistics = m_renderStats.GetPipelineStatistics();
+            ImGui::Text("Input primitives: %llu", static_cast<unsigned long long>(statistics.inputPrimitives));
+            ImGui::Text("Vertex shader invocations: %llu", static_cast<unsigned long long>(statistics.vertexInvocations));
+            ImGui::Text("Clipping: %llu primitives in, %llu out",
+                static_cast<unsigned long long>(statistics.clippingInvocations),
+                static_cast<unsigned long long>(statistics.clippingPrimitives));
+            ImGui::Text("Fragment shader invocations: %llu", static_cast<unsigned long long>(statistics.fragmentInvocations));
+        }
+        else
+        {
+            ImGui::Text("Pipeline statistics queries aren't supported");
+        }
+    }
+    ImGui::End();
+
+    if (focus) ImGui::SetNextWindowFocus();
+    ImGui::Begin("GPU Profiler");
+    {
+        // All graphs share the frame's scale, so the passes can be compared at a glance
+        const GpuProfiler::ZoneStats& frame = m_gpuProfiler.GetFrame();
+        float scale = std::max(frame.max * 1.1f, 0.1f);
+
+        ImGui::Text("Frame: %.3f ms, average %.3f ms, max %.3f ms", frame.time, frame.average, frame.max);
+        ImGui::PlotLines("##Frame", frame.history.data(), GpuProfiler::HISTORY_SIZE, frame.historyOffset, nullptr,
+            0.f, scale, ImVec2(0.f, 60.f));
+
+        ImGui::Separator();
+
+        for (uint32_t i = 0; i < m_gpuProfiler.GetZoneCount(); ++i)
+        {
+            const GpuProfiler::ZoneStats& zone = m_gpuProfiler.GetZone(i);
+            float indent = 16.f * static_cast<float>(zone.depth);
+
+            ImGui::PushID(static_cast<int>(i));
+            if (indent > 0.f) ImGui::Indent(indent);
+            ImGui::Text("%s: %.3f ms, average %.3f ms, max %.3f ms", zone.name.c_str(), zone.time, zone.average, zone.max);
+            ImGui::PlotLines("##Zone", zone.history.data(), GpuProfiler::HISTORY_SIZE, zone.historyOffset, nullptr,
+                0.f, scale, ImVec2(0.f, 30.f));
+            if (indent > 0.f) ImGui::Unindent(indent);
+            ImGui::PopID();
+        }
+
+        ImGui::Separator();
+
+        ImGui::InputText("Export File", &m_profilerExportFile);
+        if (ImGui::Button("Export JSON") && !m_gpuProfiler.ExportJson(m_profilerExportFile))
+            std::cout << "Failed to write " << m_profilerExportFile << std::endl;
+
+        ImGui::Separator();
+
+        // The CPU side has no live view, a capture is written as a trace for chrome://tracing or Perfetto
+        ImGui::InputText("CPU Trace File", &m_cpuTraceFile);
+        if (!CpuProfiler::IsCapturing())
+        {
+            if (ImGui::Button("Start CPU Capture"))
+                CpuProfiler::BeginCapture();
+        }
+        else if (ImGui::Button("Stop CPU Capture"))
+        {
+            CpuProfiler::EndCapture();
+            if (!CpuProfiler::WriteTrace(m_cpuTraceFile))
+                std::cout << "Failed to write " << m_cpuTraceFile << std::endl;
+        }
+    }
+    ImGui::End();
+
+    if (focus) ImGui::SetNextWindowFocus();
+    ImGui::Begin("Point Lights");
+    {
+        static int selectedPointLight = 0;
+
+        for (size_t i = 0; i < m_pointLights.size(); ++i)
+        {
+            std::string label = "Point Light " + std::to_string(i);
+            if (ImGui::Selectable(label.c_str(), selectedPointLight == static_cast<int>(i)))
+                selectedPointLight = static_cast<int>(i);
+        }
+
+        if (m_pointLights.size() < MAX_POINT_LIGHTS && ImGui::Button("Add"))
+        {
+            m_pointLights.push_back(PointLight());
+            selectedPointLight = static_cast<int>(m_pointLights.size()) - 1;
+        }
+
+        if (selectedPointLight < static_cast<int>(m_pointLights.size()))
+        {
+            PointLight& light = m_pointLights[selectedPointLight];
+
+            ImGui::Separator();
+            ImGui::DragFloat3("Position", &light.position.x, 0.01f);
+            ImGui::DragFloat("Strength", &light.strength, 0.01f);
+            ImGui::DragFloat("Range", &light.range, 0.1f, 1.f, 1000.f);
+
+            if (ImGui::Button("Remove"))
+                m_pointLights.erase(m_pointLights.begin() + selectedPointLight);
+        }
+
+        ImGui::Separator();
+
+        bool multiview = m_pointShadowMap.GetMultiviewEnabled();
+        if (!m_pointShadowMap.GetMultiviewSupported())
+            ImGui::Text("Multiview not supported, one pass per face");
+        else if (!m_pointShadowBenchmark.running && ImGui::Checkbox("Multiview", &multiview))
+            m_pointShadowMap.SetMultiviewEnabled(multiview);
+
+        ImGui::Text("Point shadows: %.3f ms, %u casters", m_gpuProfiler.GetZoneTime("Point Shadows"),
+            m_pointShadowMap.GetCasterCount());
+
+        if (m_pointShadowBenchmark.running)
+        {
+            ImGui::Text("Benchmarking... %u / %u", m_pointShadowBenchmark.frame, POINT_SHADOW_BENCHMARK_FRAMES * 2);
+        }
+        else if (m_pointShadowMap.GetMultiviewSupported() && ImGui::Button("Benchmark"))
+        {
+            m_pointShadowBenchmark.running = true;
+            m_pointShadowBenchmark.multiviewWasEnabled = m_pointShadowMap.GetMultiviewEnabled();
+            m_pointShadowBenchmark.frame = 0;
+            m_pointShadowBenchmark.multiviewTime = 0.f;
+            m_pointShadowBenchmark.perFaceTime = 0.f;
+            m_pointShadowMap.SetMultiviewEnabled(true);
+        }
+
+        if (!m_pointShadowBenchmark.running && m_pointShadowBenchmark.multiviewTime > 0.f)
+        {
+            ImGui::Text("Multiview: %.3f ms", m_pointShadowBenchmark.multiviewTime);
+            ImGui::Text("Six passes: %.3f ms", m_pointShadowBenchmark.perFaceTime);
+        }
     }
     ImGui::End();
 
     if (focus) ImGui::SetNextWindowFocus();
-    ImGui::Begin("Spot Light");
+    ImGui::Begin("Shadows");
     {
-        ImGui::DragFloat3("Position", &m_dirLight.slPosition.x, 0.01f);
-        ImGui::DragFloat3("Direction", &m_dirLight.slDirection.x, 0.01f, -1.f, 1.f);
-        ImGui::DragFloat("Strength", &m_dirLight.slStrength, 0.01f);
-        ImGui::DragFloat("Cutoff", &m_dirLight.slCutoff, 0.01f);
+        static bool cacheShadowMaps = true;
+        if (ImGui::Checkbox("Cache Shadow Maps", &cacheShadowMaps))
+            m_dlShadowMap.SetCachingEnabled(cacheShadowMaps);
+
+        // Every kernel is its own permutation, switching back to one that was used before is free
+        const char* filters[] = { "PCF", "Poisson" };
+        int filter = static_cast<int>(m_shaderPermutation.shadowFilterPoisson);
+        if (ImGui::Combo("Filter", &filter, filters, 2))
+            m_shaderPermutation.shadowFilterPoisson = static_cast<uint32_t>(filter);
+        ImGui::SliderInt("Filter Radius", &m_shaderPermutation.shadowFilterRadius, 0, 3);
+
+        ImGui::CheckboxFlags("Show First Spot Light's View", &m_shaderPermutation.debugView, DEBUG_VIEW_SHADOW_ATLAS);
+
+        ImGui::Text("Cascades rendered: %u", m_dlShadowMap.GetRenderedLayerCount());
+        ImGui::Text("Shadowed spot lights: %u of %u", m_shadowAtlas.GetShadowedLightCount(),
+            static_cast<uint32_t>(m_spotLights.size()));
+        ImGui::Text("Casters drawn: DL %u, atlas %u of %u entities", m_dlShadowMap.GetCasterCount(), m_shadowAtlas.GetCasterCount(),
+            m_scene.GetCount());
     }
     ImGui::End();
 
@@ -414,6 +1016,22 @@ void VulkanRenderer::renderImGui()
             glm::vec3 position = selectedObject->GetPosition();
             if (ImGui::DragFloat3("Position", &position.x, 0.01f))
                 selectedObject->SetPosition(position);
+
+            glm::vec3 rotation = selectedObject->GetRotation();
+            if (ImGui::DragFloat3("Rotation", &rotation.x, 0.5f))
+                selectedObject->SetRotation(rotation);
+
+            glm::vec3 scale = selectedObject->GetScale();
+            if (ImGui::DragFloat3("Scale", &scale.x, 0.01f))
+                selectedObject->SetScale(scale);
+
+            bool isStatic = selectedObject->IsStatic();
+            if (ImGui::Checkbox("Static", &isStatic))
+                selectedObject->SetStatic(isStatic);
+
+            bool castsShadows = selectedObject->CastsShadows();
+            if (ImGui::Checkbox("Casts Shadows", &castsShadows))
+                selectedObject->SetCastsShadows(castsShadows);
         }
         else
         {
@@ -446,6 +1064,7 @@ void VulkanRenderer::renderImGui()
     if (ImGui::BeginMainMenuBar())
     {
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Text("GPU %.3f ms", m_gpuProfiler.GetFrameTime());
 
         ImGui::EndMainMenuBar();
     }
@@ -459,10 +1078,96 @@ void VulkanRenderer::renderImGui()
     ImGui::End();*/
 }
 
-void VulkanRenderer::createInstance()
+void VulkanRenderer::updatePointShadowBenchmark()
 {
-    SDL_Window* window = Engine::GetWindow()->GetSDLWindow();
+    if (!m_pointShadowBenchmark.running) return;
+
+    // First half multiview, second half one pass per face. The profiler lags a few frames behind,
+    // so the first frames after each switch are not counted.
+    uint32_t frame = m_pointShadowBenchmark.frame % POINT_SHADOW_BENCHMARK_FRAMES;
+    bool multiview = m_pointShadowBenchmark.frame < POINT_SHADOW_BENCHMARK_FRAMES;
+
+    if (frame >= POINT_SHADOW_BENCHMARK_WARMUP)
+    {
+        float time = m_gpuProfiler.GetZoneTime("Point Shadows") / (POINT_SHADOW_BENCHMARK_FRAMES - POINT_SHADOW_BENCHMARK_WARMUP);
+        if (multiview) m_pointShadowBenchmark.multiviewTime += time;
+        else m_pointShadowBenchmark.perFaceTime += time;
+    }
+
+    if (++m_pointShadowBenchmark.frame == POINT_SHADOW_BENCHMARK_FRAMES * 2)
+    {
+        m_pointShadowBenchmark.running = false;
+        m_pointShadowMap.SetMultiviewEnabled(m_pointShadowBenchmark.multiviewWasEnabled);
+        return;
+    }
+
+    m_pointShadowMap.SetMultiviewEnabled(m_pointShadowBenchmark.frame < POINT_SHADOW_BENCHMARK_FRAMES);
+}
+
+void VulkanRenderer::updateShadowCascades()
+{
+    float nearPlane = m_camera.GetNearPlane();
+    float farPlane = std::min(m_camera.GetFarPlane(), m_shadowDistance);
+
+    // Practical split scheme: blend between logarithmic and uniform splits
+    float splits[SHADOW_CASCADE_COUNT];
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+    {
+        float p = static_cast<float>(i + 1) / static_cast<float>(SHADOW_CASCADE_COUNT);
+        float logSplit = nearPlane * std::pow(farPlane / nearPlane, p);
+        float uniformSplit = nearPlane + (farPlane - nearPlane) * p;
+        splits[i] = m_cascadeSplitLambda * logSplit + (1.f - m_cascadeSplitLambda) * uniformSplit;
+    }
+
+    glm::vec3 lightDirection = glm::normalize(glm::vec3(m_dirLight.dlDirection));
+    glm::vec3 lightUp = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+    glm::mat4 inverseView = glm::inverse(m_camera.GetViewMatrix());
+    float halfShadowMapSize = static_cast<float>(SHADOW_CASCADE_SIZE) / 2.f;
+
+    float splitNear = nearPlane;
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+    {
+        // Corners of this cascade's slice of the camera frustum in world space
+        glm::mat4 sliceProjection = glm::perspectiveZO(glm::radians(m_camera.GetFov()), m_camera.GetAspectRatio(),
+            splitNear, splits[i]);
+        glm::mat4 sliceToWorld = inverseView * glm::inverse(sliceProjection);
+
+        std::array<glm::vec3, 8> corners;
+        glm::vec3 center(0.f);
+        for (uint32_t c = 0; c < corners.size(); ++c)
+        {
+            glm::vec4 corner = sliceToWorld * glm::vec4(c & 1 ? 1.f : -1.f, c & 2 ? 1.f : -1.f, c & 4 ? 1.f : 0.f, 1.f);
+            corners[c] = glm::vec3(corner) / corner.w;
+            center += corners[c];
+        }
+        center /= static_cast<float>(corners.size());
+
+        // Fit a sphere instead of a box so the projection size doesn't change when the camera rotates
+        float radius = 0.f;
+        for (const glm::vec3& corner : corners)
+            radius = std::max(radius, glm::length(corner - center));
+        radius = std::ceil(radius * 16.f) / 16.f;
+
+        // The near plane is pulled back towards the light so casters outside the slice still land in the map
+        glm::mat4 lightView = glm::lookAt(center - lightDirection * radius, center, lightUp);
+        glm::mat4 lightProjection = glm::orthoZO(-radius, radius, -radius, radius, -m_shadowDistance, 2.f * radius);
 
+        // Snap the projection to whole shadow map texels to stop the edges from shimmering while moving
+        glm::vec4 shadowOrigin = lightProjection * lightView * glm::vec4(0.f, 0.f, 0.f, 1.f) * halfShadowMapSize;
+        glm::vec4 roundOffset = (glm::round(shadowOrigin) - shadowOrigin) / halfShadowMapSize;
+        lightProjection[3][0] += roundOffset.x;
+        lightProjection[3][1] += roundOffset.y;
+
+        m_dlShadowMap.PerspectiveData()->viewProjection[i] = lightProjection * lightView;
+        m_uboViewProjection.Data.cascadeLightSpace[i] = lightProjection * lightView;
+        m_uboViewProjection.Data.cascadeSplits[i] = splits[i];
+
+        splitNear = splits[i];
+    }
+}
+
+void VulkanRenderer::createInstance()
+{
     if (this->m_enableValidationLayers && !checkValidationLayerSupport()) 
         throw std::runtime_error("Validation layers requested, but not available!");
     
@@ -491,10 +1196,16 @@ void VulkanRenderer::createInstance()
 
     std::vector<const char*> instanceExtensions;
 
-    uint32_t sdlExtensionCount = 0;
-    SDL_Vulkan_GetInstanceExtensions(window, &sdlExtensionCount, nullptr);
-    instanceExtensions.resize(sdlExtensionCount);
-    SDL_Vulkan_GetInstanceExtensions(window, &sdlExtensionCount, instanceExtensions.data());
+    // Headless needs no surface, so none of the extensions SDL asks for
+    if (!m_headless)
+    {
+        SDL_Window* window = Engine::GetWindow()->GetSDLWindow();
+
+        uint32_t sdlExtensionCount = 0;
+        SDL_Vulkan_GetInstanceExtensions(window, &sdlExtensionCount, nullptr);
+        instanceExtensions.resize(sdlExtensionCount);
+        SDL_Vulkan_GetInstanceExtensions(window, &sdlExtensionCount, instanceExtensions.data());
+    }
 
     instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
@@ -552,23 +1263,39 @@ void VulkanRenderer::createLogicalDevice()
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
-    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    std::vector<const char*> extensions = getDeviceExtensions();
+    // Optional, memory is tracked against the heap sizes without it
+    bool memoryBudget = GpuMemory::IsBudgetSupported(m_device.physicalDevice);
+    if (memoryBudget) extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    // Optional, point shadows fall back to one pass per cube face without it
+    bool multiview = PointShadowMap::IsMultiviewSupported(m_device.physicalDevice);
+    if (multiview) extensions.push_back(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
 
     VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeaturesEXT= {};
     dynamicStateFeaturesEXT.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
     dynamicStateFeaturesEXT.extendedDynamicState = VK_TRUE;
 
+    VkPhysicalDeviceMultiviewFeatures multiviewFeatures = {};
+    multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    multiviewFeatures.multiview = VK_TRUE;
+
+    if (multiview) dynamicStateFeaturesEXT.pNext = &multiviewFeatures;
     deviceCreateInfo.pNext = &dynamicStateFeaturesEXT;
     
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // Optional, the render stats only lose their GPU side without it
+    deviceFeatures.pipelineStatisticsQuery = RenderStats::IsPipelineStatisticsSupported(m_device.physicalDevice) ? VK_TRUE : VK_FALSE;
 
     deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
     VkResult result = vkCreateDevice(m_device.physicalDevice, &deviceCreateInfo, nullptr, &m_device.logicalDevice);
     CHECK_VK_RESULT(result, "Failed to create Logical Device");
 
+    GpuMemory::Init(m_device.physicalDevice, memoryBudget);
+
     vkGetDeviceQueue(m_device.logicalDevice, indices.graphicsQueueFamily, 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device.logicalDevice, indices.presentationQueueFamily, 0, &m_presentationQueue);
 }
@@ -637,29 +1364,86 @@ void VulkanRenderer::createSwapchain()
         scImage.imageView = Image::CreateImageView(m_device.logicalDevice, image, m_swapchainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
         m_swapchainImages.push_back(scImage);
     }
+}
 
-    m_colorResolveImage.resize(m_swapchainImages.size());
+void VulkanRenderer::createOffscreenImages()
+{
+    m_swapchainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    std::cout << "Using Resolution: " << m_swapchainExtent.width << "x" << m_swapchainExtent.height << " (headless)" << std::endl;
 
-    for (size_t i = 0; i < m_swapchainImages.size(); ++i)
+    m_offscreenImages.resize(MAX_FRAMES_IN_FLIGHT);
+    for (Image& image : m_offscreenImages)
     {
-        m_colorResolveImage[i].Init(m_device.logicalDevice, m_device.physicalDevice,
-            m_swapchainExtent.width, m_swapchainExtent.height, m_swapchainImageFormat,
-            m_msaaSamples, VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+        image.Init(m_device.logicalDevice, m_device.physicalDevice, m_swapchainExtent.width, m_swapchainExtent.height,
+            m_swapchainImageFormat, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            VK_IMAGE_ASPECT_COLOR_BIT);
+
+        SwapChainImage scImage = {};
+        scImage.image = image.GetImage();
+        scImage.imageView = image.GetImageView();
+        m_swapchainImages.push_back(scImage);
     }
 }
 
 void VulkanRenderer::createPipeline()
 {
-    // -- SHADERS --
+    CPU_ZONE("Create Pipelines");
+
+    // -- PIPELINE LAYOUT --
 
-    VkPipelineShaderStageCreateInfo shaderStages[] =
+    VkPushConstantRange worldPushConstantRange = {};
+    worldPushConstantRange.size = sizeof(PushModel);
+    worldPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    worldPushConstantRange.offset = 0;
+    
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &worldPushConstantRange;
+
+    std::vector<VkDescriptorSetLayout> setLayouts =
     {
-        loadShader(m_device.logicalDevice, "vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-        loadShader(m_device.logicalDevice, "frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+        m_uboViewProjection.GetLayout(),
+        MaterialManager::GetDescriptorSetLayout(),
+        m_uboPointLight.GetLayout(),
+        ShadowMap::GetDescriptorSetLayout(),
+        m_shadowAtlas.GetDescriptorSetLayout(),
+        m_lightClusters.GetDescriptorSetLayout(),
+        m_pointShadowMap.GetDescriptorSetLayout()
     };
 
+    pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+
+    VkResult result = vkCreatePipelineLayout(m_device.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_graphicsPipelineLayout);
+    CHECK_VK_RESULT(result, "Failed to create Pipeline Layout");
+
+    // -- DEPTH PRE-PASS --
+
+    VkPipelineShaderStageCreateInfo depthPrepassStage = ShaderLibrary::GetStage("depthPrepass.vert.spv");
+
+    // -- PERMUTATIONS --
+
+    // Queued before the other main pass pipelines so draws have something to fall back to as early as possible
+    ShaderPermutation fallback;
+    fallback.shaded = 0;
+    fallback.spotLights = 0;
+    fallback.pointLights = 0;
+    m_fallbackPipelines = getPermutationPipelines(fallback);
+
+    m_depthPrepassPipeline = submitScenePipeline("Depth Pre-Pass", &depthPrepassStage, 1,
+        m_renderGraph.GetRenderPass(m_depthPrepass), false);
+
+    preparePermutations();
+}
+
+PipelineBuilder::Handle VulkanRenderer::submitScenePipeline(const std::string& name,
+    const VkPipelineShaderStageCreateInfo* stages, uint32_t stageCount, VkRenderPass renderPass, bool depthEqual)
+{
+    // Only the pre-pass has no fragment shader, and no color attachment either
+    bool colorOutput = stageCount > 1;
+
     // -- VERTEX INPUT --
 
     auto vertexBindingDescription = Vertex::getBindingDescription();
@@ -705,231 +1489,171 @@ void VulkanRenderer::createPipeline()
     VkPipelineColorBlendStateCreateInfo colorBlendCreateInfo = {};
     colorBlendCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     colorBlendCreateInfo.logicOpEnable = VK_FALSE;
-    colorBlendCreateInfo.attachmentCount = 1;
-    colorBlendCreateInfo.pAttachments = &colorBlendAttachmentState;
-
-    // -- PIPELINE LAYOUT --
-
-    VkPushConstantRange worldPushConstantRange = {};
-    worldPushConstantRange.size = sizeof(PushModel);
-    worldPushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    worldPushConstantRange.offset = 0;
-    
-    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-    pipelineLayoutCreateInfo.pPushConstantRanges = &worldPushConstantRange;
-
-    std::vector<VkDescriptorSetLayout> setLayouts =
-    {
-        m_uboViewProjection.GetLayout(),
-        MaterialManager::GetDescriptorSetLayout(),
-        m_uboPointLight.GetLayout(),
-        ShadowMap::GetDescriptorSetLayout(),
-        m_uboFragSettings.GetLayout()
-    };
-
-    pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
-    pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
-
-    VkResult result = vkCreatePipelineLayout(m_device.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_graphicsPipelineLayout);
-    CHECK_VK_RESULT(result, "Failed to create Pipeline Layout");
+    colorBlendCreateInfo.attachmentCount = colorOutput ? 1 : 0;
+    colorBlendCreateInfo.pAttachments = colorOutput ? &colorBlendAttachmentState : nullptr;
 
     // -- DEPTH STENCIL TESTING --
 
+    // After a depth pre-pass only the fragment that won the depth test is shaded
     VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {};
     depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
-    depthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
-    depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencilStateCreateInfo.depthWriteEnable = depthEqual ? VK_FALSE : VK_TRUE;
+    depthStencilStateCreateInfo.depthCompareOp = depthEqual ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
     depthStencilStateCreateInfo.depthBoundsTestEnable = VK_FALSE;
     depthStencilStateCreateInfo.stencilTestEnable = VK_FALSE;
 
-    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT };
-
-    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateCreateInfo.dynamicStateCount = 1;
-    dynamicStateCreateInfo.pDynamicStates = dynamicStates;
-
     // -- PIPELINE CREATION --
 
     VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
     pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineCreateInfo.stageCount = 2;
-    pipelineCreateInfo.pStages = shaderStages;
-    pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
+    pipelineCreateInfo.stageCount = stageCount;
+    pipelineCreateInfo.pStages = stages;
     pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
     pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStageCreateInfo;
     pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
-    pipelineCreateInfo.pDynamicState = /*&dynamicStateCreateInfo*/nullptr;
+    pipelineCreateInfo.pDynamicState = nullptr;
     pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
     pipelineCreateInfo.pMultisampleState = &multisampleCreateInfo;
     pipelineCreateInfo.pColorBlendState = &colorBlendCreateInfo;
     pipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
     pipelineCreateInfo.layout = m_graphicsPipelineLayout;
-    pipelineCreateInfo.renderPass = m_renderPass;
+    pipelineCreateInfo.renderPass = renderPass;
     pipelineCreateInfo.subpass = 0;
     pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCreateInfo.basePipelineIndex = -1;
 
-    result = vkCreateGraphicsPipelines(m_device.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_graphicsPipeline);
-    CHECK_VK_RESULT(result, "Failed to create Graphics Pipeline");
+    return m_pipelineBuilder.Submit(name, pipelineCreateInfo);
 }
 
-void VulkanRenderer::createDepthBufferImage()
+const VulkanRenderer::PermutationPipelines& VulkanRenderer::getPermutationPipelines(const ShaderPermutation& permutation)
 {
-    m_depthBufferImage.resize(m_swapchainImages.size());
+    auto it = m_permutationPipelines.find(permutation.GetKey());
+    if (it != m_permutationPipelines.end()) return it->second;
+
+    CPU_ZONE("Submit Permutation");
+
+    std::array<VkSpecializationMapEntry, 6> specializationEntries = {};
+    specializationEntries[0] = { 0, offsetof(ShaderPermutation, shadowFilterPoisson), sizeof(uint32_t) };
+    specializationEntries[1] = { 1, offsetof(ShaderPermutation, shadowFilterRadius), sizeof(int32_t) };
+    specializationEntries[2] = { 2, offsetof(ShaderPermutation, shaded), sizeof(uint32_t) };
+    specializationEntries[3] = { 3, offsetof(ShaderPermutation, spotLights), sizeof(uint32_t) };
+    specializationEntries[4] = { 4, offsetof(ShaderPermutation, pointLights), sizeof(uint32_t) };
+    specializationEntries[5] = { 5, offsetof(ShaderPermutation, debugView), sizeof(uint32_t) };
+
+    VkSpecializationInfo specializationInfo = {};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(ShaderPermutation);
+    specializationInfo.pData = &permutation;
+
+    // The library keeps the modules alive, new permutations are created from them at any time
+    std::array<VkPipelineShaderStageCreateInfo, 2> stages =
+    {
+        ShaderLibrary::GetStage("vert.spv"),
+        ShaderLibrary::GetStage("frag.spv")
+    };
+    stages[1].pSpecializationInfo = &specializationInfo;
 
-    m_depthBufferImageFormat = chooseSupportedFormat(m_device.physicalDevice,
-        {VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
-        VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    VkRenderPass renderPass = m_renderGraph.GetRenderPass(m_mainPass);
 
-    for (size_t i = 0; i < m_depthBufferImage.size(); ++i)
-    {
-        m_depthBufferImage[i].Init(m_device.logicalDevice, m_device.physicalDevice,
-            m_swapchainExtent.width, m_swapchainExtent.height, m_depthBufferImageFormat,
-            m_msaaSamples, VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            VK_IMAGE_ASPECT_DEPTH_BIT);
-    }
-    
+    std::string name = "Permutation " + std::to_string(permutation.GetKey());
+    uint32_t stageCount = static_cast<uint32_t>(stages.size());
+
+    PermutationPipelines pipelines;
+    pipelines.pipeline = submitScenePipeline(name, stages.data(), stageCount, renderPass, false);
+    pipelines.depthEqual = submitScenePipeline(name + " Depth Equal", stages.data(), stageCount, renderPass, true);
+
+    return m_permutationPipelines.emplace(permutation.GetKey(), pipelines).first->second;
 }
 
-void VulkanRenderer::createFrameBuffers()
+void VulkanRenderer::preparePermutations()
 {
-    m_swapchainFrameBuffers.resize(m_swapchainImages.size());
+    ShaderPermutation permutation = m_shaderPermutation;
 
-    for (size_t i = 0; i < m_swapchainFrameBuffers.size(); ++i)
-    {
-        std::array<VkImageView, 3> attachments =
-        {
-            m_colorResolveImage[i].GetImageView(),
-            m_depthBufferImage[i].GetImageView(),
-            m_swapchainImages[i].imageView
-        };
-
-        VkFramebufferCreateInfo frameBufferCreateInfo = {};
-        frameBufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        frameBufferCreateInfo.renderPass = m_renderPass;
-        frameBufferCreateInfo.width = m_swapchainExtent.width;
-        frameBufferCreateInfo.height = m_swapchainExtent.height;
-        frameBufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        frameBufferCreateInfo.pAttachments = attachments.data();
-        frameBufferCreateInfo.layers = 1;
-
-        VkResult result = vkCreateFramebuffer(m_device.logicalDevice, &frameBufferCreateInfo, nullptr, &m_swapchainFrameBuffers[i]);
-        CHECK_VK_RESULT(result, "Failed to create Framebuffer");
-    }
+    permutation.shaded = 0;
+    getPermutationPipelines(permutation);
+    permutation.shaded = 1;
+    getPermutationPipelines(permutation);
 }
 
-void VulkanRenderer::createRenderPass()
+void VulkanRenderer::destroyPipelines()
 {
-    VkAttachmentDescription colorAttachment = {};
-    colorAttachment.format = m_swapchainImageFormat;
-    colorAttachment.samples = m_msaaSamples;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentDescription colorResolveAttachment = {};
-    colorResolveAttachment.format = m_swapchainImageFormat;
-    colorResolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorResolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorResolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorResolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorResolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorResolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorResolveAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentDescription depthAttachment = {};
-    depthAttachment.format = m_depthBufferImageFormat;
-    depthAttachment.samples = m_msaaSamples;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference colorAttachmentRef = {};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference colorResolveAttachmentRef = {};
-    colorResolveAttachmentRef.attachment = 2;
-    colorResolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference depthAttachmentRef = {};
-    depthAttachmentRef.attachment = 1;
-    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
-    subpass.pResolveAttachments = &colorResolveAttachmentRef;
-
-    std::array<VkSubpassDependency, 2> subpassDependencies{};
-
-    subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    subpassDependencies[0].dstSubpass = 0;
-    subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    subpassDependencies[0].dependencyFlags = 0;
-
-    subpassDependencies[1].srcSubpass = 0;
-    subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    subpassDependencies[1].dstSubpass = 0;
-    subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    subpassDependencies[1].dependencyFlags = 0;
-
-    std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorResolveAttachment };
-
-    VkRenderPassCreateInfo renderPassCreateInfo = {};
-    renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-    renderPassCreateInfo.pAttachments = attachments.data();
-    renderPassCreateInfo.subpassCount = 1;
-    renderPassCreateInfo.pSubpasses = &subpass;
-    renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
-    renderPassCreateInfo.pDependencies = subpassDependencies.data();
-
-    VkResult result = vkCreateRenderPass(m_device.logicalDevice, &renderPassCreateInfo, nullptr, &m_renderPass);
-    CHECK_VK_RESULT(result, "Failed to create Render Pass");
+    // The pipelines themselves belong to the builder
+    m_permutationPipelines.clear();
+
+    vkDestroyPipelineLayout(m_device.logicalDevice, m_graphicsPipelineLayout, nullptr);
 }
 
-void VulkanRenderer::createCommandPool()
+void VulkanRenderer::buildRenderGraph()
 {
-    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
-    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    commandPoolCreateInfo.queueFamilyIndex = getQueueFamilies(m_device.physicalDevice).graphicsQueueFamily;
-    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    m_renderGraph.Clear();
+
+    m_depthBufferImageFormat = chooseSupportedFormat(m_device.physicalDevice,
+        {VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
+        VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 
-    VkResult result = vkCreateCommandPool(m_device.logicalDevice, &commandPoolCreateInfo, nullptr, &m_graphicsCommandPool);
-    CHECK_VK_RESULT(result, "Failed to create Command Pool");
+    std::vector<VkImage> swapchainImages;
+    std::vector<VkImageView> swapchainImageViews;
+    for (const SwapChainImage& image : m_swapchainImages)
+    {
+        swapchainImages.push_back(image.image);
+        swapchainImageViews.push_back(image.imageView);
+    }
+
+    RenderGraphImage backbuffer = m_renderGraph.ImportImage("Backbuffer", m_swapchainImageFormat,
+        swapchainImages, swapchainImageViews,
+        m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    RenderGraphImage color = m_renderGraph.CreateImage("Color", m_swapchainImageFormat, m_msaaSamples);
+    RenderGraphImage depth = m_renderGraph.CreateImage("Depth", m_depthBufferImageFormat, m_msaaSamples);
+
+    // Shadow maps can be cached across frames, so they keep their own images and render passes
+    m_renderGraph.AddExternalPass("Directional Shadows", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex)
+    {
+        m_dlShadowMap.RecordCommands(commandBuffer, frameIndex, m_scene, &m_gpuProfiler);
+    });
+    m_renderGraph.AddExternalPass("Spot Shadows", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex)
+    {
+        m_shadowAtlas.RecordCommands(commandBuffer, frameIndex, m_scene);
+    });
+    m_renderGraph.AddExternalPass("Point Shadows", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex)
+    {
+        m_pointShadowMap.RecordCommands(commandBuffer, frameIndex, m_scene, &m_gpuProfiler);
+    });
+
+    // Always declared so its pipeline has a render pass. While disabled the main pass clears depth
+    // itself, nothing reads the pre-pass result and the graph culls it.
+    m_depthPrepass = m_renderGraph.AddPass("Depth Pre-Pass", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex)
+    {
+        recordDepthPrepass(commandBuffer, frameIndex);
+    });
+    m_renderGraph.SetDepthAttachment(m_depthPrepass, depth, VK_ATTACHMENT_LOAD_OP_CLEAR);
+
+    m_mainPass = m_renderGraph.AddPass("Main Pass", [this](VkCommandBuffer commandBuffer, uint32_t frameIndex)
+    {
+        recordMainPass(commandBuffer, frameIndex);
+    });
+    m_renderGraph.AddColorAttachment(m_mainPass, color, VK_ATTACHMENT_LOAD_OP_CLEAR, { 0.f, 0.f, 0.f, 1.f }, backbuffer);
+    m_renderGraph.SetDepthAttachment(m_mainPass, depth,
+        m_depthPrepassEnabled ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR);
+
+    m_renderGraph.Compile(m_swapchainExtent);
 }
 
-void VulkanRenderer::createGraphicsCommandBuffer()
+void VulkanRenderer::createCommandAllocator()
 {
-    m_commandBuffers.resize(m_swapchainImages.size());
+    uint32_t queueFamily = static_cast<uint32_t>(getQueueFamilies(m_device.physicalDevice).graphicsQueueFamily);
+    m_commandAllocator.Init(m_device.logicalDevice, queueFamily, MAX_FRAMES_IN_FLIGHT, RECORD_THREAD_COUNT);
+}
 
-    VkCommandBufferAllocateInfo commandBufferAllocInfo = {};
-    commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocInfo.commandPool = m_graphicsCommandPool;
-    commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocInfo.commandBufferCount = static_cast<uint32_t>(m_commandBuffers.size());
+void VulkanRenderer::createFrameContexts()
+{
+    m_frames.resize(MAX_FRAMES_IN_FLIGHT);
 
-    VkResult result = vkAllocateCommandBuffers(m_device.logicalDevice, &commandBufferAllocInfo, m_commandBuffers.data());
-    CHECK_VK_RESULT(result, "Failed to allocate Command Buffers");
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        m_frames[i].Init(m_device.logicalDevice, i, FRAME_ARENA_SIZE);
+    }
 }
 
 void VulkanRenderer::initImGui()
@@ -959,7 +1683,10 @@ void VulkanRenderer::initImGui()
     CHECK_VK_RESULT(vkCreateDescriptorPool(m_device.logicalDevice, &poolCreateInfo, nullptr, &m_imguiDescriptorPool), "Failed to create ImGui Descriptor Pool");
 
     ImGui::CreateContext();
-    ImGui_ImplSDL2_InitForVulkan(Engine::GetWindow()->GetSDLWindow());
+    if (m_headless)
+        ImGui::GetIO().DisplaySize = ImVec2(static_cast<float>(m_swapchainExtent.width), static_cast<float>(m_swapchainExtent.height));
+    else
+        ImGui_ImplSDL2_InitForVulkan(Engine::GetWindow()->GetSDLWindow());
 
     ImGui_ImplVulkan_InitInfo imguiInitInfo = {};
     imguiInitInfo.Instance = m_instance;
@@ -970,135 +1697,231 @@ void VulkanRenderer::initImGui()
     imguiInitInfo.MinImageCount = static_cast<uint32_t>(m_swapchainImages.size());
     imguiInitInfo.ImageCount = static_cast<uint32_t>(m_swapchainImages.size());
     imguiInitInfo.MSAASamples = m_msaaSamples;
+    imguiInitInfo.PipelineCache = m_pipelineBuilder.GetCache();
 
-    ImGui_ImplVulkan_Init(&imguiInitInfo, m_renderPass);
+    ImGui_ImplVulkan_Init(&imguiInitInfo, m_renderGraph.GetRenderPass(m_mainPass));
 
-    VkCommandBuffer commandBuffer = beginCommandBuffer(m_device.logicalDevice, m_graphicsCommandPool);
+    VkCommandBuffer commandBuffer = m_commandAllocator.BeginOneShot();
     ImGui_ImplVulkan_CreateFontsTexture(commandBuffer);
-    endCommandBufferAndSubmit(m_device.logicalDevice, m_graphicsCommandPool, m_graphicsQueue, commandBuffer);
+    m_commandAllocator.SubmitOneShot(m_graphicsQueue, commandBuffer);
 
     ImGui_ImplVulkan_DestroyFontUploadObjects();
 
-    m_guiShadowMapImage = ImGui_ImplVulkan_AddTexture(m_slShadowMap.GetSampler(), m_slShadowMap.GetAnImageView(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+    m_guiShadowMapImage = ImGui_ImplVulkan_AddTexture(m_shadowAtlas.GetSampler(), m_shadowAtlas.GetImageView(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
 }
 
-void VulkanRenderer::recordCommands(uint32_t currentImage)
+void VulkanRenderer::recordCommands(VkCommandBuffer commandBuffer, uint32_t currentFrame, uint32_t currentImage)
 {
-    VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-
-    std::array<VkClearValue, 2> clearValues = {};
-    clearValues[0].color = { 0.f, 0.f, 0.f, 1.f };
-    clearValues[1].depthStencil.depth = 1.f;
-    clearValues[1].depthStencil.stencil = 0;
-
-    VkRenderPassBeginInfo renderPassBeginInfo = {};
-    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.renderPass = m_renderPass;
-    renderPassBeginInfo.renderArea.offset = { 0, 0 };
-    renderPassBeginInfo.renderArea.extent = m_swapchainExtent;
-    renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassBeginInfo.pClearValues = clearValues.data();
-    renderPassBeginInfo.framebuffer = m_swapchainFrameBuffers[currentImage];
-    
-    if (vkBeginCommandBuffer(m_commandBuffers[currentImage], &commandBufferBeginInfo) == VK_SUCCESS)
+    CPU_ZONE("Record Commands");
+
+    m_gpuProfiler.BeginFrame(commandBuffer, currentFrame);
+    m_renderStats.BeginFrame(commandBuffer, currentFrame);
+
+    m_renderGraph.Execute(commandBuffer, currentFrame, currentImage);
+
+    m_renderStats.EndFrame(commandBuffer);
+}
+
+void VulkanRenderer::recordMainPass(VkCommandBuffer commandBuffer, uint32_t currentFrame)
+{
+    //cmdSetPrimitiveTopologyEXT(commandBuffer, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+    // All permutations share the layout, so these stay bound across pipeline changes and only the material changes
+    VkDescriptorSet viewProjectionSet = m_uboViewProjection.GetDescriptorSet(currentFrame);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipelineLayout,
+        0, 1, &viewProjectionSet, 0, nullptr);
+    RenderStats::CountDescriptorBinds(1);
+
+    std::array<VkDescriptorSet, 5> lightingSets =
     {
-        m_dlShadowMap.RecordCommands(m_commandBuffers[currentImage], currentImage, m_objects);
-        m_slShadowMap.RecordCommands(m_commandBuffers[currentImage], currentImage, m_objects);
-        
-        vkCmdBeginRenderPass(m_commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        {
-            vkCmdBindPipeline(m_commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
-            //cmdSetPrimitiveTopologyEXT(m_commandBuffers[currentImage], VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+        m_uboPointLight.GetDescriptorSet(currentFrame),
+        ShadowMap::GetDescriptorSet(currentFrame),
+        m_shadowAtlas.GetDescriptorSet(currentFrame),
+        m_lightClusters.GetDescriptorSet(currentFrame),
+        m_pointShadowMap.GetDescriptorSet(currentFrame)
+    };
 
-            for (size_t j = 0; j < m_objects.size(); ++j)
-            {
-                const glm::mat4& objectTransform = m_objects[j]->GetTransform();
-                std::vector<Mesh>& meshes = m_objects[j]->GetMeshes();
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipelineLayout,
+        2, static_cast<uint32_t>(lightingSets.size()), lightingSets.data(), 0, nullptr);
+    RenderStats::CountDescriptorBinds(static_cast<uint32_t>(lightingSets.size()));
 
-                for (size_t i = 0; i < meshes.size(); ++i)
-                {
-                    std::vector<VkDescriptorSet> descriptorSets =
-                    {
-                        m_uboViewProjection.GetDescriptorSet(currentImage),
-                        MaterialManager::GetDescriptorSet(m_objects[j]->GetMaterialId(meshes[i].GetMaterialIndex())),
-                        m_uboPointLight.GetDescriptorSet(currentImage),
-                        ShadowMap::GetDescriptorSet(currentImage),
-                        m_uboFragSettings.GetDescriptorSet(currentImage)
-                    };
-                
-                    vkCmdBindDescriptorSets(m_commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipelineLayout,
-                        0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(),
-                        0, nullptr);
-                
-                    VkBuffer vertexBuffers[] = { meshes[i].GetVertexBuffer()->GetBuffer() };
-                    VkDeviceSize offsets[] = { 0 };
-                    vkCmdBindVertexBuffers(m_commandBuffers[currentImage], 0, 1, vertexBuffers, offsets);
-
-                    PushModel pushModel = {};
-                    pushModel.model = objectTransform * meshes[i].GetTransform();
-                    if (m_objects[j]->Name == "Light" || m_objects[j]->Name == "Block") pushModel.shaded = 0;
-                    else pushModel.shaded = 1;
-                    //pushModel.shaded = 1;
-                    vkCmdPushConstants(m_commandBuffers[currentImage], m_graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushModel), &pushModel);
-                
-                    if (meshes[i].Indexed())
-                    {
-                        vkCmdBindIndexBuffer(m_commandBuffers[currentImage], meshes[i].GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
-                        vkCmdDrawIndexed(m_commandBuffers[currentImage], meshes[i].GetIndexCount(), 1, 0, 0, 0);
-                    }
-                    else
-                    {
-                        vkCmdDraw(m_commandBuffers[currentImage], meshes[i].GetVertexCount(), 1, 0, 0);
-                    }
-
-                    
-                    
-                }
-            }
+    const std::vector<glm::mat4>& transforms = m_scene.GetTransforms();
+    const std::vector<uint32_t>& flags = m_scene.GetFlags();
+    const std::vector<Mesh*>& meshes = m_scene.GetMeshes();
+    const std::vector<uint32_t>& materials = m_scene.GetMaterials();
+
+    // Without the pre-pass' pipeline nothing was drawn into depth, so the regular depth test is used
+    bool depthEqual = m_depthPrepassEnabled && m_depthPrepassDrawn;
+
+    // The draw list is sorted by permutation and material, so both change only a few times per frame
+    ShaderPermutation permutation = m_shaderPermutation;
+    uint32_t boundPermutation = ~0u;
+    uint32_t boundMaterial = ~0u;
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+
+    for (uint32_t entity : m_drawList)
+    {
+        Mesh& mesh = *meshes[entity];
 
-            /*std::vector<Mesh>& meshes = m_terrain.GetMeshes();
+        permutation.shaded = (flags[entity] & SCENE_FLAG_SHADED) ? 1 : 0;
+        if (permutation.GetKey() != boundPermutation)
+        {
+            // Submitted before recording started, so this never compiles anything
+            const PermutationPipelines& pipelines = m_permutationPipelines.at(permutation.GetKey());
+            VkPipeline pipeline = m_pipelineBuilder.Get(depthEqual ? pipelines.depthEqual : pipelines.pipeline);
+            if (pipeline == VK_NULL_HANDLE)
+                pipeline = m_pipelineBuilder.Get(depthEqual ? m_fallbackPipelines.depthEqual : m_fallbackPipelines.pipeline);
 
-            std::vector<VkDescriptorSet> descriptorSets =
+            if (pipeline != VK_NULL_HANDLE && pipeline != boundPipeline)
             {
-                m_uboViewProjection.GetDescriptorSet(currentImage),
-                MaterialManager::GetDescriptorSet(m_terrain.GetMaterialId(meshes[0].GetMaterialIndex())),
-                m_uboPointLight.GetDescriptorSet(currentImage),
-                ShadowMap::GetDescriptorSet(currentImage),
-                m_uboFragSettings.GetDescriptorSet(currentImage)
-            };
-                
-            vkCmdBindDescriptorSets(m_commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipelineLayout,
-                0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(),
-                0, nullptr);
-
-            VkBuffer vertexBuffers[] = { meshes[0].GetVertexBuffer()->GetBuffer() };
-            VkDeviceSize offsets[] = { 0 };
-            vkCmdBindVertexBuffers(m_commandBuffers[currentImage], 0, 1, vertexBuffers, offsets);
-            
-            PushModel pushModel = {};
-            pushModel.model = glm::mat4(1.f);
-            pushModel.shaded = 1;
-            vkCmdPushConstants(m_commandBuffers[currentImage], m_graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushModel), &pushModel);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                RenderStats::CountPipelineBind();
+            }
+            boundPipeline = pipeline;
+            boundPermutation = permutation.GetKey();
+        }
 
-            cmdSetPrimitiveTopologyEXT(m_commandBuffers[currentImage], VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP);
-            
-            vkCmdBindIndexBuffer(m_commandBuffers[currentImage], meshes[0].GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(m_commandBuffers[currentImage], meshes[0].GetIndexCount(), 1, 0, 0, 0);*/
+        if (boundPipeline == VK_NULL_HANDLE) continue;
 
-            ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), m_commandBuffers[currentImage]);
+        if (materials[entity] != boundMaterial)
+        {
+            VkDescriptorSet materialSet = MaterialManager::GetDescriptorSet(materials[entity]);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipelineLayout,
+                1, 1, &materialSet, 0, nullptr);
+            RenderStats::CountDescriptorBinds(1);
+            boundMaterial = materials[entity];
+        }
+    
+        VkBuffer vertexBuffers[] = { mesh.GetVertexBuffer()->GetBuffer() };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        RenderStats::CountVertexBufferBind();
+
+        PushModel pushModel = {};
+        pushModel.model = transforms[entity];
+        vkCmdPushConstants(commandBuffer, m_graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushModel), &pushModel);
+        RenderStats::CountPushConstants();
+    
+        if (mesh.Indexed())
+        {
+            vkCmdBindIndexBuffer(commandBuffer, mesh.GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexed(commandBuffer, mesh.GetIndexCount(), 1, 0, 0, 0);
+            RenderStats::CountDraw(mesh.GetIndexCount());
+        }
+        else
+        {
+            vkCmdDraw(commandBuffer, mesh.GetVertexCount(), 1, 0, 0);
+            RenderStats::CountDraw(mesh.GetVertexCount());
         }
-        vkCmdEndRenderPass(m_commandBuffers[currentImage]);
-        
-        vkEndCommandBuffer(m_commandBuffers[currentImage]);
     }
-    else
+
+    /*std::vector<Mesh>& meshes = m_terrain.GetMeshes();
+
+    std::vector<VkDescriptorSet> descriptorSets =
     {
-        throw std::runtime_error("Failed to begin Command Buffer");
+        m_uboViewProjection.GetDescriptorSet(currentFrame),
+        MaterialManager::GetDescriptorSet(m_terrain.GetMaterialId(meshes[0].GetMaterialIndex())),
+        m_uboPointLight.GetDescriptorSet(currentFrame),
+        ShadowMap::GetDescriptorSet(currentFrame),
+        m_uboFragSettings.GetDescriptorSet(currentFrame)
+    };
+        
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipelineLayout,
+        0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(),
+        0, nullptr);
+
+    VkBuffer vertexBuffers[] = { meshes[0].GetVertexBuffer()->GetBuffer() };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    
+    PushModel pushModel = {};
+    pushModel.model = glm::mat4(1.f);
+    pushModel.shaded = 1;
+    vkCmdPushConstants(commandBuffer, m_graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushModel), &pushModel);
+
+    cmdSetPrimitiveTopologyEXT(commandBuffer, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP);
+    
+    vkCmdBindIndexBuffer(commandBuffer, meshes[0].GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexed(commandBuffer, meshes[0].GetIndexCount(), 1, 0, 0, 0);*/
+
+    m_gpuProfiler.BeginZone(commandBuffer, "ImGui");
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+    m_gpuProfiler.EndZone(commandBuffer);
+}
+
+void VulkanRenderer::recordDepthPrepass(VkCommandBuffer commandBuffer, uint32_t currentFrame)
+{
+    // The pass still clears depth, the main pass then tests against that
+    VkPipeline pipeline = m_pipelineBuilder.Get(m_depthPrepassPipeline);
+    m_depthPrepassDrawn = pipeline != VK_NULL_HANDLE;
+    if (!m_depthPrepassDrawn) return;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    RenderStats::CountPipelineBind();
+
+    // Positions only, the rest of the main pipeline's sets are never read
+    VkDescriptorSet descriptorSet = m_uboViewProjection.GetDescriptorSet(currentFrame);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipelineLayout,
+        0, 1, &descriptorSet, 0, nullptr);
+    RenderStats::CountDescriptorBinds(1);
+
+    const std::vector<glm::mat4>& transforms = m_scene.GetTransforms();
+    const std::vector<Mesh*>& meshes = m_scene.GetMeshes();
+
+    for (uint32_t entity : m_drawList)
+    {
+        Mesh& mesh = *meshes[entity];
+
+        VkBuffer vertexBuffers[] = { mesh.GetVertexBuffer()->GetBuffer() };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        RenderStats::CountVertexBufferBind();
+
+        PushModel pushModel = {};
+        pushModel.model = transforms[entity];
+        vkCmdPushConstants(commandBuffer, m_graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushModel), &pushModel);
+        RenderStats::CountPushConstants();
+
+        if (mesh.Indexed())
+        {
+            vkCmdBindIndexBuffer(commandBuffer, mesh.GetIndexBuffer()->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexed(commandBuffer, mesh.GetIndexCount(), 1, 0, 0, 0);
+            RenderStats::CountDraw(mesh.GetIndexCount());
+        }
+        else
+        {
+            vkCmdDraw(commandBuffer, mesh.GetVertexCount(), 1, 0, 0);
+            RenderStats::CountDraw(mesh.GetVertexCount());
+        }
     }
 }
 
+void VulkanRenderer::buildDrawList(LinearAllocator& arena)
+{
+    CPU_ZONE("Culling");
+
+    // The previous list lived in another frame's arena, which is never touched again
+    m_drawList = ArenaVector<uint32_t>(ArenaAllocator<uint32_t>(arena));
+    m_drawList.reserve(m_scene.GetCount());
+
+    Frustum frustum(m_camera.GetProjectionMatrix() * m_camera.GetViewMatrix());
+
+    m_scene.GetBvh().QueryFrustum(frustum, [&](uint32_t entity)
+    {
+        m_drawList.push_back(entity);
+    });
+
+    // Same order as the main pass binds in, the shaded permutation first and the material second
+    const std::vector<uint32_t>& flags = m_scene.GetFlags();
+    const std::vector<uint32_t>& materials = m_scene.GetMaterials();
+    auto sortKey = [&](uint32_t entity)
+    {
+        uint64_t shaded = (flags[entity] & SCENE_FLAG_SHADED) ? 1 : 0;
+        return (shaded << 32) | materials[entity];
+    };
+    std::sort(m_drawList.begin(), m_drawList.end(), [&](uint32_t a, uint32_t b) { return sortKey(a) < sortKey(b); });
+}
+
 void VulkanRenderer::getPhysicalDevice()
 {
     uint32_t deviceCount = 0;
@@ -1158,29 +1981,27 @@ SwapChainDetails VulkanRenderer::getSwapchainDetails(VkPhysicalDevice device)
     return swapChainDetails;
 }
 
-void VulkanRenderer::createSynchronization()
+void VulkanRenderer::updateLatency()
 {
-    m_imageAvailable.resize(MAX_CONCURRENT_FRAMES);
-    m_renderFinished.resize(MAX_CONCURRENT_FRAMES);
-    m_waitForDrawFinished.resize(MAX_CONCURRENT_FRAMES);
-
-    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-    VkFenceCreateInfo fenceCreateInfo = {};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (int i = 0; i < MAX_CONCURRENT_FRAMES; ++i)
+    // Polled right after waiting on a fence and again after presenting, so the completion of a frame is
+    // seen at most one CPU frame late
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
-        VkResult result = vkCreateSemaphore(m_device.logicalDevice, &semaphoreCreateInfo, nullptr, &m_imageAvailable[i]);
-        CHECK_VK_RESULT(result, "Failed to create Semaphore");
+        float latency;
+        if (!m_frames[i].PollFinished(latency)) continue;
 
-        result = vkCreateSemaphore(m_device.logicalDevice, &semaphoreCreateInfo, nullptr, &m_renderFinished[i]);
-        CHECK_VK_RESULT(result, "Failed to create Semaphore");
+        m_latency.sum += latency;
+        m_latency.max = std::max(m_latency.max, latency);
+        ++m_latency.samples;
+    }
 
-        result = vkCreateFence(m_device.logicalDevice, &fenceCreateInfo, nullptr, &m_waitForDrawFinished[i]);
-        CHECK_VK_RESULT(result, "Failed to create Fence");
+    if (m_latency.samples >= LATENCY_WINDOW)
+    {
+        m_latency.average = m_latency.sum / static_cast<float>(m_latency.samples);
+        m_latency.windowMax = m_latency.max;
+        m_latency.sum = 0.f;
+        m_latency.max = 0.f;
+        m_latency.samples = 0;
     }
 }
 
@@ -1228,8 +2049,10 @@ QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
             indices.graphicsQueueFamily = i; // If queue family is valid, then get index
         }
 
+        // Nothing is presented headless, the graphics queue stands in so the rest of the setup stays the same
         VkBool32 presentationSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentationSupport);
+        if (m_headless) presentationSupport = indices.graphicsQueueFamily == i;
+        else vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentationSupport);
         if (queueFamily.queueCount > 0 && presentationSupport)
         {
             indices.presentationQueueFamily = i;
@@ -1252,8 +2075,11 @@ bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
     
     if (!checkDeviceExtensionSupport(device)) return false;
     
-    SwapChainDetails swapChainDetails = getSwapchainDetails(device);
-    if (!swapChainDetails.isValid()) return false;
+    if (!m_headless)
+    {
+        SwapChainDetails swapChainDetails = getSwapchainDetails(device);
+        if (!swapChainDetails.isValid()) return false;
+    }
 
     return deviceFeatures.samplerAnisotropy;
 }
@@ -1268,7 +2094,7 @@ bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
     auto extensions = std::vector<VkExtensionProperties>(extensionCount);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
 
-    for (const auto& deviceExtension : deviceExtensions)
+    for (const auto& deviceExtension : getDeviceExtensions())
     {
         bool hasExtension = false;
         for (const auto& extension : extensions)
@@ -1286,6 +2112,18 @@ bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
     return true;
 }
 
+std::vector<const char*> VulkanRenderer::getDeviceExtensions()
+{
+    std::vector<const char*> extensions;
+    for (const char* extension : deviceExtensions)
+    {
+        if (m_headless && strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) continue;
+        extensions.push_back(extension);
+    }
+
+    return extensions;
+}
+
 VkSurfaceFormatKHR VulkanRenderer::chooseSwapchainSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats)
 {
     if (formats.size() == 1 && formats[0].format == VK_FORMAT_UNDEFINED)
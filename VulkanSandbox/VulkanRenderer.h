@@ -2,45 +2,118 @@
 
 #define VK_DEBUG
 
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "AssetLoader.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "CommandBufferAllocator.h"
+#include "FrameContext.h"
+#include "GpuProfiler.h"
 #include "HeightMapObject.h"
 #include "Utilities.h"
 #include "Image.h"
+#include "LightClusters.h"
+#include "LinearAllocator.h"
+#include "Lights.h"
 #include "Mesh.h"
 #include "Object.h"
+#include "PipelineBuilder.h"
+#include "PointShadowMap.h"
+#include "RenderGraph.h"
+#include "RenderStats.h"
+#include "Scene.h"
+#include "ShadowAtlas.h"
 #include "ShadowMap.h"
 #include "UniformBuffer.h"
 
 class VulkanRenderer
 {
 public:
+	struct FrameStats
+	{
+		uint32_t drawCount;
+		float gpuTime;			// ms, of the last frame the profiler collected
+		uint64_t allocations;
+		RenderStats::Counters counters;
+		RenderStats::PipelineStatistics pipelineStatistics;	// Lags behind like gpuTime
+	};
+
 	VulkanRenderer();
 	~VulkanRenderer();
 	
 	void Init();
+	// Renders into offscreen images of the given size, needs neither a window nor presentation support
+	void InitHeadless(uint32_t width, uint32_t height);
 	void Update(float deltaTime);
 	void Draw();
 	void Destroy();
+
+	// Headless only, writes the last drawn frame as PNG. Waits for the frame to finish on the GPU.
+	bool SaveFrame(const std::string& path);
+
+	// The camera follows the path from its start, input no longer moves it until the path ends
+	void PlayCameraPath(const CameraPath& path, bool loop);
+	FrameStats GetFrameStats();
+
+	// Every asset is uploaded and every pipeline built
+	bool IsLoaded();
+	// ms from the start of Init until the first frame was submitted and until IsLoaded, negative until then
+	float GetFirstFrameTime();
+	float GetLoadedTime();
 	
 private:
-	const int MAX_CONCURRENT_FRAMES = 3;
+	const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+	const uint32_t RECORD_THREAD_COUNT = 1;
+	const size_t FRAME_ARENA_SIZE = 256 * 1024;
+	const uint32_t SHADOW_CASCADE_SIZE = 512;
+	const uint32_t SHADOW_ATLAS_SIZE = 4096;
+	const uint32_t POINT_SHADOW_SIZE = 512;
 
 	HeightMapObject m_terrain;
 
 	Mesh m_testMesh;
 	Camera m_camera;
 
+	// Flythrough
+	// Records the camera into keyframes while flying around and plays them back at the renderer's time step
+	CameraPath m_cameraPath;
+	struct
+	{
+		bool recording = false;
+		bool playing = false;
+		bool loop = false;
+		float time = 0.f;
+		float nextKeyframe = 0.f;
+		std::string file = "flythrough.path";
+	} m_flythrough;
+	const float FLYTHROUGH_KEYFRAME_INTERVAL = 0.25f;
+	void updateFlythrough(float deltaTime);
+
 	float m_rad = 45.f;
-	glm::vec2 m_leftRight = { -1000.f, 1000.f };
-	glm::vec2 m_topBottom = { -1000.f, 1000.f };
-	glm::vec2 m_nearFar = { -1000.f, 1000.f };
+	float m_shadowDistance = 500.f;
+	float m_cascadeSplitLambda = 0.9f;
 
 	// Scene
+	// Objects load and own the meshes, passes only iterate the scene's tables
 	std::vector<Object*> m_objects;
+	Scene m_scene;
 	UboDirLight m_dirLight;
 	UniformBuffer<UboDirLight> m_uboPointLight;
+	std::vector<SpotLight> m_spotLights;
+	std::vector<PointLight> m_pointLights;
+
+	// Asset Loading
+	// Frames render while objects and textures load on worker threads. Objects are added to the scene once their
+	// uploads completed, materials show a flat placeholder texture until then.
+	AssetLoader m_assetLoader;
+	const float ASSET_UPLOAD_BUDGET = 2.f;		// ms per frame spent recording uploads
+	uint64_t m_initTime = 0;
+	float m_firstFrameTime = -1.f;
+	float m_loadedTime = -1.f;
+	void updateLoadTimes();
 	
 	// Vulkan Components
 	
@@ -58,27 +131,87 @@ private:
 	VkFormat m_swapchainImageFormat;
 	VkExtent2D m_swapchainExtent;
 	std::vector<SwapChainImage> m_swapchainImages;
-	std::vector<VkFramebuffer> m_swapchainFrameBuffers;
+
+	// Headless
+	// One offscreen image per frame in flight stands in for the swapchain, the frame index picks the image
+	bool m_headless = false;
+	std::vector<Image> m_offscreenImages;
+	void createOffscreenImages();
 
 	VkFormat m_depthBufferImageFormat;
-	std::vector<Image> m_depthBufferImage;
 
-	VkPipeline m_graphicsPipeline;
 	VkPipelineLayout m_graphicsPipelineLayout;
 
-	VkRenderPass m_renderPass;
+	// Pipeline Builder
+	// Compiles every pipeline but ImGui's on worker threads, ImGui's shares the pipeline cache at least
+	PipelineBuilder m_pipelineBuilder;
 
-	VkCommandPool m_graphicsCommandPool;
-	std::vector<VkCommandBuffer> m_commandBuffers;
+	// Shader Permutations
+	// Main pass pipelines by ShaderPermutation key, created the first time a permutation is needed and kept until the
+	// pipelines are destroyed. The frame's settings pick the permutation, every entity then picks shaded or not.
+	// Pipelines compile in the background, until one is done its draws use the fallback, and skip the frame if
+	// even that isn't built yet.
+	struct PermutationPipelines
+	{
+		PipelineBuilder::Handle pipeline;
+		PipelineBuilder::Handle depthEqual;		// After the depth pre-pass
+	};
+	ShaderPermutation m_shaderPermutation;
+	std::unordered_map<uint32_t, PermutationPipelines> m_permutationPipelines;
+	PermutationPipelines m_fallbackPipelines;		// Unshadowed and without spot or point lights
+	const PermutationPipelines& getPermutationPipelines(const ShaderPermutation& permutation);
+	// Creates what the current settings need, recording only looks pipelines up
+	void preparePermutations();
 
-	std::vector<VkSemaphore> m_imageAvailable;
-	std::vector<VkSemaphore> m_renderFinished;
-	std::vector<VkFence> m_waitForDrawFinished;
+	// Render Graph
+	// Owns the swapchain sized attachments, one set per frame in flight, and the passes using them
+	RenderGraph m_renderGraph;
+	RenderGraphPass m_depthPrepass;
+	RenderGraphPass m_mainPass;
+	void buildRenderGraph();
+
+	// Depth Pre-Pass
+	// Lays down depth first so the main pass only shades the visible fragment of every pixel
+	bool m_depthPrepassEnabled = false;
+	PipelineBuilder::Handle m_depthPrepassPipeline;
+	bool m_depthPrepassDrawn = false;		// Its pipeline was ready when this frame's pre-pass was recorded
+
+	// Per frame and recording thread pools, plus recycled one-shot buffers for uploads
+	CommandBufferAllocator m_commandAllocator;
+
+	// Frames in Flight
+	// More frames in flight let the CPU run further ahead of the GPU, at the cost of latency
+	std::vector<FrameContext> m_frames;
+	uint32_t m_framesInFlight = MAX_FRAMES_IN_FLIGHT;
+	uint32_t m_currentFrame = 0;
+	void createFrameContexts();
+
+	// Time from beginning a frame on the CPU until the GPU is seen done with it, over LATENCY_WINDOW frames
+	struct
+	{
+		bool enabled = false;
+		float sum = 0.f;
+		float max = 0.f;
+		uint32_t samples = 0;
+		float average = 0.f;
+		float windowMax = 0.f;
+	} m_latency;
+	const uint32_t LATENCY_WINDOW = 60;
+	void updateLatency();
+
+	// Draw List
+	// Scene indices of the entities inside the camera frustum, built into the frame's arena. The depth pre-pass and
+	// the main pass both draw from it, so their depths always match.
+	ArenaVector<uint32_t> m_drawList;
+	void buildDrawList(LinearAllocator& arena);
+
+	// Heap allocations from after the UI is built until present, should stay 0 once everything has warmed up
+	uint64_t m_frameAllocations = 0;
+	bool m_assertNoFrameAllocations = false;
 
 
 	// MSAA
 	VkSampleCountFlagBits m_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
-	std::vector<Image> m_colorResolveImage;
 
 	// ImGui
 	VkDescriptorPool m_imguiDescriptorPool;
@@ -93,35 +226,58 @@ private:
 	void createLogicalDevice();
 	void createSwapchain();
 	void createPipeline();
-	void createDepthBufferImage();
-	void createFrameBuffers();
-	void createRenderPass();
-	void createCommandPool();
-	void createGraphicsCommandBuffer();
+	// Everything using the main pipeline layout, only the stages, the render pass and the depth test differ
+	PipelineBuilder::Handle submitScenePipeline(const std::string& name, const VkPipelineShaderStageCreateInfo* stages,
+		uint32_t stageCount, VkRenderPass renderPass, bool depthEqual);
+	void destroyPipelines();
+	void createCommandAllocator();
 	
 	UniformBuffer<UboViewProjection> m_uboViewProjection;
-	UniformBuffer<UboFragSettings> m_uboFragSettings;
 	
 	void initImGui();
 	
-	void recordCommands(uint32_t currentImage);
+	void recordCommands(VkCommandBuffer commandBuffer, uint32_t currentFrame, uint32_t currentImage);
+	void recordDepthPrepass(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+	void recordMainPass(VkCommandBuffer commandBuffer, uint32_t currentFrame);
 
 	// Shadow Mapping
 	ShadowMap m_dlShadowMap;
-	ShadowMap m_slShadowMap;
+	ShadowAtlas m_shadowAtlas;
+	PointShadowMap m_pointShadowMap;
+	LightClusters m_lightClusters;
+	void updateShadowCascades();
+
+	// Profiling
+	// Zones for every render graph pass, with shadow layers, point lights and ImGui nested inside their passes
+	GpuProfiler m_gpuProfiler;
+	std::string m_profilerExportFile = "gpu_profile.json";
+	std::string m_cpuTraceFile = "cpu_trace.json";
+	// Commands recorded by every pass and pipeline statistics over the whole frame, ImGui's draws aren't counted
+	RenderStats m_renderStats;
+
+	// Alternates multiview and per face point shadow passes and averages the GPU time of both
+	struct
+	{
+		bool running = false;
+		bool multiviewWasEnabled;
+		uint32_t frame;
+		float multiviewTime = 0.f;
+		float perFaceTime = 0.f;
+	} m_pointShadowBenchmark;
+	const uint32_t POINT_SHADOW_BENCHMARK_FRAMES = 200;
+	const uint32_t POINT_SHADOW_BENCHMARK_WARMUP = 10;
+	void updatePointShadowBenchmark();
 	
 	// Get Functions
 	void getPhysicalDevice();
 	SwapChainDetails getSwapchainDetails(VkPhysicalDevice device);
 
-	// -- Create Functions --
-	void createSynchronization();
-
 	// -- Support Functions --
 	bool checkInstanceExtensionSupport(const std::vector<const char*>& extensions);
 	QueueFamilyIndices getQueueFamilies(VkPhysicalDevice device);
 	bool checkDeviceSuitable(VkPhysicalDevice device);
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+	std::vector<const char*> getDeviceExtensions();
 	VkSurfaceFormatKHR chooseSwapchainSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats);
 	VkPresentModeKHR chooseSwapchainPresentMode(const std::vector<VkPresentModeKHR>& modes);
 	VkExtent2D chooseSwapchainExtent(const VkSurfaceCapabilitiesKHR& surfaceCapabilities);
@@ -1,9 +1,51 @@
 ﻿#include <iostream>
+#include <string>
 
+#include "Benchmark.h"
 #include "Engine.h"
 
 int main(int argv, char** arg)
 {
+	// --benchmark-scene [entityCount] runs the scene benchmark instead of the renderer
+	if (argv > 1 && std::string(arg[1]) == "--benchmark-scene")
+	{
+		Benchmark::RunScene(argv > 2 ? static_cast<uint32_t>(std::stoul(arg[2])) : 100000);
+		return 0;
+	}
+
+	// --benchmark-bvh [triangleCount]
+	if (argv > 1 && std::string(arg[1]) == "--benchmark-bvh")
+	{
+		Benchmark::RunBvh(argv > 2 ? static_cast<uint32_t>(std::stoul(arg[2])) : 100000);
+		return 0;
+	}
+
+	// --headless [--frames N] [--width W] [--height H] [--dump-png directory] [--dump-interval N]
+	//            [--camera-path file] [--report path] [--warmup N] [--cpu-trace file]
+	if (argv > 1 && std::string(arg[1]) == "--headless")
+	{
+		Engine::HeadlessSettings settings;
+		for (int i = 2; i + 1 < argv; i += 2)
+		{
+			std::string option = arg[i];
+			std::string value = arg[i + 1];
+
+			if (option == "--frames") settings.frameCount = static_cast<uint32_t>(std::stoul(value));
+			else if (option == "--width") settings.width = static_cast<uint32_t>(std::stoul(value));
+			else if (option == "--height") settings.height = static_cast<uint32_t>(std::stoul(value));
+			else if (option == "--dump-png") settings.dumpDirectory = value;
+			else if (option == "--dump-interval") settings.dumpInterval = static_cast<uint32_t>(std::stoul(value));
+			else if (option == "--camera-path") settings.cameraPath = value;
+			else if (option == "--report") settings.reportPath = value;
+			else if (option == "--warmup") settings.warmupFrames = static_cast<uint32_t>(std::stoul(value));
+			else if (option == "--cpu-trace") settings.cpuTracePath = value;
+			else std::cout << "Unknown option " << option << std::endl;
+		}
+
+		Engine::InitHeadless(settings);
+		return 0;
+	}
+
 	std::cout << "Starting..." << std::endl;
 	
 	Engine::Init();
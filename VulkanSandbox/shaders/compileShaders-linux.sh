@@ -1,3 +1,7 @@
 glslangValidator -V shader.vert
 glslangValidator -V shader.frag
-glslangValidator -o depthMap.vert.spv -V depthMap.vert
\ No newline at end of file
+glslangValidator -o depthMap.vert.spv -V depthMap.vert
+glslangValidator -o shadowAtlas.vert.spv -V shadowAtlas.vert
+glslangValidator -o pointShadow.vert.spv -V pointShadow.vert
+glslangValidator -DMULTIVIEW -o pointShadowMultiview.vert.spv -V pointShadow.vert
+glslangValidator -o depthPrepass.vert.spv -V depthPrepass.vert
\ No newline at end of file
@@ -1,4 +1,8 @@
 C:\VulkanSDK\1.3.216.0\Bin\glslangValidator.exe -V shader.vert
 C:\VulkanSDK\1.3.216.0\Bin\glslangValidator.exe -V shader.frag
 C:\VulkanSDK\1.3.216.0\Bin\glslangValidator.exe -o depthMap.vert.spv -V depthMap.vert
+C:\VulkanSDK\1.3.216.0\Bin\glslangValidator.exe -o shadowAtlas.vert.spv -V shadowAtlas.vert
+C:\VulkanSDK\1.3.216.0\Bin\glslangValidator.exe -o pointShadow.vert.spv -V pointShadow.vert
+C:\VulkanSDK\1.3.216.0\Bin\glslangValidator.exe -DMULTIVIEW -o pointShadowMultiview.vert.spv -V pointShadow.vert
+C:\VulkanSDK\1.3.216.0\Bin\glslangValidator.exe -o depthPrepass.vert.spv -V depthPrepass.vert
 pause
\ No newline at end of file
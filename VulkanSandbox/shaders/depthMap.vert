@@ -4,21 +4,21 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inTexCoord;
 layout(location = 2) in vec3 inNormal;
 
-layout(binding = 0) uniform UboViewProjection
+// Must match SHADOW_CASCADE_COUNT in Camera.h
+#define SHADOW_CASCADE_COUNT 4
+
+layout(binding = 0) uniform UboLightSpace
 {
-    mat4 view;
-    mat4 projection;
-    vec4 camPos;
-    mat4 lightSpace;
-    mat4 spotLightSpace;
-} uboVP;
+    mat4 viewProjection[SHADOW_CASCADE_COUNT];
+} uboLS;
 
-layout(push_constant) uniform PushModelTransform
+layout(push_constant) uniform PushShadow
 {
     mat4 model;
-} pushModel;
+    uint layer;
+} pushShadow;
 
 void main()
 {
-    gl_Position = uboVP.projection * uboVP.view * pushModel.model * vec4(inPosition, 1.0);
+    gl_Position = uboLS.viewProjection[pushShadow.layer] * pushShadow.model * vec4(inPosition, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+
+// Must match SHADOW_CASCADE_COUNT in Camera.h
+#define SHADOW_CASCADE_COUNT 4
+
+layout(binding = 0) uniform UboViewProjection
+{
+    mat4 view;
+    mat4 projection;
+    vec4 camPos;
+    mat4 cascadeLightSpace[SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits;
+} uboVP;
+
+layout(push_constant) uniform PushModelTransform
+{
+    mat4 model;
+} pushModel;
+
+// Same expression as shader.vert, so the main pass can test for equal depth
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = uboVP.projection * uboVP.view * pushModel.model * vec4(inPosition, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#version 450
+
+// Compiled twice, with MULTIVIEW for the pass that renders all six faces at once
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : require
+#endif
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
+
+// Must match MAX_POINT_LIGHTS in Lights.h
+#define MAX_POINT_LIGHTS 8
+
+struct PointLight
+{
+    vec4 positionStrength;
+    vec4 range;
+    mat4 faceViewProjection[6];
+};
+
+layout(std430, binding = 1) readonly buffer PointLights
+{
+    uint count;
+    PointLight lights[MAX_POINT_LIGHTS];
+} pointLights;
+
+// layer is light * 6 for multiview, light * 6 + face otherwise
+layout(push_constant) uniform PushShadow
+{
+    mat4 model;
+    uint layer;
+} pushShadow;
+
+void main()
+{
+#ifdef MULTIVIEW
+    uint face = pushShadow.layer + gl_ViewIndex;
+#else
+    uint face = pushShadow.layer;
+#endif
+    gl_Position = pointLights.lights[face / 6].faceViewProjection[face % 6] * pushShadow.model * vec4(inPosition, 1.0);
+}
\ No newline at end of file
@@ -4,9 +4,41 @@ layout(location = 0) in vec2 inTexCoord;
 layout(location = 1) in vec3 inWorldPos;
 layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec3 inCamPos;
-layout(location = 4) in vec4 inShadowCoord;
-layout(location = 5) in vec4 inSpotLightShadowCoord;
-layout(location = 6) in flat uint inShaded;
+layout(location = 4) in float inViewDepth;
+
+// Must match SHADOW_CASCADE_COUNT in Camera.h
+#define SHADOW_CASCADE_COUNT 4
+// Must match MAX_SPOT_LIGHTS in Lights.h
+#define MAX_SPOT_LIGHTS 512
+// Must match MAX_POINT_LIGHTS in Lights.h
+#define MAX_POINT_LIGHTS 8
+// Must match LightClusters.h
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_COUNT (CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z)
+
+// Must match ShaderPermutation in Utilities.h
+layout(constant_id = 0) const uint SHADOW_FILTER_POISSON = 0;
+layout(constant_id = 1) const int SHADOW_FILTER_RADIUS = 1;
+layout(constant_id = 2) const uint SHADED = 1;
+layout(constant_id = 3) const uint SPOT_LIGHTS = 1;
+layout(constant_id = 4) const uint POINT_LIGHTS = 1;
+layout(constant_id = 5) const uint DEBUG_VIEW = 0;
+
+// Must match DebugViewFlags in Utilities.h
+#define DEBUG_VIEW_SHADOW_ATLAS 1
+#define DEBUG_VIEW_CASCADES 2
+#define DEBUG_VIEW_CLUSTERS 4
+
+layout(set = 0, binding = 0) uniform UboViewProjection
+{
+    mat4 view;
+    mat4 projection;
+    vec4 camPos;
+    mat4 cascadeLightSpace[SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits;
+} uboVP;
 
 layout(set = 1, binding = 0) uniform sampler2D textureSampler;
 layout(set = 1, binding = 1) uniform sampler2D specularSampler;
@@ -15,24 +47,163 @@ layout(set = 1, binding = 2) uniform sampler2D normalSampler;
 layout(set = 2, binding = 0) uniform UboLight
 {
     vec4 dlDirection;
+} uboLight;
 
-    vec4 slPosition;
-    vec4 slDirection;
-    float slStrength;
-    float slCutoff;
+layout(set = 3, binding = 0) uniform sampler2DArrayShadow shadowMapDL;
 
-} uboLight;
+layout(set = 4, binding = 0) uniform sampler2DShadow shadowAtlas;
 
-layout(set = 3, binding = 0) uniform sampler2D shadowMapDL;
-layout(set = 3, binding = 1) uniform sampler2D shadowMapSL;
+struct SpotLight
+{
+    mat4 viewProjection;
+    vec4 positionStrength;
+    vec4 directionCutoff;
+    vec4 atlasRect;         // xy offset, zw scale, zero scale when the light has no tile
+    vec4 range;
+};
+
+layout(std430, set = 4, binding = 1) readonly buffer SpotLights
+{
+    uint count;
+    SpotLight lights[MAX_SPOT_LIGHTS];
+} spotLights;
 
-layout(set = 4, binding = 0) uniform UboFragSettings
+layout(std430, set = 5, binding = 0) readonly buffer ClusterGrid
 {
-    uint drawShadowMap;
-} fragSettings;
+    vec4 depthSlicing;      // x scale, y bias
+    vec4 screenSize;
+    uvec2 clusters[CLUSTER_COUNT];  // x first index, y light count
+} clusterGrid;
+
+layout(std430, set = 5, binding = 1) readonly buffer ClusterLightIndices
+{
+    uint indices[];
+} clusterLightIndices;
+
+// Six layers per light, ordered +X, -X, +Y, -Y, +Z, -Z
+layout(set = 6, binding = 0) uniform sampler2DArrayShadow pointShadowMaps;
+
+struct PointLight
+{
+    vec4 positionStrength;
+    vec4 range;
+    mat4 faceViewProjection[6];
+};
+
+layout(std430, set = 6, binding = 1) readonly buffer PointLights
+{
+    uint count;
+    PointLight lights[MAX_POINT_LIGHTS];
+} pointLights;
+
+const vec3 cascadeColors[4] = vec3[]
+(
+    vec3(1.0, 0.25, 0.25),
+    vec3(0.25, 1.0, 0.25),
+    vec3(0.25, 0.25, 1.0),
+    vec3(1.0, 1.0, 0.25)
+);
+
+const vec2 poissonDisk[16] = vec2[]
+(
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
 
 layout(location = 0) out vec4 fragColor;
 
+// Position of a world position inside the light's atlas tile, z is the depth to compare against
+vec3 spotLightAtlasCoords(SpotLight light, vec3 worldPos)
+{
+    vec4 shadowCoord = light.viewProjection * vec4(worldPos, 1.0);
+    vec3 projCoords = shadowCoord.xyz / shadowCoord.w;
+    projCoords.xy = clamp(projCoords.xy * 0.5 + 0.5, 0.0, 1.0);
+    projCoords.xy = light.atlasRect.xy + projCoords.xy * light.atlasRect.zw;
+    return projCoords;
+}
+
+// Lights of the froxel this fragment is in
+uvec2 lightCluster()
+{
+    uvec2 tile = uvec2(gl_FragCoord.xy / clusterGrid.screenSize.xy * vec2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y));
+    tile = min(tile, uvec2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+
+    float slice = log(max(inViewDepth, 0.0001)) * clusterGrid.depthSlicing.x + clusterGrid.depthSlicing.y;
+    uint z = uint(clamp(slice, 0.0, float(CLUSTER_COUNT_Z - 1)));
+
+    return clusterGrid.clusters[tile.x + CLUSTER_COUNT_X * (tile.y + CLUSTER_COUNT_Y * z)];
+}
+
+// -- SHADOW FILTER --
+// Every tap is a hardware bilinear compare, so even a single tap is filtered
+
+int shadowFilterTaps()
+{
+    if (SHADOW_FILTER_POISSON == 1)
+        return 16;
+
+    int side = 2 * SHADOW_FILTER_RADIUS + 1;
+    return side * side;
+}
+
+// Offset of a tap in texels
+vec2 shadowFilterOffset(int tap)
+{
+    if (SHADOW_FILTER_POISSON == 1)
+        return poissonDisk[tap] * float(max(SHADOW_FILTER_RADIUS, 1));
+
+    int side = 2 * SHADOW_FILTER_RADIUS + 1;
+    return vec2(tap % side - SHADOW_FILTER_RADIUS, tap / side - SHADOW_FILTER_RADIUS);
+}
+
+// Fraction of the taps that are lit
+float filterShadowArray(sampler2DArrayShadow shadowMap, vec2 uv, float layer, float depth)
+{
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    int taps = shadowFilterTaps();
+
+    float lit = 0.0;
+    for (int i = 0; i < taps; ++i)
+        lit += texture(shadowMap, vec4(uv + shadowFilterOffset(i) * texelSize, layer, depth));
+
+    return lit / float(taps);
+}
+
+// Taps are clamped to the light's tile so neighbouring tiles don't bleed in
+float filterShadowAtlas(vec3 projCoords, vec4 atlasRect)
+{
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 minCoords = atlasRect.xy + texelSize * 0.5;
+    vec2 maxCoords = atlasRect.xy + atlasRect.zw - texelSize * 0.5;
+    int taps = shadowFilterTaps();
+
+    float lit = 0.0;
+    for (int i = 0; i < taps; ++i)
+    {
+        vec2 uv = clamp(projCoords.xy + shadowFilterOffset(i) * texelSize, minCoords, maxCoords);
+        lit += texture(shadowAtlas, vec3(uv, projCoords.z));
+    }
+
+    return lit / float(taps);
+}
+
+// Cube face the vector from the light points into
+uint pointLightFace(vec3 lightToFrag)
+{
+    vec3 a = abs(lightToFrag);
+    if (a.x >= a.y && a.x >= a.z)
+        return lightToFrag.x >= 0.0 ? 0 : 1;
+    if (a.y >= a.z)
+        return lightToFrag.y >= 0.0 ? 2 : 3;
+    return lightToFrag.z >= 0.0 ? 4 : 5;
+}
+
 /*float textureProj(vec4 shadowCoord)
 {
     float shadow = 1.0;
@@ -85,27 +256,65 @@ void main()
 
     //float shadow = textureProj(inShadowCoord);
     
-    // -- SPOT LIGHT --
+    // -- SPOT LIGHTS --
+    
+    // Constant conditions, the permutations without spot lights drop the whole block
+    uvec2 cluster = uvec2(0);
+    if (SPOT_LIGHTS == 1 || (DEBUG_VIEW & DEBUG_VIEW_CLUSTERS) != 0)
+        cluster = lightCluster();
+    
+    for (uint c = 0; SPOT_LIGHTS == 1 && c < cluster.y; ++c)
+    {
+        SpotLight light = spotLights.lights[clusterLightIndices.indices[cluster.x + c]];
+
+        vec3 vecToLight = normalize(inWorldPos - light.positionStrength.xyz);
+        float theta = acos(dot(vecToLight, light.directionCutoff.xyz));
+        float thetaDeg = theta * 180 / 3.14159265;
+        
+        if (thetaDeg >= light.directionCutoff.w)
+            continue;
+
+        float edgeIntensity = clamp((light.directionCutoff.w - thetaDeg) / 10, 0.f, 1.f);
+        float distance = distance(light.positionStrength.xyz, inWorldPos);
+
+        float shadow = 1.0;
+        if (SHADED == 1 && light.atlasRect.z > 0.0)
+        {
+            vec3 projCoordsSL = spotLightAtlasCoords(light, inWorldPos);
+            if (projCoordsSL.z < 0.99)
+                shadow = mix(0.5, 1.0, filterShadowAtlas(projCoordsSL, light.atlasRect));
+        }
+
+        diffuse += ((max(dot(n, -vecToLight), 0.0) * light.positionStrength.w) / distance) * edgeIntensity * diffuseColor.xyz * shadow;
+    }
     
-    float shadow1 = 1.0;
-    vec4 projCoordsSL = inSpotLightShadowCoord / inSpotLightShadowCoord.w;
-    projCoordsSL.xy = projCoordsSL.xy * 0.5 + 0.5;
+    // ----------------
     
-    vec3 vecToLight = normalize(inWorldPos - uboLight.slPosition.xyz);
-    float theta = acos(dot(vecToLight, normalize(uboLight.slDirection.xyz)));
-    float thetaDeg = theta * 180 / 3.14159265;
+    // -- POINT LIGHTS --
     
-    if (thetaDeg < uboLight.slCutoff)
+    for (uint i = 0; POINT_LIGHTS == 1 && i < pointLights.count; ++i)
     {
-        float edgeIntensity = clamp((uboLight.slCutoff - thetaDeg) / 10, 0.f, 1.f);
-        float distance = distance(uboLight.slPosition.xyz, inWorldPos);
-        diffuse += ((max(dot(n, -vecToLight), 0.0) * uboLight.slStrength) / distance) * edgeIntensity * diffuseColor.xyz;
+        PointLight light = pointLights.lights[i];
+
+        vec3 lightToFrag = inWorldPos - light.positionStrength.xyz;
+        float distance = length(lightToFrag);
+        
+        if (distance >= light.range.x)
+            continue;
 
-        if (projCoordsSL.z < 0.99)
+        float rangeIntensity = clamp((light.range.x - distance) / 10, 0.f, 1.f);
+
+        float shadow = 1.0;
+        if (SHADED == 1)
         {
-            float bias = 0.005;
-            shadow1 = texture(shadowMapSL, projCoordsSL.xy).r >= projCoordsSL.z ? 1.0 : 0.5;
+            uint face = pointLightFace(lightToFrag);
+            vec4 shadowCoord = light.faceViewProjection[face] * vec4(inWorldPos, 1.0);
+            vec3 projCoords = shadowCoord.xyz / shadowCoord.w;
+            projCoords.xy = clamp(projCoords.xy * 0.5 + 0.5, 0.0, 1.0);
+            shadow = mix(0.5, 1.0, filterShadowArray(pointShadowMaps, projCoords.xy, float(i * 6 + face), projCoords.z));
         }
+
+        diffuse += ((max(dot(n, -lightToFrag / distance), 0.0) * light.positionStrength.w) / distance) * rangeIntensity * diffuseColor.xyz * shadow;
     }
     
     // ----------------
@@ -113,38 +322,54 @@ void main()
     // -- DIRECTIONAL LIGHT --
 
     float shadow2 = 1.0;
-    vec4 projCoordsDL = inShadowCoord / inShadowCoord.w;
-    projCoordsDL.xy = projCoordsDL.xy * 0.5 + 0.5;
-    
-    if (projCoordsDL.z < 0.99)
+
+    // Pick the first cascade whose split still covers this fragment
+    int cascadeIndex = SHADOW_CASCADE_COUNT;
+    for (int i = 0; i < SHADOW_CASCADE_COUNT; ++i)
     {
-        float closestDepth = texture(shadowMapDL, projCoordsDL.xy).r;
-        float currentDepth = projCoordsDL.z;
-        float bias = 0.005;
-        shadow2 = closestDepth >= currentDepth - bias ? 1.0 : 0.5;
+        if (inViewDepth <= uboVP.cascadeSplits[i])
+        {
+            cascadeIndex = i;
+            break;
+        }
     }
     
+    if (SHADED == 1 && cascadeIndex < SHADOW_CASCADE_COUNT)
+    {
+        vec4 shadowCoordDL = uboVP.cascadeLightSpace[cascadeIndex] * vec4(inWorldPos, 1.0);
+        vec3 projCoordsDL = shadowCoordDL.xyz / shadowCoordDL.w;
+        projCoordsDL.xy = projCoordsDL.xy * 0.5 + 0.5;
+
+        if (projCoordsDL.z < 0.99)
+        {
+            float bias = 0.0005;
+            shadow2 = mix(0.5, 1.0, filterShadowArray(shadowMapDL, projCoordsDL.xy, float(cascadeIndex), projCoordsDL.z - bias));
+        }
+    }
+
     vec3 l = -normalize(uboLight.dlDirection.xyz);
-    diffuse += max(dot(n, l), 0.0) * diffuseColor.xyz;
+    diffuse += max(dot(n, l), 0.0) * diffuseColor.xyz * shadow2;
     
     // ---------------------
     
-    if (fragSettings.drawShadowMap == 1)
+    if ((DEBUG_VIEW & DEBUG_VIEW_SHADOW_ATLAS) != 0 && spotLights.count > 0)
     {
-        fragColor = texture(shadowMapSL, projCoordsSL.xy);
+        // Comparison sampler, shows which parts of the scene light 0 sees
+        fragColor = vec4(vec3(texture(shadowAtlas, spotLightAtlasCoords(spotLights.lights[0], inWorldPos))), 1.0);
         return;
     }
     
-    if (inShaded == 1)
+    fragColor = vec4(diffuse, 1.0);
+    
+    // Blue for few lights, red for 16 and more
+    if ((DEBUG_VIEW & DEBUG_VIEW_CLUSTERS) != 0)
     {
-        float shadow;
-        if (shadow1 == shadow2) shadow = shadow1;
-        if (shadow1 != shadow2) shadow = min(shadow1, shadow2);
-        
-        fragColor = vec4(diffuse * shadow2, 1.0);
+        float heat = clamp(float(cluster.y) / 16.0, 0.0, 1.0);
+        fragColor.rgb = mix(fragColor.rgb, mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), heat), cluster.y > 0 ? 0.6 : 0.0);
     }
-    else
+    
+    if ((DEBUG_VIEW & DEBUG_VIEW_CASCADES) != 0 && cascadeIndex < SHADOW_CASCADE_COUNT)
     {
-        fragColor = vec4(diffuse, 1.0);
+        fragColor.rgb *= cascadeColors[cascadeIndex];
     }
 }
\ No newline at end of file
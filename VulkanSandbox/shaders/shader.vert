@@ -4,28 +4,31 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inTexCoord;
 layout(location = 2) in vec3 inNormal;
 
+// Must match SHADOW_CASCADE_COUNT in Camera.h
+#define SHADOW_CASCADE_COUNT 4
+
 layout(binding = 0) uniform UboViewProjection
 {
     mat4 view;
     mat4 projection;
     vec4 camPos;
-    mat4 lightSpace;
-    mat4 spotLightSpace;
+    mat4 cascadeLightSpace[SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits;
 } uboVP;
 
 layout(push_constant) uniform PushModelTransform
 {
     mat4 model;
-    uint shaded;
 } pushModel;
 
 layout(location = 0) out vec2 outTexCoord;
 layout(location = 1) out vec3 outWorldPos;
 layout(location = 2) out vec3 outNormal;
 layout(location = 3) out vec3 outCamPos;
-layout(location = 4) out vec4 outShadowCoord;
-layout(location = 5) out vec4 outSpotLightShadowCoord;
-layout(location = 6) out uint outShaded;
+layout(location = 4) out float outViewDepth;
+
+// Must produce bit identical depth to depthPrepass.vert for the equal depth test
+invariant gl_Position;
 
 const mat4 biasMat = mat4
 (
@@ -42,7 +45,5 @@ void main()
     outWorldPos = vec3(pushModel.model * vec4(inPosition, 1.0));
     outNormal = normalize(inNormal);
     outCamPos = uboVP.camPos.rgb;
-    outShadowCoord = uboVP.lightSpace * vec4(outWorldPos, 1.0);
-    outSpotLightShadowCoord = uboVP.spotLightSpace * vec4(outWorldPos, 1.0);
-    outShaded = pushModel.shaded;
+    outViewDepth = -(uboVP.view * vec4(outWorldPos, 1.0)).z;
 }
\ No newline at end of file
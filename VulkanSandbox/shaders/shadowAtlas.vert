@@ -0,0 +1,35 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
+
+// Must match MAX_SPOT_LIGHTS in Lights.h
+#define MAX_SPOT_LIGHTS 512
+
+struct SpotLight
+{
+    mat4 viewProjection;
+    vec4 positionStrength;
+    vec4 directionCutoff;
+    vec4 atlasRect;
+    vec4 range;
+};
+
+layout(std430, binding = 1) readonly buffer SpotLights
+{
+    uint count;
+    SpotLight lights[MAX_SPOT_LIGHTS];
+} spotLights;
+
+// layer is the index of the light the tile belongs to
+layout(push_constant) uniform PushShadow
+{
+    mat4 model;
+    uint layer;
+} pushShadow;
+
+void main()
+{
+    gl_Position = spotLights.lights[pushShadow.layer].viewProjection * pushShadow.model * vec4(inPosition, 1.0);
+}
\ No newline at end of file